@@ -1,6 +1,10 @@
 #include "AppBase.h"
 #include "volk.c"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 #include <algorithm>
+#include <cstdio>
+#include <iostream>
 
 VulpixContext m_context;
 
@@ -16,10 +20,25 @@ AppBase::AppBase()
 	m_surfaceFormat = {};
 	m_surface= VK_NULL_HANDLE;
 	m_swapchain = VK_NULL_HANDLE;
+	m_storageSwapchain = false;
+	m_outputExtent = { 0, 0 };
 	m_commandPool = VK_NULL_HANDLE;
+	m_presentResource = 0;
 	
-	m_imageAcquiredSemaphore = VK_NULL_HANDLE;
-	m_renderingCompleteSemaphore = VK_NULL_HANDLE;
+	m_frameIndex = 0u;
+	m_reportTime = 0.0f;
+	m_reportFrames = 0u;
+
+	m_headless = false;
+	m_headlessFrames = 0u;
+	m_submittedFrames = 0u;
+	m_capturing = false;
+	m_swapchainCapture = false;
+	m_captureExtension = "png";
+	m_streamFormat = VideoStreamFormat::Y4m;
+	m_streamFrameRate = 60u;
+	m_quitRequested = false;
+	m_exitCode = 0;
 	
 	m_graphicsQueueFamilyIndex = 0u;
 	m_computeQueueFamilyIndex = 0u;
@@ -40,63 +59,54 @@ void AppBase::run()
 	if (init())
 	{
 		mainLoop();
+		dumpFrameTimes();
 		shutdown();
 		freeResources();
 	}
+	else
+	{
+		m_exitCode = 1;
+	}
 }
 
-bool AppBase::init()
+void AppBase::setHeadless(const uint32_t frameCount, const std::string& outputPrefix)
 {
-	if (!glfwInit())
-	{
-		return false;
-	}
+	m_headless = true;
+	m_headlessFrames = frameCount;
+	m_captureOutput = outputPrefix;
+}
 
-	if (!glfwVulkanSupported())
-	{
-		return false;
-	}
+void AppBase::setCapture(const std::string& outputPrefix, const std::string& extension)
+{
+	m_captureOutput = outputPrefix;
+	m_captureExtension = extension;
+	m_capturing = true;
+}
+
+void AppBase::setStream(const std::string& path, const VideoStreamFormat format, const uint32_t frameRate)
+{
+	m_streamPath = path;
+	m_streamFormat = format;
+	m_streamFrameRate = frameRate;
+	m_capturing = true;
+}
+
+bool AppBase::init()
+{
 	if (volkInitialize() != VK_SUCCESS)
 	{
 		return false;
 	}
 
 	initDefaultSettings();
+	m_outputExtent = { m_settings.m_resolutionX, m_settings.m_resolutionY };
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	GLFWwindow *window = glfwCreateWindow(static_cast<int>(m_settings.m_resolutionX),
-		static_cast<int>(m_settings.m_resolutionY),
-		m_settings.m_name.c_str(),
-		nullptr, nullptr);
-
-	if (!window)
+	// headless runs never touch GLFW, there may be no display to connect to
+	if (!m_headless && !initWindow())
 	{
 		return false;
 	}
 
-	glfwSetWindowUserPointer(window, this);
-
-	glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
-		{
-		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
-		app->onKeyboard(key, scancode, action, mods);
-	});
-
-	glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods)
-		{
-		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
-		app->onMouseButton(button, action, mods);
-	});
-
-	glfwSetCursorPosCallback(window, [](GLFWwindow* window, double x, double y)
-		{
-		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
-		app->onMouseMove(static_cast<float>(x), static_cast<float>(y));
-	});
-
-	m_window = window;
-
 	if (!initVulkan())
 	{
 		return false;
@@ -109,14 +119,24 @@ bool AppBase::init()
 		return false;
 	}
 
-	if (!initSurface())
+	if (m_headless)
 	{
-		return false;
+		if (!initHeadlessTarget())
+		{
+			return false;
+		}
 	}
-
-	if (!initSwapchain())
+	else
 	{
-		return false;
+		if (!initSurface())
+		{
+			return false;
+		}
+
+		if (!initSwapchain())
+		{
+			return false;
+		}
 	}
 
 	if (!initFencesAndCommandPool())
@@ -125,13 +145,22 @@ bool AppBase::init()
 	}
 
 	vulpix::initializeContext(m_device, m_commandPool, m_graphicsQueue, m_physicalDevice);
+
+	// not fatal, without timestamp support the frame just isn't profiled
+	m_gpuProfiler.initProfiler(m_device, m_physicalDevice, m_graphicsQueueFamilyIndex, m_settings.m_framesInFlight);
 	
 	//VkDevice tempDevice = m_device;
 	//VkDevice tempDevice2 = m_context.m_device;
 
 	//std::cout <<"DEViCEee" << m_device << std::endl;
 
-	if (!initOffscreenImage())
+	if (!initOffscreenImages())
+	{
+		return false;
+	}
+
+	// headless runs exist to produce the frames, windowed ones capture when asked to
+	if ((m_headless || m_capturing) && !startCapture())
 	{
 		return false;
 	}
@@ -145,20 +174,88 @@ bool AppBase::init()
 		return false;
 	}
 	initApp();
-	fillCommandBuffers();
 
 	return true;
 }
 
+bool AppBase::initWindow()
+{
+	if (!glfwInit())
+	{
+		return false;
+	}
+
+	if (!glfwVulkanSupported())
+	{
+		return false;
+	}
+
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	GLFWwindow *window = glfwCreateWindow(static_cast<int>(m_settings.m_resolutionX),
+		static_cast<int>(m_settings.m_resolutionY),
+		m_settings.m_name.c_str(),
+		nullptr, nullptr);
+
+	if (!window)
+	{
+		return false;
+	}
+
+	glfwSetWindowUserPointer(window, this);
+
+	glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
+		{
+		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
+		app->onKeyboard(key, scancode, action, mods);
+	});
+
+	glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int mods)
+		{
+		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
+		app->onMouseButton(button, action, mods);
+	});
+
+	glfwSetCursorPosCallback(window, [](GLFWwindow* window, double x, double y)
+		{
+		AppBase* app = reinterpret_cast<AppBase*>(glfwGetWindowUserPointer(window));
+		app->onMouseMove(static_cast<float>(x), static_cast<float>(y));
+	});
+
+	m_window = window;
+
+	return true;
+}
+
+void AppBase::requestQuit()
+{
+	m_quitRequested = true;
+}
+
 void AppBase::mainLoop()
 {
+	if (m_headless)
+	{
+		// no events to poll, the frames are rendered back to back with their real CPU time as dt
+		uint64_t prevTime = vulpix::trace::now();
+		for (uint32_t frame = 0; frame < m_headlessFrames && !m_quitRequested; ++frame)
+		{
+			const uint64_t currTime = vulpix::trace::now();
+			drawFrame(static_cast<float>(static_cast<double>(currTime - prevTime) * 1e-9));
+			prevTime = currTime;
+		}
+
+		flushCaptures();
+		return;
+	}
+
 	glfwSetTime(0.0);
 	double currTime;
 	double prevTime = 0.0;
 	double dt = 0.0;
 
 
-	while (!glfwWindowShouldClose(m_window))
+	while (!glfwWindowShouldClose(m_window) && !m_quitRequested)
 	{
 		currTime = glfwGetTime();
 		dt = currTime - prevTime;
@@ -168,12 +265,17 @@ void AppBase::mainLoop()
 	
 		glfwPollEvents();
 	}
+
+	flushCaptures();
 }
 
 void AppBase::shutdown()
 {
 	vkDeviceWaitIdle(m_device);
-	glfwTerminate();
+	if (!m_headless)
+	{
+		glfwTerminate();
+	}
 }
 
 void AppBase::initDefaultSettings()
@@ -186,9 +288,18 @@ void AppBase::initDefaultSettings()
 	m_settings.m_enableVSync = true;
 	m_settings.m_supportRT = false;
 	m_settings.m_supportDescriptorIndexing = false;
+	m_settings.m_framesInFlight = 2u;
+	m_settings.m_reportInterval = 0.5f;
+	m_settings.m_hitchThreshold = 1000.0f / 30.0f;
 
 	// virtual setting
 	initSettings();
+
+	m_settings.m_framesInFlight = std::max(m_settings.m_framesInFlight, 1u);
+	m_frames.resize(m_settings.m_framesInFlight);
+
+	m_cpuFrameTimes.setHitchThreshold(m_settings.m_hitchThreshold);
+	m_gpuFrameTimes.setHitchThreshold(m_settings.m_hitchThreshold);
 }
 
 bool AppBase::initVulkan()
@@ -202,13 +313,16 @@ bool AppBase::initVulkan()
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.apiVersion = VK_API_VERSION_1_2;
 
-	uint32_t requiredInstanceExtensionCount = 0u;
-	const char** requiredInstanceExtensions = glfwGetRequiredInstanceExtensions(&requiredInstanceExtensionCount);
-
 	std::vector<const char*> instanceExtensions;
 	std::vector<const char*> instanceLayers;
 
-	instanceExtensions.insert(instanceExtensions.begin(), requiredInstanceExtensions, requiredInstanceExtensions + requiredInstanceExtensionCount);
+	// the surface extensions, headless runs need none
+	if (!m_headless)
+	{
+		uint32_t requiredInstanceExtensionCount = 0u;
+		const char** requiredInstanceExtensions = glfwGetRequiredInstanceExtensions(&requiredInstanceExtensionCount);
+		instanceExtensions.insert(instanceExtensions.begin(), requiredInstanceExtensions, requiredInstanceExtensions + requiredInstanceExtensionCount);
+	}
 
 	if (m_settings.m_enableValidationLayers)
 	{
@@ -335,7 +449,16 @@ bool AppBase::initDevicesAndQueues()
 	VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddress = {};
 	bufferDeviceAddress.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
 
-	std::vector<const char*> deviceExtensions = { { VK_KHR_SWAPCHAIN_EXTENSION_NAME } };
+	// the render graph records synchronization2 barriers
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2 = {};
+	synchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+	synchronization2.synchronization2 = VK_TRUE;
+
+	std::vector<const char*> deviceExtensions = { VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME };
+	if (!m_headless)
+	{
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 
 	if (m_settings.m_supportRT)
 	{
@@ -372,6 +495,9 @@ bool AppBase::initDevicesAndQueues()
 		physicalDeviceFeatures2.pNext = &descriptorIndexing;
 	}
 
+	synchronization2.pNext = physicalDeviceFeatures2.pNext;
+	physicalDeviceFeatures2.pNext = &synchronization2;
+
 
 	vkGetPhysicalDeviceFeatures2(m_physicalDevice, &physicalDeviceFeatures2);
 
@@ -401,8 +527,12 @@ bool AppBase::initDevicesAndQueues()
 
 	if (m_settings.m_supportRT)
 	{
+		m_subgroupProperties = {};
+		m_subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+
 		m_rayTracingPipelineProperties = {  };
 		m_rayTracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+		m_rayTracingPipelineProperties.pNext = &m_subgroupProperties;
 
 		VkPhysicalDeviceProperties2 physicalDeviceProperties2 = {};
 		physicalDeviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
@@ -453,6 +583,12 @@ bool AppBase::initSwapchain()
 		}
 	}
 
+	// compute passes can write the swapchain images directly when both the surface and the format allow storage
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, m_surfaceFormat.format, &formatProperties);
+	m_storageSwapchain = (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) &&
+		(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
 	VkSwapchainKHR oldSwapchain = m_swapchain;
 
 	VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
@@ -465,7 +601,12 @@ bool AppBase::initSwapchain()
 	swapchainCreateInfo.imageColorSpace = m_surfaceFormat.colorSpace;
 	swapchainCreateInfo.imageExtent = { m_settings.m_resolutionX, m_settings.m_resolutionY };
 	swapchainCreateInfo.imageArrayLayers = 1;
-	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	// frames written straight into the swapchain images are captured from them
+	m_swapchainCapture = m_storageSwapchain && (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+	swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+		(m_storageSwapchain ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT) |
+		(m_swapchainCapture ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
 	swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	swapchainCreateInfo.queueFamilyIndexCount = 0;
 	swapchainCreateInfo.pQueueFamilyIndices = nullptr;
@@ -522,17 +663,21 @@ bool AppBase::initSwapchain()
 
 bool AppBase::initCommandBuffers()
 {
-	m_commandBuffers.resize(m_swapchainImages.size());
-
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo;
 	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	commandBufferAllocateInfo.pNext = nullptr;
 	commandBufferAllocateInfo.commandPool = m_commandPool;
 	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(m_commandBuffers.size());
+	commandBufferAllocateInfo.commandBufferCount = 1;
 
-	const VkResult error = vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, m_commandBuffers.data());
-	return (VK_SUCCESS == error); 
+	for (FrameData& frame : m_frames)
+	{
+		const VkResult error = vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, &frame.m_commandBuffer);
+		if (VK_SUCCESS != error) {
+			return false;
+		}
+	}
+	return true;
 }
 
 bool AppBase::initSynchronization()
@@ -542,13 +687,19 @@ bool AppBase::initSynchronization()
 	semaphoreCreatInfo.pNext = nullptr;
 	semaphoreCreatInfo.flags = 0;
 
-	VkResult error = vkCreateSemaphore(m_device, &semaphoreCreatInfo, nullptr, &m_imageAcquiredSemaphore);
-	if (VK_SUCCESS != error) {
-		return false;
-	}
+	for (FrameData& frame : m_frames)
+	{
+		VkResult error = vkCreateSemaphore(m_device, &semaphoreCreatInfo, nullptr, &frame.m_imageAcquiredSemaphore);
+		if (VK_SUCCESS != error) {
+			return false;
+		}
 
-	error = vkCreateSemaphore(m_device, &semaphoreCreatInfo, nullptr, &m_renderingCompleteSemaphore);
-	return (VK_SUCCESS == error);
+		error = vkCreateSemaphore(m_device, &semaphoreCreatInfo, nullptr, &frame.m_renderingCompleteSemaphore);
+		if (VK_SUCCESS != error) {
+			return false;
+		}
+	}
+	return true;
 }
 
 bool AppBase::initSurface()
@@ -606,16 +757,15 @@ bool AppBase::initFencesAndCommandPool()
 	fenceCreateInfo.pNext = nullptr;
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	m_waitForFences.resize(m_swapchainImages.size());
-	for (VkFence& fence: m_waitForFences)
+	// created signaled, the first wait of every frame returns right away
+	for (FrameData& frame : m_frames)
 	{
-		//VkResult error = 
-		vkCreateFence(m_device, &fenceCreateInfo, nullptr, &fence);
-		/*	if (error != VK_SUCCESS)
-			{
+		VkResult error = vkCreateFence(m_device, &fenceCreateInfo, nullptr, &frame.m_fence);
+		if (error != VK_SUCCESS)
+		{
 			CHECK_VK_ERROR(error, "vkCreateFence");
 			return false;
-		}*/
+		}
 	}
 
 	VkCommandPoolCreateInfo commandPoolCreateInfo;
@@ -629,113 +779,216 @@ bool AppBase::initFencesAndCommandPool()
 
 }
 
-bool AppBase::initOffscreenImage()
+bool AppBase::initOffscreenImages()
 {
+	if (m_storageSwapchain)
+	{
+		return true;
+	}
+
 	const VkExtent3D extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-	VkResult error = m_offscreenImage.createImage(VK_IMAGE_TYPE_2D,
-		m_surfaceFormat.format,
-		extent,
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	// one per frame in flight, the next frame may trace while the previous one is still being copied out
+	for (FrameData& frame : m_frames)
+	{
+		VkResult error = frame.m_offscreenImage.createImage(VK_IMAGE_TYPE_2D,
+			m_surfaceFormat.format,
+			extent,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		if (VK_SUCCESS != error) {
+			return false;
+		}
+
+		error = frame.m_offscreenImage.createImageView(VK_IMAGE_VIEW_TYPE_2D, m_surfaceFormat.format, range);
+		if (VK_SUCCESS != error) {
+			return false;
+		}
 
-	if (VK_SUCCESS != error) {
-		return false;
 	}
+	return true;
+}
 
-	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-	error = m_offscreenImage.createImageView(VK_IMAGE_VIEW_TYPE_2D, m_surfaceFormat.format, range);
-	return (VK_SUCCESS == error);
+bool AppBase::initHeadlessTarget()
+{
+	// stands in for the swapchain: the frames end up in the offscreen images, in a format the readback can hand out
+	// as is. The composite encodes to sRGB itself, storage support for it is mandatory
+	m_surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	m_surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	m_storageSwapchain = false;
+	return true;
 }
 
-void AppBase::fillCommandBuffers()
+void AppBase::recordCommandBuffer(const uint32_t frameIndex, const uint32_t imageIndex)
 {
-	// TODO: will be checked later
+	FrameData& frame = m_frames[frameIndex];
+	const VkCommandBuffer commandBuffer = frame.m_commandBuffer;
 
 	VkCommandBufferBeginInfo commandBufferBeginInfo;
 	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	commandBufferBeginInfo.pNext = nullptr;
-	commandBufferBeginInfo.flags = 0;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	commandBufferBeginInfo.pInheritanceInfo = nullptr;
 
 	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
-	for (size_t i = 0; i < m_commandBuffers.size(); i++) {
-		const VkCommandBuffer commandBuffer = m_commandBuffers[i];
-
-		VkResult error = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-		CHECK_VK_ERROR(error, "vkBeginCommandBuffer");
-
-		vulpix::imageBarrier(commandBuffer,
-			m_offscreenImage.getImage(),
-			subresourceRange,
-			0,
-			VK_ACCESS_SHADER_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_GENERAL);
-
-		fillCommandBuffer(commandBuffer, static_cast<uint32_t>(i)); // user draw code
-
-		vulpix::imageBarrier(commandBuffer,
-			m_swapchainImages[i],
-			subresourceRange,
-			0,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-		vulpix::imageBarrier(commandBuffer,
-			m_offscreenImage.getImage(),
-			subresourceRange,
-			VK_ACCESS_SHADER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_IMAGE_LAYOUT_GENERAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-		VkImageCopy copyRegion;
-		copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-		copyRegion.srcOffset = { 0, 0, 0 };
-		copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-		copyRegion.dstOffset = { 0, 0, 0 };
-		copyRegion.extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
-		vkCmdCopyImage(commandBuffer,
-			m_offscreenImage.getImage(),
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			m_swapchainImages[i],
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&copyRegion);
-
-		vulpix::imageBarrier(commandBuffer,
-			m_swapchainImages[i], subresourceRange,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			0,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	// the frame fence has signaled, so the pool can implicitly reset the buffer
+	VkResult error = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	CHECK_VK_ERROR(error, "vkBeginCommandBuffer");
+
+	m_renderGraph.reset();
+	m_gpuProfiler.beginFrame(commandBuffer, frameIndex);
+
+	if (m_headless)
+	{
+		const VkImage offscreenImage = frame.m_offscreenImage.getImage();
+		m_presentResource = m_renderGraph.importImage(offscreenImage, subresourceRange, VulpixResourceState());
+		fillCommandBuffer(commandBuffer, frameIndex, frameIndex); // user draw code
+		addCapturePass(frame, offscreenImage);
+
+		m_renderGraph.execute(commandBuffer, &m_gpuProfiler, frameIndex);
+		m_gpuProfiler.endFrame(commandBuffer, frameIndex);
 
 		error = vkEndCommandBuffer(commandBuffer);
 		CHECK_VK_ERROR(error, "vkEndCommandBuffer");
+		return;
+	}
+
+	const VkImage swapchainImage = m_swapchainImages[imageIndex];
+
+	// the acquire semaphore is waited on at the color attachment output stage, the first access chains to it.
+	// The contents of the last frame are not needed
+	const VulpixResourceState acquired = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED };
+	const VulpixGraphResource swapchainResource = m_renderGraph.importImage(swapchainImage, subresourceRange, acquired);
+
+	if (m_storageSwapchain)
+	{
+		// the frame's last pass writes the swapchain image, nothing to copy afterwards
+		m_presentResource = swapchainResource;
+		fillCommandBuffer(commandBuffer, frameIndex, imageIndex); // user draw code
+		addCapturePass(frame, swapchainImage);
+	}
+	else
+	{
+		const VkImage offscreenImage = frame.m_offscreenImage.getImage();
+		m_presentResource = m_renderGraph.importImage(offscreenImage, subresourceRange, VulpixResourceState());
+		fillCommandBuffer(commandBuffer, frameIndex, frameIndex); // user draw code
+		addCapturePass(frame, offscreenImage);
+
+		const uint32_t width = m_settings.m_resolutionX;
+		const uint32_t height = m_settings.m_resolutionY;
+		m_renderGraph.addPass("copy to swapchain", [offscreenImage, swapchainImage, width, height](VkCommandBuffer commandBuffer)
+			{
+				VkImageCopy copyRegion;
+				copyRegion.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.srcOffset = { 0, 0, 0 };
+				copyRegion.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				copyRegion.dstOffset = { 0, 0, 0 };
+				copyRegion.extent = { width, height, 1 };
+				vkCmdCopyImage(commandBuffer,
+					offscreenImage,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					swapchainImage,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1,
+					&copyRegion);
+			})
+			.read(m_presentResource, VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+			.write(swapchainResource, VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	}
+
+	// presentation waits on the semaphore, the transition only has to happen before it signals
+	m_renderGraph.addPass("present")
+		.read(swapchainResource, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	m_renderGraph.execute(commandBuffer, &m_gpuProfiler, frameIndex);
+	m_gpuProfiler.endFrame(commandBuffer, frameIndex);
+
+	error = vkEndCommandBuffer(commandBuffer);
+	CHECK_VK_ERROR(error, "vkEndCommandBuffer");
+}
+
+std::vector<VkImageView> AppBase::getPresentTargets() const
+{
+	if (m_storageSwapchain)
+	{
+		return m_swapchainImageViews;
+	}
+
+	std::vector<VkImageView> targets;
+	for (const FrameData& frame : m_frames)
+	{
+		targets.push_back(frame.m_offscreenImage.getImageView());
 	}
+	return targets;
 }
 
 void AppBase::drawFrame(const float dt)
 {
-	m_FPSCounter.update(dt);
+	VULPIX_TRACE_SCOPE("drawFrame");
 
-	uint32_t imageIndex = 0;
-	VkResult error = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_imageAcquiredSemaphore, VK_NULL_HANDLE, &imageIndex);
-	if (VK_SUCCESS != error) {
-		return;
+	m_cpuFrameTimes.addSample(dt * 1000.0f);
+
+	// the title and other per-frame text only get rebuilt a few times a second
+	m_reportTime += dt;
+	++m_reportFrames;
+	if (m_reportTime >= m_settings.m_reportInterval)
+	{
+		report(static_cast<float>(m_reportFrames) / m_reportTime, m_reportTime * 1000.0f / static_cast<float>(m_reportFrames));
+		m_reportTime = 0.0f;
+		m_reportFrames = 0u;
 	}
 
-	const VkFence fence = m_waitForFences[imageIndex];
-	error = vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX);
+	const uint32_t frameIndex = m_frameIndex;
+	FrameData& frame = m_frames[frameIndex];
+
+	// wait until the GPU is done with this frame's resources, before we even ask for an image
+	VkResult error = VK_SUCCESS;
+	{
+		VULPIX_TRACE_SCOPE("fence wait");
+		error = vkWaitForFences(m_device, 1, &frame.m_fence, VK_TRUE, UINT64_MAX);
+	}
 	if (VK_SUCCESS != error) {
 		return;
 	}
-	vkResetFences(m_device, 1, &fence);
 
-	update(imageIndex, dt);
+	// the frame that last used this slot is done, its capture can be encoded
+	if (frame.m_captureSlot != UINT32_MAX)
+	{
+		m_frameCapture.completeCapture(frame.m_captureSlot);
+		frame.m_captureSlot = UINT32_MAX;
+	}
+
+	uint32_t imageIndex = 0;
+	if (!m_headless)
+	{
+		VULPIX_TRACE_SCOPE("acquire");
+		error = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, frame.m_imageAcquiredSemaphore, VK_NULL_HANDLE, &imageIndex);
+		if (VK_SUCCESS != error && VK_SUBOPTIMAL_KHR != error) {
+			return;
+		}
+	}
+
+	// only reset once we know we'll submit, otherwise the next wait on it would never return
+	vkResetFences(m_device, 1, &frame.m_fence);
+
+	// before update, so the app sees the GPU times of the same submission as its other per-frame readbacks
+	if (m_gpuProfiler.collectFrame(m_device, frameIndex))
+	{
+		m_gpuFrameTimes.addSample(m_gpuProfiler.getLastFrameTime());
+	}
+
+	{
+		VULPIX_TRACE_SCOPE("update");
+		update(frameIndex, dt);
+	}
+	{
+		VULPIX_TRACE_SCOPE("record");
+		recordCommandBuffer(frameIndex, imageIndex);
+	}
 
 
 	const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -744,64 +997,225 @@ void AppBase::drawFrame(const float dt)
 	VkSubmitInfo submitInfo;
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pNext = nullptr;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &m_imageAcquiredSemaphore;
+	submitInfo.waitSemaphoreCount = m_headless ? 0 : 1;
+	submitInfo.pWaitSemaphores = &frame.m_imageAcquiredSemaphore;
 	submitInfo.pWaitDstStageMask = &waitStageMask;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &m_renderingCompleteSemaphore;
+	submitInfo.pCommandBuffers = &frame.m_commandBuffer;
+	submitInfo.signalSemaphoreCount = m_headless ? 0 : 1;
+	submitInfo.pSignalSemaphores = &frame.m_renderingCompleteSemaphore;
 
-	error = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, fence);
+	{
+		VULPIX_TRACE_SCOPE("submit");
+		error = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frame.m_fence);
+	}
 	if (VK_SUCCESS != error) {
 		return;
 	}
 
+	++m_submittedFrames;
+	if (m_headless)
+	{
+		m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
+		return;
+	}
+
 	VkPresentInfoKHR presentInfo;
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.pNext = nullptr;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &m_renderingCompleteSemaphore;
+	presentInfo.pWaitSemaphores = &frame.m_renderingCompleteSemaphore;
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = &m_swapchain;
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
-	error = vkQueuePresentKHR(m_graphicsQueue, &presentInfo);
-	if (VK_SUCCESS != error) {
+	{
+		VULPIX_TRACE_SCOPE("present");
+		error = vkQueuePresentKHR(m_graphicsQueue, &presentInfo);
+	}
+
+	m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
+}
+
+bool AppBase::startCapture()
+{
+	if (m_storageSwapchain && !m_swapchainCapture)
+	{
+		std::cout << "The swapchain images can't be captured" << std::endl;
+		return false;
+	}
+
+	if (!m_frameCapture.isEnabled())
+	{
+		// every slot is sized for the full resolution, the output extent only ever shrinks below it.
+		// The workers leave two cores to the frame loop and the driver
+		const uint32_t numCores = std::thread::hardware_concurrency();
+		const uint32_t numWorkers = std::clamp(numCores > 2 ? numCores - 2 : 1u, 1u, 8u);
+		const uint32_t numSlots = m_settings.m_framesInFlight + 2 * numWorkers;
+		const bool swapRedBlue = m_surfaceFormat.format == VK_FORMAT_B8G8R8A8_UNORM || m_surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB;
+		const VkExtent2D maxExtent = { m_settings.m_resolutionX, m_settings.m_resolutionY };
+
+		if (!m_frameCapture.initCapture(maxExtent, numSlots, numWorkers, swapRedBlue, m_headless,
+			[this](const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height)
+			{
+				onFrameReadback(frameNumber, pixels, width, height);
+			}))
+		{
+			std::cout << "Could not create the frame capture buffers" << std::endl;
+			return false;
+		}
+	}
+
+	// the stream starts with the next frame and has to get every one after it
+	if (!m_streamPath.empty() && !m_videoStream.isOpen() &&
+		!m_videoStream.openStream(m_streamPath, m_streamFormat, m_outputExtent.width, m_outputExtent.height, m_streamFrameRate, m_submittedFrames))
+	{
+		return false;
+	}
+
+	m_capturing = true;
+	return true;
+}
+
+void AppBase::toggleCapture()
+{
+	if (m_videoStream.isOpen())
+	{
+		std::cout << "The stream captures every frame" << std::endl;
+		return;
+	}
+
+	if (m_capturing)
+	{
+		m_capturing = false;
+		std::cout << "Capture stopped" << std::endl;
 		return;
 	}
 
+	if (m_captureOutput.empty())
+	{
+		m_captureOutput = "capture";
+	}
+	if (startCapture())
+	{
+		std::cout << "Capturing to " << m_captureOutput << "_*." << m_captureExtension << std::endl;
+	}
 }
 
-void AppBase::destroyApp()
+void AppBase::addCapturePass(FrameData& frame, const VkImage image)
 {
-	if (m_renderingCompleteSemaphore) {
-		vkDestroySemaphore(m_device, m_renderingCompleteSemaphore, nullptr);
-		m_renderingCompleteSemaphore = VK_NULL_HANDLE;
+	if (!m_capturing || (m_storageSwapchain && !m_swapchainCapture))
+	{
+		return;
 	}
 
-	if (m_imageAcquiredSemaphore) {
-		vkDestroySemaphore(m_device, m_imageAcquiredSemaphore, nullptr);
-		m_imageAcquiredSemaphore = VK_NULL_HANDLE;
+	const uint32_t slot = m_frameCapture.beginCapture(m_submittedFrames, m_outputExtent);
+	if (slot == UINT32_MAX)
+	{
+		if (m_videoStream.isOpen())
+		{
+			m_videoStream.dropFrame(m_submittedFrames);
+		}
+		return;
 	}
+	frame.m_captureSlot = slot;
+
+	// the workers read the slot once the fence has signaled
+	const VkBuffer captureBuffer = m_frameCapture.getBuffer(slot);
+	const VulpixGraphResource capture = m_renderGraph.importMemory(VulpixResourceState());
+	const uint32_t width = m_outputExtent.width;
+	const uint32_t height = m_outputExtent.height;
+	m_renderGraph.addPass("capture", [image, captureBuffer, width, height](VkCommandBuffer commandBuffer)
+		{
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.bufferOffset = 0;
+			copyRegion.bufferRowLength = 0; // tightly packed
+			copyRegion.bufferImageHeight = 0;
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			copyRegion.imageOffset = { 0, 0, 0 };
+			copyRegion.imageExtent = { width, height, 1 };
+			vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, captureBuffer, 1, &copyRegion);
+		})
+		.read(m_presentResource, VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+		.write(capture, VK_PIPELINE_STAGE_2_COPY_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+
+	m_renderGraph.addPass("host capture")
+		.read(capture, VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+}
 
-	if (!m_commandBuffers.empty()) {
-		vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
-		m_commandBuffers.clear();
+void AppBase::completeCaptures()
+{
+	vkDeviceWaitIdle(m_device);
+
+	for (FrameData& frame : m_frames)
+	{
+		if (frame.m_captureSlot != UINT32_MAX)
+		{
+			m_frameCapture.completeCapture(frame.m_captureSlot);
+			frame.m_captureSlot = UINT32_MAX;
+		}
 	}
+}
 
-	if (m_commandPool) {
-		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
-		m_commandPool = VK_NULL_HANDLE;
+void AppBase::flushCaptures()
+{
+	completeCaptures();
+
+	if (m_frameCapture.isEnabled())
+	{
+		m_frameCapture.waitIdle();
+		std::cout << "Captured " << m_frameCapture.getCapturedCount() << " frames, dropped " << m_frameCapture.getDroppedCount() << std::endl;
 	}
 
-	for (VkFence& fence : m_waitForFences) {
-		vkDestroyFence(m_device, fence, nullptr);
+	// the workers are idle, every frame the stream gets has arrived
+	m_videoStream.closeStream();
+}
+
+void AppBase::dumpFrameTimes() const
+{
+	m_cpuFrameTimes.print(std::cout, "CPU frame time");
+	if (m_gpuFrameTimes.getCount() > 0)
+	{
+		m_gpuFrameTimes.print(std::cout, "GPU frame time");
+	}
+}
+
+void AppBase::destroyApp()
+{
+	m_frameCapture.destroyCapture();
+	m_videoStream.closeStream();
+
+	for (FrameData& frame : m_frames) {
+		if (frame.m_renderingCompleteSemaphore) {
+			vkDestroySemaphore(m_device, frame.m_renderingCompleteSemaphore, nullptr);
+			frame.m_renderingCompleteSemaphore = VK_NULL_HANDLE;
+		}
+
+		if (frame.m_imageAcquiredSemaphore) {
+			vkDestroySemaphore(m_device, frame.m_imageAcquiredSemaphore, nullptr);
+			frame.m_imageAcquiredSemaphore = VK_NULL_HANDLE;
+		}
+
+		if (frame.m_commandBuffer) {
+			vkFreeCommandBuffers(m_device, m_commandPool, 1, &frame.m_commandBuffer);
+			frame.m_commandBuffer = VK_NULL_HANDLE;
+		}
+
+		if (frame.m_fence) {
+			vkDestroyFence(m_device, frame.m_fence, nullptr);
+			frame.m_fence = VK_NULL_HANDLE;
+		}
+
+		frame.m_offscreenImage.destroyImage();
 	}
-	m_waitForFences.clear();
 
-	m_offscreenImage.destroyImage();
+	m_gpuProfiler.destroyProfiler(m_device);
+
+	if (m_commandPool) {
+		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+		m_commandPool = VK_NULL_HANDLE;
+	}
 
 	for (VkImageView& view : m_swapchainImageViews) {
 		vkDestroyImageView(m_device, view, nullptr);
@@ -847,7 +1261,7 @@ void AppBase::freeResources()
 {
 }
 
-void AppBase::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+void AppBase::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t presentTarget)
 {
 }
 
@@ -863,8 +1277,34 @@ void AppBase::onKeyboard(const int key, const int scancode, const int action, co
 {
 }
 
-void AppBase::update(size_t imageIndex, const float dt)
+void AppBase::update(uint32_t frameIndex, const float dt)
+{
+}
+
+void AppBase::report(const float fps, const float frameTime)
+{
+}
+
+void AppBase::onFrameReadback(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height)
 {
+	if (m_videoStream.isOpen())
+	{
+		m_videoStream.writeFrame(frameNumber, pixels, width, height);
+	}
+
+	if (m_captureOutput.empty())
+	{
+		return;
+	}
+
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "_%05u.", frameNumber);
+	const std::string path = m_captureOutput + suffix + m_captureExtension;
+
+	if (!vulpix::writeImage(path, pixels, width, height))
+	{
+		std::cout << "Could not write " << path << std::endl;
+	}
 }
 
 // virtual end
\ No newline at end of file
@@ -5,6 +5,12 @@
 #include "Vulpix_Context.h"	
 #include "GLFW/glfw3.h"
 #include "Image.h"
+#include "Vulpix_RenderGraph.h"
+#include "Vulpix_GpuProfiler.h"
+#include "Vulpix_FrameTimeHistogram.h"
+#include "Vulpix_Trace.h"
+#include "Vulpix_FrameCapture.h"
+#include "Vulpix_VideoStream.h"
 
 struct AppSettings
 {
@@ -16,25 +22,20 @@ struct AppSettings
 	bool m_enableVSync;
 	bool m_supportRT;
 	bool m_supportDescriptorIndexing;
+	uint32_t m_framesInFlight; // frames the CPU may record ahead of the GPU, independent of the swapchain image count
+	float m_reportInterval;    // seconds between two report() calls
+	float m_hitchThreshold;    // ms, slower CPU or GPU frames count as hitches
 };
 
-struct FPSCounter
+// everything a frame touches until its fence signals, one per frame in flight
+struct FrameData
 {
-	static const size_t m_FPSHistorySize = 128;
-	float m_FPSHistory[m_FPSHistorySize] = { 0.0f };
-	size_t m_FPSHistoryIndex = 0;
-	float m_fpsAccumulator = 0.0f;
-	float m_fps = 0.0f;
-
-	void update(const float dt)
-	{
-		m_fpsAccumulator += dt - m_FPSHistory[m_FPSHistoryIndex];
-		m_FPSHistory[m_FPSHistoryIndex] = dt;
-		m_FPSHistoryIndex = (m_FPSHistoryIndex + 1) % m_FPSHistorySize;
-		m_fps = (m_fpsAccumulator > 0.0f) ? (1.0f / (m_fpsAccumulator / static_cast<float>(m_FPSHistorySize))) : FLT_MAX;
-	}
-	float getFPS() const { return m_fps; }
-	float getFrameTime() const { return 1000.0f / m_fps; }
+	VkFence m_fence = VK_NULL_HANDLE;
+	VkSemaphore m_imageAcquiredSemaphore = VK_NULL_HANDLE;
+	VkSemaphore m_renderingCompleteSemaphore = VK_NULL_HANDLE;
+	VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+	Image m_offscreenImage; // only when the swapchain images can't be storage images, copied into them at the end of the frame
+	uint32_t m_captureSlot = UINT32_MAX; // m_frameCapture slot the frame copies into until its fence signals
 };
 
 class AppBase
@@ -43,6 +44,20 @@ public:
 	AppBase();
 	virtual ~AppBase();
 
+	// call before run(). Skips GLFW, the window, the surface and the swapchain, renders frameCount frames into
+	// the offscreen images and captures every one. outputPrefix names the images the default onFrameReadback
+	// writes (<prefix>_00000.png, ...), an empty one keeps the frames in memory only
+	void setHeadless(const uint32_t frameCount, const std::string& outputPrefix);
+	// call before run(). Windowed runs capture every frame from the start, as <outputPrefix>_00000.<extension>.
+	// The extension (png or jpg) also applies to headless output
+	void setCapture(const std::string& outputPrefix, const std::string& extension);
+	// call before run(). Streams every frame to path ("-" for stdout) for an external encoder, at the output size the
+	// run starts with. Works windowed and headless, next to or instead of the image output
+	void setStream(const std::string& path, const VideoStreamFormat format, const uint32_t frameRate);
+	bool isHeadless() const { return m_headless; }
+	// process exit code, non-zero when a run that checks its results failed
+	int getExitCode() const { return m_exitCode; }
+
 	void run();
 
 
@@ -52,6 +67,7 @@ protected:
 	void shutdown();
 
 	void initDefaultSettings();
+	bool initWindow();
 	bool initVulkan();
 	bool initDevicesAndQueues();
 	bool initSwapchain();
@@ -59,22 +75,47 @@ protected:
 	bool initSynchronization();
 	bool initSurface();
 	bool initFencesAndCommandPool();
-	bool initOffscreenImage();
-	void fillCommandBuffers();
+	bool initOffscreenImages();
+	bool initHeadlessTarget();
+	// the capture ring is created on the first start. Windowed captures drop frames when the encoders fall behind,
+	// headless ones wait for them
+	bool startCapture();
+	void toggleCapture();
+	// copies image, m_presentResource, into a capture slot after the user passes
+	void addCapturePass(FrameData& frame, const VkImage image);
+	// waits for the device, every submitted frame gets queued for the capture workers
+	void completeCaptures();
+	// waits for the device and the encoders, every submitted frame gets handed out
+	void flushCaptures();
+	void recordCommandBuffer(const uint32_t frameIndex, const uint32_t imageIndex);
+
+	// the images a frame's final pass writes, the swapchain images themselves when they can be storage images,
+	// otherwise the per-frame offscreen images. fillCommandBuffer gets the index of the one to write, and
+	// adds its passes to m_renderGraph, where the target is m_presentResource
+	std::vector<VkImageView> getPresentTargets() const;
 
 	void drawFrame(const float dt);
+	// mainLoop returns after the current frame, windowed or headless
+	void requestQuit();
+	// prints the CPU and GPU frame time distributions
+	void dumpFrameTimes() const;
 	void destroyApp();
 
 	// virtual functions
 	virtual void initApp();
 	virtual void initSettings();
 	virtual void freeResources();
-	virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t presentTarget);
 
 	virtual void onMouseMove(const float x, const float y);
 	virtual void onMouseButton(const int button, const int action, const int mods);
 	virtual void onKeyboard(const int key, const int scancode, const int action, const int mods);
-	virtual void update(size_t imageIndex, const float dt);
+	virtual void update(uint32_t frameIndex, const float dt);
+	// every captured frame, as tightly packed RGBA8 sRGB rows of the m_outputExtent it was recorded with. Runs on a
+	// capture worker thread, frames can arrive out of order and at the same time
+	virtual void onFrameReadback(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height);
+	// rate limited, with the frame rate and mean frame time (ms) since the last report
+	virtual void report(const float fps, const float frameTime);
 
 
 protected:
@@ -89,13 +130,15 @@ protected:
 	VkSwapchainKHR m_swapchain;
 	std::vector<VkImage> m_swapchainImages;
 	std::vector<VkImageView> m_swapchainImageViews;
-	std::vector<VkFence> m_waitForFences;
+	bool m_storageSwapchain; // frames are written straight into the swapchain images, no offscreen copy
+	// the part of the present target a frame covers, from the top left corner. The full resolution unless the app
+	// renders smaller frames into the same images, captures only copy this part
+	VkExtent2D m_outputExtent;
 	VkCommandPool m_commandPool;
-	Image m_offscreenImage;
-	std::vector<VkCommandBuffer> m_commandBuffers;
 
-	VkSemaphore m_imageAcquiredSemaphore;
-	VkSemaphore m_renderingCompleteSemaphore;
+	// command buffers are recorded every frame, so they are tied to the frame and not to the swapchain image
+	std::vector<FrameData> m_frames;
+	uint32_t m_frameIndex;
 
 	uint32_t m_graphicsQueueFamilyIndex;
 	uint32_t m_computeQueueFamilyIndex;
@@ -106,8 +149,37 @@ protected:
 
 
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_rayTracingPipelineProperties;
-
-	FPSCounter m_FPSCounter;
+	VkPhysicalDeviceSubgroupProperties m_subgroupProperties;
+
+	// frame time distributions of the whole run, printed at exit
+	VulpixFrameTimeHistogram m_cpuFrameTimes;
+	VulpixFrameTimeHistogram m_gpuFrameTimes;
+	float m_reportTime;       // since the last report
+	uint32_t m_reportFrames;
+
+	// headless rendering, see setHeadless
+	bool m_headless;
+	uint32_t m_headlessFrames;
+	uint32_t m_submittedFrames;
+
+	// frame capture, always on when headless
+	VulpixFrameCapture m_frameCapture;
+	bool m_capturing;
+	bool m_swapchainCapture; // the swapchain images can be copied from, only needed when frames are written into them
+	std::string m_captureOutput;
+	std::string m_captureExtension;
+	VulpixVideoStream m_videoStream;
+	std::string m_streamPath;
+	VideoStreamFormat m_streamFormat;
+	uint32_t m_streamFrameRate;
+	bool m_quitRequested;
+	int m_exitCode;
+
+	// rebuilt every frame, recordCommandBuffer imports the present target, the app adds its passes in
+	// fillCommandBuffer, then the present transition (and the offscreen copy) go last
+	VulpixRenderGraph m_renderGraph;
+	VulpixGraphResource m_presentResource;
+	VulpixGpuProfiler m_gpuProfiler; // timestamps around every pass of m_renderGraph
 };
 
 
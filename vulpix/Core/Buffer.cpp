@@ -7,6 +7,7 @@ Buffer::Buffer()
 	m_buffer = VK_NULL_HANDLE;
 	m_bufferMemory = VK_NULL_HANDLE;
 	m_size = 0;
+	m_memorySize = 0;
 }
 
 Buffer::~Buffer()
@@ -70,6 +71,11 @@ VkResult Buffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMem
 				m_buffer = VK_NULL_HANDLE;
 				m_bufferMemory = VK_NULL_HANDLE;
 			}
+			else
+			{
+				m_memorySize = memoryRequirements.size;
+				vulpix::trackAllocation(m_memorySize);
+			}
 		}
 	}
 
@@ -89,6 +95,8 @@ void Buffer::destroyBuffer()
 	{
 		vkFreeMemory(m_context.m_device, m_bufferMemory, nullptr);
 		m_bufferMemory = VK_NULL_HANDLE;
+		vulpix::trackFree(m_memorySize);
+		m_memorySize = 0;
 	}
 }
 
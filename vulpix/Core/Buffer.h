@@ -26,6 +26,7 @@ private:
 	VkBuffer m_buffer;
 	VkDeviceMemory m_bufferMemory;
 	VkDeviceSize m_size;
+	VkDeviceSize m_memorySize; // of m_bufferMemory, can be larger than m_size
 };
 
 #endif // VULPIX_BUFFER_H
\ No newline at end of file
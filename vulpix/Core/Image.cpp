@@ -1,5 +1,7 @@
 #include "Image.h"
 #include "Buffer.h"
+#include "Vulpix_Trace.h"
+#include "../Shader/Shader_Config.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 // excluding old and unusefull formats
@@ -19,8 +21,10 @@ Image::Image()
 	m_format = VK_FORMAT_B8G8R8A8_UNORM;
 	m_image = VK_NULL_HANDLE;
 	m_imageMemory = VK_NULL_HANDLE;
+	m_memorySize = 0;
 	m_imageView = VK_NULL_HANDLE;
 	m_sampler = VK_NULL_HANDLE;
+	m_hasAlphaMask = false;
 }
 
 Image::~Image()
@@ -39,6 +43,8 @@ void Image::destroyImage()
 	{
 		vkFreeMemory(m_context.m_device, m_imageMemory, nullptr);
 		m_imageMemory = VK_NULL_HANDLE;
+		vulpix::trackFree(m_memorySize);
+		m_memorySize = 0;
 	}
 	if (m_imageView)
 	{
@@ -52,8 +58,10 @@ void Image::destroyImage()
 	}
 }
 
-bool Image::load(std::string path)
+bool Image::load(std::string path, const std::string& alphaPath)
 {
+	VULPIX_TRACE_SCOPE("Image::load");
+
 	int texWidth, texHeight, texChannels;
 	bool textHDR = false;
 	stbi_uc* imageData = nullptr;
@@ -71,6 +79,37 @@ bool Image::load(std::string path)
 		imageData = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 	}
 
+	m_hasAlphaMask = false;
+	if (imageData && !textHDR)
+	{
+		if (!alphaPath.empty())
+		{
+			int maskWidth, maskHeight, maskChannels;
+			stbi_uc* maskData = stbi_load(alphaPath.c_str(), &maskWidth, &maskHeight, &maskChannels, STBI_grey);
+			if (maskData)
+			{
+				// nearest sample, the mask usually has the same size anyway
+				for (int y = 0; y < texHeight; ++y)
+				{
+					for (int x = 0; x < texWidth; ++x)
+					{
+						const int mx = x * maskWidth / texWidth;
+						const int my = y * maskHeight / texHeight;
+						imageData[(y * texWidth + x) * 4 + 3] = maskData[my * maskWidth + mx];
+					}
+				}
+				stbi_image_free(maskData);
+			}
+		}
+
+		// anything that gets cut out by the alpha test makes this an alpha tested texture
+		const stbi_uc cutoff = static_cast<stbi_uc>(VULPIX_ALPHA_CUTOFF * 255.0f);
+		for (int i = 0; i < texWidth * texHeight && !m_hasAlphaMask; ++i)
+		{
+			m_hasAlphaMask = imageData[i * 4 + 3] < cutoff;
+		}
+	}
+
 	if (imageData)
 	{
 		int bpp = textHDR ? sizeof(float[4]) : sizeof(uint8_t[4]);
@@ -235,6 +274,11 @@ VkResult Image::createImage(VkImageType imageType, VkFormat format, VkExtent3D e
 				m_image = VK_NULL_HANDLE;
 				m_imageMemory = VK_NULL_HANDLE;
 			}
+			else
+			{
+				m_memorySize = memRequirements.size;
+				vulpix::trackAllocation(m_memorySize);
+			}
 		}
 	
 	}
@@ -16,7 +16,8 @@ public:
 	~Image();
 
 	void destroyImage();
-	bool load(std::string path);
+	// alphaPath optionally names a separate mask texture (OBJ map_d) that replaces the alpha channel
+	bool load(std::string path, const std::string& alphaPath = std::string());
 	
 	VkResult createImage(VkImageType imageType, VkFormat format, VkExtent3D ext, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
 	VkResult createImageView(VkImageViewType viewType, VkFormat format, VkImageSubresourceRange subResource);
@@ -27,13 +28,16 @@ public:
 	VkImageView getImageView() const { return m_imageView; }
 	VkSampler getSampler() const { return m_sampler; }
 	VkFormat getFormat() const { return m_format; }
+	bool hasAlphaMask() const { return m_hasAlphaMask; }
 
 private:
 	VkFormat m_format;
 	VkImage m_image;
 	VkDeviceMemory m_imageMemory;
+	VkDeviceSize m_memorySize;
 	VkImageView m_imageView;
 	VkSampler m_sampler;
+	bool m_hasAlphaMask;
 };
 
 
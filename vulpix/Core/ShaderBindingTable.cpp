@@ -80,7 +80,7 @@ void VulpixShaderBindingTable::addStageToHitGroup(const std::vector<VkPipelineSh
 {
     assert(!m_shaderStages.empty());
     assert(groupIndex < m_numHitShaders.size());
-	assert(!m_shaderStages.empty() && m_shaderStages.size() <= 3);
+    assert(!stages.empty() && stages.size() <= 3); // closest-hit, any-hit and intersection at most
 	assert(m_numHitShaders[groupIndex] == 0);
 
     uint32_t offset = 1; // there's always raygen shader
@@ -7,8 +7,8 @@ class VulpixAccelerationStructure
 {
 public:
 	Buffer m_Buffer;
-	VkAccelerationStructureKHR m_AccelerationStructure;
-	VkDeviceAddress m_DeviceAddress;
+	VkAccelerationStructureKHR m_AccelerationStructure = VK_NULL_HANDLE;
+	VkDeviceAddress m_DeviceAddress = 0;
 };
 
 #endif	// VULPIXAS_H
\ No newline at end of file
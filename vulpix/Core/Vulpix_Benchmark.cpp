@@ -0,0 +1,198 @@
+#include "Vulpix_Benchmark.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+	void writeString(std::ofstream& file, const std::string& text)
+	{
+		file << '"';
+		for (const char c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				file << '\\';
+			}
+			file << c;
+		}
+		file << '"';
+	}
+
+	void writeFrameTimes(std::ofstream& file, const char* name, const VulpixFrameTimeHistogram& frameTimes)
+	{
+		file << "  \"" << name << "\": { \"frames\": " << frameTimes.getCount()
+			<< ", \"mean\": " << frameTimes.getMean()
+			<< ", \"p50\": " << frameTimes.getPercentile(50.0f)
+			<< ", \"p90\": " << frameTimes.getPercentile(90.0f)
+			<< ", \"p99\": " << frameTimes.getPercentile(99.0f)
+			<< ", \"p99.9\": " << frameTimes.getPercentile(99.9f)
+			<< ", \"max\": " << frameTimes.getMax()
+			<< ", \"hitches\": " << frameTimes.getHitchCount() << " },\n";
+	}
+} // namespace
+
+bool VulpixCameraPath::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	m_keyframes.clear();
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream stream(line);
+		CameraKeyframe keyframe;
+		stream >> keyframe.m_time >> keyframe.m_position.x >> keyframe.m_position.y >> keyframe.m_position.z
+			>> keyframe.m_forward.x >> keyframe.m_forward.y >> keyframe.m_forward.z;
+		if (stream.fail())
+		{
+			m_keyframes.clear();
+			return false;
+		}
+		addKeyframe(keyframe.m_time, keyframe.m_position, keyframe.m_forward);
+	}
+
+	return !m_keyframes.empty();
+}
+
+bool VulpixCameraPath::save(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	// enough digits for a float to read back unchanged, replays must match the recording
+	file << "# vulpix camera path: time px py pz fx fy fz\n" << std::setprecision(9);
+	for (const CameraKeyframe& keyframe : m_keyframes)
+	{
+		file << keyframe.m_time << ' '
+			<< keyframe.m_position.x << ' ' << keyframe.m_position.y << ' ' << keyframe.m_position.z << ' '
+			<< keyframe.m_forward.x << ' ' << keyframe.m_forward.y << ' ' << keyframe.m_forward.z << '\n';
+	}
+	return file.good();
+}
+
+void VulpixCameraPath::addKeyframe(const float time, const vulpix::math::vec3& position, const vulpix::math::vec3& forward)
+{
+	assert(m_keyframes.empty() || time >= m_keyframes.back().m_time);
+
+	CameraKeyframe keyframe;
+	keyframe.m_time = time;
+	keyframe.m_position = position;
+	keyframe.m_forward = glm::normalize(forward);
+	m_keyframes.push_back(keyframe);
+}
+
+CameraKeyframe VulpixCameraPath::sample(const float time) const
+{
+	if (m_keyframes.empty())
+	{
+		return CameraKeyframe();
+	}
+
+	// the first keyframe after time
+	const auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+		[](const float t, const CameraKeyframe& keyframe) { return t < keyframe.m_time; });
+	if (next == m_keyframes.begin())
+	{
+		return m_keyframes.front();
+	}
+	if (next == m_keyframes.end())
+	{
+		return m_keyframes.back();
+	}
+
+	const CameraKeyframe& a = *(next - 1);
+	const CameraKeyframe& b = *next;
+	const float t = (time - a.m_time) / std::max(b.m_time - a.m_time, 1e-6f);
+
+	CameraKeyframe result;
+	result.m_time = time;
+	result.m_position = glm::mix(a.m_position, b.m_position, t);
+
+	// opposite directions have no well defined blend, keep the earlier one
+	const vulpix::math::vec3 forward = glm::mix(a.m_forward, b.m_forward, t);
+	const float length = glm::length(forward);
+	result.m_forward = length > 1e-4f ? forward / length : a.m_forward;
+	return result;
+}
+
+bool BenchmarkReport::writeJson(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	const double mraysPerSecond = m_traceTime > 0.0 ? static_cast<double>(m_rays) / (m_traceTime * 1000.0) : 0.0;
+	const uint64_t measuredFrames = m_cpuFrameTimes.getCount();
+
+	// times in ms, memory in bytes
+	file << "{\n  \"scene\": ";
+	writeString(file, m_scene);
+	file << ",\n  \"mesh_merging\": " << (m_meshMerging ? "true" : "false")
+		<< ",\n  \"triangle_splitting\": " << (m_triangleSplitting ? "true" : "false")
+		<< ",\n  \"meshes\": " << m_meshCount;
+	file << ",\n  \"camera_path\": ";
+	writeString(file, m_cameraPath);
+	file << ",\n  \"resolution\": [" << m_width << ", " << m_height << "],\n"
+		<< "  \"warmup_frames\": " << m_warmupFrames << ",\n"
+		<< "  \"measured_frames\": " << measuredFrames << ",\n"
+		<< "  \"load_ms\": " << m_loadTime << ",\n"
+		<< "  \"blas_build_ms\": " << m_blasTime << ",\n"
+		<< "  \"tlas_build_ms\": " << m_tlasTime << ",\n";
+	writeFrameTimes(file, "cpu_frame_ms", m_cpuFrameTimes);
+	writeFrameTimes(file, "gpu_frame_ms", m_gpuFrameTimes);
+	file << "  \"rays_per_frame\": " << (measuredFrames > 0 ? m_rays / measuredFrames : 0) << ",\n"
+		<< "  \"mrays_per_second\": " << mraysPerSecond << ",\n"
+		<< "  \"peak_host_memory\": " << m_peakHostMemory << ",\n"
+		<< "  \"peak_device_memory\": " << m_peakDeviceMemory << "\n}\n";
+
+	return file.good();
+}
+
+namespace vulpix
+{
+	uint64_t getPeakHostMemory()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+		}
+		return 0;
+#else
+		// kB on Linux
+		struct rusage usage = {};
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+		{
+			return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+		}
+		return 0;
+#endif
+	}
+} // namespace vulpix
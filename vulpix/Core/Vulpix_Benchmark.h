@@ -0,0 +1,85 @@
+#ifndef VULPIX_BENCHMARK_H
+#define VULPIX_BENCHMARK_H
+
+#include "../Common.h"
+#include "../Math/Vulpix_Math.h"
+#include "Vulpix_FrameTimeHistogram.h"
+
+#include <cstdint>
+
+// one recorded camera pose, time in seconds since the recording started
+struct CameraKeyframe
+{
+	float m_time = 0.0f;
+	vulpix::math::vec3 m_position = vulpix::math::vec3(0.0f);
+	vulpix::math::vec3 m_forward = vulpix::math::vec3(0.0f, 0.0f, -1.0f);
+};
+
+// Camera positions and view directions over time. Stored as text, one "time px py pz fx fy fz" line per
+// keyframe, so recorded paths can be diffed and edited by hand
+class VulpixCameraPath
+{
+public:
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	void clear() { m_keyframes.clear(); }
+	// times must not decrease
+	void addKeyframe(const float time, const vulpix::math::vec3& position, const vulpix::math::vec3& forward);
+
+	// linear in between two keyframes, the forward vector is renormalized. Clamped to the first and last keyframe
+	CameraKeyframe sample(const float time) const;
+
+	bool isEmpty() const { return m_keyframes.empty(); }
+	size_t getKeyframeCount() const { return m_keyframes.size(); }
+	float getDuration() const { return m_keyframes.empty() ? 0.0f : m_keyframes.back().m_time; }
+
+private:
+	std::vector<CameraKeyframe> m_keyframes;
+};
+
+struct BenchmarkSettings
+{
+	std::string m_cameraPath;
+	std::string m_outputPath = "vulpix_bench.json";
+	uint32_t m_warmupFrames = 120;
+	uint32_t m_measuredFrames = 1000;
+	float m_timeStep = 1.0f / 60.0f; // path time per frame, independent of the frame rate, the path loops
+};
+
+// everything a camera path benchmark measures, written out as one JSON object
+struct BenchmarkReport
+{
+	std::string m_scene;
+	bool m_meshMerging = true;
+	bool m_triangleSplitting = true;
+	uint32_t m_meshCount = 0; // after merging, one TLAS instance each (two where secondary rays use another LOD)
+	std::string m_cameraPath;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	uint32_t m_warmupFrames = 0;
+
+	float m_loadTime = 0.0f; // ms, OBJ, mesh processing, textures and mesh buffers
+	float m_blasTime = 0.0f; // ms
+	float m_tlasTime = 0.0f; // ms
+
+	VulpixFrameTimeHistogram m_cpuFrameTimes;
+	VulpixFrameTimeHistogram m_gpuFrameTimes;
+
+	// 0 without VULPIX_RAY_COUNTERS
+	uint64_t m_rays = 0;
+	double m_traceTime = 0.0; // ms, the GPU time of the trace pass over the measured frames
+
+	uint64_t m_peakHostMemory = 0;   // bytes, peak resident set of the process
+	uint64_t m_peakDeviceMemory = 0; // bytes, peak of the Vulkan memory allocated through Buffer and Image
+
+	bool writeJson(const std::string& path) const;
+};
+
+namespace vulpix
+{
+	// bytes, 0 where the platform can't tell
+	uint64_t getPeakHostMemory();
+} // namespace vulpix
+
+#endif // VULPIX_BENCHMARK_H
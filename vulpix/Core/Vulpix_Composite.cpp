@@ -0,0 +1,193 @@
+#include "Vulpix_Composite.h"
+#include "../Shader/Shader.h"
+#include "../Shader/Shader_Config.h"
+
+VulpixComposite::VulpixComposite()
+{
+	m_descriptorSetLayout = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_pipeline = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+	m_numTargets = 0;
+	m_srgbEncode = true;
+}
+
+bool VulpixComposite::initComposite(VkDevice device, const std::vector<VkImageView>& sources, const std::vector<VkImageView>& targets, const bool srgbEncode)
+{
+	const uint32_t numFrames = static_cast<uint32_t>(sources.size());
+	m_numTargets = static_cast<uint32_t>(targets.size());
+	m_srgbEncode = srgbEncode;
+	if (numFrames == 0 || m_numTargets == 0)
+	{
+		return false;
+	}
+	const uint32_t numSets = numFrames * m_numTargets;
+
+	const VkDescriptorSetLayoutBinding bindings[] = {
+		{ VULPIX_COMPOSITE_SOURCE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ VULPIX_COMPOSITE_TARGET_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+	};
+	const uint32_t numBindings = static_cast<uint32_t>(sizeof(bindings) / sizeof(bindings[0]));
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = numBindings;
+	layoutInfo.pBindings = bindings;
+
+	VkResult error = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_descriptorSetLayout);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorSetLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	// extent, tonemap operator and sRGB encoding
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uvec4);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	error = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+	CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	Shader compositeShader;
+	if (!compositeShader.load("assets/out_shaders/composite.bin"))
+	{
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compositeShader.getShaderStageInfo(VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = m_pipelineLayout;
+
+	error = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+	CHECK_VK_ERROR(error, "vkCreateComputePipelines");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numSets * numBindings };
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.maxSets = numSets;
+	descriptorPoolCreateInfo.poolSizeCount = 1;
+	descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+
+	error = vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numSets, m_descriptorSetLayout);
+	m_descriptorSets.resize(numSets);
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = numSets;
+	descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
+
+	error = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, m_descriptorSets.data());
+	CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	for (uint32_t frame = 0; frame < numFrames; ++frame)
+	{
+		for (uint32_t target = 0; target < m_numTargets; ++target)
+		{
+			// same order as bindings
+			const VkImageView views[] = {
+				sources[frame],
+				targets[target]
+			};
+
+			VkDescriptorImageInfo imageInfos[numBindings];
+			VkWriteDescriptorSet writes[numBindings];
+
+			for (uint32_t i = 0; i < numBindings; ++i)
+			{
+				imageInfos[i].sampler = VK_NULL_HANDLE;
+				imageInfos[i].imageView = views[i];
+				imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+				writes[i] = {};
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = m_descriptorSets[frame * m_numTargets + target];
+				writes[i].dstBinding = bindings[i].binding;
+				writes[i].dstArrayElement = 0;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+				writes[i].pImageInfo = &imageInfos[i];
+			}
+
+			vkUpdateDescriptorSets(device, numBindings, writes, 0, nullptr);
+		}
+	}
+
+	return true;
+}
+
+void VulpixComposite::destroyComposite(VkDevice device)
+{
+	if (m_descriptorPool)
+	{
+		vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+		m_descriptorPool = VK_NULL_HANDLE;
+	}
+	m_descriptorSets.clear();
+
+	if (m_pipeline)
+	{
+		vkDestroyPipeline(device, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout)
+	{
+		vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+
+	if (m_descriptorSetLayout)
+	{
+		vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+		m_descriptorSetLayout = VK_NULL_HANDLE;
+	}
+}
+
+void VulpixComposite::recordComposite(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const uint32_t target, const VkExtent2D extent, const uint32_t tonemap) const
+{
+	if (!m_pipeline)
+	{
+		return;
+	}
+
+	const uvec4 params(extent.width, extent.height, tonemap, m_srgbEncode ? 1u : 0u);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[frameIndex * m_numTargets + target], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uvec4), &params);
+	vkCmdDispatch(commandBuffer,
+		(extent.width + VULPIX_COMPOSITE_GROUP_SIZE - 1) / VULPIX_COMPOSITE_GROUP_SIZE,
+		(extent.height + VULPIX_COMPOSITE_GROUP_SIZE - 1) / VULPIX_COMPOSITE_GROUP_SIZE,
+		1);
+}
@@ -0,0 +1,34 @@
+#ifndef VULPIX_COMPOSITE_H
+#define VULPIX_COMPOSITE_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+
+// Final compute pass of a frame: tonemaps the linear frame image, encodes it to sRGB and writes it straight
+// into the presented image, in whatever channel order that one has
+class VulpixComposite
+{
+public:
+	VulpixComposite();
+	~VulpixComposite() = default;
+
+	// one source per frame in flight, targets are the images that get presented (swapchain images, or the
+	// offscreen images when the swapchain can't be a storage image). srgbEncode is false for _SRGB targets,
+	// those encode on store. Everything has to be in VK_IMAGE_LAYOUT_GENERAL when recorded
+	bool initComposite(VkDevice device, const std::vector<VkImageView>& sources, const std::vector<VkImageView>& targets, const bool srgbEncode);
+	void destroyComposite(VkDevice device);
+
+	// records the dispatch only, the caller's render graph pass declares the source and the target
+	void recordComposite(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const uint32_t target, const VkExtent2D extent, const uint32_t tonemap) const;
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_descriptorSets; // per frame in flight, per target
+	uint32_t m_numTargets;
+	bool m_srgbEncode;
+};
+
+#endif // VULPIX_COMPOSITE_H
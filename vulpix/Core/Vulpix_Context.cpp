@@ -1,5 +1,7 @@
 #include "Vulpix_Context.h"
 
+#include <algorithm>
+
 namespace vulpix
 {
 
@@ -30,6 +32,17 @@ void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageSubresour
 	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 }
 
+void trackAllocation(VkDeviceSize size)
+{
+	m_context.m_allocatedMemory += size;
+	m_context.m_peakAllocatedMemory = std::max(m_context.m_peakAllocatedMemory, m_context.m_allocatedMemory);
+}
+
+void trackFree(VkDeviceSize size)
+{
+	m_context.m_allocatedMemory -= size;
+}
+
 uint32_t getMemTypeIndex(VkMemoryRequirements requirement, VkMemoryPropertyFlags properties)
 {
 	uint32_t result = 0;
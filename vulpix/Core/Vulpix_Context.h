@@ -24,6 +24,9 @@ struct VulpixContext
 	VkCommandPool m_CommandPool;
 	VkQueue m_transferQueue;
 	VkPhysicalDeviceMemoryProperties m_physicalDeviceMemoryProperties;
+	// bytes bound to Buffer and Image objects, now and at most so far
+	VkDeviceSize m_allocatedMemory;
+	VkDeviceSize m_peakAllocatedMemory;
 
 };
 
@@ -33,8 +36,12 @@ extern VulpixContext m_context;
 namespace vulpix
 {
     void initializeContext(VkDevice device, VkCommandPool commandPool, VkQueue transferQueue, VkPhysicalDevice physicalDevice);
+    // full pipeline barrier, meant for one-time uploads and setup. Per-frame passes go through VulpixRenderGraph
     void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageSubresourceRange& subresourceRange, VkAccessFlags srcMask, VkAccessFlags dstMask, VkImageLayout oldL, VkImageLayout newL);
 	uint32_t getMemTypeIndex(VkMemoryRequirements requirement, VkMemoryPropertyFlags properties);
+	// every vkAllocateMemory / vkFreeMemory of Buffer and Image, for m_allocatedMemory
+	void trackAllocation(VkDeviceSize size);
+	void trackFree(VkDeviceSize size);
 
 	VkDeviceOrHostAddressKHR getBufferDeviceAddress(const Buffer& buff);
 
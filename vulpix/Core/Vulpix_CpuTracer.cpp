@@ -0,0 +1,1003 @@
+#include "Vulpix_CpuTracer.h"
+
+#include "Vulpix_TileNetwork.h"
+#include "Vulpix_Trace.h"
+#include "../Renderer/Camera.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULPIX_SSE2 1
+#include <emmintrin.h>
+#else
+#define VULPIX_SSE2 0
+#endif
+
+namespace
+{
+	const uint32_t s_tileSize = 32;
+	const uint32_t s_leafTriangles = 4;  // one packet
+	const uint32_t s_sahBins = 16;
+	const uint32_t s_maxSahDepth = 64;   // deeper nodes split at the median, which bounds the traversal stack
+	const uint32_t s_stackSize = 128;
+	const float s_rayOffset = 0.001f;    // ray_gen's self intersection offset
+
+	// ray_gen.glsl's
+	const float s_eratoRefract = 1.0f / 1.31f;
+
+	uint32_t pcgHash(const uint32_t v)
+	{
+		const uint32_t state = v * 747796405u + 2891336453u;
+		const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	vec2 pixelJitter(const uint32_t x, const uint32_t y, const uint32_t frame)
+	{
+		const uint32_t seed = pcgHash(x + pcgHash(y + pcgHash(frame)));
+		const uint32_t second = pcgHash(seed);
+		return vec2(static_cast<float>(seed), static_cast<float>(second)) * (1.0f / 4294967296.0f) - 0.5f;
+	}
+
+	vec2 dirToLatLong(const vec3& dir)
+	{
+		const float phi = std::atan2(dir.x, dir.z);
+		const float theta = std::acos(glm::clamp(dir.y, -1.0f, 1.0f));
+		return vec2((vulpix::PI + phi) * (0.5f / vulpix::PI), theta / vulpix::PI);
+	}
+
+	// composite.glsl's
+	vec3 tonemapAces(const vec3& color)
+	{
+		const float a = 2.51f;
+		const float b = 0.03f;
+		const float c = 2.43f;
+		const float d = 0.59f;
+		const float e = 0.14f;
+		return (color * (a * color + b)) / (color * (c * color + d) + e);
+	}
+
+	// what an sRGB texture format decodes to before filtering
+	const float* srgbToLinearTable()
+	{
+		static float table[256];
+		static std::once_flag once;
+		std::call_once(once, []()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const float c = static_cast<float>(i) / 255.0f;
+				table[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+		});
+		return table;
+	}
+
+	int wrap(const int i, const int size)
+	{
+		const int r = i % size;
+		return r < 0 ? r + size : r;
+	}
+
+	float surfaceArea(const vec3& boundsMin, const vec3& boundsMax)
+	{
+		const vec3 e = glm::max(boundsMax - boundsMin, vec3(0.0f));
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	// entry distance of the ray into the box, FLT_MAX when it misses it before tmax
+	float intersectBox(const vec3& boundsMin, const vec3& boundsMax, const vec3& origin, const vec3& invDirection, const float tmax)
+	{
+		const vec3 t0 = (boundsMin - origin) * invDirection;
+		const vec3 t1 = (boundsMax - origin) * invDirection;
+		const vec3 tNear = glm::min(t0, t1);
+		const vec3 tFar = glm::max(t0, t1);
+		const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tmax));
+		return enter <= exit ? enter : FLT_MAX;
+	}
+
+	// a tile queue per thread, the owner takes from the front and thieves from the back
+	struct TileQueue
+	{
+		std::mutex m_mutex;
+		std::deque<uint32_t> m_tiles;
+
+		bool pop(const bool steal, uint32_t& tile)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_tiles.empty())
+			{
+				return false;
+			}
+			if (steal)
+			{
+				tile = m_tiles.back();
+				m_tiles.pop_back();
+			}
+			else
+			{
+				tile = m_tiles.front();
+				m_tiles.pop_front();
+			}
+			return true;
+		}
+	};
+}
+
+vec4 VulpixCpuTracer::Texture::sample(const vec2& uv) const
+{
+	// linear filter at level 0 with repeat, like the samplers the textures get
+	const float x = uv.x * static_cast<float>(m_width) - 0.5f;
+	const float y = uv.y * static_cast<float>(m_height) - 0.5f;
+	const float fx = std::floor(x);
+	const float fy = std::floor(y);
+	const float wx = x - fx;
+	const float wy = y - fy;
+	const int w = static_cast<int>(m_width);
+	const int h = static_cast<int>(m_height);
+	const int x0 = wrap(static_cast<int>(fx), w);
+	const int y0 = wrap(static_cast<int>(fy), h);
+	const int x1 = wrap(x0 + 1, w);
+	const int y1 = wrap(y0 + 1, h);
+
+	const int offsets[4] = { y0 * w + x0, y0 * w + x1, y1 * w + x0, y1 * w + x1 };
+	const float weights[4] = { (1.0f - wx) * (1.0f - wy), wx * (1.0f - wy), (1.0f - wx) * wy, wx * wy };
+
+	vec4 result(0.0f);
+	if (!m_hdrTexels.empty())
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			const float* texel = &m_hdrTexels[offsets[i] * 3];
+			result += vec4(texel[0], texel[1], texel[2], 1.0f) * weights[i];
+		}
+	}
+	else
+	{
+		const float* toLinear = srgbToLinearTable();
+		for (int i = 0; i < 4; ++i)
+		{
+			const uint8_t* texel = &m_texels[offsets[i] * 4];
+			result += vec4(toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]], texel[3] / 255.0f) * weights[i];
+		}
+	}
+	return result;
+}
+
+VulpixCpuTracer::VulpixCpuTracer()
+{
+}
+
+VulpixCpuTracer::~VulpixCpuTracer()
+{
+}
+
+bool VulpixCpuTracer::buildScene(const std::vector<VulpixMeshData>& meshData, const std::vector<SceneMaterialFiles>& materials, const std::string& environmentMap)
+{
+	VULPIX_TRACE_SCOPE("VulpixCpuTracer::buildScene");
+
+	// textures first, the alpha test needs to know which materials cut anything out
+	m_textures.assign(materials.size(), Texture());
+	std::vector<bool> alphaMaterials(materials.size(), false);
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		Texture& texture = m_textures[i];
+		int width, height, channels;
+		const std::string& path = materials[i].m_texture;
+		if (path.substr(path.find_last_of('.') + 1) == "hdr")
+		{
+			float* data = stbi_loadf(path.c_str(), &width, &height, &channels, STBI_rgb);
+			if (data)
+			{
+				texture.m_hdrTexels.assign(data, data + width * height * 3);
+				texture.m_width = static_cast<uint32_t>(width);
+				texture.m_height = static_cast<uint32_t>(height);
+				stbi_image_free(data);
+			}
+			continue;
+		}
+
+		stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (!data)
+		{
+			continue;
+		}
+		texture.m_texels.assign(data, data + width * height * 4);
+		texture.m_width = static_cast<uint32_t>(width);
+		texture.m_height = static_cast<uint32_t>(height);
+		stbi_image_free(data);
+
+		// Image::load's alpha mask handling
+		if (!materials[i].m_alphaTexture.empty())
+		{
+			int maskWidth, maskHeight, maskChannels;
+			stbi_uc* maskData = stbi_load(materials[i].m_alphaTexture.c_str(), &maskWidth, &maskHeight, &maskChannels, STBI_grey);
+			if (maskData)
+			{
+				for (int y = 0; y < height; ++y)
+				{
+					for (int x = 0; x < width; ++x)
+					{
+						const int mx = x * maskWidth / width;
+						const int my = y * maskHeight / height;
+						texture.m_texels[(y * width + x) * 4 + 3] = maskData[my * maskWidth + mx];
+					}
+				}
+				stbi_image_free(maskData);
+			}
+		}
+
+		const uint8_t cutoff = static_cast<uint8_t>(VULPIX_ALPHA_CUTOFF * 255.0f);
+		for (int t = 0; t < width * height && !alphaMaterials[i]; ++t)
+		{
+			alphaMaterials[i] = texture.m_texels[t * 4 + 3] < cutoff;
+		}
+	}
+
+	m_environment = Texture();
+	int envWidth, envHeight, envChannels;
+	float* envData = stbi_loadf(environmentMap.c_str(), &envWidth, &envHeight, &envChannels, STBI_rgb);
+	if (envData)
+	{
+		m_environment.m_hdrTexels.assign(envData, envData + envWidth * envHeight * 3);
+		m_environment.m_width = static_cast<uint32_t>(envWidth);
+		m_environment.m_height = static_cast<uint32_t>(envHeight);
+		stbi_image_free(envData);
+	}
+	else
+	{
+		std::cout << "CPU tracer: could not load the environment map " << environmentMap << std::endl;
+	}
+
+	// the full detail LOD of every mesh, what camera rays close to it see
+	m_triangles.clear();
+	std::vector<vec3> positions;
+	for (const VulpixMeshData& data : meshData)
+	{
+		const VulpixMeshLodRange lod = data.getLods().front();
+		for (uint32_t f = lod.m_firstFace; f < lod.m_firstFace + lod.m_faceCount; ++f)
+		{
+			Triangle triangle;
+			for (uint32_t j = 0; j < 3; ++j)
+			{
+				triangle.m_vertices[j] = data.m_attributes[3 * f + j];
+				positions.push_back(data.m_positions[3 * f + j]);
+			}
+			triangle.m_material = data.m_materialIDs[f];
+			triangle.m_objectId = data.m_objectIDs[f];
+			triangle.m_alphaTested = triangle.m_material < alphaMaterials.size() && alphaMaterials[triangle.m_material];
+			m_triangles.push_back(triangle);
+		}
+	}
+
+	if (m_triangles.empty())
+	{
+		m_nodes.clear();
+		m_packets.clear();
+		return false;
+	}
+
+	const uint64_t buildBegin = vulpix::trace::now();
+	buildBvh(positions);
+	std::cout << "CPU tracer: " << m_triangles.size() << " triangles, " << m_nodes.size() << " BVH nodes, " << m_packets.size()
+		<< " leaf packets, built in " << static_cast<double>(vulpix::trace::now() - buildBegin) * 1e-6 << " ms" << std::endl;
+	return true;
+}
+
+void VulpixCpuTracer::buildBvh(const std::vector<vec3>& positions)
+{
+	VULPIX_TRACE_SCOPE("VulpixCpuTracer::buildBvh");
+
+	const uint32_t triangleCount = static_cast<uint32_t>(m_triangles.size());
+
+	std::vector<vec3> triMin(triangleCount);
+	std::vector<vec3> triMax(triangleCount);
+	std::vector<vec3> centroids(triangleCount);
+	std::vector<uint32_t> order(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const vec3& a = positions[3 * t + 0];
+		const vec3& b = positions[3 * t + 1];
+		const vec3& c = positions[3 * t + 2];
+		triMin[t] = glm::min(a, glm::min(b, c));
+		triMax[t] = glm::max(a, glm::max(b, c));
+		centroids[t] = (triMin[t] + triMax[t]) * 0.5f;
+		order[t] = t;
+	}
+
+	struct BuildTask
+	{
+		uint32_t m_node;
+		uint32_t m_begin;
+		uint32_t m_end;
+		uint32_t m_depth;
+	};
+
+	m_nodes.clear();
+	m_nodes.reserve(2 * (triangleCount / s_leafTriangles + 1));
+	m_packets.clear();
+	m_packets.reserve(triangleCount / s_leafTriangles + 1);
+	m_nodes.push_back(Node());
+
+	std::vector<BuildTask> tasks;
+	tasks.push_back({ 0, 0, triangleCount, 0 });
+
+	while (!tasks.empty())
+	{
+		const BuildTask task = tasks.back();
+		tasks.pop_back();
+
+		vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (uint32_t i = task.m_begin; i < task.m_end; ++i)
+		{
+			const uint32_t t = order[i];
+			boundsMin = glm::min(boundsMin, triMin[t]);
+			boundsMax = glm::max(boundsMax, triMax[t]);
+			centroidMin = glm::min(centroidMin, centroids[t]);
+			centroidMax = glm::max(centroidMax, centroids[t]);
+		}
+		m_nodes[task.m_node].m_min = boundsMin;
+		m_nodes[task.m_node].m_max = boundsMax;
+
+		const uint32_t count = task.m_end - task.m_begin;
+		if (count <= s_leafTriangles)
+		{
+			Node& leaf = m_nodes[task.m_node];
+			leaf.m_first = static_cast<uint32_t>(m_packets.size());
+			leaf.m_packetCount = 1;
+
+			TrianglePacket packet = {};
+			for (uint32_t lane = 0; lane < 4; ++lane)
+			{
+				packet.m_triangle[lane] = UINT32_MAX;
+				if (lane >= count)
+				{
+					continue;
+				}
+				const uint32_t t = order[task.m_begin + lane];
+				const vec3& v0 = positions[3 * t + 0];
+				const vec3 e1 = positions[3 * t + 1] - v0;
+				const vec3 e2 = positions[3 * t + 2] - v0;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					packet.m_v0[axis][lane] = v0[axis];
+					packet.m_edge1[axis][lane] = e1[axis];
+					packet.m_edge2[axis][lane] = e2[axis];
+				}
+				packet.m_triangle[lane] = t;
+			}
+			m_packets.push_back(packet);
+			continue;
+		}
+
+		// binned SAH over the centroids, the cost counts leaf packets rather than triangles
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+		float bestCost = FLT_MAX;
+		const vec3 centroidExtent = centroidMax - centroidMin;
+		if (task.m_depth < s_maxSahDepth)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				if (centroidExtent[axis] <= 0.0f)
+				{
+					continue;
+				}
+
+				uint32_t binCounts[s_sahBins] = {};
+				vec3 binMin[s_sahBins], binMax[s_sahBins];
+				std::fill(binMin, binMin + s_sahBins, vec3(FLT_MAX));
+				std::fill(binMax, binMax + s_sahBins, vec3(-FLT_MAX));
+
+				const float scale = static_cast<float>(s_sahBins) / centroidExtent[axis];
+				for (uint32_t i = task.m_begin; i < task.m_end; ++i)
+				{
+					const uint32_t t = order[i];
+					const uint32_t bin = std::min(static_cast<uint32_t>((centroids[t][axis] - centroidMin[axis]) * scale), s_sahBins - 1);
+					++binCounts[bin];
+					binMin[bin] = glm::min(binMin[bin], triMin[t]);
+					binMax[bin] = glm::max(binMax[bin], triMax[t]);
+				}
+
+				// right side areas swept from the back, then the left side from the front
+				float rightArea[s_sahBins];
+				uint32_t rightCount[s_sahBins];
+				vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+				uint32_t sweepCount = 0;
+				for (uint32_t b = s_sahBins - 1; b > 0; --b)
+				{
+					sweepMin = glm::min(sweepMin, binMin[b]);
+					sweepMax = glm::max(sweepMax, binMax[b]);
+					sweepCount += binCounts[b];
+					rightArea[b] = surfaceArea(sweepMin, sweepMax);
+					rightCount[b] = sweepCount;
+				}
+
+				sweepMin = vec3(FLT_MAX);
+				sweepMax = vec3(-FLT_MAX);
+				sweepCount = 0;
+				for (uint32_t b = 1; b < s_sahBins; ++b)
+				{
+					sweepMin = glm::min(sweepMin, binMin[b - 1]);
+					sweepMax = glm::max(sweepMax, binMax[b - 1]);
+					sweepCount += binCounts[b - 1];
+					if (sweepCount == 0 || rightCount[b] == 0)
+					{
+						continue;
+					}
+
+					const float leftPackets = static_cast<float>((sweepCount + s_leafTriangles - 1) / s_leafTriangles);
+					const float rightPackets = static_cast<float>((rightCount[b] + s_leafTriangles - 1) / s_leafTriangles);
+					const float cost = surfaceArea(sweepMin, sweepMax) * leftPackets + rightArea[b] * rightPackets;
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+		}
+
+		uint32_t middle = task.m_begin + count / 2;
+		if (bestAxis >= 0)
+		{
+			const float scale = static_cast<float>(s_sahBins) / centroidExtent[bestAxis];
+			const float splitMin = centroidMin[bestAxis];
+			const uint32_t* split = std::partition(order.data() + task.m_begin, order.data() + task.m_end, [&](const uint32_t t)
+			{
+				return std::min(static_cast<uint32_t>((centroids[t][bestAxis] - splitMin) * scale), s_sahBins - 1) < bestBin;
+			});
+			middle = static_cast<uint32_t>(split - order.data());
+		}
+		else
+		{
+			// all centroids in one spot, or too deep: halves along the widest axis
+			int axis = 0;
+			if (centroidExtent.y > centroidExtent[axis])
+			{
+				axis = 1;
+			}
+			if (centroidExtent.z > centroidExtent[axis])
+			{
+				axis = 2;
+			}
+			std::nth_element(order.begin() + task.m_begin, order.begin() + middle, order.begin() + task.m_end, [&](const uint32_t a, const uint32_t b)
+			{
+				return centroids[a][axis] < centroids[b][axis];
+			});
+		}
+
+		const uint32_t firstChild = static_cast<uint32_t>(m_nodes.size());
+		m_nodes[task.m_node].m_first = firstChild;
+		m_nodes.push_back(Node());
+		m_nodes.push_back(Node());
+		tasks.push_back({ firstChild + 1, middle, task.m_end, task.m_depth + 1 });
+		tasks.push_back({ firstChild, task.m_begin, middle, task.m_depth + 1 });
+	}
+}
+
+bool VulpixCpuTracer::passesAlphaTest(const uint32_t triangle, const float u, const float v) const
+{
+	// ray_ahit.glsl
+	const Triangle& tri = m_triangles[triangle];
+	if (!tri.m_alphaTested)
+	{
+		return true;
+	}
+
+	const vec3 barycentrics(1.0f - u - v, u, v);
+	const vec2 uv = barycentricLerp(vec2(tri.m_vertices[0].m_uv), vec2(tri.m_vertices[1].m_uv), vec2(tri.m_vertices[2].m_uv), barycentrics);
+	return m_textures[tri.m_material].sample(uv).a >= VULPIX_ALPHA_CUTOFF;
+}
+
+bool VulpixCpuTracer::intersect(const vec3& origin, const vec3& direction, const float tmax, const bool anyHit, Hit& hit) const
+{
+	// zero components would make the slab test divide 0 by 0
+	vec3 invDirection;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float d = std::fabs(direction[axis]) > 1e-20f ? direction[axis] : std::copysign(1e-20f, direction[axis]);
+		invDirection[axis] = 1.0f / d;
+	}
+
+	float closest = tmax;
+	hit = Hit();
+
+#if VULPIX_SSE2
+	const __m128 ox = _mm_set1_ps(origin.x);
+	const __m128 oy = _mm_set1_ps(origin.y);
+	const __m128 oz = _mm_set1_ps(origin.z);
+	const __m128 dx = _mm_set1_ps(direction.x);
+	const __m128 dy = _mm_set1_ps(direction.y);
+	const __m128 dz = _mm_set1_ps(direction.z);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+#endif
+
+	uint32_t stack[s_stackSize];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+
+	if (intersectBox(m_nodes[0].m_min, m_nodes[0].m_max, origin, invDirection, closest) == FLT_MAX)
+	{
+		return false;
+	}
+
+	for (;;)
+	{
+		const Node& node = m_nodes[nodeIndex];
+		if (node.m_packetCount == 0)
+		{
+			const float nearT = intersectBox(m_nodes[node.m_first].m_min, m_nodes[node.m_first].m_max, origin, invDirection, closest);
+			const float farT = intersectBox(m_nodes[node.m_first + 1].m_min, m_nodes[node.m_first + 1].m_max, origin, invDirection, closest);
+			if (nearT != FLT_MAX || farT != FLT_MAX)
+			{
+				// the nearer child first, the other one on the stack
+				const bool swap = farT < nearT;
+				const uint32_t first = swap ? node.m_first + 1 : node.m_first;
+				const uint32_t second = swap ? node.m_first : node.m_first + 1;
+				if ((swap ? nearT : farT) != FLT_MAX)
+				{
+					stack[stackSize++] = second;
+				}
+				nodeIndex = first;
+				continue;
+			}
+		}
+		else
+		{
+			for (uint32_t p = node.m_first; p < node.m_first + node.m_packetCount; ++p)
+			{
+				const TrianglePacket& packet = m_packets[p];
+				float t[4], u[4], v[4];
+				int mask = 0;
+
+#if VULPIX_SSE2
+				// Moller-Trumbore on four triangles
+				const __m128 e1x = _mm_load_ps(packet.m_edge1[0]);
+				const __m128 e1y = _mm_load_ps(packet.m_edge1[1]);
+				const __m128 e1z = _mm_load_ps(packet.m_edge1[2]);
+				const __m128 e2x = _mm_load_ps(packet.m_edge2[0]);
+				const __m128 e2y = _mm_load_ps(packet.m_edge2[1]);
+				const __m128 e2z = _mm_load_ps(packet.m_edge2[2]);
+
+				const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+				const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+				const __m128 tx = _mm_sub_ps(ox, _mm_load_ps(packet.m_v0[0]));
+				const __m128 ty = _mm_sub_ps(oy, _mm_load_ps(packet.m_v0[1]));
+				const __m128 tz = _mm_sub_ps(oz, _mm_load_ps(packet.m_v0[2]));
+
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+				const __m128 invDet = _mm_div_ps(one, det);
+				const __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+				const __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+				const __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+				__m128 valid = _mm_cmpneq_ps(det, zero);
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, zero));
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, zero));
+				valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), one));
+				valid = _mm_and_ps(valid, _mm_cmpgt_ps(tt, zero));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_set1_ps(closest)));
+				mask = _mm_movemask_ps(valid);
+				if (mask == 0)
+				{
+					continue;
+				}
+				_mm_storeu_ps(t, tt);
+				_mm_storeu_ps(u, uu);
+				_mm_storeu_ps(v, vv);
+#else
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					const vec3 e1(packet.m_edge1[0][lane], packet.m_edge1[1][lane], packet.m_edge1[2][lane]);
+					const vec3 e2(packet.m_edge2[0][lane], packet.m_edge2[1][lane], packet.m_edge2[2][lane]);
+					const vec3 pvec = glm::cross(direction, e2);
+					const float det = glm::dot(e1, pvec);
+					if (det == 0.0f)
+					{
+						continue;
+					}
+					const float invDet = 1.0f / det;
+					const vec3 tvec = origin - vec3(packet.m_v0[0][lane], packet.m_v0[1][lane], packet.m_v0[2][lane]);
+					const vec3 qvec = glm::cross(tvec, e1);
+					u[lane] = glm::dot(tvec, pvec) * invDet;
+					v[lane] = glm::dot(direction, qvec) * invDet;
+					t[lane] = glm::dot(e2, qvec) * invDet;
+					if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f && t[lane] > 0.0f && t[lane] < closest)
+					{
+						mask |= 1 << lane;
+					}
+				}
+#endif
+
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if ((mask & (1 << lane)) == 0 || t[lane] >= closest || !passesAlphaTest(packet.m_triangle[lane], u[lane], v[lane]))
+					{
+						continue;
+					}
+
+					closest = t[lane];
+					hit.m_distance = t[lane];
+					hit.m_triangle = packet.m_triangle[lane];
+					hit.m_u = u[lane];
+					hit.m_v = v[lane];
+					if (anyHit)
+					{
+						return true;
+					}
+				}
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			break;
+		}
+		nodeIndex = stack[--stackSize];
+	}
+
+	return hit.m_triangle != UINT32_MAX;
+}
+
+vec3 VulpixCpuTracer::tracePixel(const vec3& cameraOrigin, const vec3& cameraDirection, const CpuTracerSettings& settings, uint64_t& rays) const
+{
+	vec3 origin = cameraOrigin;
+	vec3 direction = cameraDirection;
+	vec3 finalColor(0.0f);
+
+	for (int i = 0; i < VULPIX_MAX_RECURSION; ++i)
+	{
+		Hit hit;
+		const bool found = intersect(origin, direction, settings.m_far, false, hit);
+		++rays;
+
+		// ray_miss.glsl
+		if (!found)
+		{
+			if (m_environment.isValid())
+			{
+				finalColor += vec3(m_environment.sample(dirToLatLong(direction)));
+			}
+			break;
+		}
+
+		// ray_chit.glsl
+		const Triangle& tri = m_triangles[hit.m_triangle];
+		const vec3 barycentrics(1.0f - hit.m_u - hit.m_v, hit.m_u, hit.m_v);
+		const vec3 hitNormal = glm::normalize(barycentricLerp(vec3(tri.m_vertices[0].m_normal), vec3(tri.m_vertices[1].m_normal), vec3(tri.m_vertices[2].m_normal), barycentrics));
+		const vec2 uv = barycentricLerp(vec2(tri.m_vertices[0].m_uv), vec2(tri.m_vertices[1].m_uv), vec2(tri.m_vertices[2].m_uv), barycentrics);
+		const bool textured = tri.m_material < m_textures.size() && m_textures[tri.m_material].isValid();
+		const vec3 hitColor = textured ? vec3(m_textures[tri.m_material].sample(uv)) : vec3(1.0f);
+		const float objectId = static_cast<float>(tri.m_objectId);
+
+		const vec3 hitPos = origin + direction * hit.m_distance;
+
+		if (objectId == VULPIX_OBJECT_ID_TEAPOT)
+		{
+			origin = hitPos + hitNormal * s_rayOffset;
+			direction = glm::reflect(direction, hitNormal);
+		}
+		else if (objectId == VULPIX_OBJECT_ID_ERATO)
+		{
+			const float NdotD = glm::dot(hitNormal, direction);
+			const vec3 refrNormal = (NdotD > 0.0f) ? -hitNormal : hitNormal;
+			const float refrEta = (NdotD > 0.0f) ? 1.0f / s_eratoRefract : s_eratoRefract;
+
+			origin = hitPos + direction * s_rayOffset;
+			direction = glm::refract(direction, refrNormal, refrEta);
+		}
+		else
+		{
+			const vec3 toLight = glm::normalize(settings.m_sunPosition);
+			const vec3 shadowRayOrigin = hitPos + hitNormal * s_rayOffset;
+
+			Hit shadowHit;
+			const bool shadowed = intersect(shadowRayOrigin, toLight, settings.m_far, true, shadowHit);
+			++rays;
+
+			const float lighting = shadowed ? settings.m_ambientLight : std::max(settings.m_ambientLight, glm::dot(hitNormal, toLight));
+			finalColor += hitColor * lighting;
+			break;
+		}
+	}
+
+	return finalColor;
+}
+
+CpuTraceStats VulpixCpuTracer::render(const RenderJob& job, const CpuTracerSettings& settings, std::vector<uint8_t>& pixels) const
+{
+	VULPIX_TRACE_SCOPE("VulpixCpuTracer::render");
+
+	CpuTraceStats stats;
+	pixels.assign(static_cast<size_t>(job.m_width) * job.m_height * 4, 0);
+	if (m_nodes.empty() || pixels.empty())
+	{
+		return stats;
+	}
+
+	// the same basis the pipeline gets from the camera
+	Camera camera;
+	camera.lookCameraAt(job.m_position, job.m_position + job.m_forward);
+	const vec3 origin = camera.getPosition();
+	const vec3 forward = camera.getForward();
+	const vec3 right = camera.getSide();
+	const vec3 up = camera.getUp();
+
+	const bool tiled = job.m_tile != UINT32_MAX;
+	const vec2 imageExtent = tiled ? vec2(static_cast<float>(job.m_imageWidth), static_cast<float>(job.m_imageHeight))
+		: vec2(static_cast<float>(job.m_width), static_cast<float>(job.m_height));
+	const uint32_t offsetX = tiled ? job.m_tileX : 0;
+	const uint32_t offsetY = tiled ? job.m_tileY : 0;
+	const float aspect = imageExtent.x / imageExtent.y;
+
+	const uint32_t tilesX = (job.m_width + s_tileSize - 1) / s_tileSize;
+	const uint32_t tilesY = (job.m_height + s_tileSize - 1) / s_tileSize;
+	const uint32_t tileCount = tilesX * tilesY;
+
+	uint32_t threadCount = settings.m_threadCount;
+	if (threadCount == 0)
+	{
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	threadCount = std::min(threadCount, tileCount);
+
+	// neighbouring tiles stay on one thread, stealing from the back takes the ones farthest from the owner's
+	std::vector<std::unique_ptr<TileQueue>> queues(threadCount);
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		queues[i].reset(new TileQueue());
+	}
+	for (uint32_t tile = 0; tile < tileCount; ++tile)
+	{
+		queues[static_cast<uint64_t>(tile) * threadCount / tileCount]->m_tiles.push_back(tile);
+	}
+
+	std::atomic<uint64_t> totalRays(0);
+	std::atomic<uint32_t> stolenTiles(0);
+
+	auto renderTile = [&](const uint32_t tile, uint64_t& rays)
+	{
+		const uint32_t x0 = (tile % tilesX) * s_tileSize;
+		const uint32_t y0 = (tile / tilesX) * s_tileSize;
+		const uint32_t x1 = std::min(x0 + s_tileSize, job.m_width);
+		const uint32_t y1 = std::min(y0 + s_tileSize, job.m_height);
+
+		for (uint32_t y = y0; y < y1; ++y)
+		{
+			for (uint32_t x = x0; x < x1; ++x)
+			{
+				const uint32_t imageX = x + offsetX;
+				const uint32_t imageY = y + offsetY;
+
+				// the accumulation's running mean, one frame after the other
+				vec3 mean(0.0f);
+				for (uint32_t frame = 0; frame < job.m_samples; ++frame)
+				{
+					const vec2 pixel = vec2(static_cast<float>(imageX), static_cast<float>(imageY)) + pixelJitter(imageX, imageY, frame);
+					const vec3 direction = cameraRayDir(forward, right, up, settings.m_fovY, aspect, pixelToUv(pixel, imageExtent));
+					const vec3 color = tracePixel(origin, direction, settings, rays);
+					mean = (frame == 0) ? color : glm::mix(mean, color, 1.0f / static_cast<float>(frame + 1));
+				}
+
+				// composite.glsl into an sRGB encoded RGBA8 target
+				vec3 color = glm::max(mean, vec3(0.0f));
+				if (settings.m_tonemap == VULPIX_TONEMAP_ACES)
+				{
+					color = tonemapAces(color);
+				}
+				color = linearToSrgb(glm::clamp(color, vec3(0.0f), vec3(1.0f)));
+
+				uint8_t* out = &pixels[(static_cast<size_t>(y) * job.m_width + x) * 4];
+				for (int c = 0; c < 3; ++c)
+				{
+					out[c] = static_cast<uint8_t>(color[c] * 255.0f + 0.5f);
+				}
+				out[3] = 255;
+			}
+		}
+	};
+
+	const uint64_t begin = vulpix::trace::now();
+
+	auto worker = [&](const uint32_t index)
+	{
+		VULPIX_TRACE_SCOPE("VulpixCpuTracer::worker");
+
+		uint64_t rays = 0;
+		uint32_t stolen = 0;
+		for (;;)
+		{
+			uint32_t tile;
+			bool found = queues[index]->pop(false, tile);
+			for (uint32_t i = 1; i < threadCount && !found; ++i)
+			{
+				found = queues[(index + i) % threadCount]->pop(true, tile);
+				stolen += found ? 1 : 0;
+			}
+			if (!found)
+			{
+				break;
+			}
+			renderTile(tile, rays);
+		}
+		totalRays += rays;
+		stolenTiles += stolen;
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(worker, i);
+	}
+	worker(0);
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	stats.m_rays = totalRays;
+	stats.m_seconds = static_cast<double>(vulpix::trace::now() - begin) * 1e-9;
+	stats.m_threads = threadCount;
+	stats.m_stolenTiles = stolenTiles;
+	return stats;
+}
+
+namespace vulpix
+{
+	int runCpuRender(const CpuRenderOptions& options, const CpuTracerSettings& settings)
+	{
+		std::vector<RenderJob> jobs;
+		std::vector<GoldenCase> goldenCases;
+		std::string goldenDirectory;
+		std::unique_ptr<VulpixTileClient> tileClient;
+
+		if (!options.m_goldenCases.empty())
+		{
+			if (!loadGoldenCases(options.m_goldenCases, goldenCases))
+			{
+				std::cout << "Could not load the golden cases " << options.m_goldenCases << std::endl;
+				return 1;
+			}
+
+			const size_t slash = options.m_goldenCases.find_last_of("/\\");
+			goldenDirectory = slash != std::string::npos ? options.m_goldenCases.substr(0, slash) : std::string(".");
+
+			for (size_t i = 0; i < goldenCases.size(); ++i)
+			{
+				// new references get the resolution the GPU renders them at
+				int width = static_cast<int>(vulpix::SCENE_RESOLUTION_X);
+				int height = static_cast<int>(vulpix::SCENE_RESOLUTION_Y);
+				int channels;
+				const std::string reference = goldenDirectory + "/" + goldenCases[i].m_name + ".png";
+				stbi_info(reference.c_str(), &width, &height, &channels);
+
+				RenderJob job;
+				job.m_samples = goldenCases[i].m_samples;
+				job.m_width = static_cast<uint32_t>(width);
+				job.m_height = static_cast<uint32_t>(height);
+				job.m_position = goldenCases[i].m_position;
+				job.m_forward = goldenCases[i].m_forward;
+				job.m_goldenCase = static_cast<int32_t>(i);
+				jobs.push_back(job);
+			}
+		}
+		else if (!options.m_tileWorker.empty())
+		{
+			tileClient.reset(new VulpixTileClient());
+			if (!tileClient->connectTo(options.m_tileWorker, 30))
+			{
+				return 1;
+			}
+		}
+		else if (!loadRenderJobs(options.m_batchJobs, jobs))
+		{
+			std::cout << "Could not load the render jobs " << options.m_batchJobs << std::endl;
+			return 1;
+		}
+
+		std::vector<VulpixMeshData> meshData;
+		std::vector<SceneMaterialFiles> materials;
+		VulpixCpuTracer tracer;
+		if (!loadObjScene(options.m_sceneFile, meshData, materials) || !tracer.buildScene(meshData, materials, options.m_environmentMap))
+		{
+			std::cout << "Could not load the scene " << options.m_sceneFile << std::endl;
+			return 1;
+		}
+
+		std::vector<uint8_t> pixels;
+
+		// the same image again and again, only the thread count changes
+		if (options.m_scaling && !jobs.empty())
+		{
+			const uint32_t maxThreads = settings.m_threadCount > 0 ? settings.m_threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+			CpuTracerSettings scalingSettings = settings;
+			double singleThread = 0.0;
+			for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+			{
+				scalingSettings.m_threadCount = threads;
+				const CpuTraceStats stats = tracer.render(jobs.front(), scalingSettings, pixels);
+				singleThread = (threads == 1) ? stats.getMraysPerSecond() : singleThread;
+				std::cout << "CPU scaling: " << stats.m_threads << " threads, " << stats.getMraysPerSecond() << " Mrays/s, "
+					<< stats.getMraysPerSecond() / std::max(singleThread, 1e-9) << "x, " << stats.m_stolenTiles << " tiles stolen" << std::endl;
+				if (threads == maxThreads)
+				{
+					break;
+				}
+			}
+		}
+
+		uint32_t finished = 0;
+		uint32_t failed = 0;
+		uint64_t rays = 0;
+		const uint64_t begin = trace::now();
+		for (size_t i = 0; ; ++i)
+		{
+			RenderJob job;
+			if (tileClient)
+			{
+				if (!tileClient->receiveJob(job))
+				{
+					std::cout << "Tile worker: the coordinator is done" << std::endl;
+					break;
+				}
+			}
+			else if (i < jobs.size())
+			{
+				job = jobs[i];
+			}
+			else
+			{
+				break;
+			}
+
+			const CpuTraceStats stats = tracer.render(job, settings, pixels);
+			rays += stats.m_rays;
+
+			bool succeeded = false;
+			if (job.m_tile != UINT32_MAX)
+			{
+				tileClient->sendResult(job.m_tile, pixels.data(), job.m_width, job.m_height);
+				succeeded = true;
+			}
+			else if (job.m_goldenCase >= 0)
+			{
+				succeeded = checkGoldenImage(goldenCases[job.m_goldenCase], goldenDirectory, pixels.data(), job.m_width, job.m_height, options.m_goldenUpdate);
+			}
+			else
+			{
+				succeeded = writeRenderJobImage(job, pixels.data());
+				std::cout << "Batch " << i + 1 << "/" << jobs.size() << ": " << (succeeded ? "" : "could not write ") << job.m_output
+					<< ", " << stats.m_seconds << " s, " << stats.getMraysPerSecond() << " Mrays/s on " << stats.m_threads << " threads" << std::endl;
+			}
+
+			++finished;
+			failed += succeeded ? 0 : 1;
+		}
+
+		const double seconds = static_cast<double>(trace::now() - begin) * 1e-9;
+		const char* done = !goldenCases.empty() ? " cases passed in " : (tileClient ? " tiles done in " : " images done in ");
+		std::cout << "CPU tracer: " << finished - failed << " of " << finished << done
+			<< seconds << " s, " << static_cast<double>(rays) / std::max(seconds, 1e-9) * 1e-6 << " Mrays/s" << std::endl;
+		return failed > 0 ? 1 : 0;
+	}
+} // namespace vulpix
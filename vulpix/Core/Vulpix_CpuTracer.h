@@ -0,0 +1,135 @@
+#ifndef VULPIX_CPU_TRACER_H
+#define VULPIX_CPU_TRACER_H
+
+#include "../Common.h"
+#include "Vulpix_Golden.h"
+#include "Vulpix_MeshData.h"
+#include "Vulpix_RenderJob.h"
+#include "Vulpix_SceneLoader.h"
+
+#include <cstdint>
+
+// what the ray generation shader gets from UniformParams besides the camera
+struct CpuTracerSettings
+{
+	vec3 m_sunPosition = vulpix::SCENE_SUN_POSITION;
+	float m_ambientLight = vulpix::SCENE_AMBIENT_LIGHT;
+	float m_fovY = glm::radians(vulpix::SCENE_CAMERA_FOV);
+	float m_far = vulpix::SCENE_CAMERA_FAR;
+	uint32_t m_tonemap = VULPIX_TONEMAP_CLAMP;
+	uint32_t m_threadCount = 0; // 0 for every hardware thread
+};
+
+struct CpuTraceStats
+{
+	uint64_t m_rays = 0;      // all types
+	double m_seconds = 0.0;
+	uint32_t m_threads = 0;
+	uint32_t m_stolenTiles = 0;
+
+	double getMraysPerSecond() const { return m_seconds > 0.0 ? static_cast<double>(m_rays) / m_seconds * 1e-6 : 0.0; }
+};
+
+// what main hands the CPU tracer instead of a VulpixApp, one of the job sources is set
+struct CpuRenderOptions
+{
+	std::string m_sceneFile = vulpix::SCENE_DEFAULT_FILE;
+	std::string m_environmentMap = vulpix::SCENE_ENVIRONMENT_MAP;
+	std::string m_batchJobs;       // see vulpix::loadRenderJobs
+	std::string m_goldenCases;     // see vulpix::loadGoldenCases
+	bool m_goldenUpdate = false;
+	std::string m_tileWorker;      // host:port of a VulpixTileCoordinator
+	bool m_scaling = false;        // renders the first job with 1, 2, 4, ... threads first and prints Mrays/s for each
+};
+
+// Reference renderer without a GPU. Traces the way ray_gen.glsl and its hit / miss shaders do, on a SAH BVH over
+// the full detail meshes with four triangles per leaf, tested at once with SSE2 where available. The image is cut
+// into tiles, every thread starts on its own share of them and steals from the others once it runs out.
+// The noise is the progressive one of a batch job, so an image can be compared with the GPU's render of the same
+// job. Unlike the GPU renders there are no coarser LODs for far meshes or for bounces and shadows
+class VulpixCpuTracer
+{
+public:
+	VulpixCpuTracer();
+	~VulpixCpuTracer();
+
+	// textures are loaded like Image::load does, a material without one is white. False when there is no geometry
+	bool buildScene(const std::vector<VulpixMeshData>& meshData, const std::vector<SceneMaterialFiles>& materials, const std::string& environmentMap);
+
+	// job.m_samples progressive frames, numbered from 0 like the batch does, averaged and composited into tightly
+	// packed RGBA8 rows. A tile job traces its part of the larger image
+	CpuTraceStats render(const RenderJob& job, const CpuTracerSettings& settings, std::vector<uint8_t>& pixels) const;
+
+	uint32_t getTriangleCount() const { return static_cast<uint32_t>(m_triangles.size()); }
+	uint32_t getNodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+
+private:
+	// RGBA8 with the rgb sRGB encoded, or linear float rgb for HDR files. Sampled bilinear with repeat
+	struct Texture
+	{
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		std::vector<uint8_t> m_texels;
+		std::vector<float> m_hdrTexels;
+
+		bool isValid() const { return m_width > 0; }
+		vec4 sample(const vec2& uv) const;
+	};
+
+	// min / max and either the first child (the second follows it) or the first packet of a leaf
+	struct Node
+	{
+		vec3 m_min;
+		uint32_t m_first = 0;
+		vec3 m_max;
+		uint32_t m_packetCount = 0; // 0 for inner nodes
+	};
+
+	// four triangles as v0 and the two edges, lane by lane. Unused lanes are degenerate and never hit
+	struct alignas(16) TrianglePacket
+	{
+		float m_v0[3][4];
+		float m_edge1[3][4];
+		float m_edge2[3][4];
+		uint32_t m_triangle[4];
+	};
+
+	// what the hit shaders read
+	struct Triangle
+	{
+		VertexAttributes m_vertices[3];
+		uint32_t m_material = 0;
+		uint32_t m_objectId = 0;
+		bool m_alphaTested = false;
+	};
+
+	struct Hit
+	{
+		float m_distance = -1.0f;
+		uint32_t m_triangle = UINT32_MAX;
+		float m_u = 0.0f;
+		float m_v = 0.0f;
+	};
+
+	void buildBvh(const std::vector<vec3>& positions);
+	// closest hit up to tmax, with anyHit the first one found (shadow rays)
+	bool intersect(const vec3& origin, const vec3& direction, const float tmax, const bool anyHit, Hit& hit) const;
+	bool passesAlphaTest(const uint32_t triangle, const float u, const float v) const;
+	// one sample of one pixel, the body of ray_gen's main
+	vec3 tracePixel(const vec3& origin, const vec3& direction, const CpuTracerSettings& settings, uint64_t& rays) const;
+
+	std::vector<Node> m_nodes;
+	std::vector<TrianglePacket> m_packets;
+	std::vector<Triangle> m_triangles;
+	std::vector<Texture> m_textures; // per material
+	Texture m_environment;
+};
+
+namespace vulpix
+{
+	// loads the scene and renders the jobs of options like the headless render queue does, on the CPU. Golden cases
+	// are rendered at the size of their reference. Returns the exit code, 1 when anything failed
+	int runCpuRender(const CpuRenderOptions& options, const CpuTracerSettings& settings);
+} // namespace vulpix
+
+#endif // VULPIX_CPU_TRACER_H
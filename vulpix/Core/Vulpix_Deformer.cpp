@@ -0,0 +1,211 @@
+#include "Vulpix_Deformer.h"
+#include "../Shader/Shader.h"
+
+VulpixDeformer::VulpixDeformer()
+{
+	m_descriptorSetLayout = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_pipeline = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+}
+
+bool VulpixDeformer::initDeformer(VkDevice device, const VulpixScene& scene)
+{
+	const uint32_t numDeformables = static_cast<uint32_t>(scene.m_deformableMeshes.size());
+	if (numDeformables == 0)
+	{
+		return true;
+	}
+
+	const uint32_t bindingIndices[] = {
+		VULPIX_DEFORM_REST_POSITIONS_BINDING,
+		VULPIX_DEFORM_REST_ATTRIBUTES_BINDING,
+		VULPIX_DEFORM_OUT_POSITIONS_BINDING,
+		VULPIX_DEFORM_OUT_ATTRIBUTES_BINDING,
+		VULPIX_DEFORM_DATA_BINDING,
+		VULPIX_DEFORM_JOINTS_BINDING,
+		VULPIX_DEFORM_PARAMS_BINDING
+	};
+	const uint32_t numBindings = static_cast<uint32_t>(sizeof(bindingIndices) / sizeof(bindingIndices[0]));
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(numBindings);
+	for (uint32_t i = 0; i < numBindings; ++i)
+	{
+		bindings[i].binding = bindingIndices[i];
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = numBindings;
+	layoutInfo.pBindings = bindings.data();
+
+	VkResult error = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_descriptorSetLayout);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorSetLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	// the deform slot is the only thing that changes between dispatches
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	error = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+	CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	Shader deformShader;
+	if (!deformShader.load("assets/out_shaders/deform.bin"))
+	{
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = deformShader.getShaderStageInfo(VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = m_pipelineLayout;
+
+	error = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+	CHECK_VK_ERROR(error, "vkCreateComputePipelines");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numDeformables * numBindings };
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.maxSets = numDeformables;
+	descriptorPoolCreateInfo.poolSizeCount = 1;
+	descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+
+	error = vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numDeformables, m_descriptorSetLayout);
+	m_descriptorSets.resize(numDeformables);
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = numDeformables;
+	descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
+
+	error = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, m_descriptorSets.data());
+	CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	for (uint32_t slot = 0; slot < numDeformables; ++slot)
+	{
+		const VulpixMesh& mesh = scene.m_meshes[scene.m_deformableMeshes[slot]];
+
+		// same order as bindingIndices
+		const Buffer* buffers[] = {
+			&mesh.m_restPosition,
+			&mesh.m_restAttribute,
+			&mesh.m_position,
+			&mesh.m_attribute,
+			&mesh.m_deformData,
+			&scene.m_jointPalette,
+			&scene.m_deformParams
+		};
+
+		std::vector<VkDescriptorBufferInfo> bufferInfos(numBindings);
+		std::vector<VkWriteDescriptorSet> writes(numBindings);
+
+		for (uint32_t i = 0; i < numBindings; ++i)
+		{
+			bufferInfos[i].buffer = buffers[i]->getBuffer();
+			bufferInfos[i].offset = 0;
+			bufferInfos[i].range = buffers[i]->getSize();
+
+			writes[i] = {};
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_descriptorSets[slot];
+			writes[i].dstBinding = bindingIndices[i];
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(device, numBindings, writes.data(), 0, nullptr);
+	}
+
+	return true;
+}
+
+void VulpixDeformer::destroyDeformer(VkDevice device)
+{
+	if (m_descriptorPool)
+	{
+		vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+		m_descriptorPool = VK_NULL_HANDLE;
+	}
+	m_descriptorSets.clear();
+
+	if (m_pipeline)
+	{
+		vkDestroyPipeline(device, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout)
+	{
+		vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+
+	if (m_descriptorSetLayout)
+	{
+		vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+		m_descriptorSetLayout = VK_NULL_HANDLE;
+	}
+}
+
+void VulpixDeformer::recordDeform(VkCommandBuffer commandBuffer, const VulpixScene& scene, const uint32_t frameIndex) const
+{
+	if (!m_pipeline)
+	{
+		return;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+	const uint32_t numSlots = static_cast<uint32_t>(m_descriptorSets.size());
+	for (uint32_t slot = 0; slot < numSlots; ++slot)
+	{
+		const VulpixMesh& mesh = scene.m_meshes[scene.m_deformableMeshes[slot]];
+
+		// params are sliced per frame in flight
+		const uint32_t paramsIndex = frameIndex * numSlots + slot;
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[slot], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &paramsIndex);
+		vkCmdDispatch(commandBuffer, (mesh.getBaseVertexCount() + VULPIX_DEFORM_GROUP_SIZE - 1) / VULPIX_DEFORM_GROUP_SIZE, 1, 1);
+	}
+}
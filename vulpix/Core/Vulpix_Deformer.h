@@ -0,0 +1,29 @@
+#ifndef VULPIX_DEFORMER_H
+#define VULPIX_DEFORMER_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+#include "Vulpix_Scene.h"
+
+// Compute pass that writes skinned / vertex animated meshes into their position and attribute buffers
+class VulpixDeformer
+{
+public:
+	VulpixDeformer();
+	~VulpixDeformer() = default;
+
+	bool initDeformer(VkDevice device, const VulpixScene& scene);
+	void destroyDeformer(VkDevice device);
+
+	// records the dispatches only, the caller's render graph pass declares the vertex buffer writes
+	void recordDeform(VkCommandBuffer commandBuffer, const VulpixScene& scene, const uint32_t frameIndex) const;
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_descriptorSets; // one per deform slot
+};
+
+#endif // VULPIX_DEFORMER_H
@@ -0,0 +1,63 @@
+#include "Vulpix_DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void VulpixDynamicResolution::reset(const uint32_t outputWidth, const uint32_t outputHeight, const DynamicResolutionSettings& settings)
+{
+	m_settings = settings;
+	m_settings.m_granularity = std::max(m_settings.m_granularity, 1u);
+	m_settings.m_minScale = std::min(std::max(m_settings.m_minScale, 0.0f), 1.0f);
+	m_settings.m_maxScale = std::min(std::max(m_settings.m_maxScale, m_settings.m_minScale), 1.0f);
+
+	m_outputWidth = outputWidth;
+	m_outputHeight = outputHeight;
+	m_scale = m_settings.m_maxScale;
+	m_averageFrameTime = 0.0f;
+
+	m_renderWidth = scaledExtent(m_outputWidth);
+	m_renderHeight = scaledExtent(m_outputHeight);
+}
+
+bool VulpixDynamicResolution::update(const float frameTime)
+{
+	if (frameTime <= 0.0f || m_settings.m_targetFrameTime <= 0.0f)
+	{
+		return false;
+	}
+
+	m_averageFrameTime = (m_averageFrameTime > 0.0f) ? m_averageFrameTime + (frameTime - m_averageFrameTime) * m_settings.m_smoothing : frameTime;
+
+	const float ratio = m_settings.m_targetFrameTime / m_averageFrameTime;
+	if (std::abs(ratio - 1.0f) < m_settings.m_deadband)
+	{
+		return false;
+	}
+
+	const float desired = m_scale * std::sqrt(ratio);
+	const float step = std::min(std::max(desired - m_scale, -m_settings.m_maxStep), m_settings.m_maxStep);
+	m_scale = std::min(std::max(m_scale + step, m_settings.m_minScale), m_settings.m_maxScale);
+
+	const uint32_t width = scaledExtent(m_outputWidth);
+	const uint32_t height = scaledExtent(m_outputHeight);
+	if (width == m_renderWidth && height == m_renderHeight)
+	{
+		return false;
+	}
+
+	// the average still holds frames of the old size, predict where it will land instead of waiting for it
+	// to catch up, otherwise the controller keeps pushing in the same direction and overshoots
+	const float pixelRatio = static_cast<float>(width * height) / static_cast<float>(m_renderWidth * m_renderHeight);
+	m_averageFrameTime *= pixelRatio;
+
+	m_renderWidth = width;
+	m_renderHeight = height;
+	return true;
+}
+
+uint32_t VulpixDynamicResolution::scaledExtent(const uint32_t outputExtent) const
+{
+	const uint32_t granularity = m_settings.m_granularity;
+	const uint32_t extent = static_cast<uint32_t>(std::lround(static_cast<float>(outputExtent) * m_scale / static_cast<float>(granularity))) * granularity;
+	return std::min(std::max(extent, std::min(granularity, outputExtent)), outputExtent);
+}
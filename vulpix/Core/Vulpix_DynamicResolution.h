@@ -0,0 +1,47 @@
+#ifndef VULPIX_DYNAMIC_RESOLUTION_H
+#define VULPIX_DYNAMIC_RESOLUTION_H
+
+#include "../Common.h"
+
+struct DynamicResolutionSettings
+{
+	float m_targetFrameTime = 1000.0f / 60.0f; // ms
+	float m_minScale = 0.5f;                   // per axis, relative to the output resolution
+	float m_maxScale = 1.0f;
+	float m_smoothing = 0.1f;                  // weight of a new frame time in the running average
+	float m_deadband = 0.05f;                  // relative frame time error that is left alone
+	float m_maxStep = 0.05f;                   // largest scale change per frame
+	uint32_t m_granularity = 8;                // render extents are multiples of this
+};
+
+// Picks the internal trace resolution every frame so the frame time settles at the target. Trace cost is
+// taken to be proportional to the pixel count, so the scale follows the square root of the time ratio.
+class VulpixDynamicResolution
+{
+public:
+	void reset(const uint32_t outputWidth, const uint32_t outputHeight, const DynamicResolutionSettings& settings);
+
+	// returns true when the render extent changed
+	bool update(const float frameTime);
+
+	// getters
+	uint32_t getRenderWidth() const { return m_renderWidth; }
+	uint32_t getRenderHeight() const { return m_renderHeight; }
+	float getScale() const { return m_scale; }
+	float getAverageFrameTime() const { return m_averageFrameTime; }
+	const DynamicResolutionSettings& getSettings() const { return m_settings; }
+
+private:
+	uint32_t scaledExtent(const uint32_t outputExtent) const;
+
+private:
+	DynamicResolutionSettings m_settings;
+	uint32_t m_outputWidth = 0;
+	uint32_t m_outputHeight = 0;
+	uint32_t m_renderWidth = 0;
+	uint32_t m_renderHeight = 0;
+	float m_scale = 1.0f;
+	float m_averageFrameTime = 0.0f;
+};
+
+#endif // VULPIX_DYNAMIC_RESOLUTION_H
@@ -0,0 +1,245 @@
+#include "Vulpix_FrameCapture.h"
+#include "Vulpix_Trace.h"
+
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+	std::string getExtension(const std::string& path)
+	{
+		const size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos)
+		{
+			return std::string();
+		}
+
+		std::string extension = path.substr(dot + 1);
+		for (char& c : extension)
+		{
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		}
+		return extension;
+	}
+
+	bool hasMemoryType(const VkMemoryPropertyFlags properties)
+	{
+		const VkPhysicalDeviceMemoryProperties& memoryProperties = m_context.m_physicalDeviceMemoryProperties;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		{
+			if ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+} // namespace
+
+VulpixFrameCapture::VulpixFrameCapture()
+{
+	m_swapRedBlue = false;
+	m_blockWhenFull = false;
+	m_nextSlot = 0;
+	m_activeWorkers = 0;
+	m_stopping = false;
+	m_captured = 0;
+	m_dropped = 0;
+}
+
+VulpixFrameCapture::~VulpixFrameCapture()
+{
+	destroyCapture();
+}
+
+bool VulpixFrameCapture::initCapture(const VkExtent2D maxExtent, const uint32_t slotCount, const uint32_t workerCount, const bool swapRedBlue, const bool blockWhenFull, FrameCallback callback)
+{
+	destroyCapture();
+
+	// the CPU reads every byte, uncached memory would make that several times slower
+	VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (hasMemoryType(memoryProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+	{
+		memoryProperties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	}
+
+	const VkDeviceSize slotSize = static_cast<VkDeviceSize>(maxExtent.width) * maxExtent.height * 4;
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		std::unique_ptr<Slot> slot(new Slot());
+		VkResult error = slot->m_buffer.createBuffer(slotSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties);
+		if (VK_SUCCESS == error)
+		{
+			slot->m_pixels = reinterpret_cast<uint8_t*>(slot->m_buffer.mapMemory());
+		}
+		if (!slot->m_pixels)
+		{
+			m_slots.clear();
+			return false;
+		}
+		m_slots.push_back(std::move(slot));
+	}
+
+	m_callback = std::move(callback);
+	m_swapRedBlue = swapRedBlue;
+	m_blockWhenFull = blockWhenFull;
+	m_nextSlot = 0;
+	m_stopping = false;
+
+	for (uint32_t i = 0; i < std::max(workerCount, 1u); ++i)
+	{
+		m_workers.emplace_back(&VulpixFrameCapture::workerLoop, this);
+	}
+	return true;
+}
+
+void VulpixFrameCapture::destroyCapture()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_workAvailable.notify_all();
+
+	// the workers drain the queue before they return
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+
+	for (std::unique_ptr<Slot>& slot : m_slots)
+	{
+		if (slot->m_pixels)
+		{
+			slot->m_buffer.unmapMemory();
+		}
+		slot->m_buffer.destroyBuffer();
+	}
+	m_slots.clear();
+	m_queue.clear();
+}
+
+uint32_t VulpixFrameCapture::beginCapture(const uint32_t frameNumber, const VkExtent2D extent)
+{
+	const uint32_t numSlots = static_cast<uint32_t>(m_slots.size());
+
+	// slots in flight complete as their frames' fences signal, before the next beginCapture of the same frame, so
+	// with at least as many slots as frames in flight waiting only ever waits for the workers
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		for (uint32_t i = 0; i < numSlots; ++i)
+		{
+			const uint32_t slotIndex = (m_nextSlot + i) % numSlots;
+			Slot& slot = *m_slots[slotIndex];
+			if (slot.m_state == SlotState::Free)
+			{
+				slot.m_state = SlotState::InFlight;
+				slot.m_frameNumber = frameNumber;
+				slot.m_extent = extent;
+				m_nextSlot = (slotIndex + 1) % numSlots;
+				return slotIndex;
+			}
+		}
+
+		if (!m_blockWhenFull)
+		{
+			++m_dropped;
+			return UINT32_MAX;
+		}
+
+		VULPIX_TRACE_SCOPE("capture slot wait");
+		m_slotFreed.wait(lock);
+	}
+}
+
+void VulpixFrameCapture::completeCapture(const uint32_t slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_slots[slot]->m_state = SlotState::Queued;
+		m_queue.push_back(slot);
+	}
+	m_workAvailable.notify_one();
+}
+
+void VulpixFrameCapture::waitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_slotFreed.wait(lock, [this]() { return m_queue.empty() && m_activeWorkers == 0; });
+}
+
+void VulpixFrameCapture::workerLoop()
+{
+	for (;;)
+	{
+		uint32_t slotIndex = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workAvailable.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+			{
+				return;
+			}
+			slotIndex = m_queue.front();
+			m_queue.pop_front();
+			++m_activeWorkers;
+		}
+
+		Slot& slot = *m_slots[slotIndex];
+		{
+			VULPIX_TRACE_SCOPE("capture encode");
+
+			if (m_swapRedBlue)
+			{
+				uint8_t* pixel = slot.m_pixels;
+				uint8_t* end = pixel + static_cast<size_t>(slot.m_extent.width) * slot.m_extent.height * 4;
+				for (; pixel != end; pixel += 4)
+				{
+					std::swap(pixel[0], pixel[2]);
+				}
+			}
+
+			m_callback(slot.m_frameNumber, slot.m_pixels, slot.m_extent.width, slot.m_extent.height);
+		}
+		m_captured.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			slot.m_state = SlotState::Free;
+			--m_activeWorkers;
+		}
+		m_slotFreed.notify_all();
+	}
+}
+
+namespace vulpix
+{
+	bool canWriteImage(const std::string& path)
+	{
+		const std::string extension = getExtension(path);
+		return extension == "png" || extension == "jpg" || extension == "jpeg";
+	}
+
+	bool writeImage(const std::string& path, const uint8_t* pixels, const uint32_t width, const uint32_t height)
+	{
+		const int w = static_cast<int>(width);
+		const int h = static_cast<int>(height);
+		const std::string extension = getExtension(path);
+
+		if (extension == "jpg" || extension == "jpeg")
+		{
+			return stbi_write_jpg(path.c_str(), w, h, 4, pixels, 95) != 0;
+		}
+
+		if (extension == "png")
+		{
+			return stbi_write_png(path.c_str(), w, h, 4, pixels, w * 4) != 0;
+		}
+
+		return false;
+	}
+} // namespace vulpix
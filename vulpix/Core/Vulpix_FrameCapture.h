@@ -0,0 +1,95 @@
+#ifndef VULPIX_FRAME_CAPTURE_H
+#define VULPIX_FRAME_CAPTURE_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+#include "Buffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Host copies of finished frames that never stall the frame loop on the GPU. A frame copies its final image into
+// a slot of a ring of persistently mapped buffers. Once the frame's fence has signaled, a worker thread hands the
+// slot to the callback, and the slot is free again when the callback returns. The workers encode in parallel,
+// so a slow encoder only costs frames when all the slots are waiting on it
+class VulpixFrameCapture
+{
+public:
+	// called on a worker thread, possibly for several frames at once and out of order. Tightly packed RGBA8 rows
+	using FrameCallback = std::function<void(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height)>;
+
+	VulpixFrameCapture();
+	~VulpixFrameCapture();
+
+	// maxExtent is the largest frame a slot holds. swapRedBlue when the captured images are BGRA.
+	// blockWhenFull makes beginCapture wait for a slot instead of dropping the frame
+	bool initCapture(const VkExtent2D maxExtent, const uint32_t slotCount, const uint32_t workerCount, const bool swapRedBlue, const bool blockWhenFull, FrameCallback callback);
+	// hands out every frame that completed, then stops the workers
+	void destroyCapture();
+
+	bool isEnabled() const { return !m_slots.empty(); }
+
+	// a free slot for the frame to copy into, UINT32_MAX when the frame is dropped
+	uint32_t beginCapture(const uint32_t frameNumber, const VkExtent2D extent);
+	VkBuffer getBuffer(const uint32_t slot) const { return m_slots[slot]->m_buffer.getBuffer(); }
+	// the frame that copied into the slot has finished on the GPU, queue it for the workers
+	void completeCapture(const uint32_t slot);
+	// returns once the workers are done with every completed frame
+	void waitIdle();
+
+	uint64_t getCapturedCount() const { return m_captured.load(std::memory_order_relaxed); }
+	uint64_t getDroppedCount() const { return m_dropped; }
+
+private:
+	enum class SlotState : uint32_t
+	{
+		Free,
+		InFlight, // the GPU copies into it
+		Queued,   // waits for or is in a worker
+	};
+
+	struct Slot
+	{
+		Buffer m_buffer;
+		uint8_t* m_pixels = nullptr; // mapped for the lifetime of the slot
+		uint32_t m_frameNumber = 0;
+		VkExtent2D m_extent = { 0, 0 };
+		SlotState m_state = SlotState::Free;
+	};
+
+	void workerLoop();
+
+	std::vector<std::unique_ptr<Slot>> m_slots;
+	std::vector<std::thread> m_workers;
+	FrameCallback m_callback;
+	bool m_swapRedBlue;
+	bool m_blockWhenFull;
+	uint32_t m_nextSlot;
+
+	// slot states and the queue are guarded by m_mutex, the pixels belong to whoever moved the slot into its state
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_slotFreed;
+	std::deque<uint32_t> m_queue;
+	uint32_t m_activeWorkers;
+	bool m_stopping;
+
+	std::atomic<uint64_t> m_captured;
+	uint64_t m_dropped;
+};
+
+namespace vulpix
+{
+	// true for the .png, .jpg and .jpeg files writeImage knows. Frames are read back tonemapped to 8 bits, so
+	// there is no HDR output
+	bool canWriteImage(const std::string& path);
+	// tightly packed RGBA8 sRGB rows, .png or .jpg after the extension. False for other extensions
+	bool writeImage(const std::string& path, const uint8_t* pixels, const uint32_t width, const uint32_t height);
+} // namespace vulpix
+
+#endif // VULPIX_FRAME_CAPTURE_H
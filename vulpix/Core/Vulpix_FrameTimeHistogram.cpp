@@ -0,0 +1,68 @@
+#include "Vulpix_FrameTimeHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+VulpixFrameTimeHistogram::VulpixFrameTimeHistogram()
+{
+	m_hitchThreshold = 1000.0f / 30.0f;
+	reset();
+}
+
+void VulpixFrameTimeHistogram::reset()
+{
+	std::fill(m_buckets, m_buckets + m_numBuckets, 0ull);
+	m_count = 0;
+	m_hitchCount = 0;
+	m_sum = 0.0;
+	m_max = 0.0f;
+	m_last = 0.0f;
+}
+
+void VulpixFrameTimeHistogram::addSample(const float ms)
+{
+	const float octaves = std::log2(std::max(ms, m_minTime) / m_minTime);
+	const uint32_t bucket = std::min(static_cast<uint32_t>(octaves * m_bucketsPerOctave), m_numBuckets - 1);
+
+	++m_buckets[bucket];
+	++m_count;
+	m_sum += ms;
+	m_max = std::max(m_max, ms);
+	m_last = ms;
+
+	if (ms > m_hitchThreshold)
+	{
+		++m_hitchCount;
+	}
+}
+
+float VulpixFrameTimeHistogram::getPercentile(const float p) const
+{
+	if (m_count == 0)
+	{
+		return 0.0f;
+	}
+
+	// the sample at rank ceil(p% of count), at least the first one
+	const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(static_cast<double>(m_count) * p / 100.0)));
+
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < m_numBuckets; ++i)
+	{
+		seen += m_buckets[i];
+		if (seen >= rank)
+		{
+			// the bucket bound can lie above the slowest frame
+			const float upperBound = m_minTime * std::exp2(static_cast<float>(i + 1) / m_bucketsPerOctave);
+			return std::min(upperBound, m_max);
+		}
+	}
+	return m_max;
+}
+
+void VulpixFrameTimeHistogram::print(std::ostream& stream, const char* name) const
+{
+	stream << name << ": " << m_count << " frames, mean " << getMean() << " ms, p50 " << getPercentile(50.0f)
+		<< " ms, p90 " << getPercentile(90.0f) << " ms, p99 " << getPercentile(99.0f) << " ms, p99.9 " << getPercentile(99.9f)
+		<< " ms, max " << m_max << " ms, " << m_hitchCount << " hitches over " << m_hitchThreshold << " ms" << std::endl;
+}
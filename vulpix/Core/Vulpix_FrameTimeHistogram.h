@@ -0,0 +1,49 @@
+#ifndef VULPIX_FRAME_TIME_HISTOGRAM_H
+#define VULPIX_FRAME_TIME_HISTOGRAM_H
+
+#include "../Common.h"
+
+#include <cstdint>
+#include <ostream>
+
+// Distribution of frame times since the last reset, in logarithmic buckets of about 4% width, so the tail
+// percentiles of a long run cost as little memory and time as those of a short one
+class VulpixFrameTimeHistogram
+{
+public:
+	static const uint32_t m_bucketsPerOctave = 16;
+	static const uint32_t m_numBuckets = 20 * m_bucketsPerOctave; // 0.01 ms to about 10 s
+	static constexpr float m_minTime = 0.01f;                      // ms, everything below lands in the first bucket
+
+	VulpixFrameTimeHistogram();
+	~VulpixFrameTimeHistogram() = default;
+
+	void reset();
+	void addSample(const float ms);
+
+	// frames slower than this count as hitches
+	void setHitchThreshold(const float ms) { m_hitchThreshold = ms; }
+	float getHitchThreshold() const { return m_hitchThreshold; }
+
+	// upper bound of the bucket holding the percentile, p in [0, 100]
+	float getPercentile(const float p) const;
+	float getMax() const { return m_max; }
+	float getMean() const { return m_count > 0 ? static_cast<float>(m_sum / static_cast<double>(m_count)) : 0.0f; }
+	float getLast() const { return m_last; }
+	uint64_t getCount() const { return m_count; }
+	uint64_t getHitchCount() const { return m_hitchCount; }
+
+	// one line: count, mean, p50 / p90 / p99 / p99.9, max and hitches
+	void print(std::ostream& stream, const char* name) const;
+
+private:
+	uint64_t m_buckets[m_numBuckets];
+	uint64_t m_count;
+	uint64_t m_hitchCount;
+	double m_sum;
+	float m_max;
+	float m_last;
+	float m_hitchThreshold;
+};
+
+#endif // VULPIX_FRAME_TIME_HISTOGRAM_H
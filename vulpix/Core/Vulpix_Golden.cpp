@@ -0,0 +1,212 @@
+#include "Vulpix_Golden.h"
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// box SSIM windows, 8x8 at a stride of 4 instead of a gaussian at every pixel
+	const uint32_t s_ssimWindow = 8;
+	const uint32_t s_ssimStride = 4;
+
+	float luminance(const uint8_t* pixel)
+	{
+		// Rec. 709 weights on the sRGB encoded values, not on linear light
+		return 0.2126f * pixel[0] + 0.7152f * pixel[1] + 0.0722f * pixel[2];
+	}
+
+	double computeSsim(const std::vector<float>& a, const std::vector<float>& b, const uint32_t width, const uint32_t height)
+	{
+		const double c1 = (0.01 * 255.0) * (0.01 * 255.0);
+		const double c2 = (0.03 * 255.0) * (0.03 * 255.0);
+
+		// images smaller than a window are compared as one
+		const uint32_t windowX = std::min(s_ssimWindow, width);
+		const uint32_t windowY = std::min(s_ssimWindow, height);
+
+		double ssimSum = 0.0;
+		uint32_t windows = 0;
+		for (uint32_t y0 = 0; y0 + windowY <= height; y0 += s_ssimStride)
+		{
+			for (uint32_t x0 = 0; x0 + windowX <= width; x0 += s_ssimStride)
+			{
+				double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+				for (uint32_t y = y0; y < y0 + windowY; ++y)
+				{
+					for (uint32_t x = x0; x < x0 + windowX; ++x)
+					{
+						const double va = a[y * width + x];
+						const double vb = b[y * width + x];
+						sumA += va;
+						sumB += vb;
+						sumAA += va * va;
+						sumBB += vb * vb;
+						sumAB += va * vb;
+					}
+				}
+
+				const double count = static_cast<double>(windowX * windowY);
+				const double meanA = sumA / count;
+				const double meanB = sumB / count;
+				const double varA = sumAA / count - meanA * meanA;
+				const double varB = sumBB / count - meanB * meanB;
+				const double covariance = sumAB / count - meanA * meanB;
+
+				ssimSum += ((2.0 * meanA * meanB + c1) * (2.0 * covariance + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+				++windows;
+			}
+		}
+		return windows > 0 ? ssimSum / windows : 1.0;
+	}
+} // namespace
+
+namespace vulpix
+{
+	bool loadGoldenCases(const std::string& path, std::vector<GoldenCase>& cases)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		cases.clear();
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+
+			std::istringstream stream(line);
+			GoldenCase goldenCase;
+			stream >> goldenCase.m_name >> goldenCase.m_samples
+				>> goldenCase.m_position.x >> goldenCase.m_position.y >> goldenCase.m_position.z
+				>> goldenCase.m_forward.x >> goldenCase.m_forward.y >> goldenCase.m_forward.z;
+			if (stream.fail() || goldenCase.m_samples == 0)
+			{
+				std::cout << "Invalid golden case: " << line << std::endl;
+				cases.clear();
+				return false;
+			}
+
+			// optional tolerances
+			float minPsnr = 0.0f, minSsim = 0.0f;
+			if (stream >> minPsnr >> minSsim)
+			{
+				goldenCase.m_minPsnr = minPsnr;
+				goldenCase.m_minSsim = minSsim;
+			}
+
+			goldenCase.m_forward = glm::normalize(goldenCase.m_forward);
+			cases.push_back(goldenCase);
+		}
+
+		return !cases.empty();
+	}
+
+	ImageCompareResult compareImages(const uint8_t* image, const uint8_t* reference, const uint32_t width, const uint32_t height, std::vector<uint8_t>* heatmap)
+	{
+		const size_t numPixels = static_cast<size_t>(width) * height;
+
+		std::vector<float> imageLuminance(numPixels);
+		std::vector<float> referenceLuminance(numPixels);
+		if (heatmap)
+		{
+			heatmap->resize(numPixels * 4);
+		}
+
+		ImageCompareResult result;
+		uint64_t squaredErrorSum = 0;
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			const uint8_t* a = image + i * 4;
+			const uint8_t* b = reference + i * 4;
+
+			uint32_t pixelError = 0;
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				const int32_t delta = static_cast<int32_t>(a[c]) - static_cast<int32_t>(b[c]);
+				squaredErrorSum += static_cast<uint64_t>(delta * delta);
+				pixelError = std::max(pixelError, static_cast<uint32_t>(std::abs(delta)));
+			}
+
+			result.m_maxError = std::max(result.m_maxError, pixelError);
+			result.m_changedPixels += pixelError > 0 ? 1 : 0;
+			imageLuminance[i] = luminance(a);
+			referenceLuminance[i] = luminance(b);
+
+			if (heatmap)
+			{
+				// 4x gain, so differences of a few codes still show
+				const float t = std::min(static_cast<float>(pixelError) * 4.0f / 255.0f, 1.0f);
+				const float background = referenceLuminance[i] * 0.25f;
+				uint8_t* out = heatmap->data() + i * 4;
+				out[0] = static_cast<uint8_t>(std::max(std::min(t * 3.0f, 1.0f) * 255.0f, background));
+				out[1] = static_cast<uint8_t>(std::max(std::min(std::max(t * 3.0f - 1.0f, 0.0f), 1.0f) * 255.0f, background));
+				out[2] = static_cast<uint8_t>(std::max(std::min(std::max(t * 3.0f - 2.0f, 0.0f), 1.0f) * 255.0f, background));
+				out[3] = 255;
+			}
+		}
+
+		const double mse = static_cast<double>(squaredErrorSum) / static_cast<double>(numPixels * 3);
+		result.m_psnr = mse > 0.0 ? std::min(10.0 * std::log10(255.0 * 255.0 / mse), MAX_PSNR) : MAX_PSNR;
+		result.m_ssim = computeSsim(imageLuminance, referenceLuminance, width, height);
+		return result;
+	}
+
+	bool checkGoldenImage(const GoldenCase& goldenCase, const std::string& directory, const uint8_t* pixels, const uint32_t width, const uint32_t height, const bool update)
+	{
+		const std::string basePath = directory + "/" + goldenCase.m_name;
+		const std::string referencePath = basePath + ".png";
+		const int stride = static_cast<int>(width * 4);
+
+		if (update)
+		{
+			const bool written = stbi_write_png(referencePath.c_str(), static_cast<int>(width), static_cast<int>(height), 4, pixels, stride) != 0;
+			std::cout << "Golden " << goldenCase.m_name << ": " << (written ? "reference written to " : "could not write ") << referencePath << std::endl;
+			return written;
+		}
+
+		int referenceWidth = 0, referenceHeight = 0, channels = 0;
+		stbi_uc* reference = stbi_load(referencePath.c_str(), &referenceWidth, &referenceHeight, &channels, 4);
+		if (!reference)
+		{
+			// the references aren't part of the repository, they come from a run on a known good build
+			std::cout << "Golden " << goldenCase.m_name << ": FAILED, no reference at " << referencePath
+				<< ", write the references with --golden-update first" << std::endl;
+			stbi_write_png((basePath + "_result.png").c_str(), static_cast<int>(width), static_cast<int>(height), 4, pixels, stride);
+			return false;
+		}
+		if (referenceWidth != static_cast<int>(width) || referenceHeight != static_cast<int>(height))
+		{
+			std::cout << "Golden " << goldenCase.m_name << ": FAILED, the reference is " << referenceWidth << "x" << referenceHeight
+				<< ", rendered " << width << "x" << height << std::endl;
+			stbi_image_free(reference);
+			stbi_write_png((basePath + "_result.png").c_str(), static_cast<int>(width), static_cast<int>(height), 4, pixels, stride);
+			return false;
+		}
+
+		std::vector<uint8_t> heatmap;
+		const ImageCompareResult result = compareImages(pixels, reference, width, height, &heatmap);
+		stbi_image_free(reference);
+
+		const bool passed = result.m_psnr >= goldenCase.m_minPsnr && result.m_ssim >= goldenCase.m_minSsim;
+		std::cout << "Golden " << goldenCase.m_name << ": " << (passed ? "passed" : "FAILED") << ", PSNR " << result.m_psnr << " dB (min " << goldenCase.m_minPsnr
+			<< "), SSIM " << result.m_ssim << " (min " << goldenCase.m_minSsim << "), max error " << result.m_maxError << ", "
+			<< result.m_changedPixels << " pixels changed" << std::endl;
+
+		if (!passed)
+		{
+			stbi_write_png((basePath + "_result.png").c_str(), static_cast<int>(width), static_cast<int>(height), 4, pixels, stride);
+			stbi_write_png((basePath + "_diff.png").c_str(), static_cast<int>(width), static_cast<int>(height), 4, heatmap.data(), stride);
+		}
+		return passed;
+	}
+} // namespace vulpix
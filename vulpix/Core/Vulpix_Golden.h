@@ -0,0 +1,50 @@
+#ifndef VULPIX_GOLDEN_H
+#define VULPIX_GOLDEN_H
+
+#include "../Common.h"
+#include "../Math/Vulpix_Math.h"
+
+#include <cstdint>
+
+// One golden image: a camera pose rendered with a fixed number of accumulated samples, compared with
+// <directory>/<m_name>.png. A case fails when either metric drops below its tolerance
+struct GoldenCase
+{
+	std::string m_name;
+	uint32_t m_samples = 1;
+	vulpix::math::vec3 m_position = vulpix::math::vec3(0.0f);
+	vulpix::math::vec3 m_forward = vulpix::math::vec3(0.0f, 0.0f, -1.0f);
+	float m_minPsnr = 40.0f; // dB
+	float m_minSsim = 0.98f;
+};
+
+struct ImageCompareResult
+{
+	double m_psnr = 0.0;        // dB over the RGB channels, MAX_PSNR for identical images
+	double m_ssim = 0.0;        // simplified SSIM of the luminance (see compareImages), 1 for identical images
+	uint32_t m_maxError = 0;    // largest difference of any channel, 0 - 255
+	uint32_t m_changedPixels = 0;
+};
+
+namespace vulpix
+{
+	const double MAX_PSNR = 100.0;
+
+	// a text file with one "name samples px py pz fx fy fz [minPsnr minSsim]" line per case, # starts a comment.
+	// The pose is a camera path line without its time
+	bool loadGoldenCases(const std::string& path, std::vector<GoldenCase>& cases);
+
+	// both tightly packed RGBA8 rows, alpha is ignored. heatmap, when given, gets the per-pixel error as RGBA8,
+	// black to red to yellow to white over the dimmed reference.
+	// The SSIM is a simplified one and not a perceptual metric: the mean over 8x8 box windows at a stride of 4
+	// (no gaussian weighting, a single scale) of the SSIM of the Rec. 709 luminance of the sRGB encoded 8 bit
+	// values, with the usual constants for a 0 - 255 range. It has no model of color, contrast masking or viewing
+	// distance, it only catches local structure changes that a mean squared error like PSNR averages away
+	ImageCompareResult compareImages(const uint8_t* image, const uint8_t* reference, const uint32_t width, const uint32_t height, std::vector<uint8_t>* heatmap);
+
+	// compares a rendered case with its reference and prints the result. A failed case also writes
+	// <name>_result.png and <name>_diff.png next to the reference. update writes the image as the new reference
+	bool checkGoldenImage(const GoldenCase& goldenCase, const std::string& directory, const uint8_t* pixels, const uint32_t width, const uint32_t height, const bool update);
+} // namespace vulpix
+
+#endif // VULPIX_GOLDEN_H
@@ -0,0 +1,302 @@
+#include "Vulpix_GpuProfiler.h"
+#include "Vulpix_Trace.h"
+
+#include <algorithm>
+#include <fstream>
+
+VulpixGpuProfiler::VulpixGpuProfiler()
+{
+	m_queryPool = VK_NULL_HANDLE;
+	m_queriesPerFrame = 0;
+	m_timestampPeriod = 1.0f;
+	m_timestampMask = ~0ull;
+	m_openStage = UINT32_MAX;
+	m_frameHistory.m_name = "frame";
+	m_lastFrameTime = 0.0f;
+}
+
+bool VulpixGpuProfiler::initProfiler(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndex, const uint32_t framesInFlight)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
+
+	const uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilyProperties[queueFamilyIndex].timestampValidBits : 0;
+	if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f)
+	{
+		// no timestamps on this queue, the profiler stays disabled and every call is a no-op
+		return false;
+	}
+
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	m_timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1ull);
+
+	// a begin / end pair per stage, plus one around the whole frame
+	m_queriesPerFrame = 2 * (m_maxStages + 1);
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = m_queriesPerFrame * framesInFlight;
+
+	VkResult error = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &m_queryPool);
+	CHECK_VK_ERROR(error, "vkCreateQueryPool");
+	if (VK_SUCCESS != error)
+	{
+		m_queryPool = VK_NULL_HANDLE;
+		return false;
+	}
+
+	m_frameSlots.assign(framesInFlight, FrameSlot());
+	m_results.resize(2 * m_queriesPerFrame);
+	return true;
+}
+
+void VulpixGpuProfiler::destroyProfiler(VkDevice device)
+{
+	if (m_queryPool)
+	{
+		vkDestroyQueryPool(device, m_queryPool, nullptr);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+	m_frameSlots.clear();
+}
+
+bool VulpixGpuProfiler::collectFrame(VkDevice device, const uint32_t frameIndex)
+{
+	if (!m_queryPool)
+	{
+		return false;
+	}
+
+	FrameSlot& slot = m_frameSlots[frameIndex];
+	const uint32_t firstQuery = frameIndex * m_queriesPerFrame;
+	bool collected = false;
+
+	if (slot.m_recorded)
+	{
+		// the fence of this frame has signaled, the results are there unless the driver is still flushing them.
+		// No WAIT_BIT: an unavailable query is skipped rather than waited for
+		const uint32_t numQueries = 2 * (static_cast<uint32_t>(slot.m_stages.size()) + 1);
+		const VkResult error = vkGetQueryPoolResults(device, m_queryPool, firstQuery, numQueries,
+			numQueries * 2 * sizeof(uint64_t), m_results.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if (VK_SUCCESS == error || VK_NOT_READY == error)
+		{
+			const auto elapsed = [this](const uint32_t pair, float& ms)
+			{
+				const uint64_t* begin = &m_results[4 * pair];
+				const uint64_t* end = &m_results[4 * pair + 2];
+				if (!begin[1] || !end[1])
+				{
+					return false;
+				}
+				const uint64_t ticks = ((end[0] - begin[0]) & m_timestampMask);
+				ms = static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod * 1e-6);
+				return true;
+			};
+
+			float ms = 0.0f;
+			if (elapsed(0, ms))
+			{
+				addSample(m_frameHistory, ms);
+				m_lastFrameTime = ms;
+				collected = true;
+			}
+			for (size_t i = 0; i < slot.m_stages.size(); ++i)
+			{
+				if (elapsed(static_cast<uint32_t>(i) + 1, ms))
+				{
+					addSample(m_stageHistories[slot.m_stages[i]], ms);
+				}
+			}
+
+#if VULPIX_TRACE_ENABLED
+			// the GPU clock has no known relation to the CPU one, the frame is placed at its submission
+			if (collected)
+			{
+				const uint64_t frameBegin = m_results[0];
+				const auto toTrace = [this, &slot, frameBegin](const uint64_t ticks)
+				{
+					return slot.m_submitTime + static_cast<uint64_t>(static_cast<double>((ticks - frameBegin) & m_timestampMask) * m_timestampPeriod);
+				};
+
+				vulpix::trace::addGpuEvent(m_frameHistory.m_name, toTrace(m_results[0]), toTrace(m_results[2]));
+				for (size_t i = 0; i < slot.m_stages.size(); ++i)
+				{
+					const uint64_t* pair = &m_results[4 * (i + 1)];
+					if (pair[1] && pair[3])
+					{
+						vulpix::trace::addGpuEvent(m_stageHistories[slot.m_stages[i]].m_name, toTrace(pair[0]), toTrace(pair[2]));
+					}
+				}
+			}
+#endif
+		}
+	}
+
+	slot.m_stages.clear();
+	slot.m_recorded = false;
+	return collected;
+}
+
+void VulpixGpuProfiler::beginFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+	if (!m_queryPool)
+	{
+		return;
+	}
+
+	FrameSlot& slot = m_frameSlots[frameIndex];
+	const uint32_t firstQuery = frameIndex * m_queriesPerFrame;
+
+	slot.m_stages.clear();
+	slot.m_recorded = true;
+	m_openStage = UINT32_MAX;
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, firstQuery, m_queriesPerFrame);
+	// ALL_COMMANDS: written once everything before it has finished, so no earlier work is counted to this frame
+	vkCmdWriteTimestamp2KHR(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, m_queryPool, firstQuery);
+}
+
+void VulpixGpuProfiler::endFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+	if (!m_queryPool)
+	{
+		return;
+	}
+
+	endStage(commandBuffer, frameIndex);
+	vkCmdWriteTimestamp2KHR(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, m_queryPool, frameIndex * m_queriesPerFrame + 1);
+	m_frameSlots[frameIndex].m_submitTime = vulpix::trace::now();
+}
+
+void VulpixGpuProfiler::beginStage(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const std::string& name)
+{
+	if (!m_queryPool)
+	{
+		return;
+	}
+
+	endStage(commandBuffer, frameIndex);
+
+	FrameSlot& slot = m_frameSlots[frameIndex];
+	if (slot.m_stages.size() >= m_maxStages)
+	{
+		return;
+	}
+
+	slot.m_stages.push_back(getStageIndex(name));
+	m_openStage = static_cast<uint32_t>(slot.m_stages.size());
+
+	vkCmdWriteTimestamp2KHR(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, m_queryPool, frameIndex * m_queriesPerFrame + 2 * m_openStage);
+}
+
+void VulpixGpuProfiler::endStage(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+	if (!m_queryPool || m_openStage == UINT32_MAX)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp2KHR(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, m_queryPool, frameIndex * m_queriesPerFrame + 2 * m_openStage + 1);
+	m_openStage = UINT32_MAX;
+}
+
+std::vector<GpuStageStats> VulpixGpuProfiler::getStats() const
+{
+	std::vector<GpuStageStats> stats;
+	stats.push_back(computeStats(m_frameHistory));
+	for (const StageHistory& history : m_stageHistories)
+	{
+		stats.push_back(computeStats(history));
+	}
+	return stats;
+}
+
+float VulpixGpuProfiler::getLastStageTime(const std::string& name) const
+{
+	for (const StageHistory& history : m_stageHistories)
+	{
+		if (history.m_name == name && history.m_count > 0)
+		{
+			return history.m_times[(history.m_next + m_historySize - 1) % m_historySize];
+		}
+	}
+	return 0.0f;
+}
+
+bool VulpixGpuProfiler::writeCsv(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "stage,samples,last_ms,min_ms,avg_ms,p99_ms\n";
+	for (const GpuStageStats& stage : getStats())
+	{
+		file << stage.m_name << ',' << stage.m_samples << ',' << stage.m_last << ','
+			<< stage.m_min << ',' << stage.m_avg << ',' << stage.m_p99 << '\n';
+	}
+	return file.good();
+}
+
+uint32_t VulpixGpuProfiler::getStageIndex(const std::string& name)
+{
+	// a handful of stages, a linear search is cheaper than hashing the name
+	for (size_t i = 0; i < m_stageHistories.size(); ++i)
+	{
+		if (m_stageHistories[i].m_name == name)
+		{
+			return static_cast<uint32_t>(i);
+		}
+	}
+
+	m_stageHistories.emplace_back();
+	m_stageHistories.back().m_name = name;
+	return static_cast<uint32_t>(m_stageHistories.size() - 1);
+}
+
+void VulpixGpuProfiler::addSample(StageHistory& history, const float ms)
+{
+	history.m_times[history.m_next] = ms;
+	history.m_next = (history.m_next + 1) % m_historySize;
+	if (history.m_count < m_historySize)
+	{
+		++history.m_count;
+	}
+}
+
+GpuStageStats VulpixGpuProfiler::computeStats(const StageHistory& history) const
+{
+	GpuStageStats stats;
+	stats.m_name = history.m_name;
+	stats.m_samples = history.m_count;
+	if (history.m_count == 0)
+	{
+		return stats;
+	}
+
+	float sorted[m_historySize];
+	std::copy(history.m_times, history.m_times + history.m_count, sorted);
+	std::sort(sorted, sorted + history.m_count);
+
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < history.m_count; ++i)
+	{
+		sum += sorted[i];
+	}
+
+	stats.m_last = history.m_times[(history.m_next + m_historySize - 1) % m_historySize];
+	stats.m_min = sorted[0];
+	stats.m_avg = sum / static_cast<float>(history.m_count);
+	stats.m_p99 = sorted[std::min(history.m_count - 1, (history.m_count * 99) / 100)];
+	return stats;
+}
@@ -0,0 +1,85 @@
+#ifndef VULPIX_GPU_PROFILER_H
+#define VULPIX_GPU_PROFILER_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+
+// rolling statistics of one GPU stage over the last VulpixGpuProfiler::m_historySize frames, in ms
+struct GpuStageStats
+{
+	std::string m_name;
+	float m_last = 0.0f;
+	float m_min = 0.0f;
+	float m_avg = 0.0f;
+	float m_p99 = 0.0f;
+	uint32_t m_samples = 0;
+};
+
+// Timestamp queries around every GPU stage of a frame. Each frame in flight owns a slice of the query pool,
+// its results are read once its fence has signaled, when they are ready, so reading never stalls
+class VulpixGpuProfiler
+{
+public:
+	static const uint32_t m_maxStages = 32;     // per frame
+	static const uint32_t m_historySize = 256;  // frames the rolling stats cover
+
+	VulpixGpuProfiler();
+	~VulpixGpuProfiler() = default;
+
+	bool initProfiler(VkDevice device, VkPhysicalDevice physicalDevice, const uint32_t queueFamilyIndex, const uint32_t framesInFlight);
+	void destroyProfiler(VkDevice device);
+
+	bool isEnabled() const { return m_queryPool != VK_NULL_HANDLE; }
+
+	// call once the frame's fence has signaled, collects what the frame measured the last time it ran.
+	// False when there was nothing to collect, or its frame time was not available yet
+	bool collectFrame(VkDevice device, const uint32_t frameIndex);
+	// resets the frame's queries, the first command of its command buffer
+	void beginFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+	void endFrame(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+
+	// stages are identified by name, the same name every frame accumulates into the same stats
+	void beginStage(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const std::string& name);
+	void endStage(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+
+	// the whole frame first, then the stages in the order they were first seen
+	std::vector<GpuStageStats> getStats() const;
+	float getLastFrameTime() const { return m_lastFrameTime; }
+	// latest sample of a stage, 0 for stages that never ran
+	float getLastStageTime(const std::string& name) const;
+	bool writeCsv(const std::string& path) const;
+
+private:
+	struct FrameSlot
+	{
+		std::vector<uint32_t> m_stages; // stage index per begin / end query pair
+		bool m_recorded = false;
+		uint64_t m_submitTime = 0;      // vulpix::trace::now() when the frame was done recording
+	};
+
+	struct StageHistory
+	{
+		std::string m_name;
+		float m_times[m_historySize] = {};
+		uint32_t m_count = 0;
+		uint32_t m_next = 0;
+	};
+
+	uint32_t getStageIndex(const std::string& name);
+	void addSample(StageHistory& history, const float ms);
+	GpuStageStats computeStats(const StageHistory& history) const;
+
+	VkQueryPool m_queryPool;
+	uint32_t m_queriesPerFrame;
+	float m_timestampPeriod; // ns per tick
+	uint64_t m_timestampMask;
+	uint32_t m_openStage;    // query pair of the stage being recorded, UINT32_MAX between stages
+
+	std::vector<FrameSlot> m_frameSlots;
+	StageHistory m_frameHistory;
+	std::vector<StageHistory> m_stageHistories;
+	std::vector<uint64_t> m_results; // value and availability per query
+	float m_lastFrameTime;
+};
+
+#endif // VULPIX_GPU_PROFILER_H
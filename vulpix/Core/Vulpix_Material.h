@@ -7,6 +7,7 @@ class VulpixMaterial
 {
 public:
 	Image m_texture;
+	bool m_alphaTested = false; // faces using it go into the any-hit geometry
 };
 
 #endif // VULPIX_MATERIAL_H
\ No newline at end of file
@@ -4,21 +4,60 @@
 #include "Buffer.h"
 #include "VulpixAS.h"
 #include "../Common.h"
+#include "../Shader/Shader_Config.h"
+
+class VulpixMeshLod
+{
+public:
+	uint32_t m_firstFace = 0;
+	uint32_t m_faceCount = 0;
+	uint32_t m_alphaFaceCount = 0; // the last faces of the range, built as a separate non-opaque geometry
+	float m_error = 0.0f;          // simplification error in world units, 0 for the full mesh
+
+	VulpixAccelerationStructure m_BLAS;
+};
 
 class VulpixMesh
 {
+public:
+	bool isDeformable() const { return m_deformMode != VULPIX_DEFORM_MODE_NONE; }
+	// LOD 0 comes first in the buffers, and it is the only LOD that gets deformed
+	uint32_t getBaseVertexCount() const { return m_lods[0].m_faceCount * 3; }
+
 public:
 	uint32_t m_vertexCount;
-	uint32_t m_faceCount;
-	
+	uint32_t m_faceCount; // all LODs together
+
 	Buffer m_position;
 	Buffer m_attribute;
 	Buffer m_index;
 	Buffer m_faces;
 	Buffer m_material;
 
-	VulpixAccelerationStructure m_BLAS;
+	// LODs share the buffers above, one BLAS each
+	std::vector<VulpixMeshLod> m_lods;
+	uint32_t m_primaryLod = 0;
+	uint32_t m_secondaryLod = 0;
+
+	// deformation, m_position and m_attribute are rewritten from the rest pose every frame
+	uint32_t m_deformMode = VULPIX_DEFORM_MODE_NONE;
+	uint32_t m_deformSlot = 0;
+	Buffer m_restPosition;
+	Buffer m_restAttribute;
+	Buffer m_deformData; // SkinVertex or MorphVertex per vertex
+
+	uint32_t m_jointBase = 0;
+	uint32_t m_jointCount = 0;
+	float m_morphWeight = 0.0f;
+	float m_maxMorphOffset = 0.0f;
+
+	// bounding sphere, for LOD selection and the refit drift estimate
+	vec3 m_boundsCenter = vec3(0.0f);
+	float m_boundsRadius = 1.0f;
 
+	// refit bookkeeping
+	uint32_t m_refitCount = 0;
+	float m_buildMorphWeight = 0.0f;
 };
 
-#endif
\ No newline at end of file
+#endif
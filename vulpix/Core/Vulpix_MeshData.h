@@ -0,0 +1,66 @@
+#ifndef VULPIX_MESH_DATA_H
+#define VULPIX_MESH_DATA_H
+
+#include "../Common.h"
+#include "../Shader/Shader_Config.h"
+
+// a contiguous run of faces forming one LOD of a mesh
+struct VulpixMeshLodRange
+{
+	uint32_t m_firstFace = 0;
+	uint32_t m_faceCount = 0;
+	uint32_t m_alphaFaceCount = 0; // alpha tested faces, kept at the end of the range
+	float m_error = 0.0f;          // simplification error in world units, 0 for the full mesh
+};
+
+// CPU side geometry, what the loader produces and the load-time passes work on before we upload it.
+// Same layout as the GPU buffers: three unshared vertices per face.
+class VulpixMeshData
+{
+public:
+	std::vector<vec3> m_positions;
+	std::vector<VertexAttributes> m_attributes;
+	std::vector<uint32_t> m_materialIDs; // per face
+	std::vector<uint32_t> m_objectIDs;   // per face, ends up in Faces.w for the hit shader
+	std::vector<VulpixMeshLodRange> m_lods; // empty means the whole mesh is a single LOD
+
+public:
+	uint32_t getFaceCount() const { return static_cast<uint32_t>(m_materialIDs.size()); }
+	uint32_t getVertexCount() const { return static_cast<uint32_t>(m_positions.size()); }
+
+	std::vector<VulpixMeshLodRange> getLods() const
+	{
+		if (!m_lods.empty())
+		{
+			return m_lods;
+		}
+
+		VulpixMeshLodRange full;
+		full.m_faceCount = getFaceCount();
+		return { full };
+	}
+
+	void appendFace(const VulpixMeshData& src, const uint32_t face)
+	{
+		for (uint32_t j = 0; j < 3; ++j)
+		{
+			m_positions.push_back(src.m_positions[3 * face + j]);
+			m_attributes.push_back(src.m_attributes[3 * face + j]);
+		}
+		m_materialIDs.push_back(src.m_materialIDs[face]);
+		m_objectIDs.push_back(src.m_objectIDs[face]);
+	}
+
+	void computeBounds(vec3& boundsMin, vec3& boundsMax) const
+	{
+		boundsMin = vec3(FLT_MAX);
+		boundsMax = vec3(-FLT_MAX);
+		for (const vec3& p : m_positions)
+		{
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+	}
+};
+
+#endif // VULPIX_MESH_DATA_H
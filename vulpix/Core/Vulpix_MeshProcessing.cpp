@@ -0,0 +1,493 @@
+#include "Vulpix_MeshProcessing.h"
+#include "Vulpix_MeshSimplifier.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace vulpix
+{
+	namespace
+	{
+		struct MeshBounds
+		{
+			vec3 m_min = vec3(FLT_MAX);
+			vec3 m_max = vec3(-FLT_MAX);
+
+			void grow(const MeshBounds& other)
+			{
+				m_min = glm::min(m_min, other.m_min);
+				m_max = glm::max(m_max, other.m_max);
+			}
+
+			bool isValid() const { return m_min.x <= m_max.x; }
+			vec3 getCenter() const { return (m_min + m_max) * 0.5f; }
+			float getDiagonal() const { return isValid() ? glm::length(m_max - m_min) : 0.0f; }
+
+			float getArea() const
+			{
+				if (!isValid())
+				{
+					return 0.0f;
+				}
+
+				const vec3 d = m_max - m_min;
+				return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+			}
+		};
+
+		// spreads the lower 10 bits so that three of them can be interleaved
+		uint32_t expandBits(uint32_t v)
+		{
+			v = (v * 0x00010001u) & 0xFF0000FFu;
+			v = (v * 0x00000101u) & 0x0F00F00Fu;
+			v = (v * 0x00000011u) & 0xC30C30C3u;
+			v = (v * 0x00000005u) & 0x49249249u;
+			return v;
+		}
+
+		uint32_t mortonCode(const vec3& p, const MeshBounds& scene)
+		{
+			const vec3 extent = glm::max(scene.m_max - scene.m_min, vec3(1e-6f));
+			const vec3 n = glm::clamp((p - scene.m_min) / extent, vec3(0.0f), vec3(1.0f)) * 1023.0f;
+			return (expandBits(static_cast<uint32_t>(n.x)) << 2) |
+				   (expandBits(static_cast<uint32_t>(n.y)) << 1) |
+				    expandBits(static_cast<uint32_t>(n.z));
+		}
+
+		MeshBounds computeBounds(const VulpixMeshData& mesh)
+		{
+			MeshBounds bounds;
+			mesh.computeBounds(bounds.m_min, bounds.m_max);
+			return bounds;
+		}
+
+		struct SplitTriangle
+		{
+			vec3 m_positions[3];
+			VertexAttributes m_attributes[3];
+			uint32_t m_materialID;
+			uint32_t m_objectID;
+			uint32_t m_depth;
+
+			float getBoxArea() const
+			{
+				MeshBounds bounds;
+				bounds.m_min = glm::min(m_positions[0], glm::min(m_positions[1], m_positions[2]));
+				bounds.m_max = glm::max(m_positions[0], glm::max(m_positions[1], m_positions[2]));
+				return bounds.getArea();
+			}
+
+			float getArea() const
+			{
+				return 0.5f * glm::length(glm::cross(m_positions[1] - m_positions[0], m_positions[2] - m_positions[0]));
+			}
+		};
+
+		struct SplitCandidate
+		{
+			float m_boxArea;
+			uint32_t m_mesh;
+			uint32_t m_triangle;
+
+			bool operator<(const SplitCandidate& other) const { return m_boxArea < other.m_boxArea; }
+		};
+
+		bool needsSplit(const SplitTriangle& tri, const SplitSettings& settings)
+		{
+			return tri.m_depth < settings.m_maxSplitDepth && tri.getBoxArea() > settings.m_areaRatio * std::max(tri.getArea(), 1e-12f);
+		}
+
+		// halves the triangle on its longest edge, the new vertex is the edge midpoint so the
+		// interpolated attributes stay exactly what the unsplit triangle would give
+		void bisect(SplitTriangle& tri, SplitTriangle& other)
+		{
+			uint32_t edge = 0;
+			float longest = -1.0f;
+			for (uint32_t e = 0; e < 3; ++e)
+			{
+				const float len = glm::length(tri.m_positions[(e + 1) % 3] - tri.m_positions[e]);
+				if (len > longest)
+				{
+					longest = len;
+					edge = e;
+				}
+			}
+
+			const uint32_t a = edge;
+			const uint32_t b = (edge + 1) % 3;
+			const vec3 midPos = (tri.m_positions[a] + tri.m_positions[b]) * 0.5f;
+			VertexAttributes midAttr;
+			midAttr.m_normal = (tri.m_attributes[a].m_normal + tri.m_attributes[b].m_normal) * 0.5f;
+			midAttr.m_uv = (tri.m_attributes[a].m_uv + tri.m_attributes[b].m_uv) * 0.5f;
+
+			++tri.m_depth;
+			other = tri;
+
+			// same winding for both halves: (a, mid, c) and (mid, b, c)
+			tri.m_positions[b] = midPos;
+			tri.m_attributes[b] = midAttr;
+			other.m_positions[a] = midPos;
+			other.m_attributes[a] = midAttr;
+		}
+	}
+
+	LodStats generateLods(std::vector<VulpixMeshData>& meshes, const LodSettings& settings)
+	{
+		LodStats stats;
+		for (VulpixMeshData& mesh : meshes)
+		{
+			const uint32_t numFaces = mesh.getFaceCount();
+			stats.m_facesBefore += numFaces;
+
+			VulpixMeshLodRange full;
+			full.m_faceCount = numFaces;
+			mesh.m_lods.assign(1, full);
+
+			VulpixMeshData previous;
+			const VulpixMeshData* source = &mesh;
+			float error = 0.0f;
+
+			for (uint32_t lod = 1; lod < std::min<uint32_t>(settings.m_lodCount, VULPIX_MAX_LODS); ++lod)
+			{
+				const uint32_t sourceFaces = source->getFaceCount();
+				if (sourceFaces < settings.m_minFaces)
+				{
+					break;
+				}
+
+				float lodError = 0.0f;
+				VulpixMeshData simplified = simplifyMesh(*source, static_cast<uint32_t>(sourceFaces * settings.m_reduction), lodError);
+
+				// not worth a BLAS if the simplifier got stuck
+				if (simplified.getFaceCount() == 0 || simplified.getFaceCount() > sourceFaces * 0.9f)
+				{
+					break;
+				}
+
+				// errors add up since every LOD starts from the previous one
+				error += lodError;
+
+				VulpixMeshLodRange range;
+				range.m_firstFace = mesh.getFaceCount();
+				range.m_faceCount = simplified.getFaceCount();
+				range.m_error = error;
+				mesh.m_lods.push_back(range);
+
+				for (uint32_t f = 0; f < simplified.getFaceCount(); ++f)
+				{
+					mesh.appendFace(simplified, f);
+				}
+
+				previous = std::move(simplified);
+				source = &previous;
+				++stats.m_lodCount;
+			}
+
+			if (mesh.m_lods.size() > 1)
+			{
+				++stats.m_meshesWithLods;
+			}
+			stats.m_facesAfter += mesh.getFaceCount();
+		}
+
+		return stats;
+	}
+
+	uint32_t partitionAlphaTested(std::vector<VulpixMeshData>& meshes, const std::vector<bool>& alphaMaterials)
+	{
+		uint32_t totalAlphaFaces = 0;
+		for (VulpixMeshData& mesh : meshes)
+		{
+			std::vector<VulpixMeshLodRange> lods = mesh.getLods();
+
+			VulpixMeshData result;
+			result.m_positions.reserve(mesh.m_positions.size());
+			result.m_attributes.reserve(mesh.m_attributes.size());
+			result.m_materialIDs.reserve(mesh.m_materialIDs.size());
+			result.m_objectIDs.reserve(mesh.m_objectIDs.size());
+
+			for (VulpixMeshLodRange& lod : lods)
+			{
+				std::vector<uint32_t> alphaFaces;
+				for (uint32_t f = lod.m_firstFace; f < lod.m_firstFace + lod.m_faceCount; ++f)
+				{
+					const uint32_t matID = mesh.m_materialIDs[f];
+					if (matID < alphaMaterials.size() && alphaMaterials[matID])
+					{
+						alphaFaces.push_back(f);
+					}
+					else
+					{
+						result.appendFace(mesh, f);
+					}
+				}
+
+				for (const uint32_t f : alphaFaces)
+				{
+					result.appendFace(mesh, f);
+				}
+
+				lod.m_alphaFaceCount = static_cast<uint32_t>(alphaFaces.size());
+			}
+
+			// only the full mesh counts, the LODs repeat the same surfaces
+			totalAlphaFaces += lods[0].m_alphaFaceCount;
+
+			result.m_lods = lods;
+			mesh = std::move(result);
+		}
+
+		return totalAlphaFaces;
+	}
+
+	float estimateInstanceCost(const std::vector<VulpixMeshData>& meshes)
+	{
+		// surface area heuristic: a box is hit with probability area(box) / area(scene)
+		MeshBounds scene;
+		float instanceArea = 0.0f;
+		for (const VulpixMeshData& mesh : meshes)
+		{
+			const MeshBounds bounds = computeBounds(mesh);
+			scene.grow(bounds);
+			instanceArea += bounds.getArea();
+		}
+
+		const float sceneArea = scene.getArea();
+		return sceneArea > 0.0f ? instanceArea / sceneArea : 0.0f;
+	}
+
+	SplitStats splitLongTriangles(std::vector<VulpixMeshData>& meshes, const SplitSettings& settings)
+	{
+		SplitStats stats;
+
+		std::vector<std::vector<SplitTriangle>> triangles(meshes.size());
+		std::priority_queue<SplitCandidate> queue;
+		std::vector<std::vector<uint32_t>> splitSource(meshes.size()); // input face each triangle came from
+
+		for (size_t m = 0; m < meshes.size(); ++m)
+		{
+			const VulpixMeshData& mesh = meshes[m];
+			const uint32_t numFaces = mesh.getFaceCount();
+			triangles[m].resize(numFaces);
+			splitSource[m].resize(numFaces);
+
+			for (uint32_t f = 0; f < numFaces; ++f)
+			{
+				SplitTriangle& tri = triangles[m][f];
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					tri.m_positions[j] = mesh.m_positions[3 * f + j];
+					tri.m_attributes[j] = mesh.m_attributes[3 * f + j];
+				}
+				tri.m_materialID = mesh.m_materialIDs[f];
+				tri.m_objectID = mesh.m_objectIDs[f];
+				tri.m_depth = 0;
+				splitSource[m][f] = f;
+
+				stats.m_boxAreaBefore += tri.getBoxArea();
+				if (needsSplit(tri, settings))
+				{
+					queue.push({ tri.getBoxArea(), static_cast<uint32_t>(m), f });
+				}
+			}
+			stats.m_facesBefore += numFaces;
+		}
+
+		// worst boxes first, every split adds one face
+		const uint32_t budget = static_cast<uint32_t>(stats.m_facesBefore * settings.m_maxAddedFaces);
+		uint32_t added = 0;
+		std::vector<std::vector<bool>> wasSplit(meshes.size());
+		for (size_t m = 0; m < meshes.size(); ++m)
+		{
+			wasSplit[m].assign(meshes[m].getFaceCount(), false);
+		}
+
+		while (!queue.empty() && added < budget)
+		{
+			const SplitCandidate candidate = queue.top();
+			queue.pop();
+
+			std::vector<SplitTriangle>& meshTriangles = triangles[candidate.m_mesh];
+			SplitTriangle other;
+			bisect(meshTriangles[candidate.m_triangle], other);
+
+			const uint32_t otherIdx = static_cast<uint32_t>(meshTriangles.size());
+			meshTriangles.push_back(other);
+			splitSource[candidate.m_mesh].push_back(splitSource[candidate.m_mesh][candidate.m_triangle]);
+			wasSplit[candidate.m_mesh][splitSource[candidate.m_mesh][candidate.m_triangle]] = true;
+			++added;
+
+			const SplitTriangle& first = meshTriangles[candidate.m_triangle];
+			if (needsSplit(first, settings))
+			{
+				queue.push({ first.getBoxArea(), candidate.m_mesh, candidate.m_triangle });
+			}
+			if (needsSplit(other, settings))
+			{
+				queue.push({ other.getBoxArea(), candidate.m_mesh, otherIdx });
+			}
+		}
+
+		if (added == 0)
+		{
+			stats.m_facesAfter = stats.m_facesBefore;
+			stats.m_boxAreaAfter = stats.m_boxAreaBefore;
+			return stats;
+		}
+
+		// write back, pieces of a face stay next to each other to keep the original face order coherent
+		for (size_t m = 0; m < meshes.size(); ++m)
+		{
+			const std::vector<SplitTriangle>& meshTriangles = triangles[m];
+			const std::vector<uint32_t>& source = splitSource[m];
+
+			std::vector<uint32_t> order(meshTriangles.size());
+			for (uint32_t i = 0; i < order.size(); ++i)
+			{
+				order[i] = i;
+			}
+			std::stable_sort(order.begin(), order.end(), [&source](const uint32_t a, const uint32_t b) { return source[a] < source[b]; });
+
+			VulpixMeshData& mesh = meshes[m];
+			mesh.m_positions.clear();
+			mesh.m_attributes.clear();
+			mesh.m_materialIDs.clear();
+			mesh.m_objectIDs.clear();
+
+			for (const uint32_t i : order)
+			{
+				const SplitTriangle& tri = meshTriangles[i];
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					mesh.m_positions.push_back(tri.m_positions[j]);
+					mesh.m_attributes.push_back(tri.m_attributes[j]);
+				}
+				mesh.m_materialIDs.push_back(tri.m_materialID);
+				mesh.m_objectIDs.push_back(tri.m_objectID);
+				stats.m_boxAreaAfter += tri.getBoxArea();
+			}
+
+			stats.m_facesAfter += mesh.getFaceCount();
+			stats.m_splitFaces += static_cast<uint32_t>(std::count(wasSplit[m].begin(), wasSplit[m].end(), true));
+		}
+
+		return stats;
+	}
+
+	MergeStats mergeSmallMeshes(std::vector<VulpixMeshData>& meshes, const MergeSettings& settings)
+	{
+		MergeStats stats;
+		stats.m_meshesBefore = static_cast<uint32_t>(meshes.size());
+		stats.m_instanceCostBefore = estimateInstanceCost(meshes);
+
+		std::vector<MeshBounds> bounds(meshes.size());
+		MeshBounds scene;
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			bounds[i] = computeBounds(meshes[i]);
+			scene.grow(bounds[i]);
+		}
+
+		// small meshes, sorted along a morton curve so neighbours in the list are neighbours in space
+		std::vector<std::pair<uint32_t, uint32_t>> candidates; // (morton code, mesh index)
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			const uint32_t faces = meshes[i].getFaceCount();
+			if (faces > 0 && faces < settings.m_smallMeshFaces)
+			{
+				candidates.emplace_back(mortonCode(bounds[i].getCenter(), scene), static_cast<uint32_t>(i));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		// greedy sweep, a cluster closes once it gets too big or too spread out
+		const float maxExtent = settings.m_maxClusterExtent * scene.getDiagonal();
+		std::vector<std::vector<uint32_t>> clusters;
+		std::vector<uint32_t> current;
+		MeshBounds currentBounds;
+		uint32_t currentFaces = 0;
+
+		for (const auto& candidate : candidates)
+		{
+			const uint32_t idx = candidate.second;
+			MeshBounds grown = currentBounds;
+			grown.grow(bounds[idx]);
+
+			const bool fits = currentFaces + meshes[idx].getFaceCount() <= settings.m_maxClusterFaces && grown.getDiagonal() <= maxExtent;
+			if (!current.empty() && !fits)
+			{
+				clusters.push_back(current);
+				current.clear();
+				grown = bounds[idx];
+				currentFaces = 0;
+			}
+
+			current.push_back(idx);
+			currentBounds = grown;
+			currentFaces += meshes[idx].getFaceCount();
+		}
+		if (!current.empty())
+		{
+			clusters.push_back(current);
+		}
+
+		// build the merged meshes, single mesh clusters stay as they are
+		std::vector<bool> consumed(meshes.size(), false);
+		std::vector<VulpixMeshData> merged;
+		for (const std::vector<uint32_t>& cluster : clusters)
+		{
+			if (cluster.size() < 2)
+			{
+				continue;
+			}
+
+			VulpixMeshData dst;
+			uint32_t faces = 0;
+			for (const uint32_t idx : cluster)
+			{
+				faces += meshes[idx].getFaceCount();
+			}
+
+			dst.m_positions.reserve(faces * 3);
+			dst.m_attributes.reserve(faces * 3);
+			dst.m_materialIDs.reserve(faces);
+			dst.m_objectIDs.reserve(faces);
+
+			for (const uint32_t idx : cluster)
+			{
+				const VulpixMeshData& src = meshes[idx];
+				dst.m_positions.insert(dst.m_positions.end(), src.m_positions.begin(), src.m_positions.end());
+				dst.m_attributes.insert(dst.m_attributes.end(), src.m_attributes.begin(), src.m_attributes.end());
+				dst.m_materialIDs.insert(dst.m_materialIDs.end(), src.m_materialIDs.begin(), src.m_materialIDs.end());
+				dst.m_objectIDs.insert(dst.m_objectIDs.end(), src.m_objectIDs.begin(), src.m_objectIDs.end());
+				consumed[idx] = true;
+			}
+
+			merged.push_back(std::move(dst));
+			stats.m_mergedMeshes += static_cast<uint32_t>(cluster.size());
+			++stats.m_clusters;
+		}
+
+		// untouched meshes keep their relative order, clusters go to the end
+		std::vector<VulpixMeshData> result;
+		result.reserve(meshes.size() - stats.m_mergedMeshes + merged.size());
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			if (!consumed[i])
+			{
+				result.push_back(std::move(meshes[i]));
+			}
+		}
+		for (VulpixMeshData& mesh : merged)
+		{
+			result.push_back(std::move(mesh));
+		}
+
+		meshes.swap(result);
+
+		stats.m_meshesAfter = static_cast<uint32_t>(meshes.size());
+		stats.m_instanceCostAfter = estimateInstanceCost(meshes);
+		return stats;
+	}
+
+} // namespace vulpix
@@ -0,0 +1,75 @@
+#ifndef VULPIX_MESH_PROCESSING_H
+#define VULPIX_MESH_PROCESSING_H
+
+#include "Vulpix_MeshData.h"
+
+// load-time geometry passes, they all run on the CPU side mesh data before anything is uploaded
+namespace vulpix
+{
+	struct MergeSettings
+	{
+		uint32_t m_smallMeshFaces = 2048;       // meshes below this are merge candidates
+		uint32_t m_maxClusterFaces = 65536;     // keep merged BLASes small enough to stay cheap to build
+		float m_maxClusterExtent = 0.15f;       // cluster bounds diagonal, relative to the scene diagonal
+	};
+
+	struct MergeStats
+	{
+		uint32_t m_meshesBefore = 0;
+		uint32_t m_meshesAfter = 0;
+		uint32_t m_mergedMeshes = 0;            // inputs that ended up in a cluster
+		uint32_t m_clusters = 0;
+		// expected number of instance boxes a random ray through the scene hits (SAH estimate)
+		float m_instanceCostBefore = 0.0f;
+		float m_instanceCostAfter = 0.0f;
+	};
+
+	struct SplitSettings
+	{
+		float m_areaRatio = 16.0f;              // split when the box surface area exceeds this many times the triangle area
+		float m_maxAddedFaces = 0.25f;          // budget, relative to the input face count
+		uint32_t m_maxSplitDepth = 6;           // a single triangle ends up in at most 2^depth pieces
+	};
+
+	struct SplitStats
+	{
+		uint32_t m_facesBefore = 0;
+		uint32_t m_facesAfter = 0;
+		uint32_t m_splitFaces = 0;              // input faces that got split at least once
+		// summed triangle box surface area, what the BVH builder has to enclose
+		float m_boxAreaBefore = 0.0f;
+		float m_boxAreaAfter = 0.0f;
+	};
+
+	// splits long thin triangles along their longest edge, worst boxes first, until the budget runs out
+	SplitStats splitLongTriangles(std::vector<VulpixMeshData>& meshes, const SplitSettings& settings);
+
+	// merges spatially adjacent small meshes into one mesh each, faces keep their material and object ids
+	MergeStats mergeSmallMeshes(std::vector<VulpixMeshData>& meshes, const MergeSettings& settings);
+
+	struct LodSettings
+	{
+		uint32_t m_lodCount = VULPIX_MAX_LODS;  // including the full mesh
+		float m_reduction = 0.5f;               // face count of a LOD relative to the previous one
+		uint32_t m_minFaces = 512;              // meshes (and LODs) below this are not simplified further
+	};
+
+	struct LodStats
+	{
+		uint32_t m_meshesWithLods = 0;
+		uint32_t m_lodCount = 0;                // simplified LODs over all meshes
+		uint32_t m_facesBefore = 0;
+		uint32_t m_facesAfter = 0;              // all LODs together
+	};
+
+	// appends simplified LODs to every mesh, each LOD is simplified from the previous one
+	LodStats generateLods(std::vector<VulpixMeshData>& meshes, const LodSettings& settings);
+
+	// moves faces with alpha tested materials to the end of each LOD, has to run after the passes that reorder faces
+	uint32_t partitionAlphaTested(std::vector<VulpixMeshData>& meshes, const std::vector<bool>& alphaMaterials);
+
+	float estimateInstanceCost(const std::vector<VulpixMeshData>& meshes);
+
+} // namespace vulpix
+
+#endif // VULPIX_MESH_PROCESSING_H
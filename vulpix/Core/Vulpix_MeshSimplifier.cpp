@@ -0,0 +1,423 @@
+#include "Vulpix_MeshSimplifier.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace vulpix
+{
+	namespace
+	{
+		// how much more a border edge resists moving than the surface around it
+		const double boundaryWeight = 10.0;
+		// collapses that turn a face further than this (cosine) are rejected
+		const float minFlipCosine = 0.2f;
+
+		// symmetric 4x4 plane quadric, plus the summed weight so the error can be normalized
+		struct Quadric
+		{
+			double m_a2 = 0.0, m_ab = 0.0, m_ac = 0.0, m_ad = 0.0;
+			double m_b2 = 0.0, m_bc = 0.0, m_bd = 0.0;
+			double m_c2 = 0.0, m_cd = 0.0;
+			double m_d2 = 0.0;
+			double m_weight = 0.0;
+
+			static Quadric fromPlane(const vec3& n, const vec3& p, const double weight)
+			{
+				const double a = n.x, b = n.y, c = n.z;
+				const double d = -(a * p.x + b * p.y + c * p.z);
+
+				Quadric q;
+				q.m_a2 = a * a * weight; q.m_ab = a * b * weight; q.m_ac = a * c * weight; q.m_ad = a * d * weight;
+				q.m_b2 = b * b * weight; q.m_bc = b * c * weight; q.m_bd = b * d * weight;
+				q.m_c2 = c * c * weight; q.m_cd = c * d * weight;
+				q.m_d2 = d * d * weight;
+				q.m_weight = weight;
+				return q;
+			}
+
+			Quadric& operator+=(const Quadric& o)
+			{
+				m_a2 += o.m_a2; m_ab += o.m_ab; m_ac += o.m_ac; m_ad += o.m_ad;
+				m_b2 += o.m_b2; m_bc += o.m_bc; m_bd += o.m_bd;
+				m_c2 += o.m_c2; m_cd += o.m_cd;
+				m_d2 += o.m_d2;
+				m_weight += o.m_weight;
+				return *this;
+			}
+
+			double evaluate(const vec3& v) const
+			{
+				const double x = v.x, y = v.y, z = v.z;
+				const double e = m_a2 * x * x + 2.0 * m_ab * x * y + 2.0 * m_ac * x * z + 2.0 * m_ad * x
+							   + m_b2 * y * y + 2.0 * m_bc * y * z + 2.0 * m_bd * y
+							   + m_c2 * z * z + 2.0 * m_cd * z
+							   + m_d2;
+				return std::max(e, 0.0);
+			}
+		};
+
+		struct Collapse
+		{
+			double m_cost;
+			uint32_t m_keep;
+			uint32_t m_remove;
+			uint32_t m_keepVersion;
+			uint32_t m_removeVersion;
+			vec3 m_target;
+
+			bool operator>(const Collapse& other) const { return m_cost > other.m_cost; }
+		};
+
+		class Simplifier
+		{
+		public:
+			explicit Simplifier(const VulpixMeshData& src) : m_src(src) {}
+
+			VulpixMeshData run(const uint32_t targetFaces, float& error);
+
+		private:
+			void weld();
+			void buildQuadrics();
+			void pushCollapse(const uint32_t a, const uint32_t b);
+			bool flips(const uint32_t moved, const uint32_t other, const vec3& target) const;
+			void collapse(const Collapse& c);
+
+		private:
+			const VulpixMeshData& m_src;
+
+			std::vector<vec3> m_positions;
+			std::vector<Quadric> m_quadrics;
+			std::vector<uint32_t> m_versions;
+			std::vector<bool> m_vertexAlive;
+			std::vector<std::vector<uint32_t>> m_vertexFaces;
+
+			std::vector<uint32_t> m_corners; // 3 welded vertices per face
+			std::vector<bool> m_faceAlive;
+			uint32_t m_liveFaces = 0;
+
+			std::vector<std::pair<uint32_t, uint32_t>> m_edges;
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+		};
+
+		void Simplifier::weld()
+		{
+			const uint32_t numCorners = m_src.getVertexCount();
+
+			std::vector<uint32_t> order(numCorners);
+			for (uint32_t i = 0; i < numCorners; ++i)
+			{
+				order[i] = i;
+			}
+
+			const std::vector<vec3>& pos = m_src.m_positions;
+			std::sort(order.begin(), order.end(), [&pos](const uint32_t a, const uint32_t b)
+			{
+				if (pos[a].x != pos[b].x)
+				{
+					return pos[a].x < pos[b].x;
+				}
+				if (pos[a].y != pos[b].y)
+				{
+					return pos[a].y < pos[b].y;
+				}
+				return pos[a].z < pos[b].z;
+			});
+
+			m_corners.resize(numCorners);
+			for (uint32_t i = 0; i < numCorners; ++i)
+			{
+				if (i == 0 || pos[order[i]] != pos[order[i - 1]])
+				{
+					m_positions.push_back(pos[order[i]]);
+				}
+				m_corners[order[i]] = static_cast<uint32_t>(m_positions.size() - 1);
+			}
+
+			const size_t numVertices = m_positions.size();
+			m_quadrics.resize(numVertices);
+			m_versions.assign(numVertices, 0);
+			m_vertexAlive.assign(numVertices, true);
+			m_vertexFaces.resize(numVertices);
+
+			const uint32_t numFaces = m_src.getFaceCount();
+			m_faceAlive.assign(numFaces, true);
+			m_liveFaces = numFaces;
+
+			for (uint32_t f = 0; f < numFaces; ++f)
+			{
+				const uint32_t* c = &m_corners[3 * f];
+				// faces that welded into a line or a point have nothing to simplify
+				if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0])
+				{
+					m_faceAlive[f] = false;
+					--m_liveFaces;
+					continue;
+				}
+
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					m_vertexFaces[c[j]].push_back(f);
+
+					const uint32_t a = c[j];
+					const uint32_t b = c[(j + 1) % 3];
+					m_edges.emplace_back(std::min(a, b), std::max(a, b));
+				}
+			}
+		}
+
+		void Simplifier::buildQuadrics()
+		{
+			const uint32_t numFaces = m_src.getFaceCount();
+			for (uint32_t f = 0; f < numFaces; ++f)
+			{
+				if (!m_faceAlive[f])
+				{
+					continue;
+				}
+
+				const uint32_t* c = &m_corners[3 * f];
+				const vec3 cross = glm::cross(m_positions[c[1]] - m_positions[c[0]], m_positions[c[2]] - m_positions[c[0]]);
+				const float len = glm::length(cross);
+				if (len <= 0.0f)
+				{
+					continue;
+				}
+
+				const Quadric q = Quadric::fromPlane(cross / len, m_positions[c[0]], 0.5 * len);
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					m_quadrics[c[j]] += q;
+				}
+			}
+
+			// edges used by a single face are borders, pin them with a plane standing on the edge
+			std::sort(m_edges.begin(), m_edges.end());
+			std::vector<std::pair<uint32_t, uint32_t>> uniqueEdges;
+			for (size_t i = 0; i < m_edges.size();)
+			{
+				size_t j = i + 1;
+				while (j < m_edges.size() && m_edges[j] == m_edges[i])
+				{
+					++j;
+				}
+
+				const uint32_t a = m_edges[i].first;
+				const uint32_t b = m_edges[i].second;
+				if (j - i == 1)
+				{
+					for (const uint32_t f : m_vertexFaces[a])
+					{
+						const uint32_t* c = &m_corners[3 * f];
+						if (c[0] != b && c[1] != b && c[2] != b)
+						{
+							continue;
+						}
+
+						const vec3 edge = m_positions[b] - m_positions[a];
+						const vec3 faceNormal = glm::cross(m_positions[c[1]] - m_positions[c[0]], m_positions[c[2]] - m_positions[c[0]]);
+						const vec3 n = glm::cross(edge, faceNormal);
+						const float len = glm::length(n);
+						if (len > 0.0f)
+						{
+							const double edgeLength2 = glm::dot(edge, edge);
+							const Quadric q = Quadric::fromPlane(n / len, m_positions[a], boundaryWeight * edgeLength2);
+							m_quadrics[a] += q;
+							m_quadrics[b] += q;
+						}
+						break;
+					}
+				}
+
+				uniqueEdges.push_back(m_edges[i]);
+				i = j;
+			}
+			m_edges.swap(uniqueEdges);
+		}
+
+		void Simplifier::pushCollapse(const uint32_t a, const uint32_t b)
+		{
+			Quadric q = m_quadrics[a];
+			q += m_quadrics[b];
+
+			// endpoints or midpoint, cheaper and more robust than solving for the optimum
+			const vec3 candidates[3] = { m_positions[a], m_positions[b], (m_positions[a] + m_positions[b]) * 0.5f };
+
+			Collapse best;
+			best.m_cost = DBL_MAX;
+			for (const vec3& candidate : candidates)
+			{
+				const double cost = q.evaluate(candidate);
+				if (cost < best.m_cost)
+				{
+					best.m_cost = cost;
+					best.m_target = candidate;
+				}
+			}
+
+			best.m_keep = a;
+			best.m_remove = b;
+			best.m_keepVersion = m_versions[a];
+			best.m_removeVersion = m_versions[b];
+			m_queue.push(best);
+		}
+
+		bool Simplifier::flips(const uint32_t moved, const uint32_t other, const vec3& target) const
+		{
+			for (const uint32_t f : m_vertexFaces[moved])
+			{
+				if (!m_faceAlive[f])
+				{
+					continue;
+				}
+
+				const uint32_t* c = &m_corners[3 * f];
+				// faces on the collapsed edge disappear anyway
+				if (c[0] == other || c[1] == other || c[2] == other)
+				{
+					continue;
+				}
+
+				vec3 p[3] = { m_positions[c[0]], m_positions[c[1]], m_positions[c[2]] };
+				const vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					if (c[j] == moved)
+					{
+						p[j] = target;
+					}
+				}
+				const vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+				const float lengths = glm::length(before) * glm::length(after);
+				if (lengths <= 0.0f || glm::dot(before, after) < minFlipCosine * lengths)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void Simplifier::collapse(const Collapse& c)
+		{
+			const uint32_t a = c.m_keep;
+			const uint32_t b = c.m_remove;
+
+			for (const uint32_t f : m_vertexFaces[b])
+			{
+				if (!m_faceAlive[f])
+				{
+					continue;
+				}
+
+				uint32_t* corners = &m_corners[3 * f];
+				if (corners[0] == a || corners[1] == a || corners[2] == a)
+				{
+					m_faceAlive[f] = false;
+					--m_liveFaces;
+					continue;
+				}
+
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					if (corners[j] == b)
+					{
+						corners[j] = a;
+					}
+				}
+				m_vertexFaces[a].push_back(f);
+			}
+
+			m_vertexFaces[b].clear();
+			m_vertexAlive[b] = false;
+
+			// drop dead faces from the survivor's list while we're at it
+			std::vector<uint32_t>& faces = m_vertexFaces[a];
+			faces.erase(std::remove_if(faces.begin(), faces.end(), [this](const uint32_t f) { return !m_faceAlive[f]; }), faces.end());
+
+			m_positions[a] = c.m_target;
+			m_quadrics[a] += m_quadrics[b];
+			++m_versions[a];
+
+			for (const uint32_t f : faces)
+			{
+				const uint32_t* corners = &m_corners[3 * f];
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					if (corners[j] != a)
+					{
+						pushCollapse(a, corners[j]);
+					}
+				}
+			}
+		}
+
+		VulpixMeshData Simplifier::run(const uint32_t targetFaces, float& error)
+		{
+			weld();
+			buildQuadrics();
+
+			for (const auto& edge : m_edges)
+			{
+				pushCollapse(edge.first, edge.second);
+			}
+
+			double maxError = 0.0;
+			while (m_liveFaces > targetFaces && !m_queue.empty())
+			{
+				const Collapse c = m_queue.top();
+				m_queue.pop();
+
+				if (!m_vertexAlive[c.m_keep] || !m_vertexAlive[c.m_remove] ||
+					m_versions[c.m_keep] != c.m_keepVersion || m_versions[c.m_remove] != c.m_removeVersion)
+					continue;
+
+				if (flips(c.m_keep, c.m_remove, c.m_target) || flips(c.m_remove, c.m_keep, c.m_target))
+				{
+					continue;
+				}
+
+				const double weight = m_quadrics[c.m_keep].m_weight + m_quadrics[c.m_remove].m_weight;
+				if (weight > 0.0)
+				{
+					maxError = std::max(maxError, c.m_cost / weight);
+				}
+
+				collapse(c);
+			}
+
+			error = static_cast<float>(std::sqrt(maxError));
+
+			VulpixMeshData dst;
+			dst.m_positions.reserve(m_liveFaces * 3);
+			dst.m_attributes.reserve(m_liveFaces * 3);
+			dst.m_materialIDs.reserve(m_liveFaces);
+			dst.m_objectIDs.reserve(m_liveFaces);
+
+			const uint32_t numFaces = m_src.getFaceCount();
+			for (uint32_t f = 0; f < numFaces; ++f)
+			{
+				if (!m_faceAlive[f])
+				{
+					continue;
+				}
+
+				for (uint32_t j = 0; j < 3; ++j)
+				{
+					dst.m_positions.push_back(m_positions[m_corners[3 * f + j]]);
+					dst.m_attributes.push_back(m_src.m_attributes[3 * f + j]);
+				}
+				dst.m_materialIDs.push_back(m_src.m_materialIDs[f]);
+				dst.m_objectIDs.push_back(m_src.m_objectIDs[f]);
+			}
+
+			return dst;
+		}
+	}
+
+	VulpixMeshData simplifyMesh(const VulpixMeshData& src, const uint32_t targetFaces, float& error)
+	{
+		Simplifier simplifier(src);
+		return simplifier.run(targetFaces, error);
+	}
+
+} // namespace vulpix
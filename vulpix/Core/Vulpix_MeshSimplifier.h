@@ -0,0 +1,15 @@
+#ifndef VULPIX_MESH_SIMPLIFIER_H
+#define VULPIX_MESH_SIMPLIFIER_H
+
+#include "Vulpix_MeshData.h"
+
+namespace vulpix
+{
+	// quadric error edge collapse (Garland & Heckbert). Vertices are welded by position, so the
+	// corners keep their own normals and uvs and only move with the collapsed positions.
+	// error receives the largest rms distance of a collapse to the planes it replaced, in world units.
+	VulpixMeshData simplifyMesh(const VulpixMeshData& src, const uint32_t targetFaces, float& error);
+
+} // namespace vulpix
+
+#endif // VULPIX_MESH_SIMPLIFIER_H
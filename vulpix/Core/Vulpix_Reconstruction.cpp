@@ -0,0 +1,198 @@
+#include "Vulpix_Reconstruction.h"
+#include "../Shader/Shader.h"
+#include "../Shader/Shader_Config.h"
+
+VulpixReconstruction::VulpixReconstruction()
+{
+	m_descriptorSetLayout = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_pipeline = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+	m_numOutputs = 0;
+}
+
+bool VulpixReconstruction::initReconstruction(VkDevice device, VkImageView samples, const VkImageView history[2], const std::vector<VkImageView>& outputs, VkBuffer params)
+{
+	m_numOutputs = static_cast<uint32_t>(outputs.size());
+	if (m_numOutputs == 0)
+	{
+		return false;
+	}
+	const uint32_t numSets = m_numOutputs * 2;
+
+	const VkDescriptorSetLayoutBinding bindings[] = {
+		{ VULPIX_RECONSTRUCT_SAMPLES_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ VULPIX_RECONSTRUCT_HISTORY_IN_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ VULPIX_RECONSTRUCT_HISTORY_OUT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ VULPIX_RECONSTRUCT_OUTPUT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+		{ VULPIX_RECONSTRUCT_PARAMS_BINDING, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+	};
+	const uint32_t numBindings = static_cast<uint32_t>(sizeof(bindings) / sizeof(bindings[0]));
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = numBindings;
+	layoutInfo.pBindings = bindings;
+
+	VkResult error = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_descriptorSetLayout);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorSetLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	error = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+	CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	Shader reconstructShader;
+	if (!reconstructShader.load("assets/out_shaders/reconstruct.bin"))
+	{
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = reconstructShader.getShaderStageInfo(VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = m_pipelineLayout;
+
+	error = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+	CHECK_VK_ERROR(error, "vkCreateComputePipelines");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	const VkDescriptorPoolSize poolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numSets * 4 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, numSets }
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.maxSets = numSets;
+	descriptorPoolCreateInfo.poolSizeCount = 2;
+	descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+
+	error = vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numSets, m_descriptorSetLayout);
+	m_descriptorSets.resize(numSets);
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = numSets;
+	descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
+
+	error = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, m_descriptorSets.data());
+	CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	VkDescriptorBufferInfo paramsInfo = { params, 0, sizeof(UniformParams) };
+
+	for (uint32_t parity = 0; parity < 2; ++parity)
+	{
+		for (uint32_t output = 0; output < m_numOutputs; ++output)
+		{
+			const VkDescriptorSet set = m_descriptorSets[parity * m_numOutputs + output];
+
+			// same order as the image bindings
+			const VkImageView views[] = {
+				samples,
+				history[parity],
+				history[1 - parity],
+				outputs[output]
+			};
+
+			VkDescriptorImageInfo imageInfos[4];
+			VkWriteDescriptorSet writes[numBindings];
+
+			for (uint32_t i = 0; i < numBindings; ++i)
+			{
+				writes[i] = {};
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = set;
+				writes[i].dstBinding = bindings[i].binding;
+				writes[i].dstArrayElement = 0;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = bindings[i].descriptorType;
+
+				if (i < 4)
+				{
+					imageInfos[i].sampler = VK_NULL_HANDLE;
+					imageInfos[i].imageView = views[i];
+					imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+					writes[i].pImageInfo = &imageInfos[i];
+				}
+				else
+				{
+					writes[i].pBufferInfo = &paramsInfo;
+				}
+			}
+
+			vkUpdateDescriptorSets(device, numBindings, writes, 0, nullptr);
+		}
+	}
+
+	return true;
+}
+
+void VulpixReconstruction::destroyReconstruction(VkDevice device)
+{
+	if (m_descriptorPool)
+	{
+		vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+		m_descriptorPool = VK_NULL_HANDLE;
+	}
+	m_descriptorSets.clear();
+
+	if (m_pipeline)
+	{
+		vkDestroyPipeline(device, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout)
+	{
+		vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+
+	if (m_descriptorSetLayout)
+	{
+		vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+		m_descriptorSetLayout = VK_NULL_HANDLE;
+	}
+}
+
+void VulpixReconstruction::recordReconstruct(VkCommandBuffer commandBuffer, const uint32_t output, const uint32_t parity, const uint32_t paramsOffset, const VkExtent2D extent) const
+{
+	if (!m_pipeline)
+	{
+		return;
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[parity * m_numOutputs + output], 1, &paramsOffset);
+	vkCmdDispatch(commandBuffer,
+		(extent.width + VULPIX_RECONSTRUCT_GROUP_SIZE - 1) / VULPIX_RECONSTRUCT_GROUP_SIZE,
+		(extent.height + VULPIX_RECONSTRUCT_GROUP_SIZE - 1) / VULPIX_RECONSTRUCT_GROUP_SIZE,
+		1);
+}
@@ -0,0 +1,36 @@
+#ifndef VULPIX_RECONSTRUCTION_H
+#define VULPIX_RECONSTRUCTION_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+
+// Compute pass that completes an interleaved (checkerboard / 2x2) frame: traced pixels are taken as they are,
+// the skipped ones are reprojected from last frame's history and clamped to their traced neighbors
+class VulpixReconstruction
+{
+public:
+	VulpixReconstruction();
+	~VulpixReconstruction() = default;
+
+	// outputs are the images the pass can write its result to, the two history images are ping-ponged,
+	// everything has to be in VK_IMAGE_LAYOUT_GENERAL when recorded. The params are UniformParams, bound
+	// with a dynamic offset
+	bool initReconstruction(VkDevice device, VkImageView samples, const VkImageView history[2], const std::vector<VkImageView>& outputs, VkBuffer params);
+	void destroyReconstruction(VkDevice device);
+
+	bool isValid() const { return m_pipeline != VK_NULL_HANDLE; }
+
+	// reads history[parity], writes history[1 - parity]. Records the dispatch only, the caller's render graph
+	// pass declares the samples, both history images and the output
+	void recordReconstruct(VkCommandBuffer commandBuffer, const uint32_t output, const uint32_t parity, const uint32_t paramsOffset, const VkExtent2D extent) const;
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_descriptorSets; // per parity, per output
+	uint32_t m_numOutputs;
+};
+
+#endif // VULPIX_RECONSTRUCTION_H
@@ -0,0 +1,172 @@
+#include "Vulpix_RenderGraph.h"
+#include "Vulpix_GpuProfiler.h"
+
+VulpixGraphPass& VulpixGraphPass::read(const VulpixGraphResource resource, const VkPipelineStageFlags2KHR stageMask, const VkAccessFlags2KHR accessMask, const VkImageLayout layout)
+{
+	m_uses.push_back({ resource, stageMask, accessMask, layout, false });
+	return *this;
+}
+
+VulpixGraphPass& VulpixGraphPass::write(const VulpixGraphResource resource, const VkPipelineStageFlags2KHR stageMask, const VkAccessFlags2KHR accessMask, const VkImageLayout layout)
+{
+	m_uses.push_back({ resource, stageMask, accessMask, layout, true });
+	return *this;
+}
+
+void VulpixRenderGraph::reset()
+{
+	m_resources.clear();
+	m_passes.clear();
+}
+
+VulpixGraphResource VulpixRenderGraph::importImage(VkImage image, const VkImageSubresourceRange& range, const VulpixResourceState& state)
+{
+	// the earlier access counts as a write, whatever it was the graph's first access has to wait for it
+	Resource resource = {};
+	resource.m_image = image;
+	resource.m_range = range;
+	resource.m_layout = state.m_layout;
+	resource.m_writeStages = state.m_stageMask;
+	resource.m_writeAccess = state.m_accessMask;
+
+	m_resources.push_back(resource);
+	return static_cast<VulpixGraphResource>(m_resources.size() - 1);
+}
+
+VulpixGraphResource VulpixRenderGraph::importMemory(const VulpixResourceState& state)
+{
+	Resource resource = {};
+	resource.m_image = VK_NULL_HANDLE;
+	resource.m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.m_writeStages = state.m_stageMask;
+	resource.m_writeAccess = state.m_accessMask;
+
+	m_resources.push_back(resource);
+	return static_cast<VulpixGraphResource>(m_resources.size() - 1);
+}
+
+VulpixGraphPass& VulpixRenderGraph::addPass(const char* name, std::function<void(VkCommandBuffer)> record)
+{
+	m_passes.emplace_back();
+	VulpixGraphPass& pass = m_passes.back();
+	pass.m_name = name;
+	pass.m_record = std::move(record);
+	return pass;
+}
+
+void VulpixRenderGraph::execute(VkCommandBuffer commandBuffer, VulpixGpuProfiler* profiler, const uint32_t frameIndex)
+{
+	m_barrierBatchCount = 0;
+	m_imageBarrierCount = 0;
+
+	for (const VulpixGraphPass& pass : m_passes)
+	{
+		m_imageBarriers.clear();
+
+		// the pass's barrier counts to its time, waiting on its inputs is part of what it costs
+		const bool timed = profiler && pass.m_record;
+		if (timed)
+		{
+			profiler->beginStage(commandBuffer, frameIndex, pass.m_name);
+		}
+
+		// all buffer and AS dependencies of the pass go into one global barrier
+		VkMemoryBarrier2KHR memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+
+		for (const VulpixGraphPass::Use& use : pass.m_uses)
+		{
+			Resource& resource = m_resources[use.m_resource];
+			const bool isImage = resource.m_image != VK_NULL_HANDLE;
+			const bool transition = isImage && resource.m_layout != use.m_layout;
+
+			VkPipelineStageFlags2KHR srcStages = VK_PIPELINE_STAGE_2_NONE_KHR;
+			VkAccessFlags2KHR srcAccess = VK_ACCESS_2_NONE_KHR;
+			bool needsBarrier = false;
+
+			if (transition || use.m_write)
+			{
+				// waits for the last write and for every read since, the reads only need an execution dependency
+				srcStages = resource.m_writeStages | resource.m_readStages;
+				srcAccess = resource.m_writeAccess;
+				needsBarrier = transition || srcStages != VK_PIPELINE_STAGE_2_NONE_KHR;
+			}
+			else
+			{
+				// a read after a write, unless an earlier barrier already made the write visible to this stage and access
+				srcStages = resource.m_writeStages;
+				srcAccess = resource.m_writeAccess;
+				needsBarrier = srcStages != VK_PIPELINE_STAGE_2_NONE_KHR &&
+					((use.m_stageMask & ~resource.m_readStages) || (use.m_accessMask & ~resource.m_readAccess));
+			}
+
+			if (needsBarrier)
+			{
+				if (isImage)
+				{
+					VkImageMemoryBarrier2KHR imageBarrier = {};
+					imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+					imageBarrier.srcStageMask = srcStages;
+					imageBarrier.srcAccessMask = srcAccess;
+					imageBarrier.dstStageMask = use.m_stageMask;
+					imageBarrier.dstAccessMask = use.m_accessMask;
+					imageBarrier.oldLayout = resource.m_layout;
+					imageBarrier.newLayout = use.m_layout;
+					imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+					imageBarrier.image = resource.m_image;
+					imageBarrier.subresourceRange = resource.m_range;
+					m_imageBarriers.push_back(imageBarrier);
+				}
+				else
+				{
+					memoryBarrier.srcStageMask |= srcStages;
+					memoryBarrier.srcAccessMask |= srcAccess;
+					memoryBarrier.dstStageMask |= use.m_stageMask;
+					memoryBarrier.dstAccessMask |= use.m_accessMask;
+				}
+			}
+
+			if (transition || use.m_write)
+			{
+				// a layout transition is a write of its own, later reads from other stages have to see it
+				resource.m_writeStages = use.m_stageMask;
+				resource.m_writeAccess = use.m_write ? use.m_accessMask : VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+				resource.m_readStages = use.m_write ? VK_PIPELINE_STAGE_2_NONE_KHR : use.m_stageMask;
+				resource.m_readAccess = use.m_write ? VK_ACCESS_2_NONE_KHR : use.m_accessMask;
+				resource.m_layout = isImage ? use.m_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+			else
+			{
+				resource.m_readStages |= use.m_stageMask;
+				resource.m_readAccess |= use.m_accessMask;
+			}
+		}
+
+		const bool hasMemoryBarrier = memoryBarrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE_KHR || memoryBarrier.dstStageMask != VK_PIPELINE_STAGE_2_NONE_KHR;
+		if (hasMemoryBarrier || !m_imageBarriers.empty())
+		{
+			VkDependencyInfoKHR dependencyInfo = {};
+			dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+			dependencyInfo.memoryBarrierCount = hasMemoryBarrier ? 1 : 0;
+			dependencyInfo.pMemoryBarriers = &memoryBarrier;
+			dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(m_imageBarriers.size());
+			dependencyInfo.pImageMemoryBarriers = m_imageBarriers.data();
+
+			vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+
+			++m_barrierBatchCount;
+			m_imageBarrierCount += static_cast<uint32_t>(m_imageBarriers.size());
+		}
+
+		if (pass.m_record)
+		{
+			pass.m_record(commandBuffer);
+		}
+
+		if (timed)
+		{
+			profiler->endStage(commandBuffer, frameIndex);
+		}
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef VULPIX_RENDER_GRAPH_H
+#define VULPIX_RENDER_GRAPH_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+
+#include <functional>
+
+class VulpixGpuProfiler;
+
+// index of a resource in the graph, valid until the next reset
+typedef uint32_t VulpixGraphResource;
+
+// last access of a resource before this frame's graph (by an earlier submission or by code outside the graph).
+// An UNDEFINED layout drops the contents of an image
+struct VulpixResourceState
+{
+	VkPipelineStageFlags2KHR m_stageMask = VK_PIPELINE_STAGE_2_NONE_KHR;
+	VkAccessFlags2KHR m_accessMask = VK_ACCESS_2_NONE_KHR;
+	VkImageLayout m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+// a recorded step of the frame and everything it touches, the graph orders the passes' accesses with the
+// barriers and layout transitions the declarations ask for, so the record function itself has none
+class VulpixGraphPass
+{
+public:
+	// the layout only matters for images
+	VulpixGraphPass& read(const VulpixGraphResource resource, const VkPipelineStageFlags2KHR stageMask, const VkAccessFlags2KHR accessMask, const VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+	VulpixGraphPass& write(const VulpixGraphResource resource, const VkPipelineStageFlags2KHR stageMask, const VkAccessFlags2KHR accessMask, const VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+
+private:
+	friend class VulpixRenderGraph;
+
+	struct Use
+	{
+		VulpixGraphResource m_resource;
+		VkPipelineStageFlags2KHR m_stageMask;
+		VkAccessFlags2KHR m_accessMask;
+		VkImageLayout m_layout;
+		bool m_write;
+	};
+
+	std::string m_name;
+	std::function<void(VkCommandBuffer)> m_record;
+	std::vector<Use> m_uses;
+};
+
+// Per-frame list of passes, executed in the order they were added. Before each pass it records one
+// synchronization2 barrier batch holding only the dependencies that pass actually has: read after write,
+// write after read / write and layout changes. Reads after reads in the same layout need nothing
+class VulpixRenderGraph
+{
+public:
+	VulpixRenderGraph() = default;
+	~VulpixRenderGraph() = default;
+
+	// drops the passes and resources of the last frame, keeps the allocations
+	void reset();
+
+	// images get image barriers over the range, everything else (buffers, ASs) global memory barriers
+	VulpixGraphResource importImage(VkImage image, const VkImageSubresourceRange& range, const VulpixResourceState& state);
+	VulpixGraphResource importMemory(const VulpixResourceState& state);
+
+	// the returned pass is only valid until the next addPass, declare its resources right away
+	VulpixGraphPass& addPass(const char* name, std::function<void(VkCommandBuffer)> record = nullptr);
+
+	// with a profiler every pass that records something gets its own timestamp pair, named after the pass
+	void execute(VkCommandBuffer commandBuffer, VulpixGpuProfiler* profiler = nullptr, const uint32_t frameIndex = 0);
+
+	// of the last execute
+	uint32_t getBarrierBatchCount() const { return m_barrierBatchCount; }
+	uint32_t getImageBarrierCount() const { return m_imageBarrierCount; }
+
+private:
+	struct Resource
+	{
+		VkImage m_image;
+		VkImageSubresourceRange m_range;
+		VkImageLayout m_layout;
+		// last write (or layout transition) and the reads since, a read already covered by m_readStages /
+		// m_readAccess saw the write and needs no barrier of its own
+		VkPipelineStageFlags2KHR m_writeStages;
+		VkAccessFlags2KHR m_writeAccess;
+		VkPipelineStageFlags2KHR m_readStages;
+		VkAccessFlags2KHR m_readAccess;
+	};
+
+	std::vector<Resource> m_resources;
+	std::vector<VulpixGraphPass> m_passes;
+	std::vector<VkImageMemoryBarrier2KHR> m_imageBarriers;
+
+	uint32_t m_barrierBatchCount = 0;
+	uint32_t m_imageBarrierCount = 0;
+};
+
+#endif // VULPIX_RENDER_GRAPH_H
@@ -0,0 +1,50 @@
+#include "Vulpix_RenderJob.h"
+
+#include "Vulpix_FrameCapture.h"
+
+#include <iostream>
+
+namespace vulpix
+{
+	bool loadRenderJobs(const std::string& path, std::vector<RenderJob>& jobs)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		jobs.clear();
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+
+			std::istringstream stream(line);
+			RenderJob job;
+			stream >> job.m_output >> job.m_samples >> job.m_width >> job.m_height
+				>> job.m_position.x >> job.m_position.y >> job.m_position.z
+				>> job.m_forward.x >> job.m_forward.y >> job.m_forward.z;
+			if (stream.fail() || job.m_samples == 0 || job.m_width == 0 || job.m_height == 0 || !canWriteImage(job.m_output))
+			{
+				std::cout << "Invalid render job: " << line << std::endl;
+				jobs.clear();
+				return false;
+			}
+
+			job.m_forward = glm::normalize(job.m_forward);
+			jobs.push_back(job);
+		}
+
+		return !jobs.empty();
+	}
+
+	bool writeRenderJobImage(const RenderJob& job, const uint8_t* pixels)
+	{
+		return writeImage(job.m_output, pixels, job.m_width, job.m_height);
+	}
+} // namespace vulpix
@@ -0,0 +1,38 @@
+#ifndef VULPIX_RENDER_JOB_H
+#define VULPIX_RENDER_JOB_H
+
+#include "../Common.h"
+#include "../Math/Vulpix_Math.h"
+
+#include <cstdint>
+
+// One image of a batch: a camera pose rendered at its own resolution with a fixed number of accumulated samples
+struct RenderJob
+{
+	std::string m_output; // .png or .jpg
+	uint32_t m_samples = 1;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	vulpix::math::vec3 m_position = vulpix::math::vec3(0.0f);
+	vulpix::math::vec3 m_forward = vulpix::math::vec3(0.0f, 0.0f, -1.0f);
+	int32_t m_goldenCase = -1; // index of the golden case the image is checked against instead of written, -1 for none
+
+	// a tile of a larger image, rendered for a VulpixTileCoordinator. m_width and m_height are the tile's
+	uint32_t m_tile = UINT32_MAX; // index the result goes back with, UINT32_MAX when the job is a whole image
+	uint32_t m_tileX = 0;
+	uint32_t m_tileY = 0;
+	uint32_t m_imageWidth = 0;
+	uint32_t m_imageHeight = 0;
+};
+
+namespace vulpix
+{
+	// a text file with one "output samples width height px py pz fx fy fz" line per job, # starts a comment.
+	// The pose is a camera path line without its time
+	bool loadRenderJobs(const std::string& path, std::vector<RenderJob>& jobs);
+
+	// tightly packed RGBA8 rows, see vulpix::writeImage
+	bool writeRenderJobImage(const RenderJob& job, const uint8_t* pixels);
+} // namespace vulpix
+
+#endif // VULPIX_RENDER_JOB_H
@@ -1,37 +1,34 @@
 #include "Vulpix_Scene.h"
 #include "../Math/Vulpix_Math.h"
+#include "Vulpix_Trace.h"
+#include <algorithm>
+#include <cfloat>
 
-void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
-{
-    const VkTransformMatrixKHR transform = {
-       1.0f, 0.0f, 0.0f, 0.0f,
-       0.0f, 1.0f, 0.0f, 0.0f,
-       0.0f, 0.0f, 1.0f, 0.0f,
-    };
+// deformed meshes trade some trace speed for cheap per-frame refits
+static const VkBuildAccelerationStructureFlagsKHR deformBLASFlags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR;
 
-    const size_t numMeshes = m_meshes.size();
+// opaque faces and alpha tested faces
+static const uint32_t maxGeometriesPerBLAS = 2;
 
-    // create instances for our meshes
-    std::vector<VkAccelerationStructureInstanceKHR> instances(numMeshes, VkAccelerationStructureInstanceKHR{});
-    for (size_t i = 0; i < numMeshes; ++i) {
-        VulpixMesh& mesh = m_meshes[i];
-
-        VkAccelerationStructureInstanceKHR& instance = instances[i];
-        instance.transform = transform;
-        instance.instanceCustomIndex = static_cast<uint32_t>(i);
-        instance.mask = 0xff;
-        instance.instanceShaderBindingTableRecordOffset = 0;
-        instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-        instance.accelerationStructureReference = mesh.m_BLAS.m_DeviceAddress;
+void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
+{
+    VULPIX_TRACE_SCOPE("buildTLAS");
+
+    // create instances for our meshes, each slice has room for a primary and a secondary ray one per mesh
+    const uint32_t maxInstances = getInstanceCapacity();
+    std::vector<VkAccelerationStructureInstanceKHR> instances(maxInstances * m_framesInFlight, VkAccelerationStructureInstanceKHR{});
+    m_instanceCounts.assign(m_framesInFlight, 0u);
+    for (uint32_t frame = 0; frame < m_framesInFlight; ++frame) {
+        m_instanceCounts[frame] = fillInstances(&instances[frame * maxInstances]);
     }
 
-    Buffer instancesBuffer;
-    VkResult error = instancesBuffer.createBuffer(instances.size() * sizeof(VkAccelerationStructureInstanceKHR),
+    // instances stay alive, TLAS refits and LOD switches read them again (one slice per frame in flight)
+    VkResult error = m_instances.createBuffer(instances.size() * sizeof(VkAccelerationStructureInstanceKHR),
         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     CHECK_VK_ERROR(error, "instancesBuffer.Create");
 
-    if (!instancesBuffer.uploadData(instances.data(), instancesBuffer.getSize())) {
+    if (!m_instances.uploadData(instances.data(), m_instances.getSize())) {
         assert(false && "Failed to upload instances buffer");
     }
 
@@ -39,7 +36,7 @@ void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
     // and here we create out top-level acceleration structure that'll represent our scene
     VkAccelerationStructureGeometryInstancesDataKHR tlasInstancesInfo = {};
     tlasInstancesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-    tlasInstancesInfo.data = vulpix::getBufferDeviceAddressConst(instancesBuffer);
+    tlasInstancesInfo.data = getInstancesAddress(0);
 
     VkAccelerationStructureGeometryKHR  tlasGeoInfo = {};
     tlasGeoInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
@@ -48,16 +45,21 @@ void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
 
     VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {};
     buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    m_TLASFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    // with LODs the instances point at other BLASes every now and then, so we rebuild instead of refit
+    if (hasDeformables() && !hasLods()) {
+        m_TLASFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    }
+
     buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
     buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-    buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    buildInfo.flags = m_TLASFlags;
     buildInfo.geometryCount = 1;
     buildInfo.pGeometries = &tlasGeoInfo;
 
-    const uint32_t numInstances = static_cast<uint32_t>(instances.size());
-
     VkAccelerationStructureBuildSizesInfoKHR sizeInfo = { VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
-    vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &numInstances, &sizeInfo);
+    // later LOD switches rebuild into the same TLAS, so size it for a full slice
+    vkGetAccelerationStructureBuildSizesKHR(device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &maxInstances, &sizeInfo);
 
     m_TLAS.m_Buffer.createBuffer(sizeInfo.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
@@ -70,6 +72,13 @@ void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
     error = vkCreateAccelerationStructureKHR(device, &createInfo, nullptr, &m_TLAS.m_AccelerationStructure);
     CHECK_VK_ERROR(error, "vkCreateAccelerationStructureKHR");
 
+    // one persistent scratch buffer serves every per-frame refit and rebuild
+    if (hasDeformables() || hasLods()) {
+        const VkDeviceSize updateScratchSize = std::max(m_deformScratchSize, std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize));
+        error = m_updateScratch.createBuffer(updateScratchSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CHECK_VK_ERROR(error, "updateScratch.Create");
+    }
+
 
     Buffer scratchBuffer;
     error = scratchBuffer.createBuffer(sizeInfo.buildScratchSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
@@ -95,7 +104,7 @@ void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
     VkAccelerationStructureBuildRangeInfoKHR range = {};
-    range.primitiveCount = numInstances;
+    range.primitiveCount = m_instanceCounts[0];
 
     const VkAccelerationStructureBuildRangeInfoKHR* ranges[1] = { &range };
 
@@ -121,51 +130,82 @@ void VulpixScene::buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
 
 void VulpixScene::buildBLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
 {
+    VULPIX_TRACE_SCOPE("buildBLAS");
+
     const size_t numMeshes = m_meshes.size();
 
-    std::vector<VkAccelerationStructureGeometryKHR> geometries(numMeshes, VkAccelerationStructureGeometryKHR{});
-    std::vector<VkAccelerationStructureBuildRangeInfoKHR> ranges(numMeshes, VkAccelerationStructureBuildRangeInfoKHR{});
-    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(numMeshes, VkAccelerationStructureBuildGeometryInfoKHR{});
-    std::vector<VkAccelerationStructureBuildSizesInfoKHR> sizeInfos(numMeshes, VkAccelerationStructureBuildSizesInfoKHR{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR });
+    if (hasDeformables()) {
+        createDeformBuffers();
+    }
 
+    // one BLAS per mesh LOD, deformed meshes only ever use their full LOD
+    std::vector<std::pair<uint32_t, uint32_t>> jobs;
+    m_hasLods = false;
     for (size_t i = 0; i < numMeshes; ++i) {
         VulpixMesh& mesh = m_meshes[i];
+        if (mesh.isDeformable()) {
+            mesh.m_lods.resize(1);
+        }
+        m_hasLods = m_hasLods || mesh.m_lods.size() > 1;
+
+        for (size_t lod = 0; lod < mesh.m_lods.size(); ++lod) {
+            jobs.emplace_back(static_cast<uint32_t>(i), static_cast<uint32_t>(lod));
+        }
+    }
 
-        VkAccelerationStructureGeometryKHR& geometry = geometries[i];
-        VkAccelerationStructureBuildRangeInfoKHR& range = ranges[i];
-        VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos[i];
+    const size_t numBLAS = jobs.size();
 
-        range.primitiveCount = mesh.m_faceCount;
+    std::vector<VkAccelerationStructureGeometryKHR> geometries(numBLAS * maxGeometriesPerBLAS, VkAccelerationStructureGeometryKHR{});
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> ranges(numBLAS * maxGeometriesPerBLAS, VkAccelerationStructureBuildRangeInfoKHR{});
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(numBLAS, VkAccelerationStructureBuildGeometryInfoKHR{});
+    std::vector<VkAccelerationStructureBuildSizesInfoKHR> sizeInfos(numBLAS, VkAccelerationStructureBuildSizesInfoKHR{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR });
 
-        geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-        geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-        geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    for (size_t i = 0; i < numBLAS; ++i) {
+        const VulpixMesh& mesh = m_meshes[jobs[i].first];
+        const VulpixMeshLod& lod = mesh.m_lods[jobs[i].second];
 
-        geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-        geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-        geometry.geometry.triangles.vertexData = vulpix::getBufferDeviceAddressConst(mesh.m_position);
-        geometry.geometry.triangles.vertexStride = sizeof(vulpix::math::vec3);
-        geometry.geometry.triangles.maxVertex = mesh.m_vertexCount;
-        geometry.geometry.triangles.indexData = vulpix::getBufferDeviceAddressConst(mesh.m_index);
-        geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+        VkAccelerationStructureGeometryKHR* geometry = &geometries[i * maxGeometriesPerBLAS];
+        VkAccelerationStructureBuildRangeInfoKHR* range = &ranges[i * maxGeometriesPerBLAS];
+        VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos[i];
+
+        const uint32_t geometryCount = fillBLASGeometries(mesh, lod, geometry, range);
 
         buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
         buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
         buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-        buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-        buildInfo.geometryCount = 1;
-        buildInfo.pGeometries = &geometry;
+        buildInfo.flags = mesh.isDeformable() ? deformBLASFlags : VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+        buildInfo.geometryCount = geometryCount;
+        buildInfo.pGeometries = geometry;
+
+        uint32_t maxPrimitiveCounts[maxGeometriesPerBLAS] = {};
+        for (uint32_t g = 0; g < geometryCount; ++g) {
+            maxPrimitiveCounts[g] = range[g].primitiveCount;
+        }
 
         vkGetAccelerationStructureBuildSizesKHR(device,
             VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
             &buildInfo,
-            &range.primitiveCount,
+            maxPrimitiveCounts,
             &sizeInfos[i]);
     }
 
     VkDeviceSize maximumBlasSize = 0;
+    VkDeviceSize totalBlasSize = 0;
     for (const auto& sizeInfo : sizeInfos) {
         maximumBlasSize = std::max(sizeInfo.buildScratchSize, maximumBlasSize);
+        totalBlasSize += sizeInfo.accelerationStructureSize;
+    }
+
+    // deformed meshes get refit / rebuilt later from a persistent scratch buffer
+    m_deformScratchSize = 0;
+    for (size_t i = 0; i < numBLAS; ++i) {
+        if (m_meshes[jobs[i].first].isDeformable()) {
+            m_deformScratchSize = std::max(m_deformScratchSize, std::max(sizeInfos[i].buildScratchSize, sizeInfos[i].updateScratchSize));
+        }
+    }
+
+    if (m_hasLods) {
+        std::cout << "BLAS: " << numBLAS << " for " << numMeshes << " meshes, " << (totalBlasSize >> 20) << " MB" << std::endl;
     }
 
     Buffer scratchBuffer;
@@ -193,27 +233,27 @@ void VulpixScene::buildBLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
     memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
 
     // build bottom-level ASs
-    for (size_t i = 0; i < numMeshes; ++i) {
-        VulpixMesh& mesh = m_meshes[i];
+    for (size_t i = 0; i < numBLAS; ++i) {
+        VulpixAccelerationStructure& blas = m_meshes[jobs[i].first].m_lods[jobs[i].second].m_BLAS;
 
-        mesh.m_BLAS.m_Buffer.createBuffer(sizeInfos[i].accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        blas.m_Buffer.createBuffer(sizeInfos[i].accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         VkAccelerationStructureCreateInfoKHR createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
         createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
         createInfo.size = sizeInfos[i].accelerationStructureSize;
-        createInfo.buffer = mesh.m_BLAS.m_Buffer.getBuffer();
+        createInfo.buffer = blas.m_Buffer.getBuffer();
 
-        error = vkCreateAccelerationStructureKHR(device, &createInfo, nullptr, &mesh.m_BLAS.m_AccelerationStructure);
+        error = vkCreateAccelerationStructureKHR(device, &createInfo, nullptr, &blas.m_AccelerationStructure);
         CHECK_VK_ERROR(error, "vkCreateAccelerationStructureKHR");
 
 
         VkAccelerationStructureBuildGeometryInfoKHR& buildInfo = buildInfos[i];
         buildInfo.scratchData = vulpix::getBufferDeviceAddress(scratchBuffer);
         buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
-        buildInfo.dstAccelerationStructure = mesh.m_BLAS.m_AccelerationStructure;
+        buildInfo.dstAccelerationStructure = blas.m_AccelerationStructure;
 
-        const VkAccelerationStructureBuildRangeInfoKHR* range[1] = { &ranges[i] };
+        const VkAccelerationStructureBuildRangeInfoKHR* range[1] = { &ranges[i * maxGeometriesPerBLAS] };
 
         vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, range);
 
@@ -237,12 +277,505 @@ void VulpixScene::buildBLAS(VkDevice device, VkCommandPool cPool, VkQueue queue)
     vkFreeCommandBuffers(device, cPool, 1, &commandBuffer);
 
     // get handles
-    for (size_t i = 0; i < numMeshes; ++i) {
-        VulpixMesh& mesh = m_meshes[i];
+    for (size_t i = 0; i < numBLAS; ++i) {
+        VulpixAccelerationStructure& blas = m_meshes[jobs[i].first].m_lods[jobs[i].second].m_BLAS;
 
         VkAccelerationStructureDeviceAddressInfoKHR addressInfo = {};
         addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-        addressInfo.accelerationStructure = mesh.m_BLAS.m_AccelerationStructure;
-        mesh.m_BLAS.m_DeviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device, &addressInfo);
+        addressInfo.accelerationStructure = blas.m_AccelerationStructure;
+        blas.m_DeviceAddress = vkGetAccelerationStructureDeviceAddressKHR(device, &addressInfo);
+    }
+
+    snapshotBuildPose();
+}
+
+bool VulpixScene::makeSkinned(const size_t meshIndex, const std::vector<SkinVertex>& skin, const uint32_t jointBase)
+{
+    if (meshIndex >= m_meshes.size() || skin.size() != m_meshes[meshIndex].getBaseVertexCount()) {
+        return false;
+    }
+
+    // only joints that actually carry weight count towards the drift estimate
+    uint32_t jointCount = 0;
+    for (const SkinVertex& v : skin) {
+        for (int k = 0; k < 4; ++k) {
+            if (v.m_weights[k] > 0.0f) {
+                jointCount = std::max(jointCount, v.m_joints[k] + 1);
+            }
+        }
+    }
+
+    if (jointBase + jointCount > VULPIX_MAX_JOINTS) {
+        return false;
+    }
+
+    if (!prepareDeformable(meshIndex, VULPIX_DEFORM_MODE_SKINNED, skin.data(), skin.size() * sizeof(SkinVertex))) {
+        return false;
+    }
+
+    VulpixMesh& mesh = m_meshes[meshIndex];
+    mesh.m_jointBase = jointBase;
+    mesh.m_jointCount = jointCount;
+    return true;
+}
+
+bool VulpixScene::makeVertexAnimated(const size_t meshIndex, const std::vector<MorphVertex>& target)
+{
+    if (meshIndex >= m_meshes.size() || target.size() != m_meshes[meshIndex].getBaseVertexCount()) {
+        return false;
+    }
+
+    if (!prepareDeformable(meshIndex, VULPIX_DEFORM_MODE_VERTEX_ANIMATED, target.data(), target.size() * sizeof(MorphVertex))) {
+        return false;
+    }
+
+    VulpixMesh& mesh = m_meshes[meshIndex];
+
+    const vec3* positions = reinterpret_cast<const vec3*>(mesh.m_restPosition.mapMemory());
+    if (positions) {
+        for (size_t i = 0; i < target.size(); ++i) {
+            mesh.m_maxMorphOffset = std::max(mesh.m_maxMorphOffset, glm::length(vec3(target[i].m_position) - positions[i]));
+        }
+        mesh.m_restPosition.unmapMemory();
+    }
+    return true;
+}
+
+void VulpixScene::setJointMatrices(const std::vector<mat4>& joints, const uint32_t firstJoint)
+{
+    assert(firstJoint + joints.size() <= m_joints.size());
+
+    std::copy(joints.begin(), joints.end(), m_joints.begin() + firstJoint);
+    m_jointsDirty = true;
+}
+
+void VulpixScene::setMorphWeight(const size_t meshIndex, const float weight)
+{
+    assert(meshIndex < m_meshes.size());
+    m_meshes[meshIndex].m_morphWeight = weight;
+}
+
+void VulpixScene::updateDeformables(const uint32_t frameIndex)
+{
+    if (!hasDeformables()) {
+        return;
+    }
+
+    // each frame in flight has its own palette and params slice, a changed palette has to reach all of them
+    if (m_jointsDirty) {
+        m_pendingJointUploads = m_framesInFlight;
+        m_jointsDirty = false;
+    }
+
+    if (!m_mappedJointPalette || !m_mappedDeformParams) {
+        return;
+    }
+
+    if (m_pendingJointUploads > 0) {
+        std::copy(m_joints.begin(), m_joints.end(), m_mappedJointPalette + frameIndex * VULPIX_MAX_JOINTS);
+        --m_pendingJointUploads;
+    }
+
+    const uint32_t numSlots = static_cast<uint32_t>(m_deformableMeshes.size());
+    DeformParams* params = m_mappedDeformParams + frameIndex * numSlots;
+
+    for (const uint32_t meshIdx : m_deformableMeshes) {
+        VulpixMesh& mesh = m_meshes[meshIdx];
+
+        DeformParams& meshParams = params[mesh.m_deformSlot];
+        meshParams.m_vertexCountModeJointBase = uvec4(mesh.getBaseVertexCount(), mesh.m_deformMode, frameIndex * VULPIX_MAX_JOINTS + mesh.m_jointBase, 0u);
+        meshParams.m_morphWeight = vec4(mesh.m_morphWeight, 0.0f, 0.0f, 0.0f);
+
+        // every frame refits once, the tree degrades with the number of refits and with how far we moved from the built pose
+        ++mesh.m_refitCount;
+        if (mesh.m_refitCount >= m_maxRefitsBeforeRebuild || computeDrift(mesh) > m_rebuildDriftThreshold) {
+            m_rebuildPending = true;
+        }
+    }
+}
+
+void VulpixScene::recordASUpdate(VkCommandBuffer commandBuffer, const uint32_t frameIndex)
+{
+    if (!needsASUpdate()) {
+        return;
+    }
+
+    // the builds share one scratch buffer, between two of them it needs a barrier of its own
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+    const VkDeviceOrHostAddressKHR scratchAddress = vulpix::getBufferDeviceAddress(m_updateScratch);
+
+    // refit bottom-level ASs in place, or rebuild them from the current pose into the same ASs (addresses and
+    // descriptors stay valid) once the refits degraded them too much. The render graph pass already waits for
+    // the rays of the previous frames, so nothing traces against them meanwhile
+    const bool rebuildBLAS = m_rebuildPending;
+    for (const uint32_t meshIdx : m_deformableMeshes) {
+        VulpixMesh& mesh = m_meshes[meshIdx];
+
+        VulpixAccelerationStructure& blas = mesh.m_lods[0].m_BLAS;
+
+        VkAccelerationStructureGeometryKHR geometries[maxGeometriesPerBLAS];
+        VkAccelerationStructureBuildRangeInfoKHR range[maxGeometriesPerBLAS];
+        const uint32_t geometryCount = fillBLASGeometries(mesh, mesh.m_lods[0], geometries, range);
+
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {};
+        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        buildInfo.mode = rebuildBLAS ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+        buildInfo.flags = deformBLASFlags;
+        buildInfo.geometryCount = geometryCount;
+        buildInfo.pGeometries = geometries;
+        buildInfo.srcAccelerationStructure = rebuildBLAS ? VK_NULL_HANDLE : blas.m_AccelerationStructure;
+        buildInfo.dstAccelerationStructure = blas.m_AccelerationStructure;
+        buildInfo.scratchData = scratchAddress;
+
+        const VkAccelerationStructureBuildRangeInfoKHR* ranges[1] = { range };
+
+        vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, ranges);
+
+        // guard our scratch buffer
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    // and the top-level one, instance bounds changed with the refits (or the LOD selection changed). A TLAS
+    // built for LODs can't be refit, so with LODs it is rebuilt whenever it has to change at all, and so it is
+    // after rebuilt BLASes
+    const bool rebuildTLAS = hasLods() || rebuildBLAS;
+
+    VkAccelerationStructureGeometryKHR tlasGeoInfo = {};
+    tlasGeoInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    tlasGeoInfo.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    tlasGeoInfo.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    tlasGeoInfo.geometry.instances.data = getInstancesAddress(frameIndex);
+
+    VkAccelerationStructureBuildGeometryInfoKHR tlasBuildInfo = {};
+    tlasBuildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    tlasBuildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    tlasBuildInfo.mode = rebuildTLAS ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+    tlasBuildInfo.flags = m_TLASFlags;
+    tlasBuildInfo.geometryCount = 1;
+    tlasBuildInfo.pGeometries = &tlasGeoInfo;
+    tlasBuildInfo.srcAccelerationStructure = rebuildTLAS ? VK_NULL_HANDLE : m_TLAS.m_AccelerationStructure;
+    tlasBuildInfo.dstAccelerationStructure = m_TLAS.m_AccelerationStructure;
+    tlasBuildInfo.scratchData = scratchAddress;
+
+    VkAccelerationStructureBuildRangeInfoKHR tlasRange = {};
+    tlasRange.primitiveCount = getInstanceCount(frameIndex);
+
+    const VkAccelerationStructureBuildRangeInfoKHR* tlasRanges[1] = { &tlasRange };
+
+    vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &tlasBuildInfo, tlasRanges);
+
+    if (rebuildBLAS) {
+        snapshotBuildPose();
+    }
+}
+
+bool VulpixScene::prepareDeformable(const size_t meshIndex, const uint32_t mode, const void* data, const VkDeviceSize dataSize)
+{
+    VulpixMesh& mesh = m_meshes[meshIndex];
+    if (mesh.isDeformable()) {
+        return false;
+    }
+
+    const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkResult error = mesh.m_restPosition.createBuffer(mesh.m_position.getSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory);
+    CHECK_VK_ERROR(error, "mesh.restPosition.Create");
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    error = mesh.m_restAttribute.createBuffer(mesh.m_attribute.getSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory);
+    CHECK_VK_ERROR(error, "mesh.restAttribute.Create");
+    if (VK_SUCCESS != error) {
+        return false;
+    }
+
+    error = mesh.m_deformData.createBuffer(dataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory);
+    CHECK_VK_ERROR(error, "mesh.deformData.Create");
+    if (VK_SUCCESS != error || !mesh.m_deformData.uploadData(const_cast<void*>(data), dataSize)) {
+        return false;
+    }
+
+    // mesh buffers live in host memory, so the rest pose is a plain copy
+    vec3* positions = reinterpret_cast<vec3*>(mesh.m_position.mapMemory());
+    if (!positions) {
+        return false;
+    }
+
+    vec3 boundsMin(FLT_MAX);
+    vec3 boundsMax(-FLT_MAX);
+    for (uint32_t i = 0; i < mesh.getBaseVertexCount(); ++i) {
+        boundsMin = glm::min(boundsMin, positions[i]);
+        boundsMax = glm::max(boundsMax, positions[i]);
+    }
+    mesh.m_boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    mesh.m_boundsRadius = std::max(glm::length(boundsMax - boundsMin) * 0.5f, 1e-4f);
+
+    mesh.m_restPosition.uploadData(positions, mesh.m_position.getSize());
+    mesh.m_position.unmapMemory();
+
+    void* attribs = mesh.m_attribute.mapMemory();
+    if (!attribs) {
+        return false;
+    }
+    mesh.m_restAttribute.uploadData(attribs, mesh.m_attribute.getSize());
+    mesh.m_attribute.unmapMemory();
+
+    if (m_joints.empty()) {
+        m_joints.assign(VULPIX_MAX_JOINTS, mat4(1.0f));
+    }
+
+    mesh.m_deformMode = mode;
+    mesh.m_deformSlot = static_cast<uint32_t>(m_deformableMeshes.size());
+    m_deformableMeshes.push_back(static_cast<uint32_t>(meshIndex));
+
+    return true;
+}
+
+void VulpixScene::createDeformBuffers()
+{
+    const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // one slice per frame in flight, the CPU writes the next frame's slice while the GPU reads the current one
+    VkResult error = m_jointPalette.createBuffer(m_framesInFlight * VULPIX_MAX_JOINTS * sizeof(mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory);
+    CHECK_VK_ERROR(error, "jointPalette.Create");
+
+    error = m_deformParams.createBuffer(m_framesInFlight * m_deformableMeshes.size() * sizeof(DeformParams), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostMemory);
+    CHECK_VK_ERROR(error, "deformParams.Create");
+
+    // coherent memory, both stay mapped until destroyDeformBuffers
+    m_mappedJointPalette = reinterpret_cast<mat4*>(m_jointPalette.mapMemory());
+    m_mappedDeformParams = reinterpret_cast<DeformParams*>(m_deformParams.mapMemory());
+
+    m_jointsDirty = true;
+    for (uint32_t frame = 0; frame < m_framesInFlight; ++frame) {
+        updateDeformables(frame);
+    }
+}
+
+uint32_t VulpixScene::fillBLASGeometries(const VulpixMesh& mesh, const VulpixMeshLod& lod, VkAccelerationStructureGeometryKHR* geometries, VkAccelerationStructureBuildRangeInfoKHR* ranges) const
+{
+    const uint32_t opaqueFaceCount = lod.m_faceCount - lod.m_alphaFaceCount;
+    const uint32_t geometryCount = (lod.m_alphaFaceCount > 0) ? 2 : 1;
+
+    for (uint32_t i = 0; i < geometryCount; ++i) {
+        VkAccelerationStructureGeometryKHR& geometry = geometries[i];
+        geometry = {};
+        geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+
+        geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+        geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+        geometry.geometry.triangles.vertexData = vulpix::getBufferDeviceAddressConst(mesh.m_position);
+        geometry.geometry.triangles.vertexStride = sizeof(vulpix::math::vec3);
+        geometry.geometry.triangles.maxVertex = mesh.m_vertexCount;
+        geometry.geometry.triangles.indexData = vulpix::getBufferDeviceAddressConst(mesh.m_index);
+        geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+
+        ranges[i] = {};
+    }
+
+    // opaque faces always go into geometry 0 (even if there are none) so the alpha tested ones
+    // are always geometry 1 and pick the any-hit groups from the SBT
+    geometries[0].flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+    ranges[0].primitiveCount = opaqueFaceCount;
+    ranges[0].primitiveOffset = lod.m_firstFace * 3 * sizeof(uint32_t);
+
+    if (geometryCount > 1) {
+        geometries[1].flags = VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR;
+        ranges[1].primitiveCount = lod.m_alphaFaceCount;
+        ranges[1].primitiveOffset = (lod.m_firstFace + opaqueFaceCount) * 3 * sizeof(uint32_t);
     }
+
+    return geometryCount;
+}
+
+void VulpixScene::destroyDeformBuffers()
+{
+    if (m_mappedJointPalette) {
+        m_jointPalette.unmapMemory();
+        m_mappedJointPalette = nullptr;
+    }
+    if (m_mappedDeformParams) {
+        m_deformParams.unmapMemory();
+        m_mappedDeformParams = nullptr;
+    }
+    m_jointPalette.destroyBuffer();
+    m_deformParams.destroyBuffer();
+}
+
+void VulpixScene::createMeshInfos()
+{
+    std::vector<MeshInfo> infos(m_meshes.size() * VULPIX_MAX_LODS, MeshInfo{ uvec4(0u) });
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        const VulpixMesh& mesh = m_meshes[i];
+        for (size_t l = 0; l < mesh.m_lods.size(); ++l) {
+            const VulpixMeshLod& lod = mesh.m_lods[l];
+            infos[i * VULPIX_MAX_LODS + l].m_faceRange = uvec4(lod.m_firstFace, lod.m_firstFace + lod.m_faceCount - lod.m_alphaFaceCount, lod.m_faceCount, 0u);
+        }
+    }
+
+    VkResult error = m_meshInfos.createBuffer(infos.size() * sizeof(MeshInfo), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    CHECK_VK_ERROR(error, "meshInfos.Create");
+
+    if (!m_meshInfos.uploadData(infos.data(), m_meshInfos.getSize())) {
+        assert(false && "Failed to upload mesh infos buffer");
+    }
+}
+
+uint32_t VulpixScene::fillInstances(VkAccelerationStructureInstanceKHR* instances) const
+{
+    const VkTransformMatrixKHR transform = {
+       1.0f, 0.0f, 0.0f, 0.0f,
+       0.0f, 1.0f, 0.0f, 0.0f,
+       0.0f, 0.0f, 1.0f, 0.0f,
+    };
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < m_meshes.size(); ++i) {
+        const VulpixMesh& mesh = m_meshes[i];
+        const uint32_t lods[2] = { mesh.m_primaryLod, mesh.m_secondaryLod };
+
+        // when both ray types agree one instance serves both, only differing LODs get a secondary ray instance
+        const bool shared = (mesh.m_primaryLod == mesh.m_secondaryLod);
+        const uint32_t masks[2] = {
+            shared ? (VULPIX_PRIMARY_RAY_MASK | VULPIX_SECONDARY_RAY_MASK) : VULPIX_PRIMARY_RAY_MASK,
+            VULPIX_SECONDARY_RAY_MASK
+        };
+
+        const uint32_t numInstances = shared ? 1 : 2;
+        for (uint32_t k = 0; k < numInstances; ++k) {
+            VkAccelerationStructureInstanceKHR& instance = instances[count++];
+            instance.transform = transform;
+            instance.instanceCustomIndex = static_cast<uint32_t>(i * VULPIX_MAX_LODS + lods[k]);
+            instance.mask = masks[k];
+            instance.instanceShaderBindingTableRecordOffset = 0;
+            instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+            instance.accelerationStructureReference = mesh.m_lods[lods[k]].m_BLAS.m_DeviceAddress;
+        }
+    }
+    return count;
+}
+
+uint32_t VulpixScene::getInstanceCapacity() const
+{
+    // without LODs both ray types always share the single LOD
+    return static_cast<uint32_t>(m_meshes.size() * (hasLods() ? 2 : 1));
+}
+
+uint32_t VulpixScene::selectLod(const VulpixMesh& mesh, const vec3& cameraPos, const float pixelsPerUnitAtOne, const float maxPixelError) const
+{
+    if (mesh.isDeformable()) {
+        return 0;
+    }
+
+    // project each LOD's error from the nearest point of the bounding sphere and take the coarsest one that stays below the limit
+    const float distance = glm::length(mesh.m_boundsCenter - cameraPos) - mesh.m_boundsRadius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    const float pixelsPerUnit = pixelsPerUnitAtOne / distance;
+
+    uint32_t selected = 0;
+    for (uint32_t l = 1; l < static_cast<uint32_t>(mesh.m_lods.size()); ++l) {
+        if (mesh.m_lods[l].m_error * pixelsPerUnit > maxPixelError) {
+            break;
+        }
+        selected = l;
+    }
+    return selected;
+}
+
+bool VulpixScene::updateLods(const uint32_t frameIndex, const vec3& cameraPos, const float fovY, const float viewportHeight)
+{
+    m_instancesChanged = false;
+    if (!hasLods()) {
+        return false;
+    }
+
+    // pixels covered by one world unit seen at distance one
+    const float pixelsPerUnitAtOne = viewportHeight / (2.0f * std::tan(glm::radians(fovY) * 0.5f));
+
+    bool changed = false;
+    for (VulpixMesh& mesh : m_meshes) {
+        const uint32_t primaryLod = selectLod(mesh, cameraPos, pixelsPerUnitAtOne, m_lodPixelError);
+        const uint32_t secondaryLod = m_secondaryRayLods ? selectLod(mesh, cameraPos, pixelsPerUnitAtOne, m_lodPixelError * m_secondaryLodBias) : primaryLod;
+
+        changed = changed || primaryLod != mesh.m_primaryLod || secondaryLod != mesh.m_secondaryLod;
+        mesh.m_primaryLod = primaryLod;
+        mesh.m_secondaryLod = secondaryLod;
+    }
+
+    // like the joint palette, a new selection has to reach every frame's instance slice
+    if (changed) {
+        m_pendingInstanceUploads = m_framesInFlight;
+    }
+
+    if (m_pendingInstanceUploads > 0) {
+        const VkDeviceSize sliceSize = getInstanceCapacity() * sizeof(VkAccelerationStructureInstanceKHR);
+        VkAccelerationStructureInstanceKHR* instances = reinterpret_cast<VkAccelerationStructureInstanceKHR*>(m_instances.mapMemory(sliceSize, frameIndex * sliceSize));
+        if (instances) {
+            m_instanceCounts[frameIndex] = fillInstances(instances);
+            m_instances.unmapMemory();
+        }
+        --m_pendingInstanceUploads;
+        m_instancesChanged = true;
+    }
+
+    return changed;
+}
+
+VkDeviceOrHostAddressConstKHR VulpixScene::getInstancesAddress(const uint32_t frameIndex) const
+{
+    VkDeviceOrHostAddressConstKHR address = vulpix::getBufferDeviceAddressConst(m_instances);
+    address.deviceAddress += frameIndex * getInstanceCapacity() * sizeof(VkAccelerationStructureInstanceKHR);
+    return address;
+}
+
+float VulpixScene::computeDrift(const VulpixMesh& mesh) const
+{
+    if (mesh.m_deformMode == VULPIX_DEFORM_MODE_VERTEX_ANIMATED) {
+        return std::abs(mesh.m_morphWeight - mesh.m_buildMorphWeight) * mesh.m_maxMorphOffset / mesh.m_boundsRadius;
+    }
+
+    if (mesh.m_jointCount == 0) {
+        return 0.0f;
+    }
+
+    // a rigid motion of the whole skeleton refits perfectly, only joints moving relative to each other hurt,
+    // so compare every joint's motion since the build against the first one, measured on the bounding sphere
+    const mat4 reference = m_joints[mesh.m_jointBase] * glm::inverse(m_buildJoints[mesh.m_jointBase]);
+
+    float drift = 0.0f;
+    for (uint32_t j = mesh.m_jointBase; j < mesh.m_jointBase + mesh.m_jointCount; ++j) {
+        const mat4 delta = m_joints[j] * glm::inverse(m_buildJoints[j]) - reference;
+
+        const float centerOffset = glm::length(vec3(delta * vec4(mesh.m_boundsCenter, 1.0f)));
+        const float axisOffset = std::max(glm::length(vec3(delta[0])), std::max(glm::length(vec3(delta[1])), glm::length(vec3(delta[2]))));
+
+        drift = std::max(drift, centerOffset / mesh.m_boundsRadius + axisOffset);
+    }
+    return drift;
+}
+
+void VulpixScene::snapshotBuildPose()
+{
+    m_buildJoints = m_joints;
+
+    for (const uint32_t meshIdx : m_deformableMeshes) {
+        VulpixMesh& mesh = m_meshes[meshIdx];
+        mesh.m_refitCount = 0;
+        mesh.m_buildMorphWeight = mesh.m_morphWeight;
+    }
+
+    m_rebuildPending = false;
 }
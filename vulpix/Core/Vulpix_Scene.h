@@ -17,11 +17,88 @@ public:
 	std::vector< VkDescriptorBufferInfo> m_attributesBufferInfos;
 	std::vector< VkDescriptorBufferInfo> m_facesBufferInfos;
 
+	// one MeshInfo per mesh LOD (VULPIX_MAX_LODS slots per mesh)
+	Buffer m_meshInfos;
+
+	// deformable meshes (indices into m_meshes, ordered by deform slot)
+	std::vector<uint32_t> m_deformableMeshes;
+	Buffer m_jointPalette;
+	Buffer m_deformParams;
+
+	// host written per-frame data (instances, joint palette, deform params) is sliced this many times,
+	// has to be set before buildBLAS
+	uint32_t m_framesInFlight = 1;
+
+	// refit tuning
+	uint32_t m_maxRefitsBeforeRebuild = 240;
+	float m_rebuildDriftThreshold = 0.25f; // relative to the mesh bounding radius
+
+	// LOD selection tuning
+	float m_lodPixelError = 1.0f;    // max projected simplification error of primary rays, in pixels
+	bool m_secondaryRayLods = true;  // let shadow / bounce rays use coarser LODs than primary rays
+	float m_secondaryLodBias = 4.0f; // secondary rays tolerate this many times the primary error
 
 public:
 	void buildTLAS(VkDevice device, VkCommandPool cPool, VkQueue queue);
 	void buildBLAS(VkDevice device, VkCommandPool cPool, VkQueue queue);
+	void createMeshInfos();
+	void destroyDeformBuffers();
+
+	// deformation, the make* calls must happen before buildBLAS
+	bool makeSkinned(const size_t meshIndex, const std::vector<SkinVertex>& skin, const uint32_t jointBase = 0);
+	bool makeVertexAnimated(const size_t meshIndex, const std::vector<MorphVertex>& target);
+	void setJointMatrices(const std::vector<mat4>& joints, const uint32_t firstJoint = 0);
+	void setMorphWeight(const size_t meshIndex, const float weight);
+
+	bool hasDeformables() const { return !m_deformableMeshes.empty(); }
+	bool needsRebuild() const { return m_rebuildPending; }
+	bool hasLods() const { return m_hasLods; }
+	// TLAS instances of a frame's slice, one per mesh plus one for every mesh whose secondary rays use another LOD
+	uint32_t getInstanceCount(const uint32_t frameIndex) const { return m_instanceCounts[frameIndex]; }
+	// deformed meshes refit every frame, otherwise only a new LOD selection in this frame's instances needs a TLAS build
+	bool needsASUpdate() const { return hasDeformables() || m_instancesChanged; }
+
+	// per frame: picks mesh LODs for the camera and rewrites this frame's instances if the selection changed
+	// (or another frame's slice changed before), the TLAS is then rebuilt by recordASUpdate
+	bool updateLods(const uint32_t frameIndex, const vec3& cameraPos, const float fovY, const float viewportHeight);
+
+	// per frame: upload deform params and track refit quality
+	void updateDeformables(const uint32_t frameIndex);
+	// records BLAS refits of deformed meshes (full rebuilds when needsRebuild) followed by a TLAS refit (or
+	// rebuild with LODs), nothing when needsASUpdate is false. Only the barriers between the builds are recorded,
+	// the caller's render graph pass orders the whole update against the rays
+	void recordASUpdate(VkCommandBuffer commandBuffer, const uint32_t frameIndex);
+
+private:
+	bool prepareDeformable(const size_t meshIndex, const uint32_t mode, const void* data, const VkDeviceSize dataSize);
+	void createDeformBuffers();
+	uint32_t fillBLASGeometries(const VulpixMesh& mesh, const VulpixMeshLod& lod, VkAccelerationStructureGeometryKHR* geometries, VkAccelerationStructureBuildRangeInfoKHR* ranges) const;
+	uint32_t fillInstances(VkAccelerationStructureInstanceKHR* instances) const;
+	uint32_t getInstanceCapacity() const;
+	VkDeviceOrHostAddressConstKHR getInstancesAddress(const uint32_t frameIndex) const;
+	uint32_t selectLod(const VulpixMesh& mesh, const vec3& cameraPos, const float pixelsPerUnitAtOne, const float maxPixelError) const;
+	float computeDrift(const VulpixMesh& mesh) const;
+	void snapshotBuildPose();
+
+private:
+	Buffer m_instances;
+	std::vector<uint32_t> m_instanceCounts; // per frame slice
+	Buffer m_updateScratch;
+	VkDeviceSize m_deformScratchSize = 0;
+	VkBuildAccelerationStructureFlagsKHR m_TLASFlags = 0;
+
+	std::vector<mat4> m_joints;
+	std::vector<mat4> m_buildJoints;
+	// both buffers with all their frame slices, mapped from createDeformBuffers to destroyDeformBuffers
+	mat4* m_mappedJointPalette = nullptr;
+	DeformParams* m_mappedDeformParams = nullptr;
+	bool m_jointsDirty = false;
+	uint32_t m_pendingJointUploads = 0;
+	uint32_t m_pendingInstanceUploads = 0;
+	bool m_instancesChanged = false; // this frame's slice was rewritten by updateLods
+	bool m_rebuildPending = false;
+	bool m_hasLods = false;
 };
 
 
-#endif // VULPIX_SCENE_H
\ No newline at end of file
+#endif // VULPIX_SCENE_H
@@ -0,0 +1,78 @@
+#include "Vulpix_SceneLoader.h"
+
+#include "Vulpix_Trace.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <cassert>
+
+namespace vulpix
+{
+	bool loadObjScene(const std::string& fileName, std::vector<VulpixMeshData>& meshData, std::vector<SceneMaterialFiles>& materials)
+	{
+		VULPIX_TRACE_SCOPE("loadObjScene");
+
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> objMaterials;
+		std::string warn, error;
+
+		const size_t slash = fileName.find_last_of('/');
+		const std::string baseDir = (slash != std::string::npos) ? fileName.substr(0, slash) : std::string(".");
+
+		meshData.clear();
+		materials.clear();
+
+		if (!tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &error, fileName.c_str(), baseDir.c_str(), true)) {
+			return false;
+		}
+
+		meshData.resize(shapes.size());
+
+		for (size_t meshIdx = 0; meshIdx < shapes.size(); ++meshIdx) {
+			VulpixMeshData& data = meshData[meshIdx];
+			const tinyobj::shape_t& shape = shapes[meshIdx];
+
+			const size_t numFaces = shape.mesh.num_face_vertices.size();
+			const size_t numVertices = numFaces * 3;
+
+			data.m_positions.resize(numVertices);
+			data.m_attributes.resize(numVertices);
+			data.m_materialIDs.resize(numFaces);
+			data.m_objectIDs.assign(numFaces, static_cast<uint32_t>(meshIdx));
+
+			size_t vIdx = 0;
+			for (size_t f = 0; f < numFaces; ++f) {
+				assert(shape.mesh.num_face_vertices[f] == 3);
+				for (size_t j = 0; j < 3; ++j, ++vIdx) {
+					const tinyobj::index_t& i = shape.mesh.indices[vIdx];
+
+					vec3& pos = data.m_positions[vIdx];
+					vec4& normal = data.m_attributes[vIdx].m_normal;
+					vec4& uv = data.m_attributes[vIdx].m_uv;
+
+					pos.x = attrib.vertices[3 * i.vertex_index + 0];
+					pos.y = attrib.vertices[3 * i.vertex_index + 1];
+					pos.z = attrib.vertices[3 * i.vertex_index + 2];
+					normal.x = attrib.normals[3 * i.normal_index + 0];
+					normal.y = attrib.normals[3 * i.normal_index + 1];
+					normal.z = attrib.normals[3 * i.normal_index + 2];
+					uv.x = attrib.texcoords[2 * i.texcoord_index + 0];
+					uv.y = attrib.texcoords[2 * i.texcoord_index + 1];
+				}
+
+				data.m_materialIDs[f] = static_cast<uint32_t>(shape.mesh.material_ids[f]);
+			}
+		}
+
+		materials.resize(objMaterials.size());
+		for (size_t i = 0; i < objMaterials.size(); ++i) {
+			const tinyobj::material_t& srcMat = objMaterials[i];
+			materials[i].m_texture = baseDir + "/" + srcMat.diffuse_texname;
+			materials[i].m_alphaTexture = srcMat.alpha_texname.empty() ? std::string() : baseDir + "/" + srcMat.alpha_texname;
+		}
+
+		return true;
+	}
+} // namespace vulpix
@@ -0,0 +1,33 @@
+#ifndef VULPIX_SCENE_LOADER_H
+#define VULPIX_SCENE_LOADER_H
+
+#include "../Common.h"
+#include "Vulpix_MeshData.h"
+
+// the texture files of an OBJ material
+struct SceneMaterialFiles
+{
+	std::string m_texture;
+	std::string m_alphaTexture; // empty when the material has none
+};
+
+namespace vulpix
+{
+	// everything the scene is lit and seen with besides its files, the ray tracing pipeline and the CPU tracer
+	// have to agree on these
+	const char* const SCENE_DEFAULT_FILE = "assets/scene/sponza/vulpix_sponza.obj";
+	const math::vec3 SCENE_SUN_POSITION = math::vec3(1474.4f, 1940.45f, 397.55f);
+	const float SCENE_AMBIENT_LIGHT = 0.1f;
+	const char* const SCENE_ENVIRONMENT_MAP = "assets/env_map/blue_photo_studio_4k.hdr";
+	const float SCENE_CAMERA_NEAR = 0.1f;
+	const float SCENE_CAMERA_FAR = 10000.0f;
+	const float SCENE_CAMERA_FOV = 45.0f; // vertical, degrees
+	const uint32_t SCENE_RESOLUTION_X = 2560; // the frame size, and that of new golden references
+	const uint32_t SCENE_RESOLUTION_Y = 1440;
+
+	// one mesh per shape with three unshared vertices per face, the object id of every face is the shape it came
+	// from. Texture paths are next to the OBJ file. False when the file can't be read
+	bool loadObjScene(const std::string& fileName, std::vector<VulpixMeshData>& meshData, std::vector<SceneMaterialFiles>& materials);
+} // namespace vulpix
+
+#endif // VULPIX_SCENE_LOADER_H
@@ -0,0 +1,631 @@
+#include "Vulpix_TileNetwork.h"
+#include "Vulpix_Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+	const VulpixSocket NO_SOCKET = static_cast<VulpixSocket>(INVALID_SOCKET);
+	const int SEND_FLAGS = 0;
+	const int SHUTDOWN_BOTH = SD_BOTH;
+
+	void closeSocket(const VulpixSocket socket) { closesocket(static_cast<SOCKET>(socket)); }
+	void sleepMs(const uint32_t ms) { Sleep(ms); }
+
+	bool initSockets()
+	{
+		static const bool initialized = []()
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		return initialized;
+	}
+#else
+	const VulpixSocket NO_SOCKET = -1;
+	// a closed peer fails the send instead of ending the process
+	const int SEND_FLAGS = MSG_NOSIGNAL;
+	const int SHUTDOWN_BOTH = SHUT_RDWR;
+
+	void closeSocket(const VulpixSocket socket) { close(socket); }
+	void sleepMs(const uint32_t ms) { usleep(ms * 1000); }
+	bool initSockets() { return true; }
+#endif
+
+	const uint32_t TILE_PROTOCOL_MAGIC = 0x54585056; // "VPXT"
+	const uint32_t TILE_PROTOCOL_VERSION = 1;
+	// tiles a worker holds, one renders while the other's result and the next job are on the wire
+	const uint32_t MAX_TILES_IN_FLIGHT = 2;
+	// workers rendering one tile at the same time, the original and one that took it over
+	const uint32_t MAX_TILE_ASSIGNMENTS = 2;
+
+	enum class TileMessage : uint32_t
+	{
+		Hello,   // worker -> coordinator, TileHelloMessage
+		Welcome, // coordinator -> worker, the tile size
+		Job,     // coordinator -> worker, TileJobMessage
+		Result,  // worker -> coordinator, TileResultMessage and the pixels
+		Done,    // coordinator -> worker, nothing left to render
+	};
+
+	struct TileMessageHeader
+	{
+		uint32_t m_type;
+		uint32_t m_size; // of the payload after the header
+	};
+
+	struct TileHelloMessage
+	{
+		uint32_t m_magic;
+		uint32_t m_version;
+	};
+
+	struct TileJobMessage
+	{
+		uint32_t m_tile;
+		uint32_t m_x;
+		uint32_t m_y;
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_imageWidth;
+		uint32_t m_imageHeight;
+		uint32_t m_samples;
+		float m_position[3];
+		float m_forward[3];
+	};
+
+	struct TileResultMessage
+	{
+		uint32_t m_tile;
+		uint32_t m_width;
+		uint32_t m_height;
+	};
+
+	bool sendAll(const VulpixSocket socket, const void* data, const size_t size)
+	{
+		const char* bytes = reinterpret_cast<const char*>(data);
+		size_t sent = 0;
+		while (sent < size)
+		{
+			const int chunk = static_cast<int>(std::min<size_t>(size - sent, 1 << 20));
+			const auto result = ::send(socket, bytes + sent, chunk, SEND_FLAGS);
+			if (result <= 0)
+			{
+				return false;
+			}
+			sent += static_cast<size_t>(result);
+		}
+		return true;
+	}
+
+	bool receiveAll(const VulpixSocket socket, void* data, const size_t size)
+	{
+		char* bytes = reinterpret_cast<char*>(data);
+		size_t received = 0;
+		while (received < size)
+		{
+			const int chunk = static_cast<int>(std::min<size_t>(size - received, 1 << 20));
+			const auto result = ::recv(socket, bytes + received, chunk, 0);
+			if (result <= 0)
+			{
+				return false;
+			}
+			received += static_cast<size_t>(result);
+		}
+		return true;
+	}
+
+	bool sendMessage(const VulpixSocket socket, const TileMessage type, const void* payload, const uint32_t size)
+	{
+		const TileMessageHeader header = { static_cast<uint32_t>(type), size };
+		return sendAll(socket, &header, sizeof(header)) && (size == 0 || sendAll(socket, payload, size));
+	}
+
+	// the header, and the payload when it has the expected size
+	bool receiveMessage(const VulpixSocket socket, const TileMessage type, void* payload, const uint32_t size)
+	{
+		TileMessageHeader header;
+		if (!receiveAll(socket, &header, sizeof(header)) || header.m_type != static_cast<uint32_t>(type) || header.m_size != size)
+		{
+			return false;
+		}
+		return size == 0 || receiveAll(socket, payload, size);
+	}
+
+	void setNoDelay(const VulpixSocket socket)
+	{
+		// small job messages would otherwise wait for the last result's acknowledgement
+		const int noDelay = 1;
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+	}
+} // namespace
+
+VulpixTileCoordinator::VulpixTileCoordinator()
+{
+	m_tileSize = 0;
+	m_finishedTiles = 0;
+	m_duplicateTiles = 0;
+	m_finishedJobs = 0;
+	m_failedJobs = 0;
+}
+
+VulpixTileCoordinator::~VulpixTileCoordinator()
+{
+}
+
+bool VulpixTileCoordinator::run(const uint16_t port, const std::vector<RenderJob>& jobs, const uint32_t tileSize)
+{
+	if (!initSockets())
+	{
+		return false;
+	}
+
+	m_jobs = jobs;
+	m_tileSize = tileSize;
+	m_tiles.clear();
+	m_pending.clear();
+	m_images.assign(jobs.size(), std::vector<uint8_t>());
+	m_remainingTiles.assign(jobs.size(), 0);
+	m_finishedTiles = 0;
+	m_duplicateTiles = 0;
+	m_finishedJobs = 0;
+	m_failedJobs = 0;
+
+	// jobs in file order, each row by row, so the first images are written while the later ones still render
+	for (uint32_t jobIndex = 0; jobIndex < jobs.size(); ++jobIndex)
+	{
+		const RenderJob& job = jobs[jobIndex];
+		m_images[jobIndex].resize(static_cast<size_t>(job.m_width) * job.m_height * 4);
+		for (uint32_t y = 0; y < job.m_height; y += tileSize)
+		{
+			for (uint32_t x = 0; x < job.m_width; x += tileSize)
+			{
+				Tile tile;
+				tile.m_job = jobIndex;
+				tile.m_x = x;
+				tile.m_y = y;
+				tile.m_width = std::min(tileSize, job.m_width - x);
+				tile.m_height = std::min(tileSize, job.m_height - y);
+				m_pending.push_back(static_cast<uint32_t>(m_tiles.size()));
+				m_tiles.push_back(tile);
+				++m_remainingTiles[jobIndex];
+			}
+		}
+	}
+
+	const VulpixSocket listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == NO_SOCKET)
+	{
+		return false;
+	}
+
+	const int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 16) != 0)
+	{
+		std::cout << "Could not listen on port " << port << std::endl;
+		closeSocket(listener);
+		return false;
+	}
+
+	std::cout << "Coordinator: " << jobs.size() << " jobs in " << m_tiles.size() << " tiles of up to " << tileSize << "x" << tileSize
+		<< ", waiting for workers on port " << port << std::endl;
+
+	const uint64_t startTime = vulpix::trace::now();
+	for (;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_finishedTiles == m_tiles.size())
+			{
+				break;
+			}
+		}
+
+		// wakes up now and then to see whether the workers are done
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listener, &readable);
+		timeval timeout = { 0, 100000 };
+		if (::select(static_cast<int>(listener + 1), &readable, nullptr, nullptr, &timeout) <= 0)
+		{
+			continue;
+		}
+
+		const VulpixSocket socket = ::accept(listener, nullptr, nullptr);
+		if (socket == NO_SOCKET)
+		{
+			continue;
+		}
+		setNoDelay(socket);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const uint32_t workerIndex = static_cast<uint32_t>(m_connections.size());
+		std::unique_ptr<Connection> connection(new Connection());
+		connection->m_socket = socket;
+		m_connections.push_back(std::move(connection));
+		m_connections.back()->m_thread = std::thread(&VulpixTileCoordinator::serveWorker, this, workerIndex);
+	}
+	const double seconds = static_cast<double>(vulpix::trace::now() - startTime) * 1e-9;
+
+	closeSocket(listener);
+
+	// workers still rendering a duplicate are cut off, they take the closed connection as the end of the batch
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (std::unique_ptr<Connection>& connection : m_connections)
+		{
+			::shutdown(connection->m_socket, SHUTDOWN_BOTH);
+			threads.push_back(std::move(connection->m_thread));
+		}
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::cout << "Coordinator: " << m_finishedJobs - m_failedJobs << " of " << m_finishedJobs << " images written in " << seconds << " s by "
+		<< m_connections.size() << " workers, " << m_duplicateTiles << " tiles rendered twice" << std::endl;
+	for (size_t i = 0; i < m_connections.size(); ++i)
+	{
+		std::cout << "  worker " << i << ": " << m_connections[i]->m_tiles << " tiles" << std::endl;
+		closeSocket(m_connections[i]->m_socket);
+	}
+	m_connections.clear();
+
+	return m_failedJobs == 0;
+}
+
+uint32_t VulpixTileCoordinator::acquireTile(const std::vector<uint32_t>& held, const bool wait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		if (m_finishedTiles == m_tiles.size())
+		{
+			return UINT32_MAX;
+		}
+
+		if (!m_pending.empty())
+		{
+			const uint32_t tileIndex = m_pending.front();
+			m_pending.pop_front();
+			Tile& tile = m_tiles[tileIndex];
+			tile.m_assignments = 1;
+			tile.m_assignTime = vulpix::trace::now();
+			return tileIndex;
+		}
+
+		// nothing new to render, take over the tile that has been in flight the longest
+		uint32_t stolen = UINT32_MAX;
+		for (uint32_t i = 0; i < m_tiles.size(); ++i)
+		{
+			const Tile& tile = m_tiles[i];
+			if (tile.m_done || tile.m_assignments == 0 || tile.m_assignments >= MAX_TILE_ASSIGNMENTS ||
+				std::find(held.begin(), held.end(), i) != held.end())
+			{
+				continue;
+			}
+			if (stolen == UINT32_MAX || tile.m_assignTime < m_tiles[stolen].m_assignTime)
+			{
+				stolen = i;
+			}
+		}
+		if (stolen != UINT32_MAX)
+		{
+			++m_tiles[stolen].m_assignments;
+			return stolen;
+		}
+
+		if (!wait)
+		{
+			return UINT32_MAX;
+		}
+		m_tilesChanged.wait(lock);
+	}
+}
+
+void VulpixTileCoordinator::completeTile(const uint32_t workerIndex, const uint32_t tileIndex, const uint8_t* pixels)
+{
+	std::vector<uint8_t> image;
+	uint32_t jobIndex = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Tile& tile = m_tiles[tileIndex];
+		--tile.m_assignments;
+		if (tile.m_done)
+		{
+			++m_duplicateTiles;
+			return;
+		}
+
+		jobIndex = tile.m_job;
+		const size_t imagePitch = static_cast<size_t>(m_jobs[jobIndex].m_width) * 4;
+		const size_t tilePitch = static_cast<size_t>(tile.m_width) * 4;
+		uint8_t* target = m_images[jobIndex].data() + tile.m_y * imagePitch + tile.m_x * 4;
+		for (uint32_t row = 0; row < tile.m_height; ++row)
+		{
+			std::memcpy(target + row * imagePitch, pixels + row * tilePitch, tilePitch);
+		}
+
+		tile.m_done = true;
+		++m_finishedTiles;
+		++m_connections[workerIndex]->m_tiles;
+		if (--m_remainingTiles[jobIndex] == 0)
+		{
+			image.swap(m_images[jobIndex]);
+		}
+	}
+	m_tilesChanged.notify_all();
+
+	if (image.empty())
+	{
+		return;
+	}
+
+	const RenderJob& job = m_jobs[jobIndex];
+	const bool written = vulpix::writeRenderJobImage(job, image.data());
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	++m_finishedJobs;
+	m_failedJobs += written ? 0 : 1;
+	std::cout << "Batch " << m_finishedJobs << "/" << m_jobs.size() << ": " << (written ? "" : "could not write ") << job.m_output << std::endl;
+}
+
+void VulpixTileCoordinator::releaseTile(const uint32_t tileIndex)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Tile& tile = m_tiles[tileIndex];
+		if (--tile.m_assignments == 0 && !tile.m_done)
+		{
+			m_pending.push_front(tileIndex);
+		}
+	}
+	m_tilesChanged.notify_all();
+}
+
+void VulpixTileCoordinator::serveWorker(const uint32_t workerIndex)
+{
+	VulpixSocket socket;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		socket = m_connections[workerIndex]->m_socket;
+	}
+
+	TileHelloMessage hello;
+	if (!receiveMessage(socket, TileMessage::Hello, &hello, sizeof(hello)) || hello.m_magic != TILE_PROTOCOL_MAGIC ||
+		hello.m_version != TILE_PROTOCOL_VERSION || !sendMessage(socket, TileMessage::Welcome, &m_tileSize, sizeof(m_tileSize)))
+	{
+		std::cout << "Coordinator: worker " << workerIndex << " does not speak the tile protocol" << std::endl;
+		return;
+	}
+	std::cout << "Coordinator: worker " << workerIndex << " connected" << std::endl;
+
+	std::vector<uint32_t> held;
+	std::vector<uint8_t> pixels;
+	bool connected = true;
+	while (connected)
+	{
+		// only a worker that holds nothing waits for work, the others first return what they have
+		while (held.size() < MAX_TILES_IN_FLIGHT)
+		{
+			const uint32_t tileIndex = acquireTile(held, held.empty());
+			if (tileIndex == UINT32_MAX)
+			{
+				break;
+			}
+
+			const Tile& tile = m_tiles[tileIndex];
+			const RenderJob& job = m_jobs[tile.m_job];
+			const TileJobMessage message = { tileIndex, tile.m_x, tile.m_y, tile.m_width, tile.m_height, job.m_width, job.m_height, job.m_samples,
+				{ job.m_position.x, job.m_position.y, job.m_position.z }, { job.m_forward.x, job.m_forward.y, job.m_forward.z } };
+			held.push_back(tileIndex);
+			if (!sendMessage(socket, TileMessage::Job, &message, sizeof(message)))
+			{
+				connected = false;
+				break;
+			}
+		}
+
+		if (!connected)
+		{
+			break;
+		}
+		if (held.empty())
+		{
+			sendMessage(socket, TileMessage::Done, nullptr, 0);
+			break;
+		}
+
+		TileMessageHeader header;
+		TileResultMessage result;
+		if (!receiveAll(socket, &header, sizeof(header)) || header.m_type != static_cast<uint32_t>(TileMessage::Result) ||
+			header.m_size < sizeof(result) || !receiveAll(socket, &result, sizeof(result)))
+		{
+			break;
+		}
+
+		const auto heldTile = std::find(held.begin(), held.end(), result.m_tile);
+		if (heldTile == held.end() || result.m_width != m_tiles[result.m_tile].m_width || result.m_height != m_tiles[result.m_tile].m_height ||
+			header.m_size != sizeof(result) + static_cast<size_t>(result.m_width) * result.m_height * 4)
+		{
+			std::cout << "Coordinator: worker " << workerIndex << " sent a tile it wasn't given" << std::endl;
+			break;
+		}
+
+		pixels.resize(header.m_size - sizeof(result));
+		if (!receiveAll(socket, pixels.data(), pixels.size()))
+		{
+			break;
+		}
+
+		held.erase(heldTile);
+		completeTile(workerIndex, result.m_tile, pixels.data());
+	}
+
+	// whatever it still held goes to the others
+	for (const uint32_t tileIndex : held)
+	{
+		releaseTile(tileIndex);
+	}
+}
+
+VulpixTileClient::VulpixTileClient()
+{
+	m_socket = NO_SOCKET;
+	m_tileSize = 0;
+}
+
+VulpixTileClient::~VulpixTileClient()
+{
+	disconnect();
+}
+
+bool VulpixTileClient::connectTo(const std::string& address, const uint32_t timeoutSeconds)
+{
+	disconnect();
+	if (!initSockets())
+	{
+		return false;
+	}
+
+	const size_t colon = address.rfind(':');
+	if (colon == std::string::npos)
+	{
+		std::cout << "The coordinator address needs a port, host:port" << std::endl;
+		return false;
+	}
+	const std::string host = address.substr(0, colon);
+	const std::string port = address.substr(colon + 1);
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	const uint64_t deadline = vulpix::trace::now() + static_cast<uint64_t>(timeoutSeconds) * 1000000000ull;
+	while (m_socket == NO_SOCKET)
+	{
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) == 0)
+		{
+			for (const addrinfo* info = addresses; info && m_socket == NO_SOCKET; info = info->ai_next)
+			{
+				const VulpixSocket socket = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+				if (socket == NO_SOCKET)
+				{
+					continue;
+				}
+				if (::connect(socket, info->ai_addr, static_cast<int>(info->ai_addrlen)) == 0)
+				{
+					m_socket = socket;
+				}
+				else
+				{
+					closeSocket(socket);
+				}
+			}
+			freeaddrinfo(addresses);
+		}
+
+		if (m_socket == NO_SOCKET)
+		{
+			if (vulpix::trace::now() > deadline)
+			{
+				std::cout << "Could not connect to the coordinator at " << address << std::endl;
+				return false;
+			}
+			sleepMs(250);
+		}
+	}
+	setNoDelay(m_socket);
+
+	const TileHelloMessage hello = { TILE_PROTOCOL_MAGIC, TILE_PROTOCOL_VERSION };
+	if (!sendMessage(m_socket, TileMessage::Hello, &hello, sizeof(hello)) ||
+		!receiveMessage(m_socket, TileMessage::Welcome, &m_tileSize, sizeof(m_tileSize)) || m_tileSize == 0)
+	{
+		std::cout << "The coordinator at " << address << " did not answer" << std::endl;
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+void VulpixTileClient::disconnect()
+{
+	if (m_socket != NO_SOCKET)
+	{
+		closeSocket(m_socket);
+		m_socket = NO_SOCKET;
+	}
+}
+
+bool VulpixTileClient::receiveJob(RenderJob& job)
+{
+	if (m_socket == NO_SOCKET)
+	{
+		return false;
+	}
+
+	TileMessageHeader header;
+	TileJobMessage message;
+	if (!receiveAll(m_socket, &header, sizeof(header)) || header.m_type != static_cast<uint32_t>(TileMessage::Job) ||
+		header.m_size != sizeof(message) || !receiveAll(m_socket, &message, sizeof(message)))
+	{
+		// Done, or the connection is gone
+		return false;
+	}
+
+	job = RenderJob();
+	job.m_samples = message.m_samples;
+	job.m_width = message.m_width;
+	job.m_height = message.m_height;
+	job.m_position = vulpix::math::vec3(message.m_position[0], message.m_position[1], message.m_position[2]);
+	job.m_forward = vulpix::math::vec3(message.m_forward[0], message.m_forward[1], message.m_forward[2]);
+	job.m_tile = message.m_tile;
+	job.m_tileX = message.m_x;
+	job.m_tileY = message.m_y;
+	job.m_imageWidth = message.m_imageWidth;
+	job.m_imageHeight = message.m_imageHeight;
+	return true;
+}
+
+bool VulpixTileClient::sendResult(const uint32_t tile, const uint8_t* pixels, const uint32_t width, const uint32_t height)
+{
+	std::lock_guard<std::mutex> lock(m_sendMutex);
+	if (m_socket == NO_SOCKET)
+	{
+		return false;
+	}
+
+	const size_t size = static_cast<size_t>(width) * height * 4;
+	const TileResultMessage result = { tile, width, height };
+	const TileMessageHeader header = { static_cast<uint32_t>(TileMessage::Result), static_cast<uint32_t>(sizeof(result) + size) };
+	return sendAll(m_socket, &header, sizeof(header)) && sendAll(m_socket, &result, sizeof(result)) && sendAll(m_socket, pixels, size);
+}
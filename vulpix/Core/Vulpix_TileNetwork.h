@@ -0,0 +1,103 @@
+#ifndef VULPIX_TILE_NETWORK_H
+#define VULPIX_TILE_NETWORK_H
+
+#include "../Common.h"
+#include "Vulpix_RenderJob.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+using VulpixSocket = uintptr_t;
+#else
+using VulpixSocket = int;
+#endif
+
+// Batch rendering across processes. The coordinator splits every job of a batch into tiles and serves them over
+// TCP to worker processes, headless Vulpix instances on this machine or others that load the scene once and render
+// whatever tiles they get. Workers pull a new tile for every one they return, so faster ones render more. Once none
+// is left to hand out, idle workers also get the tiles still in flight on others (at most twice each), the first
+// result wins. Every process has to run the same build, the messages are the raw structs
+class VulpixTileCoordinator
+{
+public:
+	VulpixTileCoordinator();
+	~VulpixTileCoordinator();
+
+	// listens on port until every image is composited and written. False when the port can't be opened or an image
+	// could not be written
+	bool run(const uint16_t port, const std::vector<RenderJob>& jobs, const uint32_t tileSize);
+
+private:
+	struct Tile
+	{
+		uint32_t m_job = 0;
+		uint32_t m_x = 0;
+		uint32_t m_y = 0;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint32_t m_assignments = 0; // workers rendering it right now
+		uint64_t m_assignTime = 0;  // of the first of them
+		bool m_done = false;
+	};
+
+	struct Connection
+	{
+		VulpixSocket m_socket;
+		std::thread m_thread;
+		uint32_t m_tiles = 0; // results that were used
+	};
+
+	// a tile the worker doesn't hold yet, UINT32_MAX when there is none. wait blocks until there is one or all are done
+	uint32_t acquireTile(const std::vector<uint32_t>& held, const bool wait);
+	void completeTile(const uint32_t workerIndex, const uint32_t tileIndex, const uint8_t* pixels);
+	void releaseTile(const uint32_t tileIndex);
+	void serveWorker(const uint32_t workerIndex);
+
+	std::vector<RenderJob> m_jobs;
+	uint32_t m_tileSize;
+
+	// guarded by m_mutex
+	std::mutex m_mutex;
+	std::condition_variable m_tilesChanged;
+	std::vector<Tile> m_tiles;
+	std::deque<uint32_t> m_pending;
+	std::vector<std::vector<uint8_t>> m_images;  // RGBA8, released once written
+	std::vector<uint32_t> m_remainingTiles;      // per job
+	std::vector<std::unique_ptr<Connection>> m_connections;
+	uint32_t m_finishedTiles;
+	uint32_t m_duplicateTiles; // results that arrived after another worker's
+	uint32_t m_finishedJobs;
+	uint32_t m_failedJobs;
+};
+
+// the worker side, its render queue gets one tile job after the other
+class VulpixTileClient
+{
+public:
+	VulpixTileClient();
+	~VulpixTileClient();
+
+	// address is host:port. Retries for timeoutSeconds, the workers may start before the coordinator
+	bool connectTo(const std::string& address, const uint32_t timeoutSeconds);
+	void disconnect();
+
+	// the largest tile the coordinator hands out
+	uint32_t getTileSize() const { return m_tileSize; }
+
+	// blocks, false once the coordinator is done or gone
+	bool receiveJob(RenderJob& job);
+	// tightly packed RGBA8 rows of the tile, safe to call from the capture workers
+	bool sendResult(const uint32_t tile, const uint8_t* pixels, const uint32_t width, const uint32_t height);
+
+private:
+	VulpixSocket m_socket;
+	uint32_t m_tileSize;
+	std::mutex m_sendMutex;
+};
+
+#endif // VULPIX_TILE_NETWORK_H
@@ -0,0 +1,152 @@
+#include "Vulpix_Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace
+{
+	const uint64_t s_ringSize = 1 << 16; // events per thread, about a minute of frames
+
+	struct TraceEvent
+	{
+		const char* m_name;
+		uint64_t m_begin;
+		uint64_t m_end;
+	};
+
+	// written by its thread only, the writer publishes each event with the release store of m_written
+	struct TraceBuffer
+	{
+		uint32_t m_id = 0;
+		std::atomic<uint64_t> m_written{ 0 };
+		std::unique_ptr<TraceEvent[]> m_events{ new TraceEvent[s_ringSize] };
+	};
+
+	const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+	// buffers are never freed, the events of threads that have exited still get written out
+	std::mutex s_registryMutex;
+	std::vector<std::unique_ptr<TraceBuffer>> s_threadBuffers;
+	TraceBuffer s_gpuBuffer;
+	std::unordered_set<std::string> s_gpuNames;
+
+	thread_local TraceBuffer* t_buffer = nullptr;
+
+	TraceBuffer& getThreadBuffer()
+	{
+		if (!t_buffer)
+		{
+			// once per thread
+			std::lock_guard<std::mutex> lock(s_registryMutex);
+			s_threadBuffers.emplace_back(new TraceBuffer());
+			t_buffer = s_threadBuffers.back().get();
+			t_buffer->m_id = static_cast<uint32_t>(s_threadBuffers.size());
+		}
+		return *t_buffer;
+	}
+
+	void append(TraceBuffer& buffer, const TraceEvent& event)
+	{
+		const uint64_t index = buffer.m_written.load(std::memory_order_relaxed);
+		buffer.m_events[index % s_ringSize] = event;
+		buffer.m_written.store(index + 1, std::memory_order_release);
+	}
+
+	void writeString(std::ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				file << '\\';
+			}
+			file << *c;
+		}
+		file << '"';
+	}
+
+	void writeEvents(std::ofstream& file, const TraceBuffer& buffer, const uint32_t pid, bool& first)
+	{
+		const uint64_t written = buffer.m_written.load(std::memory_order_acquire);
+		const uint64_t begin = written > s_ringSize ? written - s_ringSize : 0;
+
+		for (uint64_t i = begin; i < written; ++i)
+		{
+			const TraceEvent& event = buffer.m_events[i % s_ringSize];
+
+			// complete events, timestamps in us
+			file << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer.m_id << ",\"name\":";
+			writeString(file, event.m_name);
+			file << ",\"ts\":" << static_cast<double>(event.m_begin) / 1000.0
+				<< ",\"dur\":" << static_cast<double>(event.m_end - event.m_begin) / 1000.0 << "}";
+			first = false;
+		}
+	}
+
+	void writeName(std::ofstream& file, const char* type, const uint32_t pid, const uint32_t tid, const std::string& name, bool& first)
+	{
+		file << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"name\":\"" << type << "\",\"args\":{\"name\":";
+		writeString(file, name.c_str());
+		file << "}}";
+		first = false;
+	}
+} // namespace
+
+namespace vulpix
+{
+namespace trace
+{
+	uint64_t now()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count());
+	}
+
+	void addEvent(const char* name, const uint64_t begin, const uint64_t end)
+	{
+		append(getThreadBuffer(), { name, begin, end });
+	}
+
+	void addGpuEvent(const std::string& name, const uint64_t begin, const uint64_t end)
+	{
+		// a few stage names, they are interned once and kept for good
+		const char* internedName = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(s_registryMutex);
+			internedName = s_gpuNames.insert(name).first->c_str();
+		}
+		append(s_gpuBuffer, { internedName, begin, end });
+	}
+
+	bool writeJson(const std::string& path)
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(s_registryMutex);
+
+		// CPU threads in process 1, the GPU queue in process 2
+		bool first = true;
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		writeName(file, "process_name", 1, 0, "CPU", first);
+		writeName(file, "process_name", 2, 0, "GPU", first);
+		writeName(file, "thread_name", 2, 0, "graphics queue (aligned to submit)", first);
+
+		for (const std::unique_ptr<TraceBuffer>& buffer : s_threadBuffers)
+		{
+			writeName(file, "thread_name", 1, buffer->m_id, "thread " + std::to_string(buffer->m_id), first);
+			writeEvents(file, *buffer, 1, first);
+		}
+		writeEvents(file, s_gpuBuffer, 2, first);
+
+		file << "\n]}\n";
+		return file.good();
+	}
+} // namespace trace
+} // namespace vulpix
@@ -0,0 +1,56 @@
+#ifndef VULPIX_TRACE_H
+#define VULPIX_TRACE_H
+
+#include "../Common.h"
+
+#include <cstdint>
+
+// CPU timeline instrumentation, written out as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+// 0 compiles every VULPIX_TRACE_SCOPE out
+#ifndef VULPIX_TRACE_ENABLED
+#define VULPIX_TRACE_ENABLED 1
+#endif
+
+namespace vulpix
+{
+namespace trace
+{
+	// ns on a steady clock, the timebase of every event
+	uint64_t now();
+
+	// name has to outlive the trace, scopes only take string literals. Each thread records into its own ring of
+	// the most recent events, appending takes no lock
+	void addEvent(const char* name, const uint64_t begin, const uint64_t end);
+
+	// GPU work on its own track. The name is copied, begin is on the now() timebase
+	void addGpuEvent(const std::string& name, const uint64_t begin, const uint64_t end);
+
+	// all threads' rings as one JSON trace. Threads still recording may lose the events they overwrite meanwhile
+	bool writeJson(const std::string& path);
+} // namespace trace
+} // namespace vulpix
+
+class VulpixTraceScope
+{
+public:
+	explicit VulpixTraceScope(const char* name) : m_name(name), m_begin(vulpix::trace::now()) {}
+	~VulpixTraceScope() { vulpix::trace::addEvent(m_name, m_begin, vulpix::trace::now()); }
+
+	VulpixTraceScope(const VulpixTraceScope&) = delete;
+	VulpixTraceScope& operator=(const VulpixTraceScope&) = delete;
+
+private:
+	const char* m_name;
+	uint64_t m_begin;
+};
+
+#define VULPIX_TRACE_CONCAT_INNER(a, b) a##b
+#define VULPIX_TRACE_CONCAT(a, b) VULPIX_TRACE_CONCAT_INNER(a, b)
+
+#if VULPIX_TRACE_ENABLED
+#define VULPIX_TRACE_SCOPE(name) VulpixTraceScope VULPIX_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define VULPIX_TRACE_SCOPE(name)
+#endif
+
+#endif // VULPIX_TRACE_H
@@ -0,0 +1,73 @@
+#include "Vulpix_UniformRing.h"
+#include <algorithm>
+
+VulpixUniformRing::VulpixUniformRing()
+{
+	m_mapped = nullptr;
+	m_sliceSize = 0;
+	m_alignment = 1;
+	m_sliceBegin = 0;
+	m_head = 0;
+}
+
+VulpixUniformRing::~VulpixUniformRing()
+{
+	destroyRing();
+}
+
+VkResult VulpixUniformRing::createRing(const VkDeviceSize sliceSize, const uint32_t numFrames)
+{
+	VkPhysicalDeviceProperties properties = {};
+	vkGetPhysicalDeviceProperties(m_context.m_physicalDevice, &properties);
+
+	// dynamic offsets have to honor the device alignment, slices start aligned as well
+	m_alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	m_sliceSize = (sliceSize + m_alignment - 1) / m_alignment * m_alignment;
+
+	VkResult error = m_buffer.createBuffer(m_sliceSize * numFrames, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (VK_SUCCESS != error)
+	{
+		return error;
+	}
+
+	// coherent memory stays mapped for the lifetime of the ring
+	m_mapped = reinterpret_cast<uint8_t*>(m_buffer.mapMemory());
+	if (!m_mapped)
+	{
+		m_buffer.destroyBuffer();
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+
+	beginFrame(0);
+	return VK_SUCCESS;
+}
+
+void VulpixUniformRing::destroyRing()
+{
+	if (m_mapped)
+	{
+		m_buffer.unmapMemory();
+		m_mapped = nullptr;
+	}
+	m_buffer.destroyBuffer();
+}
+
+void VulpixUniformRing::beginFrame(const uint32_t frameIndex)
+{
+	m_sliceBegin = frameIndex * m_sliceSize;
+	m_head = m_sliceBegin;
+}
+
+void* VulpixUniformRing::allocate(const VkDeviceSize size, uint32_t& dynamicOffset)
+{
+	const VkDeviceSize alignedSize = (size + m_alignment - 1) / m_alignment * m_alignment;
+	if (!m_mapped || m_head + alignedSize > m_sliceBegin + m_sliceSize)
+	{
+		return nullptr;
+	}
+
+	dynamicOffset = static_cast<uint32_t>(m_head);
+	void* block = m_mapped + m_head;
+	m_head += alignedSize;
+	return block;
+}
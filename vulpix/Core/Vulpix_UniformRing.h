@@ -0,0 +1,42 @@
+#ifndef VULPIX_UNIFORM_RING_H
+#define VULPIX_UNIFORM_RING_H
+
+#include "Buffer.h"
+#include "../Common.h"
+
+// Persistently mapped uniform buffer with one slice per frame in flight. Blocks are sub-allocated linearly
+// from the current frame's slice and bound through dynamic offsets, so a frame only ever writes memory its
+// own (already signaled) fence protects
+class VulpixUniformRing
+{
+public:
+	VulpixUniformRing();
+	~VulpixUniformRing();
+
+	VkResult createRing(const VkDeviceSize sliceSize, const uint32_t numFrames);
+	void destroyRing();
+
+	// rewinds the frame's slice, must be called after the frame's fence has signaled
+	void beginFrame(const uint32_t frameIndex);
+
+	// returns nullptr when the slice is full, dynamicOffset is the offset to bind the block with
+	void* allocate(const VkDeviceSize size, uint32_t& dynamicOffset);
+
+	template<typename T>
+	T* allocate(uint32_t& dynamicOffset) { return reinterpret_cast<T*>(allocate(sizeof(T), dynamicOffset)); }
+
+	// getters
+	VkBuffer getBuffer() const { return m_buffer.getBuffer(); }
+	VkDeviceSize getSliceSize() const { return m_sliceSize; }
+	VkDeviceSize getUsedSize() const { return m_head - m_sliceBegin; }
+
+private:
+	Buffer m_buffer;
+	uint8_t* m_mapped;
+	VkDeviceSize m_sliceSize;
+	VkDeviceSize m_alignment;
+	VkDeviceSize m_sliceBegin;
+	VkDeviceSize m_head;
+};
+
+#endif // VULPIX_UNIFORM_RING_H
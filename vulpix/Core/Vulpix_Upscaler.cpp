@@ -0,0 +1,195 @@
+#include "Vulpix_Upscaler.h"
+#include "../Shader/Shader.h"
+#include "../Shader/Shader_Config.h"
+
+VulpixUpscaler::VulpixUpscaler()
+{
+	m_descriptorSetLayout = VK_NULL_HANDLE;
+	m_pipelineLayout = VK_NULL_HANDLE;
+	m_pipeline = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+}
+
+bool VulpixUpscaler::initUpscaler(VkDevice device, const std::vector<VkImageView>& sources, const std::vector<VkImageView>& targets)
+{
+	const uint32_t numFrames = static_cast<uint32_t>(sources.size());
+	if (numFrames == 0 || targets.size() != sources.size())
+	{
+		return false;
+	}
+
+	const uint32_t bindingIndices[] = {
+		VULPIX_UPSCALE_SOURCE_BINDING,
+		VULPIX_UPSCALE_TARGET_BINDING
+	};
+	const uint32_t numBindings = static_cast<uint32_t>(sizeof(bindingIndices) / sizeof(bindingIndices[0]));
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(numBindings);
+	for (uint32_t i = 0; i < numBindings; ++i)
+	{
+		bindings[i].binding = bindingIndices[i];
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = numBindings;
+	layoutInfo.pBindings = bindings.data();
+
+	VkResult error = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_descriptorSetLayout);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorSetLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	// source and target extents change with the render scale, they go in as push constants
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uvec4);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	error = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout);
+	CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	Shader upscaleShader;
+	if (!upscaleShader.load("assets/out_shaders/upscale.bin"))
+	{
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = upscaleShader.getShaderStageInfo(VK_SHADER_STAGE_COMPUTE_BIT);
+	pipelineInfo.layout = m_pipelineLayout;
+
+	error = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline);
+	CHECK_VK_ERROR(error, "vkCreateComputePipelines");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numFrames * numBindings };
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.maxSets = numFrames;
+	descriptorPoolCreateInfo.poolSizeCount = 1;
+	descriptorPoolCreateInfo.pPoolSizes = &poolSize;
+
+	error = vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
+	CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(numFrames, m_descriptorSetLayout);
+	m_descriptorSets.resize(numFrames);
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = numFrames;
+	descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
+
+	error = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, m_descriptorSets.data());
+	CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
+
+	for (uint32_t frame = 0; frame < numFrames; ++frame)
+	{
+		// same order as bindingIndices
+		const VkImageView views[] = {
+			sources[frame],
+			targets[frame]
+		};
+
+		VkDescriptorImageInfo imageInfos[numBindings];
+		VkWriteDescriptorSet writes[numBindings];
+
+		for (uint32_t i = 0; i < numBindings; ++i)
+		{
+			imageInfos[i].sampler = VK_NULL_HANDLE;
+			imageInfos[i].imageView = views[i];
+			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			writes[i] = {};
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_descriptorSets[frame];
+			writes[i].dstBinding = bindingIndices[i];
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[i].pImageInfo = &imageInfos[i];
+		}
+
+		vkUpdateDescriptorSets(device, numBindings, writes, 0, nullptr);
+	}
+
+	return true;
+}
+
+void VulpixUpscaler::destroyUpscaler(VkDevice device)
+{
+	if (m_descriptorPool)
+	{
+		vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+		m_descriptorPool = VK_NULL_HANDLE;
+	}
+	m_descriptorSets.clear();
+
+	if (m_pipeline)
+	{
+		vkDestroyPipeline(device, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout)
+	{
+		vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+
+	if (m_descriptorSetLayout)
+	{
+		vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+		m_descriptorSetLayout = VK_NULL_HANDLE;
+	}
+}
+
+void VulpixUpscaler::recordUpscale(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const VkExtent2D sourceExtent, const VkExtent2D targetExtent) const
+{
+	if (!m_pipeline)
+	{
+		return;
+	}
+
+	const uvec4 extents(sourceExtent.width, sourceExtent.height, targetExtent.width, targetExtent.height);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[frameIndex], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uvec4), &extents);
+	vkCmdDispatch(commandBuffer,
+		(targetExtent.width + VULPIX_UPSCALE_GROUP_SIZE - 1) / VULPIX_UPSCALE_GROUP_SIZE,
+		(targetExtent.height + VULPIX_UPSCALE_GROUP_SIZE - 1) / VULPIX_UPSCALE_GROUP_SIZE,
+		1);
+}
@@ -0,0 +1,30 @@
+#ifndef VULPIX_UPSCALER_H
+#define VULPIX_UPSCALER_H
+
+#include "../Common.h"
+#include "Vulpix_Context.h"
+
+// Compute pass that stretches the traced top-left region of a source image over a whole target image
+// (bilinear), used when the rays are launched below the output resolution
+class VulpixUpscaler
+{
+public:
+	VulpixUpscaler();
+	~VulpixUpscaler() = default;
+
+	// one source / target pair per frame in flight, both in VK_IMAGE_LAYOUT_GENERAL when recorded
+	bool initUpscaler(VkDevice device, const std::vector<VkImageView>& sources, const std::vector<VkImageView>& targets);
+	void destroyUpscaler(VkDevice device);
+
+	// records the dispatch only, the caller's render graph pass orders it after the source writes
+	void recordUpscale(VkCommandBuffer commandBuffer, const uint32_t frameIndex, const VkExtent2D sourceExtent, const VkExtent2D targetExtent) const;
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorPool m_descriptorPool;
+	std::vector<VkDescriptorSet> m_descriptorSets; // one per frame in flight
+};
+
+#endif // VULPIX_UPSCALER_H
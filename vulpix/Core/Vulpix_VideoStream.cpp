@@ -0,0 +1,442 @@
+#include "Vulpix_VideoStream.h"
+#include "Vulpix_Trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULPIX_SSE2 1
+#include <emmintrin.h>
+#else
+#define VULPIX_SSE2 0
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+namespace
+{
+	// converted frames waiting for the writer, ahead of the one it writes next
+	const uint32_t MAX_PENDING_FRAMES = 8;
+
+	// BT.709 limited range in 8.8 fixed point. The chroma rows sum to 0, so grey stays at 128
+	const int32_t Y_R = 47, Y_G = 157, Y_B = 16;
+	const int32_t U_R = -26, U_G = -86, U_B = 112;
+	const int32_t V_R = 112, V_G = -102, V_B = -10;
+
+	inline uint8_t toLuma(const int32_t r, const int32_t g, const int32_t b)
+	{
+		return static_cast<uint8_t>(16 + ((Y_R * r + Y_G * g + Y_B * b + 128) >> 8));
+	}
+
+	inline uint8_t toChroma(const int32_t r, const int32_t g, const int32_t b, const int32_t cr, const int32_t cg, const int32_t cb)
+	{
+		return static_cast<uint8_t>(128 + ((cr * r + cg * g + cb * b + 128) >> 8));
+	}
+
+#if VULPIX_SSE2
+	// 8 RGBA pixels as 16 bit R, G and B lanes
+	inline void loadRgb(const uint8_t* pixels, __m128i& r, __m128i& g, __m128i& b)
+	{
+		const __m128i mask = _mm_set1_epi32(0xFF);
+		const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+		const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16));
+		r = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+		g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+		b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+	}
+
+	// the weighted sum is at most 56228, it fits the 16 bit lanes unsigned
+	inline __m128i lumaLanes(const __m128i r, const __m128i g, const __m128i b)
+	{
+		__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(Y_R)), _mm_mullo_epi16(g, _mm_set1_epi16(Y_G)));
+		sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(Y_B)));
+		sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+		return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+	}
+
+	// signed, every partial sum stays within +-28688
+	inline __m128i chromaLanes(const __m128i r, const __m128i g, const __m128i b, const int16_t cr, const int16_t cg, const int16_t cb)
+	{
+		__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+		sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+		sum = _mm_add_epi16(sum, _mm_set1_epi16(128));
+		return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+	}
+
+	// sums of horizontally adjacent pairs of two 8 lane vectors, as 8 lanes
+	inline __m128i pairSums(const __m128i a, const __m128i b)
+	{
+		const __m128i one = _mm_set1_epi16(1);
+		return _mm_packs_epi32(_mm_madd_epi16(a, one), _mm_madd_epi16(b, one));
+	}
+
+	inline __m128i average2x2(const __m128i row0a, const __m128i row0b, const __m128i row1a, const __m128i row1b)
+	{
+		const __m128i sums = pairSums(_mm_add_epi16(row0a, row1a), _mm_add_epi16(row0b, row1b));
+		return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+	}
+#endif
+} // namespace
+
+VulpixVideoStream::VulpixVideoStream()
+{
+	m_file = nullptr;
+	m_closeFile = false;
+	m_format = VideoStreamFormat::Y4m;
+	m_width = 0;
+	m_height = 0;
+	m_framePeriod = 0;
+	m_nextFrame = 0;
+	m_stopping = false;
+	m_written = 0;
+	m_dropped = 0;
+	m_late = 0;
+	m_writeFailed = false;
+}
+
+VulpixVideoStream::~VulpixVideoStream()
+{
+	closeStream();
+}
+
+bool VulpixVideoStream::openStream(const std::string& path, const VideoStreamFormat format, const uint32_t width, const uint32_t height,
+	const uint32_t frameRate, const uint32_t firstFrame)
+{
+	closeStream();
+
+#if !defined(_WIN32)
+	// a reader that goes away fails the write instead of ending the process
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+	if (path == "-")
+	{
+#if defined(_WIN32)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		m_file = stdout;
+		m_closeFile = false;
+	}
+	else
+	{
+#if defined(_WIN32)
+		if (path.compare(0, 9, "\\\\.\\pipe\\") == 0)
+		{
+			const HANDLE pipe = CreateNamedPipeA(path.c_str(), PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT, 1, 1 << 20, 0, 0, nullptr);
+			if (pipe == INVALID_HANDLE_VALUE)
+			{
+				std::cout << "Could not create the pipe " << path << std::endl;
+				return false;
+			}
+
+			std::cout << "Waiting for a reader on " << path << std::endl;
+			if (!ConnectNamedPipe(pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+			{
+				CloseHandle(pipe);
+				return false;
+			}
+			const int fd = _open_osfhandle(reinterpret_cast<intptr_t>(pipe), _O_WRONLY | _O_BINARY);
+			m_file = fd >= 0 ? _fdopen(fd, "wb") : nullptr;
+		}
+		else
+#endif
+		{
+			// opening a FIFO blocks until the reader opens it too
+			m_file = std::fopen(path.c_str(), "wb");
+		}
+		m_closeFile = true;
+	}
+
+	if (!m_file)
+	{
+		std::cout << "Could not open the stream " << path << std::endl;
+		return false;
+	}
+
+	m_format = format;
+	m_width = width;
+	m_height = height;
+	m_framePeriod = 1000000000ull / std::max(frameRate, 1u);
+	m_nextFrame = firstFrame;
+	m_stopping = false;
+	m_written = 0;
+	m_dropped = 0;
+	m_late = 0;
+	m_writeFailed = false;
+
+	if (m_format == VideoStreamFormat::Y4m)
+	{
+		std::fprintf(m_file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, frameRate);
+	}
+
+	m_writer = std::thread(&VulpixVideoStream::writerLoop, this);
+	return true;
+}
+
+void VulpixVideoStream::closeStream()
+{
+	if (!m_file)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_frameAvailable.notify_all();
+	m_spaceAvailable.notify_all();
+	m_writer.join();
+
+	if (m_closeFile)
+	{
+		std::fclose(m_file);
+	}
+	else
+	{
+		std::fflush(m_file);
+	}
+	m_file = nullptr;
+
+	m_pending.clear();
+	m_droppedFrames.clear();
+	m_freeBuffers.clear();
+
+	std::cout << "Stream: " << m_written << " frames written, " << m_dropped << " dropped, " << m_late << " late" << std::endl;
+}
+
+size_t VulpixVideoStream::getFrameSize() const
+{
+	const size_t numPixels = static_cast<size_t>(m_width) * m_height;
+	if (m_format == VideoStreamFormat::Rgba)
+	{
+		return numPixels * 4;
+	}
+	const size_t numChroma = static_cast<size_t>((m_width + 1) / 2) * ((m_height + 1) / 2);
+	return numPixels + 2 * numChroma;
+}
+
+void VulpixVideoStream::writeFrame(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height)
+{
+	// the stream can't change its size, the frame is repeated over instead
+	if (width != m_width || height != m_height)
+	{
+		dropFrame(frameNumber);
+		return;
+	}
+
+	FrameBuffer buffer;
+	{
+		// the frame the writer waits for always gets through, later ones wait for room
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_spaceAvailable.wait(lock, [this, frameNumber]() { return m_stopping || frameNumber < m_nextFrame + MAX_PENDING_FRAMES; });
+		if (m_stopping || frameNumber < m_nextFrame)
+		{
+			return;
+		}
+		if (!m_freeBuffers.empty())
+		{
+			buffer = std::move(m_freeBuffers.back());
+			m_freeBuffers.pop_back();
+		}
+	}
+
+	if (!buffer)
+	{
+		buffer.reset(new std::vector<uint8_t>(getFrameSize()));
+	}
+
+	{
+		VULPIX_TRACE_SCOPE("stream convert");
+		uint8_t* data = buffer->data();
+		if (m_format == VideoStreamFormat::Rgba)
+		{
+			std::memcpy(data, pixels, buffer->size());
+		}
+		else
+		{
+			const size_t numChroma = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+			uint8_t* u = data + static_cast<size_t>(width) * height;
+			vulpix::convertRgbaToYuv420(pixels, width, height, data, u, u + numChroma);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending[frameNumber] = std::move(buffer);
+	}
+	m_frameAvailable.notify_one();
+}
+
+void VulpixVideoStream::dropFrame(const uint32_t frameNumber)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (frameNumber < m_nextFrame)
+		{
+			return;
+		}
+		m_droppedFrames.insert(frameNumber);
+	}
+	m_frameAvailable.notify_one();
+}
+
+void VulpixVideoStream::writerLoop()
+{
+	FrameBuffer lastFrame; // repeated for dropped frames
+	for (;;)
+	{
+		FrameBuffer frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_frameAvailable.wait(lock, [this]()
+				{
+					return m_stopping || m_pending.count(m_nextFrame) != 0 || m_droppedFrames.count(m_nextFrame) != 0;
+				});
+
+			auto pending = m_pending.find(m_nextFrame);
+			if (pending != m_pending.end())
+			{
+				frame = std::move(pending->second);
+				m_pending.erase(pending);
+			}
+			else if (m_droppedFrames.erase(m_nextFrame) == 0)
+			{
+				// stopping, whatever is still missing never arrives
+				if (m_pending.empty())
+				{
+					return;
+				}
+				m_nextFrame = m_pending.begin()->first;
+				continue;
+			}
+			++m_nextFrame;
+
+			if (frame && lastFrame)
+			{
+				m_freeBuffers.push_back(std::move(lastFrame));
+			}
+		}
+		m_spaceAvailable.notify_all();
+
+		if (frame)
+		{
+			lastFrame = std::move(frame);
+		}
+		else
+		{
+			++m_dropped;
+		}
+
+		if (!lastFrame || m_writeFailed)
+		{
+			continue;
+		}
+
+		VULPIX_TRACE_SCOPE("stream write");
+		const uint64_t start = vulpix::trace::now();
+		if (m_format == VideoStreamFormat::Y4m)
+		{
+			std::fputs("FRAME\n", m_file);
+		}
+		const size_t size = lastFrame->size();
+		if (std::fwrite(lastFrame->data(), 1, size, m_file) != size || std::fflush(m_file) != 0)
+		{
+			std::cout << "Stream: the reader stopped accepting frames" << std::endl;
+			m_writeFailed = true;
+			continue;
+		}
+		++m_written;
+
+		// the reader can't keep up with the frame rate
+		if (vulpix::trace::now() - start > m_framePeriod)
+		{
+			++m_late;
+		}
+	}
+}
+
+namespace vulpix
+{
+	void convertRgbaToYuv420(const uint8_t* rgba, const uint32_t width, const uint32_t height, uint8_t* y, uint8_t* u, uint8_t* v)
+	{
+		const uint32_t chromaWidth = (width + 1) / 2;
+		const size_t rowPitch = static_cast<size_t>(width) * 4;
+
+		for (uint32_t row = 0; row < height; row += 2)
+		{
+			// an odd last row pairs with itself
+			const uint8_t* row0 = rgba + row * rowPitch;
+			const uint8_t* row1 = row + 1 < height ? row0 + rowPitch : row0;
+			uint8_t* y0 = y + static_cast<size_t>(row) * width;
+			uint8_t* y1 = row + 1 < height ? y0 + width : nullptr;
+			uint8_t* uRow = u + static_cast<size_t>(row / 2) * chromaWidth;
+			uint8_t* vRow = v + static_cast<size_t>(row / 2) * chromaWidth;
+
+			uint32_t x = 0;
+#if VULPIX_SSE2
+			// 16 pixels of both rows per iteration, 8 chroma samples
+			for (; x + 16 <= width; x += 16)
+			{
+				__m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+				loadRgb(row0 + x * 4, r0a, g0a, b0a);
+				loadRgb(row0 + x * 4 + 32, r0b, g0b, b0b);
+				loadRgb(row1 + x * 4, r1a, g1a, b1a);
+				loadRgb(row1 + x * 4 + 32, r1b, g1b, b1b);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(lumaLanes(r0a, g0a, b0a), lumaLanes(r0b, g0b, b0b)));
+				if (y1)
+				{
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(lumaLanes(r1a, g1a, b1a), lumaLanes(r1b, g1b, b1b)));
+				}
+
+				const __m128i r = average2x2(r0a, r0b, r1a, r1b);
+				const __m128i g = average2x2(g0a, g0b, g1a, g1b);
+				const __m128i b = average2x2(b0a, b0b, b1a, b1b);
+				const __m128i cu = chromaLanes(r, g, b, U_R, U_G, U_B);
+				const __m128i cv = chromaLanes(r, g, b, V_R, V_G, V_B);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(uRow + x / 2), _mm_packus_epi16(cu, cu));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(vRow + x / 2), _mm_packus_epi16(cv, cv));
+			}
+#endif
+			// the same arithmetic for the rest, an odd last column pairs with itself
+			for (; x < width; x += 2)
+			{
+				const uint32_t x1 = x + 1 < width ? x + 1 : x;
+				const uint8_t* p00 = row0 + x * 4;
+				const uint8_t* p01 = row0 + x1 * 4;
+				const uint8_t* p10 = row1 + x * 4;
+				const uint8_t* p11 = row1 + x1 * 4;
+
+				y0[x] = toLuma(p00[0], p00[1], p00[2]);
+				if (x + 1 < width)
+				{
+					y0[x + 1] = toLuma(p01[0], p01[1], p01[2]);
+				}
+				if (y1)
+				{
+					y1[x] = toLuma(p10[0], p10[1], p10[2]);
+					if (x + 1 < width)
+					{
+						y1[x + 1] = toLuma(p11[0], p11[1], p11[2]);
+					}
+				}
+
+				const int32_t r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+				const int32_t g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+				const int32_t b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+				uRow[x / 2] = toChroma(r, g, b, U_R, U_G, U_B);
+				vRow[x / 2] = toChroma(r, g, b, V_R, V_G, V_B);
+			}
+		}
+	}
+} // namespace vulpix
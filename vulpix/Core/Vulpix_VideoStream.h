@@ -0,0 +1,87 @@
+#ifndef VULPIX_VIDEO_STREAM_H
+#define VULPIX_VIDEO_STREAM_H
+
+#include "../Common.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+enum class VideoStreamFormat : uint32_t
+{
+	Y4m,  // YUV4MPEG2, 4:2:0 BT.709 limited range
+	Rgba, // raw RGBA8 frames back to back, the reader has to know the size and rate
+};
+
+// Captured frames written in order to stdout or a pipe, for an external encoder to read as they are rendered.
+// Frames arrive from the capture workers out of order, each converted on the worker that delivers it, and a writer
+// thread puts them out in frame order. A frame the capture dropped repeats the one before it, so the stream keeps
+// its frame rate
+class VulpixVideoStream
+{
+public:
+	VulpixVideoStream();
+	~VulpixVideoStream();
+
+	// path "-" is stdout, anything else printed to it would end up in the stream. On Windows a \\.\pipe\ path is
+	// created as a named pipe and waits for the reader to connect, elsewhere a FIFO has to exist already (mkfifo).
+	// firstFrame is the frame number of the first frame written
+	bool openStream(const std::string& path, const VideoStreamFormat format, const uint32_t width, const uint32_t height,
+		const uint32_t frameRate, const uint32_t firstFrame);
+	// writes the frames that arrived, then prints the counts
+	void closeStream();
+
+	bool isOpen() const { return m_file != nullptr; }
+
+	// tightly packed RGBA8 rows. Called from the capture workers, waits while the writer is too far behind
+	void writeFrame(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height);
+	// the frame will never arrive
+	void dropFrame(const uint32_t frameNumber);
+
+	uint64_t getWrittenCount() const { return m_written; }
+	uint64_t getDroppedCount() const { return m_dropped; }
+	uint64_t getLateCount() const { return m_late; }
+
+private:
+	using FrameBuffer = std::unique_ptr<std::vector<uint8_t>>;
+
+	void writerLoop();
+	size_t getFrameSize() const;
+
+	FILE* m_file;
+	bool m_closeFile; // not stdout
+	VideoStreamFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint64_t m_framePeriod; // ns
+	std::thread m_writer;
+
+	// the frame queue, guarded by m_mutex
+	std::mutex m_mutex;
+	std::condition_variable m_frameAvailable;
+	std::condition_variable m_spaceAvailable;
+	std::map<uint32_t, FrameBuffer> m_pending;
+	std::set<uint32_t> m_droppedFrames;
+	std::vector<FrameBuffer> m_freeBuffers;
+	uint32_t m_nextFrame;
+	bool m_stopping;
+
+	// written by the writer thread only, read once it has stopped
+	uint64_t m_written;
+	uint64_t m_dropped;
+	uint64_t m_late;     // frames the reader took longer than a frame period to accept
+	bool m_writeFailed;
+};
+
+namespace vulpix
+{
+	// planar Y, then U and V at half the resolution in both directions, rounded up. SSE2 where available
+	void convertRgbaToYuv420(const uint8_t* rgba, const uint32_t width, const uint32_t height, uint8_t* y, uint8_t* u, uint8_t* v);
+} // namespace vulpix
+
+#endif // VULPIX_VIDEO_STREAM_H
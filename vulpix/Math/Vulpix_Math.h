@@ -20,6 +20,8 @@ namespace vulpix
 		using vec2 = glm::highp_vec2;
 		using vec3 = glm::highp_vec3;
 		using vec4 = glm::highp_vec4;
+		using uvec2 = glm::highp_uvec2;
+		using uvec4 = glm::highp_uvec4;
 		using mat4 = glm::highp_mat4;
 		using quat = glm::highp_quat;
 
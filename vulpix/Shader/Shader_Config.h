@@ -5,6 +5,10 @@
 #include "../Common.h"
 #include "../Math/Vulpix_Math.h"
 using namespace vulpix::math;
+// the helpers at the bottom are compiled by both sides, so they must be inline in c++
+#define VULPIX_SHADER_FUNC inline
+#else
+#define VULPIX_SHADER_FUNC
 #endif
 
 #define VULPIX_PRIMARY_HIT_SHADERS_INDEX                    0
@@ -12,6 +16,12 @@ using namespace vulpix::math;
 #define VULPIX_PRIMARY_SHADOW_HIT_SHADERS_INDEX             1
 #define VULPIX_PRIMARY_SHADOW_MISS_SHADERS_INDEX            1
 
+// hit group = geometry index * VULPIX_NUM_RAY_TYPES + ray type, geometry 1 of a BLAS holds the alpha tested faces
+#define VULPIX_NUM_RAY_TYPES                                2
+#define VULPIX_ALPHA_HIT_SHADERS_INDEX                      2
+#define VULPIX_ALPHA_SHADOW_HIT_SHADERS_INDEX               3
+#define VULPIX_NUM_HIT_GROUPS                               4
+
 #define VULPIX_MATERIAL_IDS_SET                             1
 #define VULPIX_ATTRIBUTES_SET                               2
 #define VULPIX_FACES_SET                                    3
@@ -25,12 +35,63 @@ using namespace vulpix::math;
 #define VULPIX_RESULT_IMAGE_BINDING                         1
 #define VULPIX_CAMDATA_SET                                  0   
 #define VULPIX_CAMDATA_BINDING                              2
+#define VULPIX_MESH_INFO_SET                                0
+#define VULPIX_MESH_INFO_BINDING                            3
+#define VULPIX_ACCUMULATION_IMAGE_SET                       0
+#define VULPIX_ACCUMULATION_IMAGE_BINDING                   4
+#define VULPIX_FRAME_STATS_SET                              0
+#define VULPIX_FRAME_STATS_BINDING                          5
+#define VULPIX_SAMPLE_IMAGE_SET                             0
+#define VULPIX_SAMPLE_IMAGE_BINDING                         6
+#define VULPIX_SECONDARY_CACHE_SET                          0
+#define VULPIX_SECONDARY_CACHE_BINDING                      7   // two images, ping-ponged
 
 // shader locs
 #define VULPIX_PRIMARY_RAYGEN_SHADER_LOC                    0
 #define VULPIX_HIT_ATTRIBUTES_SHADER_LOC                    1
 #define VULPIX_SHADOW_RAYGEN_SHADER_LOC                     2
 
+// deform compute shader locations (single set)
+#define VULPIX_DEFORM_REST_POSITIONS_BINDING                0
+#define VULPIX_DEFORM_REST_ATTRIBUTES_BINDING               1
+#define VULPIX_DEFORM_OUT_POSITIONS_BINDING                 2
+#define VULPIX_DEFORM_OUT_ATTRIBUTES_BINDING                3
+#define VULPIX_DEFORM_DATA_BINDING                          4
+#define VULPIX_DEFORM_JOINTS_BINDING                        5
+#define VULPIX_DEFORM_PARAMS_BINDING                        6
+#define VULPIX_DEFORM_GROUP_SIZE                            64
+
+#define VULPIX_DEFORM_MODE_NONE                             0
+#define VULPIX_DEFORM_MODE_SKINNED                          1
+#define VULPIX_DEFORM_MODE_VERTEX_ANIMATED                  2
+
+// upscale compute shader locations (single set)
+#define VULPIX_UPSCALE_SOURCE_BINDING                       0
+#define VULPIX_UPSCALE_TARGET_BINDING                       1
+#define VULPIX_UPSCALE_GROUP_SIZE                           8
+
+// composite compute shader locations (single set)
+#define VULPIX_COMPOSITE_SOURCE_BINDING                     0
+#define VULPIX_COMPOSITE_TARGET_BINDING                     1
+#define VULPIX_COMPOSITE_GROUP_SIZE                         8
+
+// composite tonemap operators
+#define VULPIX_TONEMAP_CLAMP                                0 // radiance above 1 clips
+#define VULPIX_TONEMAP_ACES                                 1 // filmic curve fit, rolls highlights off
+
+// reconstruct compute shader locations (single set)
+#define VULPIX_RECONSTRUCT_SAMPLES_BINDING                  0
+#define VULPIX_RECONSTRUCT_HISTORY_IN_BINDING               1
+#define VULPIX_RECONSTRUCT_HISTORY_OUT_BINDING              2
+#define VULPIX_RECONSTRUCT_OUTPUT_BINDING                   3
+#define VULPIX_RECONSTRUCT_PARAMS_BINDING                   4
+#define VULPIX_RECONSTRUCT_GROUP_SIZE                       8
+
+// interleaved tracing, which pixels get a ray this frame
+#define VULPIX_INTERLEAVE_NONE                              0
+#define VULPIX_INTERLEAVE_CHECKERBOARD                      1   // half, alternating checkerboard
+#define VULPIX_INTERLEAVE_2X2                               2   // a quarter, one pixel of every 2x2 quad
+
 
 //#define VULPIX_OBJECT_ID_BUNNY                              0.0f
 //#define VULPIX_OBJECT_ID_PLANE                              1.0f
@@ -45,6 +106,24 @@ using namespace vulpix::math;
 
 // config vars
 #define VULPIX_MAX_RECURSION 10 // bounce count
+#define VULPIX_MAX_JOINTS 256 // size of the scene joint palette
+#define VULPIX_ALPHA_CUTOFF 0.5f // alpha tested texels below this are cut out
+#define VULPIX_MAX_LODS 4 // per mesh, instance custom index = mesh index * VULPIX_MAX_LODS + lod
+#define VULPIX_UNIFORM_RING_SLICE_SIZE 65536 // per frame uniform memory, UniformParams and any other per-frame blocks
+#define VULPIX_STATS_STRIDE 8 // every 8th pixel in x and y feeds the frame stats
+#define VULPIX_CACHE_DEPTH_TOLERANCE 0.02f // relative primary hit distance change that counts as a disocclusion
+#define VULPIX_CACHE_VIEW_COS 0.9998f // reflections are view dependent, cached ones survive a view change of about 1 degree
+#define VULPIX_CACHE_BLEND 0.5f // weight of a refreshed result against the cached one
+#define VULPIX_CONVERGENCE_SCALE 4096.0f // fixed point scale of the summed luminance changes (atomics are integer only)
+#define VULPIX_RAY_COUNTERS 1 // per ray type counts of every frame, 0 compiles them out of the shaders and the app
+#ifndef VULPIX_SUBGROUP_RAY_COUNTERS
+#define VULPIX_SUBGROUP_RAY_COUNTERS 1 // sum the ray counters per subgroup, ray_gen_atomics.bin is built with 0
+#endif
+
+// instance masks, every mesh has an instance for primary rays and one for secondary rays
+// (both masks on one instance when they use the same LOD)
+#define VULPIX_PRIMARY_RAY_MASK                             0x01
+#define VULPIX_SECONDARY_RAY_MASK                           0x02
 
 // shader structs
 
@@ -73,23 +152,94 @@ struct UniformParams
     vec4 m_cameraRight;
     vec4 m_cameraNearFarFOV;
     vec4 m_sunPosAndAmbient;
+    vec4 m_frameParams;         // x: frame index, y: unused, zw: subpixel jitter in pixels
+    vec4 m_accumulationParams;  // x: samples already in the accumulation image (0 restarts it), y: 1 when accumulating
+    vec4 m_renderParams;        // xy: traced extent in pixels (before interleaving), z: VULPIX_INTERLEAVE_*, w: interleave phase
+    vec4 m_historyParams;       // x: 1 when last frame's history matches this frame's extent and mode,
+                                // y: secondary cache image read this frame (the other one is written), z: 1 when it is usable,
+                                // w: secondary cache refresh interval in frames, 0 turns the cache off
+    vec4 m_tileParams;          // xy: offset of the traced extent in the image, zw: image extent (the traced extent unless tiled)
+    // last frame's camera (the field of view does not change at runtime), for reprojection
+    vec4 m_prevCameraPosition;
+    vec4 m_prevCameraDirection;
+    vec4 m_prevCameraUp;
+    vec4 m_prevCameraRight;
+};
 
+// progressive convergence estimate
+struct ConvergenceParams
+{
+    uint m_luminanceDeltaSum; // sum of |new mean - old mean| luminance, fixed point (VULPIX_CONVERGENCE_SCALE)
+    uint m_sampleCount;
+};
+
+// secondary bounce cache, counted on the VULPIX_STATS_STRIDE grid
+struct SecondaryCacheStats
+{
+    uint m_candidatePixels; // primary hit on a reflective / refractive surface
+    uint m_reusedPixels;    // served from the cache, no secondary rays
+    uint m_rejectedPixels;  // history found but disoccluded or seen from too different a direction
+    uint m_secondaryRays;   // rays traced after the primary one in candidate pixels
+};
+
+// rays traced by the whole frame (not only the stats grid), summed per subgroup before the atomics
+struct RayCounters
+{
+    uint m_primary;
+    uint m_reflection;
+    uint m_refraction;
+    uint m_shadow;
+};
+
+// one per frame in flight, read back and cleared by the host
+struct FrameStats
+{
+    ConvergenceParams m_convergence;
+    SecondaryCacheStats m_secondaryCache;
+#if VULPIX_RAY_COUNTERS
+    RayCounters m_rays;
+#endif
+};
+
+// one per mesh LOD, indexed by the instance custom index
+struct MeshInfo
+{
+	uvec4 m_faceRange; // x: first face of the LOD, y: its first alpha tested face (the faces before it are opaque), z: face count
+};
+
+// deformation inputs, one SkinVertex / MorphVertex per mesh vertex
+struct SkinVertex
+{
+	uvec4 m_joints;
+	vec4 m_weights;
+};
+
+struct MorphVertex
+{
+	vec4 m_position;
+	vec4 m_normal;
+};
+
+struct DeformParams
+{
+	uvec4 m_vertexCountModeJointBase; // x: vertex count, y: VULPIX_DEFORM_MODE_*, z: first joint in the palette
+	vec4 m_morphWeight;
 };
 
 // shader helper functions, it is intersting that we can use c++ functions in shaders :D (her gun yeni bi bilgi :P sasirmaya devamke)
 
-vec2 barycentricLerp(vec2 a, vec2 b, vec2 c, vec3 barycentric)
+VULPIX_SHADER_FUNC vec2 barycentricLerp(vec2 a, vec2 b, vec2 c, vec3 barycentric)
 {
 	return a * barycentric.x + b * barycentric.y + c * barycentric.z;
 }
 
-vec3 barycentricLerp(vec3 a, vec3 b, vec3 c, vec3 barycentric)
+VULPIX_SHADER_FUNC vec3 barycentricLerp(vec3 a, vec3 b, vec3 c, vec3 barycentric)
 {
 	return a * barycentric.x + b * barycentric.y + c * barycentric.z;
 }
 
 
-float linearToSrgb(float channel) {
+VULPIX_SHADER_FUNC float linearToSrgb(float channel) {
     if (channel <= 0.0031308f) {
         return 12.92f * channel;
     }
@@ -98,8 +248,49 @@ float linearToSrgb(float channel) {
     }
 }
 
-vec3 linearToSrgb(vec3 linear) {
+VULPIX_SHADER_FUNC vec3 linearToSrgb(vec3 linear) {
     return vec3(linearToSrgb(linear.r), linearToSrgb(linear.g), linearToSrgb(linear.b));
 }
 
+// pinhole camera, uv is in [-1, 1] over the traced extent with y pointing down, aspect = width / height
+VULPIX_SHADER_FUNC vec3 cameraRayDir(vec3 forward, vec3 right, vec3 up, float fovY, float aspect, vec2 uv) {
+    const float planeHeight = tan(fovY * 0.5f);
+    return normalize(forward + right * (planeHeight * aspect * uv.x) - up * (planeHeight * uv.y));
+}
+
+// inverse of cameraRayDir, only meaningful when dot(dir, forward) > 0
+VULPIX_SHADER_FUNC vec2 cameraProject(vec3 forward, vec3 right, vec3 up, float fovY, float aspect, vec3 dir) {
+    const float planeHeight = tan(fovY * 0.5f);
+    const float depth = dot(dir, forward);
+    return vec2(dot(dir, right) / (depth * planeHeight * aspect), -dot(dir, up) / (depth * planeHeight));
+}
+
+VULPIX_SHADER_FUNC vec2 pixelToUv(vec2 pixel, vec2 extent) {
+    return (pixel / (extent - 1.0f)) * 2.0f - 1.0f;
+}
+
+VULPIX_SHADER_FUNC vec2 uvToPixel(vec2 uv, vec2 extent) {
+    return (uv * 0.5f + 0.5f) * (extent - 1.0f);
+}
+
+// the pixel of the traced extent that launch id (x, y) covers, the launch is narrower (checkerboard)
+// or narrower and shorter (2x2) than the extent. The phase picks this frame's subset
+VULPIX_SHADER_FUNC uvec2 interleavedPixel(uvec2 launchId, uint mode, uint phase) {
+    if (mode == VULPIX_INTERLEAVE_CHECKERBOARD) {
+        return uvec2(launchId.x * 2u + ((launchId.y + phase) & 1u), launchId.y);
+    } else if (mode == VULPIX_INTERLEAVE_2X2) {
+        return uvec2(launchId.x * 2u + (phase & 1u), launchId.y * 2u + (phase >> 1u));
+    }
+    return launchId;
+}
+
+VULPIX_SHADER_FUNC bool isInterleavedPixelTraced(uvec2 pixel, uint mode, uint phase) {
+    if (mode == VULPIX_INTERLEAVE_CHECKERBOARD) {
+        return ((pixel.x + pixel.y + phase) & 1u) == 0u;
+    } else if (mode == VULPIX_INTERLEAVE_2X2) {
+        return (pixel.x & 1u) == (phase & 1u) && (pixel.y & 1u) == (phase >> 1u);
+    }
+    return true;
+}
+
 #endif // VULPIX_SHADER_CONFIG_H
\ No newline at end of file
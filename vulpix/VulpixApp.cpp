@@ -1,18 +1,14 @@
 #include "VulpixApp.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-
 #include "Shader/Shader_Config.h"
 
+#include <algorithm>
+#include <cmath>
+
 #define SHADER_FOLDER "shaders/"
 #define MODEL_FOLDER "assets/scene"
 #define ENVIRONMENT_FOLDER "assets/env_map"
 
-// scene settings
-static const vulpix::math::vec3 sunPos = vulpix::math::vec3(1474.4f, 1940.45f, 397.55f);
-static const float ambientLight = 0.1f;
-
 VulpixApp::VulpixApp() : AppBase()
 {
 	m_pipelineLayout = VK_NULL_HANDLE;
@@ -33,35 +29,198 @@ VulpixApp::~VulpixApp()
 	freeResources();
 }
 
+void VulpixApp::setScene(const std::string& fileName)
+{
+	m_sceneFile = fileName;
+}
+
+void VulpixApp::setEnvironmentMap(const std::string& fileName)
+{
+	m_environmentMap = fileName;
+}
+
+void VulpixApp::setMeshMerging(const bool enabled)
+{
+	m_mergeSmallMeshes = enabled;
+}
+
+void VulpixApp::setTriangleSplitting(const bool enabled)
+{
+	m_splitLongTriangles = enabled;
+}
+
+void VulpixApp::setDeformDemo(const uint32_t meshIndex)
+{
+	m_deformDemoMesh = static_cast<int32_t>(meshIndex);
+}
+
+void VulpixApp::setSkinDemo(const uint32_t meshIndex)
+{
+	m_skinDemoMesh = static_cast<int32_t>(meshIndex);
+}
+
+void VulpixApp::setBenchmark(const BenchmarkSettings& settings)
+{
+	m_pathBenchmark = PathBenchmark();
+	m_pathBenchmark.m_settings = settings;
+	m_pathBenchmark.m_running = true;
+}
+
+void VulpixApp::setGoldenTest(const std::string& casesPath, const bool update)
+{
+	m_renderQueue = RenderQueue();
+	m_renderQueue.m_goldenCasesPath = casesPath;
+	m_renderQueue.m_goldenUpdate = update;
+	m_renderQueue.m_running = true;
+}
+
+bool VulpixApp::setBatch(const std::string& jobsPath)
+{
+	m_renderQueue = RenderQueue();
+	if (!vulpix::loadRenderJobs(jobsPath, m_renderQueue.m_jobs))
+	{
+		std::cout << "Could not load the render jobs " << jobsPath << std::endl;
+		return false;
+	}
+	m_renderQueue.m_running = true;
+	return true;
+}
+
+bool VulpixApp::setTileWorker(const std::string& address)
+{
+	m_tileClient.reset(new VulpixTileClient());
+	if (!m_tileClient->connectTo(address, 30))
+	{
+		m_tileClient.reset();
+		return false;
+	}
+
+	m_renderQueue = RenderQueue();
+	m_renderQueue.m_running = true;
+	return true;
+}
+
 void VulpixApp::initApp()
 {
+	const uint64_t loadBegin = vulpix::trace::now();
 	loadScene();
+	m_pathBenchmark.m_report.m_loadTime = static_cast<float>(static_cast<double>(vulpix::trace::now() - loadBegin) * 1e-6);
 	createScene();
 	createCamera();
+	createAccumulation();
+	createTraceImages();
+	if (!createComposite())
+	{
+		m_exitCode = 1;
+		requestQuit();
+		return;
+	}
+	createInterleaveImages();
+	createSecondaryCache();
 	createDescriptorSetLayouts();
-	createRTPipelineAndSBT();
+	if (!createRTPipelineAndSBT())
+	{
+		m_exitCode = 1;
+		requestQuit();
+		return;
+	}
 	updateDescriptorSets();
+
+	// headless frames are compared against each other, the launch size must not follow the machine's speed
+	if (isHeadless())
+	{
+		m_dynamicResolution = false;
+	}
+
+	if (m_renderQueue.m_running && !startRenderQueue())
+	{
+		m_renderQueue.m_running = false;
+		m_exitCode = 1;
+		requestQuit();
+		return;
+	}
+
+	if (m_pathBenchmark.m_running)
+	{
+		if (!m_cameraPath.load(m_pathBenchmark.m_settings.m_cameraPath))
+		{
+			std::cout << "Could not load the camera path " << m_pathBenchmark.m_settings.m_cameraPath << std::endl;
+			m_pathBenchmark.m_running = false;
+			requestQuit();
+			return;
+		}
+
+		// same launch size every run, whatever the machine's speed
+		m_dynamicResolution = false;
+		std::cout << "Path benchmark: " << m_cameraPath.getKeyframeCount() << " keyframes, " << m_pathBenchmark.m_settings.m_warmupFrames
+			<< " warmup and " << m_pathBenchmark.m_settings.m_measuredFrames << " measured frames" << std::endl;
+	}
 }
 
 void VulpixApp::initSettings()
 {
-	m_settings.m_resolutionX = 2560;
-	m_settings.m_resolutionY= 1440;
+	m_settings.m_resolutionX = vulpix::SCENE_RESOLUTION_X;
+	m_settings.m_resolutionY = vulpix::SCENE_RESOLUTION_Y;
 	m_settings.m_name = "Vulpix";
 	m_settings.m_enableValidationLayers= true;
 	m_settings.m_enableVSync = false;
 	m_settings.m_supportRT = true;
 	m_settings.m_supportDescriptorIndexing = true;
+	m_settings.m_framesInFlight = 2;
+
+	// every batch job renders into the top left corner of the same images
+	if (m_tileClient)
+	{
+		m_settings.m_resolutionX = m_tileClient->getTileSize();
+		m_settings.m_resolutionY = m_tileClient->getTileSize();
+	}
+	else if (!m_renderQueue.m_jobs.empty())
+	{
+		m_settings.m_resolutionX = 0;
+		m_settings.m_resolutionY = 0;
+		for (const RenderJob& job : m_renderQueue.m_jobs)
+		{
+			m_settings.m_resolutionX = std::max(m_settings.m_resolutionX, job.m_width);
+			m_settings.m_resolutionY = std::max(m_settings.m_resolutionY, job.m_height);
+		}
+	}
 }
 
 void VulpixApp::freeResources()
 {
+	m_deformer.destroyDeformer(m_device);
+	m_upscaler.destroyUpscaler(m_device);
+	m_composite.destroyComposite(m_device);
+	m_reconstruction.destroyReconstruction(m_device);
+
 	for (VulpixMesh& mesh: m_scene.m_meshes)
 	{
-		vkDestroyAccelerationStructureKHR(m_device, mesh.m_BLAS.m_AccelerationStructure, nullptr);
+		for (VulpixMeshLod& lod : mesh.m_lods)
+		{
+			vkDestroyAccelerationStructureKHR(m_device, lod.m_BLAS.m_AccelerationStructure, nullptr);
+		}
 	}
 	m_scene.m_meshes.clear();
 	m_scene.m_materials.clear();
+	m_scene.m_meshInfos.destroyBuffer();
+	m_scene.destroyDeformBuffers();
+	m_uniformRing.destroyRing();
+
+	m_accumulationImage.destroyImage();
+	for (Buffer& buffer : m_frameStatsBuffers)
+	{
+		buffer.unmapMemory();
+		buffer.destroyBuffer();
+	}
+	m_frameStatsBuffers.clear();
+	m_frameStats.clear();
+	m_traceImages.clear();
+	m_frameImages.clear();
+	m_sampleImage.destroyImage();
+	m_historyImages[0].destroyImage();
+	m_historyImages[1].destroyImage();
+	m_secondaryCache[0].destroyImage();
+	m_secondaryCache[1].destroyImage();
 
 	if (m_scene.m_TLAS.m_AccelerationStructure)
 	{
@@ -74,354 +233,1505 @@ void VulpixApp::freeResources()
 		vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
 		m_descriptorPool = VK_NULL_HANDLE;
 	}
+	m_descriptorSets.clear();
+	m_frameDescriptorSets.clear();
 
 	m_sbt.destroySBT();
 
 	if (m_pipeline)
 	{
-		vkDestroyPipeline(m_device, m_pipeline, nullptr);
-		m_pipeline = VK_NULL_HANDLE;
+		vkDestroyPipeline(m_device, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout)
+	{
+		vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+
+	for (VkDescriptorSetLayout& layout : m_descriptorSetLayouts)
+	{
+		vkDestroyDescriptorSetLayout(m_device, layout, nullptr);
+	}
+	m_descriptorSetLayouts.clear();
+
+}
+
+void VulpixApp::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t presentTarget)
+{
+	// below the output resolution the rays go to the trace image and get upscaled into the frame image
+	const VkExtent2D outputExtent = m_outputExtent;
+	const bool upscale = m_renderExtent.width != outputExtent.width || m_renderExtent.height != outputExtent.height;
+	const uint32_t frameSet = upscale ? m_settings.m_framesInFlight + frameIndex : frameIndex;
+	const bool interleaved = m_interleave != VULPIX_INTERLEAVE_NONE;
+	const bool updateAS = m_scene.needsASUpdate();
+
+	VkImageSubresourceRange colorRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// what the previous frames left behind. Frames in flight share the ASs, the accumulation, history and cache
+	// images, so the first access of this frame has to wait for the last one of the previous frame. An UNDEFINED
+	// layout drops contents nobody will read
+	const VulpixResourceState unused = {};
+	const VulpixResourceState traced = { VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL };
+	const VulpixResourceState reconstructed = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL };
+	const VulpixResourceState readByRays = { VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_NONE_KHR };
+	const VulpixResourceState built = { VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR };
+
+	VulpixResourceState accumulationState = traced;
+	if (m_accumulatedSamples <= 1)
+	{
+		// the first sample after a restart (update already counted it) ignores the contents
+		accumulationState.m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+	VulpixResourceState historyState = reconstructed;
+	historyState.m_layout = m_historyValid ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	VulpixResourceState cacheState = traced;
+	cacheState.m_layout = m_secondaryCacheValid ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VulpixRenderGraph& graph = m_renderGraph;
+	const VulpixGraphResource geometry = graph.importMemory(m_scene.hasDeformables() ? readByRays : unused);
+	const VulpixGraphResource sceneAS = graph.importMemory(updateAS ? built : unused);
+	const VulpixGraphResource frameStats = graph.importMemory(unused);
+	const VulpixGraphResource frameImage = graph.importImage(m_frameImages[frameIndex].getImage(), colorRange, unused);
+	const VulpixGraphResource traceImage = graph.importImage(m_traceImages[frameIndex].getImage(), colorRange, unused);
+	const VulpixGraphResource accumulation = graph.importImage(m_accumulationImage.getImage(), colorRange, accumulationState);
+	const VulpixGraphResource samples = graph.importImage(m_sampleImage.getImage(), colorRange, unused);
+	const VulpixGraphResource history[2] = {
+		graph.importImage(m_historyImages[0].getImage(), colorRange, historyState),
+		graph.importImage(m_historyImages[1].getImage(), colorRange, historyState)
+	};
+	const VulpixGraphResource cache[2] = {
+		graph.importImage(m_secondaryCache[0].getImage(), colorRange, cacheState),
+		graph.importImage(m_secondaryCache[1].getImage(), colorRange, cacheState)
+	};
+
+	// deform first, the rays need the refitted ASs
+	if (m_scene.hasDeformables())
+	{
+		graph.addPass("deform", [this, frameIndex](VkCommandBuffer commandBuffer)
+			{
+				m_deformer.recordDeform(commandBuffer, m_scene, frameIndex);
+			})
+			.write(geometry, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+	}
+
+	// refits and / or the TLAS rebuild for the current LOD selection
+	if (updateAS)
+	{
+		graph.addPass("as update", [this, frameIndex](VkCommandBuffer commandBuffer)
+			{
+				m_scene.recordASUpdate(commandBuffer, frameIndex);
+			})
+			.read(geometry, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+			.write(sceneAS, VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+	}
+
+	// interleaved rays write the sample image, the reconstruction then fills the image the rays would have written
+	const VulpixGraphResource rayOutput = interleaved ? samples : (upscale ? traceImage : frameImage);
+	const VkExtent2D launchExtent = getLaunchExtent();
+
+	VulpixGraphPass& trace = graph.addPass("trace", [this, frameIndex, frameSet, launchExtent](VkCommandBuffer commandBuffer)
+		{
+			vkCmdBindPipeline(commandBuffer,
+				VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+				m_pipeline);
+
+			// set 0 belongs to the frame (its params are picked by the dynamic offset), the scene sets are shared
+			vkCmdBindDescriptorSets(commandBuffer,
+				VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+				m_pipelineLayout, 0,
+				1, &m_frameDescriptorSets[frameSet],
+				1, &m_frameParamsOffsets[frameIndex]);
+
+			vkCmdBindDescriptorSets(commandBuffer,
+				VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+				m_pipelineLayout, 1,
+				static_cast<uint32_t>(m_descriptorSets.size()) - 1, m_descriptorSets.data() + 1,
+				0, 0);
+
+			VkStridedDeviceAddressRegionKHR raygenRegion = {
+				m_sbt.getSBTAddress() + m_sbt.getRaygenOffset(),
+				m_sbt.getGroupsStride(),
+				m_sbt.getRaygenSize()
+			};
+
+			VkStridedDeviceAddressRegionKHR missRegion = {
+				m_sbt.getSBTAddress() + m_sbt.getMissGroupsOffset(),
+				m_sbt.getGroupsStride(),
+				m_sbt.getMissGroupsSize()
+			};
+
+			VkStridedDeviceAddressRegionKHR hitRegion = {
+				m_sbt.getSBTAddress() + m_sbt.getHitGroupsOffset(),
+				m_sbt.getGroupsStride(),
+				m_sbt.getHitGroupsSize()
+			};
+
+			VkStridedDeviceAddressRegionKHR callableRegion = {};
+
+			vkCmdTraceRaysKHR(commandBuffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, launchExtent.width, launchExtent.height, 1u);
+		});
+
+	trace.read(sceneAS, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR)
+		.read(geometry, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+		.write(accumulation, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR)
+		.write(frameStats, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR)
+		.write(rayOutput, VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+
+	if (m_secondaryCacheActive)
+	{
+		// last frame's cache is read, this frame's written
+		trace.read(cache[m_secondaryCacheParity], VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+			.write(cache[1 - m_secondaryCacheParity], VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+	}
+
+	if (interleaved)
+	{
+		const uint32_t parity = m_historyParity;
+		const uint32_t paramsOffset = m_frameParamsOffsets[frameIndex];
+		const VkExtent2D renderExtent = m_renderExtent;
+
+		graph.addPass("reconstruct", [this, frameSet, parity, paramsOffset, renderExtent](VkCommandBuffer commandBuffer)
+			{
+				m_reconstruction.recordReconstruct(commandBuffer, frameSet, parity, paramsOffset, renderExtent);
+			})
+			.read(samples, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+			.read(history[parity], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+			.write(history[1 - parity], VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR)
+			.write(upscale ? traceImage : frameImage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+	}
+
+	if (upscale)
+	{
+		const VkExtent2D renderExtent = m_renderExtent;
+
+		graph.addPass("upscale", [this, frameIndex, renderExtent, outputExtent](VkCommandBuffer commandBuffer)
+			{
+				m_upscaler.recordUpscale(commandBuffer, frameIndex, renderExtent, outputExtent);
+			})
+			.read(traceImage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+			.write(frameImage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+	}
+
+	// tonemap and encode into the presented image, the swapchain image itself when it allows storage
+	const uint32_t tonemap = m_tonemap;
+	graph.addPass("composite", [this, frameIndex, presentTarget, outputExtent, tonemap](VkCommandBuffer commandBuffer)
+		{
+			m_composite.recordComposite(commandBuffer, frameIndex, presentTarget, outputExtent, tonemap);
+		})
+		.read(frameImage, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR)
+		.write(m_presentResource, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+
+	// frame stats are read on the host once the frame fence signals
+	graph.addPass("stats readback")
+		.read(frameStats, VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+}
+
+void VulpixApp::onMouseMove(const float x, const float y)
+{
+	vulpix::math::vec2 newCursorPos(x, y);
+	vulpix::math::vec2 delta = m_cursorPos - newCursorPos;
+
+	if (m_LMBDown)
+	{
+		m_camera.rotateCamera(delta.x * m_rotationSpeed, delta.y * m_rotationSpeed);
+	}
+	m_cursorPos = newCursorPos;
+}
+
+void VulpixApp::onMouseButton(const int button, const int action, const int mods)
+{
+
+	if (button == GLFW_MOUSE_BUTTON_LEFT)
+	{
+		if (action == GLFW_PRESS)
+		{
+			m_LMBDown = true;
+		}
+		else if (action == GLFW_RELEASE)
+		{
+			m_LMBDown = false;
+		}
+	}
+}
+
+void VulpixApp::onKeyboard(const int key, const int scancode, const int action, const int mods)
+{
+	if (GLFW_PRESS == action) {
+		switch (key) {
+		case GLFW_KEY_W: m_WKeyDown = true; break;
+		case GLFW_KEY_A: m_AKeyDown = true; break;
+		case GLFW_KEY_S: m_SKeyDown = true; break;
+		case GLFW_KEY_D: m_DKeyDown = true; break;
+
+		case GLFW_KEY_P:
+			m_progressive = !m_progressive;
+			m_restartAccumulation = true;
+			break;
+
+		case GLFW_KEY_R:
+			m_dynamicResolution = !m_dynamicResolution;
+			m_resolutionController.reset(m_settings.m_resolutionX, m_settings.m_resolutionY, m_dynamicResolutionSettings);
+			break;
+
+		case GLFW_KEY_1: applyPreset(RenderPreset::Quality); break;
+		case GLFW_KEY_2: applyPreset(RenderPreset::Balanced); break;
+		case GLFW_KEY_3: applyPreset(RenderPreset::Performance); break;
+		case GLFW_KEY_B: startBenchmark(); break;
+		case GLFW_KEY_K: toggleCameraRecording(); break;
+		case GLFW_KEY_V: toggleCapture(); break;
+
+		case GLFW_KEY_C:
+			m_secondaryCacheEnabled = !m_secondaryCacheEnabled;
+			break;
+
+		case GLFW_KEY_T:
+			m_tonemap = (m_tonemap == VULPIX_TONEMAP_CLAMP) ? VULPIX_TONEMAP_ACES : VULPIX_TONEMAP_CLAMP;
+			break;
+
+		case GLFW_KEY_G:
+			dumpFrameTimes();
+			dumpGpuProfile();
+			break;
+
+		case GLFW_KEY_F:
+			if (vulpix::trace::writeJson("vulpix_trace.json"))
+			{
+				std::cout << "Timeline written to vulpix_trace.json" << std::endl;
+			}
+			break;
+
+		case GLFW_KEY_LEFT_SHIFT:
+		case GLFW_KEY_RIGHT_SHIFT:
+			m_ShiftDown = true;
+			break;
+		}
+	}
+	else if (GLFW_RELEASE == action) {
+		switch (key) {
+		case GLFW_KEY_W: m_WKeyDown = false; break;
+		case GLFW_KEY_A: m_AKeyDown = false; break;
+		case GLFW_KEY_S: m_SKeyDown = false; break;
+		case GLFW_KEY_D: m_DKeyDown = false; break;
+
+		case GLFW_KEY_LEFT_SHIFT:
+		case GLFW_KEY_RIGHT_SHIFT:
+			m_ShiftDown = false;
+			break;
+		}
+	}
+}
+
+void VulpixApp::report(const float fps, const float frameTime)
+{
+	std::string camPos = "x: " + std::to_string(m_camera.getPosition().x) + " y: " + std::to_string(m_camera.getPosition().y) + " z:" + std::to_string(m_camera.getPosition().z);
+	std::string frameStat = "Frame: " + std::to_string(fps) + "   "+ std::to_string(frameTime) + " ms " + " Hitches: " + std::to_string(m_cpuFrameTimes.getHitchCount()) + " Camera Position: " + camPos;
+	if (m_gpuProfiler.isEnabled())
+	{
+		frameStat += "   GPU: " + std::to_string(m_gpuProfiler.getLastFrameTime()) + " ms";
+	}
+	if (m_dynamicResolution)
+	{
+		frameStat += "   Render: " + std::to_string(m_renderExtent.width) + "x" + std::to_string(m_renderExtent.height);
+	}
+	if (m_interleave != VULPIX_INTERLEAVE_NONE)
+	{
+		const VkExtent2D launchExtent = getLaunchExtent();
+		const float rayRatio = static_cast<float>(launchExtent.width * launchExtent.height) / static_cast<float>(m_renderExtent.width * m_renderExtent.height);
+		frameStat += "   Rays: " + std::to_string(static_cast<int>(rayRatio * 100.0f + 0.5f)) + "%";
+	}
+	else if (m_progressive)
+	{
+		frameStat += "   Samples: " + std::to_string(m_accumulatedSamples) + " Convergence: " + std::to_string(m_convergence);
+	}
+	if (m_secondaryCacheActive)
+	{
+		frameStat += "   Cache reuse: " + std::to_string(static_cast<int>(m_secondaryCacheReuse * 100.0f + 0.5f)) + "% (" + std::to_string(m_secondaryRaysSaved) + " rays saved)";
+	}
+#if VULPIX_RAY_COUNTERS
+	frameStat += "   Traced: " + std::to_string(m_raysPerFrame) + " rays, " + std::to_string(m_mraysPerSecond) + " Mrays/s";
+#endif
+	std::string title = m_settings.m_name + " " + frameStat;
+	if (m_window)
+	{
+		glfwSetWindowTitle(m_window, title.c_str());
+	}
+	else
+	{
+		std::cout << title << std::endl;
+	}
+}
+
+void VulpixApp::update(uint32_t frameIndex, const float dt)
+{
+	VULPIX_TRACE_SCOPE("VulpixApp::update");
+
+	updateBenchmark(dt);
+	updatePathBenchmark(dt);
+	updateRenderQueue();
+
+	// the frame fence has signaled, nothing on the GPU reads this frame's slice of the ring anymore
+	m_uniformRing.beginFrame(frameIndex);
+	UniformParams *params = m_uniformRing.allocate<UniformParams>(m_frameParamsOffsets[frameIndex]);
+	if (!params)
+	{
+		std::cout << "Could not allocate the frame params from the uniform ring" << std::endl;
+		m_exitCode = 1;
+		requestQuit();
+		return;
+	}
+	params->m_sunPosAndAmbient = vulpix::math::vec4(vulpix::SCENE_SUN_POSITION, vulpix::SCENE_AMBIENT_LIGHT);
+	updateCamera(params, dt);
+
+	params->m_frameParams = vec4(static_cast<float>(m_frameNumber), 0.0f, 0.0f, 0.0f);
+	++m_frameNumber;
+
+	// a tile sees the scene at the detail of the whole image
+	const uint32_t imageHeight = m_tileImageExtent.height > 0 ? m_tileImageExtent.height : m_outputExtent.height;
+	const bool lodsChanged = m_scene.updateLods(frameIndex, m_camera.getPosition(), m_camera.getFOV(), static_cast<float>(imageHeight));
+	updateDeformDemo(dt);
+	updateSkinDemo(dt);
+	m_scene.updateDeformables(frameIndex);
+
+	updateRenderExtent(dt);
+	updateInterleave(params);
+	if (m_tileImageExtent.width > 0)
+	{
+		params->m_tileParams = vec4(static_cast<float>(m_tileOffset.x), static_cast<float>(m_tileOffset.y),
+			static_cast<float>(m_tileImageExtent.width), static_cast<float>(m_tileImageExtent.height));
+	}
+	else
+	{
+		params->m_tileParams = vec4(0.0f, 0.0f, static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height));
+	}
+
+	// animated meshes change every frame, there is nothing to converge to
+	updateAccumulation(frameIndex, params, lodsChanged || m_scene.hasDeformables());
+	updateSecondaryCache(frameIndex, params);
+	updateRayCounters(frameIndex);
+
+	//renderUI();
+}
+
+void VulpixApp::loadScene()
+{
+	VULPIX_TRACE_SCOPE("loadScene");
+
+	std::vector<VulpixMeshData> meshData;
+	std::vector<SceneMaterialFiles> materials;
+	if (vulpix::loadObjScene(m_sceneFile, meshData, materials)) {
+		// split before merging, merging budgets by face count
+		if (m_splitLongTriangles) {
+			const vulpix::SplitStats stats = vulpix::splitLongTriangles(meshData, m_splitSettings);
+			std::cout << "Triangle splitting: " << stats.m_facesBefore << " -> " << stats.m_facesAfter << " faces ("
+				<< stats.m_splitFaces << " split), summed triangle box area " << stats.m_boxAreaBefore << " -> " << stats.m_boxAreaAfter << std::endl;
+		}
+
+		if (m_mergeSmallMeshes) {
+			const vulpix::MergeStats stats = vulpix::mergeSmallMeshes(meshData, m_mergeSettings);
+			// the cost is the SAH model's, compare --bench runs with and without --no-merge for the measured one
+			std::cout << "Mesh merging: " << stats.m_meshesBefore << " -> " << stats.m_meshesAfter << " TLAS instances ("
+				<< stats.m_mergedMeshes << " small meshes in " << stats.m_clusters << " clusters), "
+				<< "estimated instance boxes per ray " << stats.m_instanceCostBefore << " -> " << stats.m_instanceCostAfter << std::endl;
+		}
+
+		// LODs of the final meshes, appended to their own mesh data
+		if (m_generateLods) {
+			const vulpix::LodStats stats = vulpix::generateLods(meshData, m_lodSettings);
+			std::cout << "LOD generation: " << stats.m_lodCount << " LODs for " << stats.m_meshesWithLods << " meshes, "
+				<< stats.m_facesBefore << " -> " << stats.m_facesAfter << " faces stored" << std::endl;
+		}
+
+		m_scene.m_materials.resize(materials.size());
+
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.baseMipLevel = 0;
+		subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		subresourceRange.baseArrayLayer = 0;
+		subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+		std::vector<bool> alphaMaterials(materials.size(), false);
+
+		for (size_t i = 0; i < materials.size(); ++i) {
+			VulpixMaterial& dstMat = m_scene.m_materials[i];
+
+			if (dstMat.m_texture.load(materials[i].m_texture, materials[i].m_alphaTexture)) {
+				dstMat.m_texture.createImageView(VK_IMAGE_VIEW_TYPE_2D, dstMat.m_texture.getFormat(), subresourceRange);
+				dstMat.m_texture.createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+			}
+
+			dstMat.m_alphaTested = dstMat.m_texture.hasAlphaMask();
+			alphaMaterials[i] = dstMat.m_alphaTested;
+		}
+
+		// last pass, it only reorders faces inside each LOD
+		const uint32_t alphaFaces = vulpix::partitionAlphaTested(meshData, alphaMaterials);
+		std::cout << "Alpha testing: " << std::count(alphaMaterials.begin(), alphaMaterials.end(), true) << " materials, " << alphaFaces << " faces" << std::endl;
+
+		m_scene.m_meshes.resize(meshData.size());
+
+		for (size_t meshIdx = 0; meshIdx < meshData.size(); ++meshIdx) {
+			createMeshBuffers(m_scene.m_meshes[meshIdx], meshData[meshIdx]);
+		}
+	}
+
+	m_scene.createMeshInfos();
+
+	// prepare shader resources infos
+	const size_t numMeshes = m_scene.m_meshes.size();
+	const size_t numMaterials = m_scene.m_materials.size();
+
+	m_scene.m_matBufferInfos.resize(numMeshes);
+	m_scene.m_attributesBufferInfos.resize(numMeshes);
+	m_scene.m_facesBufferInfos.resize(numMeshes);
+
+	for (size_t i = 0; i < numMeshes; ++i) {
+		const VulpixMesh& mesh = m_scene.m_meshes[i];
+		VkDescriptorBufferInfo& matIDsInfo = m_scene.m_matBufferInfos[i];
+		VkDescriptorBufferInfo& attribsInfo = m_scene.m_attributesBufferInfos[i];
+		VkDescriptorBufferInfo& facesInfo = m_scene.m_facesBufferInfos[i];
+
+		matIDsInfo.buffer = mesh.m_material.getBuffer();
+		matIDsInfo.offset = 0;
+		matIDsInfo.range = mesh.m_material.getSize();
+
+		attribsInfo.buffer = mesh.m_attribute.getBuffer();
+		attribsInfo.offset = 0;
+		attribsInfo.range = mesh.m_attribute.getSize();
+
+		facesInfo.buffer = mesh.m_faces.getBuffer();
+		facesInfo.offset = 0;
+		facesInfo.range = mesh.m_faces.getSize();
+	}
+
+	m_scene.m_texBufferInfos.resize(numMaterials);
+	for (size_t i = 0; i < numMaterials; ++i) {
+		const VulpixMaterial& mat = m_scene.m_materials[i];
+		VkDescriptorImageInfo& textureInfo = m_scene.m_texBufferInfos[i];
+
+		textureInfo.sampler = mat.m_texture.getSampler();
+		textureInfo.imageView = mat.m_texture.getImageView();
+		textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+}
+
+void VulpixApp::createMeshBuffers(VulpixMesh& mesh, const VulpixMeshData& data)
+{
+	const size_t numFaces = data.getFaceCount();
+	const size_t numVertices = data.getVertexCount();
+
+	mesh.m_vertexCount = static_cast<uint32_t>(numVertices);
+	mesh.m_faceCount = static_cast<uint32_t>(numFaces);
+
+	const std::vector<VulpixMeshLodRange> lods = data.getLods();
+	mesh.m_lods.resize(lods.size());
+	for (size_t i = 0; i < lods.size(); ++i) {
+		mesh.m_lods[i].m_firstFace = lods[i].m_firstFace;
+		mesh.m_lods[i].m_faceCount = lods[i].m_faceCount;
+		mesh.m_lods[i].m_alphaFaceCount = lods[i].m_alphaFaceCount;
+		mesh.m_lods[i].m_error = lods[i].m_error;
+	}
+
+	// LOD selection measures distance to the full mesh bounds
+	vec3 boundsMin, boundsMax;
+	data.computeBounds(boundsMin, boundsMax);
+	mesh.m_boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	mesh.m_boundsRadius = std::max(glm::length(boundsMax - boundsMin) * 0.5f, 1e-4f);
+
+	const size_t positionsBufferSize = numVertices * sizeof(vec3);
+	const size_t indicesBufferSize = numFaces * 3 * sizeof(uint32_t);
+	const size_t facesBufferSize = numFaces * 4 * sizeof(uint32_t);
+	const size_t attribsBufferSize = numVertices * sizeof(VertexAttributes);
+	const size_t matIDsBufferSize = numFaces * sizeof(uint32_t);
+
+	VkResult error = mesh.m_position.createBuffer(positionsBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	CHECK_VK_ERROR(error, "mesh.positions.Create");
+
+	error = mesh.m_index.createBuffer(indicesBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	CHECK_VK_ERROR(error, "mesh.indices.Create");
+
+	error = mesh.m_faces.createBuffer(facesBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	CHECK_VK_ERROR(error, "mesh.faces.Create");
+
+	error = mesh.m_attribute.createBuffer(attribsBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	CHECK_VK_ERROR(error, "mesh.attribs.Create");
+
+	error = mesh.m_material.createBuffer(matIDsBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	CHECK_VK_ERROR(error, "mesh.matIDs.Create");
+
+	vec3* positions = reinterpret_cast<vec3*>(mesh.m_position.mapMemory());
+	VertexAttributes* attribs = reinterpret_cast<VertexAttributes*>(mesh.m_attribute.mapMemory());
+	uint32_t* indices = reinterpret_cast<uint32_t*>(mesh.m_index.mapMemory());
+	uint32_t* faces = reinterpret_cast<uint32_t*>(mesh.m_faces.mapMemory());
+	uint32_t* matIDs = reinterpret_cast<uint32_t*>(mesh.m_material.mapMemory());
+
+	std::memcpy(positions, data.m_positions.data(), positionsBufferSize);
+	std::memcpy(attribs, data.m_attributes.data(), attribsBufferSize);
+	std::memcpy(matIDs, data.m_materialIDs.data(), matIDsBufferSize);
+
+	for (size_t f = 0; f < numFaces; ++f) {
+		const uint32_t a = static_cast<uint32_t>(3 * f + 0);
+		const uint32_t b = static_cast<uint32_t>(3 * f + 1);
+		const uint32_t c = static_cast<uint32_t>(3 * f + 2);
+		indices[a] = a;
+		indices[b] = b;
+		indices[c] = c;
+		faces[4 * f + 0] = a;
+		faces[4 * f + 1] = b;
+		faces[4 * f + 2] = c;
+		faces[4 * f + 3] = data.m_objectIDs[f];
+	}
+
+	mesh.m_material.unmapMemory();
+	mesh.m_index.unmapMemory();
+	mesh.m_faces.unmapMemory();
+	mesh.m_attribute.unmapMemory();
+	mesh.m_position.unmapMemory();
+}
+
+void VulpixApp::createScene()
+{
+	m_scene.m_framesInFlight = m_settings.m_framesInFlight;
+	createDeformDemo();
+	createSkinDemo();
+
+	// both wait for the queue, the times cover the whole build
+	const uint64_t blasBegin = vulpix::trace::now();
+	m_scene.buildBLAS(m_device, m_commandPool, m_graphicsQueue);
+	const uint64_t tlasBegin = vulpix::trace::now();
+	m_scene.buildTLAS(m_device, m_commandPool, m_graphicsQueue);
+	const uint64_t tlasEnd = vulpix::trace::now();
+	m_pathBenchmark.m_report.m_blasTime = static_cast<float>(static_cast<double>(tlasBegin - blasBegin) * 1e-6);
+	m_pathBenchmark.m_report.m_tlasTime = static_cast<float>(static_cast<double>(tlasEnd - tlasBegin) * 1e-6);
+
+	if (!m_deformer.initDeformer(m_device, m_scene))
+	{
+		std::cout << "Could not create the deform pass" << std::endl;
+	}
+
+	m_envTexture.load(m_environmentMap);
+
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	subresourceRange.baseArrayLayer = 0;
+	subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	m_envTexture.createImageView(VK_IMAGE_VIEW_TYPE_2D, m_envTexture.getFormat(), subresourceRange);
+	m_envTexture.createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+	m_envTextureInfo.sampler = m_envTexture.getSampler();
+	m_envTextureInfo.imageView = m_envTexture.getImageView();
+	m_envTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+}
+
+void VulpixApp::createDeformDemo()
+{
+	if (m_deformDemoMesh < 0)
+	{
+		return;
+	}
+
+	const size_t meshIndex = static_cast<size_t>(m_deformDemoMesh);
+	if (meshIndex >= m_scene.m_meshes.size())
+	{
+		std::cout << "Deform demo: the scene has no mesh " << meshIndex << std::endl;
+		m_deformDemoMesh = -1;
+		return;
+	}
+
+	// the morph target inflates the mesh along its normals by half its bounding radius, far enough that
+	// swinging the weight drifts past m_rebuildDriftThreshold and the refits get replaced by rebuilds
+	VulpixMesh& mesh = m_scene.m_meshes[meshIndex];
+	const uint32_t vertexCount = mesh.getBaseVertexCount();
+	const float offset = mesh.m_boundsRadius * 0.5f;
+
+	const vec3* positions = reinterpret_cast<const vec3*>(mesh.m_position.mapMemory());
+	const VertexAttributes* attribs = reinterpret_cast<const VertexAttributes*>(mesh.m_attribute.mapMemory());
+
+	std::vector<MorphVertex> target(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const vec3 normal = vec3(attribs[i].m_normal);
+		target[i].m_position = vec4(positions[i] + normal * offset, 1.0f);
+		target[i].m_normal = attribs[i].m_normal;
+	}
+
+	mesh.m_attribute.unmapMemory();
+	mesh.m_position.unmapMemory();
+
+	if (!m_scene.makeVertexAnimated(meshIndex, target))
+	{
+		std::cout << "Deform demo: could not make mesh " << meshIndex << " vertex animated" << std::endl;
+		m_deformDemoMesh = -1;
+		return;
+	}
+	std::cout << "Deform demo: mesh " << meshIndex << ", " << vertexCount << " vertices" << std::endl;
+}
+
+void VulpixApp::updateDeformDemo(const float dt)
+{
+	if (m_deformDemoMesh < 0)
+	{
+		return;
+	}
+
+	// one inflate / deflate cycle every four seconds
+	m_deformDemoTime += dt;
+	const float weight = 0.5f - 0.5f * std::cos(m_deformDemoTime * vulpix::PI * 0.5f);
+	m_scene.setMorphWeight(static_cast<size_t>(m_deformDemoMesh), weight);
+}
+
+void VulpixApp::createSkinDemo()
+{
+	if (m_skinDemoMesh < 0)
+	{
+		return;
+	}
+
+	const size_t meshIndex = static_cast<size_t>(m_skinDemoMesh);
+	if (meshIndex >= m_scene.m_meshes.size())
+	{
+		std::cout << "Skin demo: the scene has no mesh " << meshIndex << std::endl;
+		m_skinDemoMesh = -1;
+		return;
+	}
+
+	// joint 0 holds the mesh in place, joint 1 bends it around its center. The weights blend from one to the
+	// other over the middle of the bounding sphere's height, so the bend stretches the mesh instead of tearing it
+	VulpixMesh& mesh = m_scene.m_meshes[meshIndex];
+	const uint32_t vertexCount = mesh.getBaseVertexCount();
+	const float blendBegin = mesh.m_boundsCenter.y - mesh.m_boundsRadius * 0.5f;
+
+	const vec3* positions = reinterpret_cast<const vec3*>(mesh.m_position.mapMemory());
+
+	std::vector<SkinVertex> skin(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const float upper = glm::clamp((positions[i].y - blendBegin) / mesh.m_boundsRadius, 0.0f, 1.0f);
+		skin[i].m_joints = uvec4(0u, 1u, 0u, 0u);
+		skin[i].m_weights = vec4(1.0f - upper, upper, 0.0f, 0.0f);
+	}
+
+	mesh.m_position.unmapMemory();
+
+	if (!m_scene.makeSkinned(meshIndex, skin))
+	{
+		std::cout << "Skin demo: could not skin mesh " << meshIndex << std::endl;
+		m_skinDemoMesh = -1;
+		return;
+	}
+	std::cout << "Skin demo: mesh " << meshIndex << ", " << vertexCount << " vertices" << std::endl;
+}
+
+void VulpixApp::updateSkinDemo(const float dt)
+{
+	if (m_skinDemoMesh < 0)
+	{
+		return;
+	}
+
+	// one swing to either side every four seconds, far enough that the drift forces rebuilds
+	m_skinDemoTime += dt;
+	const float angle = 0.5f * std::sin(m_skinDemoTime * vulpix::PI * 0.5f);
+
+	const vec3 center = m_scene.m_meshes[static_cast<size_t>(m_skinDemoMesh)].m_boundsCenter;
+	const mat4 bend = glm::translate(center) * glm::rotate(angle, vec3(0.0f, 0.0f, 1.0f)) * glm::translate(-center);
+	m_scene.setJointMatrices({ mat4(1.0f), bend });
+}
+
+void VulpixApp::createCamera()
+{
+	static_assert(sizeof(UniformParams) <= VULPIX_UNIFORM_RING_SLICE_SIZE, "UniformParams does not fit into a uniform ring slice");
+
+	VkResult error = m_uniformRing.createRing(VULPIX_UNIFORM_RING_SLICE_SIZE, m_settings.m_framesInFlight);
+	CHECK_VK_ERROR(error, "Could not create the uniform ring");
+	m_frameParamsOffsets.assign(m_settings.m_framesInFlight, 0u);
+
+	m_camera.setViewport( { 0, 0, static_cast<int>(m_settings.m_resolutionX), static_cast<int>(m_settings.m_resolutionY) } ) ;
+	m_camera.setPlanes(vulpix::SCENE_CAMERA_NEAR, vulpix::SCENE_CAMERA_FAR);
+	m_camera.setFOV(vulpix::SCENE_CAMERA_FOV);
+	m_camera.lookCameraAt(vulpix::math::vec3(0.f, 2.f, 15.f), vulpix::math::vec3(0.f, 0.f, 0.f));
+
+	m_prevCameraPosition = vec4(m_camera.getPosition(), 0.0f);
+	m_prevCameraDirection = vec4(m_camera.getForward(), 0.0f);
+	m_prevCameraUp = vec4(m_camera.getUp(), 0.0f);
+	m_prevCameraRight = vec4(m_camera.getSide(), 0.0f);
+
+}
+
+void VulpixApp::updateCamera(UniformParams* params, const float dt)
+{
+	vec2 moveDelta(0.0f, 0.0f);
+	if (m_WKeyDown) {
+		moveDelta.y += 1.0f;
+	}
+	if (m_SKeyDown) {
+		moveDelta.y -= 1.0f;
+	}
+	if (m_AKeyDown) {
+		moveDelta.x -= 1.0f;
+	}
+	if (m_DKeyDown) {
+		moveDelta.x += 1.0f;
+	}
+
+	moveDelta *= m_moveSpeed * dt * (m_ShiftDown ? m_mouseSensitivity : 1.0f);
+	m_camera.moveCamera(moveDelta.x, moveDelta.y);
+
+	// replayed poses replace whatever the input did
+	if (m_pathBenchmark.m_running)
+	{
+		const CameraKeyframe keyframe = m_cameraPath.sample(m_pathBenchmark.m_pathTime);
+		m_camera.lookCameraAt(keyframe.m_position, keyframe.m_position + keyframe.m_forward);
+	}
+	else if (m_recordingCamera)
+	{
+		m_cameraPath.addKeyframe(m_recordingTime, m_camera.getPosition(), m_camera.getForward());
+		m_recordingTime += dt;
+	}
+
+	params->m_cameraPosition = vec4(m_camera.getPosition(), 0.0f);
+	params->m_cameraDirection = vec4(m_camera.getForward(), 0.0f);
+	params->m_cameraUp = vec4(m_camera.getUp(), 0.0f);
+	params->m_cameraRight = vec4(m_camera.getSide(), 0.0f);
+	params->m_cameraNearFarFOV = vec4(m_camera.getNearPlane(), m_camera.getFarPlane(), glm::radians(m_camera.getFOV()), 0.0f);
+
+	params->m_prevCameraPosition = m_prevCameraPosition;
+	params->m_prevCameraDirection = m_prevCameraDirection;
+	params->m_prevCameraUp = m_prevCameraUp;
+	params->m_prevCameraRight = m_prevCameraRight;
+
+	m_prevCameraPosition = params->m_cameraPosition;
+	m_prevCameraDirection = params->m_cameraDirection;
+	m_prevCameraUp = params->m_cameraUp;
+	m_prevCameraRight = params->m_cameraRight;
+
+
+	
+}
+
+void VulpixApp::createAccumulation()
+{
+	const VkExtent3D extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// full float, an 8 bit target can't hold a running mean of hundreds of samples
+	VkResult error = m_accumulationImage.createImage(VK_IMAGE_TYPE_2D,
+		VK_FORMAT_R32G32B32A32_SFLOAT,
+		extent,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	CHECK_VK_ERROR(error, "Could not create the accumulation image");
+
+	error = m_accumulationImage.createImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32G32B32A32_SFLOAT, range);
+	CHECK_VK_ERROR(error, "Could not create the accumulation image view");
+
+	// the counters of a frame are only touched by the host after its fence, so each frame gets its own
+	m_frameStatsBuffers.resize(m_settings.m_framesInFlight);
+	m_frameStats.resize(m_settings.m_framesInFlight);
+	for (uint32_t frame = 0; frame < m_settings.m_framesInFlight; ++frame)
+	{
+		error = m_frameStatsBuffers[frame].createBuffer(sizeof(FrameStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		CHECK_VK_ERROR(error, "Could not create the frame stats buffer");
+
+		m_frameStats[frame] = reinterpret_cast<FrameStats*>(m_frameStatsBuffers[frame].mapMemory());
+		*m_frameStats[frame] = {};
+	}
+
+	m_accumulatedSamples = 0;
+	m_restartAccumulation = true;
+}
+
+void VulpixApp::createTraceImages()
+{
+	const VkExtent3D extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// same format as the frame images, the upscale is a plain filtered copy. Half floats keep the radiance
+	// above 1 for the tonemap in the composite
+	m_traceImages.resize(m_settings.m_framesInFlight);
+	m_frameImages.resize(m_settings.m_framesInFlight);
+	std::vector<VkImageView> sources;
+	std::vector<VkImageView> targets;
+
+	for (uint32_t frame = 0; frame < m_settings.m_framesInFlight; ++frame)
+	{
+		Image* images[] = { &m_traceImages[frame], &m_frameImages[frame] };
+		for (Image* image : images)
+		{
+			VkResult error = image->createImage(VK_IMAGE_TYPE_2D,
+				VK_FORMAT_R16G16B16A16_SFLOAT,
+				extent,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_STORAGE_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			CHECK_VK_ERROR(error, "Could not create a trace / frame image");
+
+			error = image->createImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R16G16B16A16_SFLOAT, range);
+			CHECK_VK_ERROR(error, "Could not create a trace / frame image view");
+		}
+
+		sources.push_back(m_traceImages[frame].getImageView());
+		targets.push_back(m_frameImages[frame].getImageView());
+	}
+
+	if (!m_upscaler.initUpscaler(m_device, sources, targets))
+	{
+		std::cout << "Could not create the upscale pass (is assets/out_shaders/upscale.bin compiled?), dynamic resolution is disabled" << std::endl;
+		m_dynamicResolution = false;
+	}
+
+	m_resolutionController.reset(m_settings.m_resolutionX, m_settings.m_resolutionY, m_dynamicResolutionSettings);
+	m_renderExtent = { m_settings.m_resolutionX, m_settings.m_resolutionY };
+}
+
+bool VulpixApp::createComposite()
+{
+	std::vector<VkImageView> sources;
+	for (const Image& frameImage : m_frameImages)
+	{
+		sources.push_back(frameImage.getImageView());
+	}
+
+	// _SRGB formats encode on store, everything else gets the encoded values
+	const bool srgbEncode = m_surfaceFormat.format != VK_FORMAT_B8G8R8A8_SRGB && m_surfaceFormat.format != VK_FORMAT_R8G8B8A8_SRGB;
+	if (!m_composite.initComposite(m_device, sources, getPresentTargets(), srgbEncode))
+	{
+		std::cout << "Could not create the composite pass (is assets/out_shaders/composite.bin compiled?), nothing can be presented" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VulpixApp::updateRenderExtent(const float dt)
+{
+	VkExtent2D extent = m_outputExtent;
+
+	// dt is the time between two frames, with the CPU waiting on a fence every frame it follows the GPU
+	// once the GPU is the bottleneck, which is the only case where the trace resolution matters
+	if (m_dynamicResolution)
+	{
+		m_resolutionController.update(dt * 1000.0f);
+		extent = { m_resolutionController.getRenderWidth(), m_resolutionController.getRenderHeight() };
+	}
+
+	if (extent.width != m_renderExtent.width || extent.height != m_renderExtent.height)
+	{
+		m_renderExtent = extent;
+		m_restartAccumulation = true;
+	}
+}
+
+void VulpixApp::createInterleaveImages()
+{
+	const VkExtent3D extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	// half floats are plenty for one frame of radiance, and for the hit distance the reprojection needs
+	Image* images[] = { &m_sampleImage, &m_historyImages[0], &m_historyImages[1] };
+	for (Image* image : images)
+	{
+		VkResult error = image->createImage(VK_IMAGE_TYPE_2D,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			extent,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		CHECK_VK_ERROR(error, "Could not create an interleave image");
+
+		error = image->createImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R16G16B16A16_SFLOAT, range);
+		CHECK_VK_ERROR(error, "Could not create an interleave image view");
+	}
+
+	// same output order as the frame sets: frame images first, then trace images
+	std::vector<VkImageView> outputs;
+	for (const Image& frameImage : m_frameImages)
+	{
+		outputs.push_back(frameImage.getImageView());
+	}
+	for (const Image& traceImage : m_traceImages)
+	{
+		outputs.push_back(traceImage.getImageView());
+	}
+
+	const VkImageView history[2] = { m_historyImages[0].getImageView(), m_historyImages[1].getImageView() };
+	if (!m_reconstruction.initReconstruction(m_device, m_sampleImage.getImageView(), history, outputs, m_uniformRing.getBuffer()))
+	{
+		std::cout << "Could not create the reconstruct pass (is assets/out_shaders/reconstruct.bin compiled?), interleaved presets are disabled" << std::endl;
+	}
+}
+
+void VulpixApp::updateInterleave(UniformParams* params)
+{
+	// history is only usable when last frame reconstructed the same extent with the same pattern
+	const bool interleaved = m_interleave != VULPIX_INTERLEAVE_NONE;
+	m_historyValid = interleaved && m_historyWritten && m_historyInterleave == m_interleave &&
+		m_historyExtent.width == m_renderExtent.width && m_historyExtent.height == m_renderExtent.height;
+
+	uint32_t phase = 0;
+	if (interleaved)
+	{
+		// last frame wrote the other history image
+		m_historyParity = 1 - m_historyParity;
+
+		// the 2x2 order goes diagonal first, so any two consecutive frames cover both rows and columns
+		static const uint32_t quadOrder[4] = { 0, 3, 1, 2 };
+		phase = (m_interleave == VULPIX_INTERLEAVE_CHECKERBOARD) ? (m_interleaveFrame & 1) : quadOrder[m_interleaveFrame & 3];
+		++m_interleaveFrame;
+	}
+
+	m_historyWritten = interleaved;
+	m_historyInterleave = m_interleave;
+	m_historyExtent = m_renderExtent;
+
+	params->m_renderParams = vec4(static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height), static_cast<float>(m_interleave), static_cast<float>(phase));
+	params->m_historyParams = vec4(m_historyValid ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+VkExtent2D VulpixApp::getLaunchExtent() const
+{
+	switch (m_interleave)
+	{
+	case VULPIX_INTERLEAVE_CHECKERBOARD:
+		return { (m_renderExtent.width + 1) / 2, m_renderExtent.height };
+	case VULPIX_INTERLEAVE_2X2:
+		return { (m_renderExtent.width + 1) / 2, (m_renderExtent.height + 1) / 2 };
+	default:
+		return m_renderExtent;
+	}
+}
+
+void VulpixApp::applyPreset(const RenderPreset preset)
+{
+	static const uint32_t interleaveModes[] = { VULPIX_INTERLEAVE_NONE, VULPIX_INTERLEAVE_CHECKERBOARD, VULPIX_INTERLEAVE_2X2 };
+
+	m_preset = preset;
+	m_interleave = interleaveModes[static_cast<size_t>(preset)];
+
+	// without the reconstruct pass nobody would fill the skipped pixels
+	if (m_interleave != VULPIX_INTERLEAVE_NONE && !m_reconstruction.isValid())
+	{
+		m_preset = RenderPreset::Quality;
+		m_interleave = VULPIX_INTERLEAVE_NONE;
+	}
+	m_restartAccumulation = true;
+}
+
+void VulpixApp::startBenchmark()
+{
+	if (m_benchmark.m_running)
+	{
+		return;
+	}
+
+	m_benchmark = PresetBenchmark();
+	m_benchmark.m_running = true;
+	m_benchmark.m_savedPreset = m_preset;
+	m_benchmark.m_savedDynamicResolution = m_dynamicResolution;
+
+	// a fixed launch size, otherwise the controller would even out the frame times we want to compare
+	m_dynamicResolution = false;
+	applyPreset(RenderPreset::Quality);
+
+	std::cout << "Preset benchmark started, keep the camera still" << std::endl;
+}
+
+void VulpixApp::updateBenchmark(const float dt)
+{
+	if (!m_benchmark.m_running)
+	{
+		return;
+	}
+
+	// dt covers the previous frame, which ran with the current preset
+	if (m_benchmark.m_frame > PresetBenchmark::m_warmupFrames)
+	{
+		const VkExtent2D launchExtent = getLaunchExtent();
+		m_benchmark.m_time += dt;
+		m_benchmark.m_rays += static_cast<double>(launchExtent.width) * static_cast<double>(launchExtent.height);
+	}
+
+	if (++m_benchmark.m_frame <= PresetBenchmark::m_warmupFrames + PresetBenchmark::m_measuredFrames)
+	{
+		return;
+	}
+
+	const size_t preset = m_benchmark.m_preset;
+	m_benchmark.m_frameTime[preset] = static_cast<float>(m_benchmark.m_time * 1000.0 / PresetBenchmark::m_measuredFrames);
+	m_benchmark.m_raysPerFrame[preset] = m_benchmark.m_rays / PresetBenchmark::m_measuredFrames;
+
+	m_benchmark.m_frame = 0;
+	m_benchmark.m_time = 0.0;
+	m_benchmark.m_rays = 0.0;
+
+	// skip the interleaved presets when they are not available
+	if (++m_benchmark.m_preset < static_cast<uint32_t>(RenderPreset::Count) && m_reconstruction.isValid())
+	{
+		applyPreset(static_cast<RenderPreset>(m_benchmark.m_preset));
+		return;
+	}
+
+	static const char* presetNames[] = { "quality", "balanced", "performance" };
+
+	std::cout << "Preset benchmark, " << m_renderExtent.width << "x" << m_renderExtent.height << ", "
+		<< PresetBenchmark::m_measuredFrames << " frames each" << std::endl;
+
+	for (uint32_t i = 0; i < m_benchmark.m_preset; ++i)
+	{
+		const double raysPerSecond = m_benchmark.m_raysPerFrame[i] * 1000.0 / std::max(m_benchmark.m_frameTime[i], 0.001f);
+
+		std::cout << "  " << presetNames[i] << ": " << m_benchmark.m_frameTime[i] << " ms, "
+			<< static_cast<uint64_t>(m_benchmark.m_raysPerFrame[i]) << " primary rays per frame, "
+			<< raysPerSecond / 1000000.0 << " Mrays/s";
+
+		if (i > 0)
+		{
+			const double raySaving = 1.0 - m_benchmark.m_raysPerFrame[i] / m_benchmark.m_raysPerFrame[0];
+			std::cout << ", " << raySaving * 100.0 << "% fewer rays, "
+				<< m_benchmark.m_frameTime[0] / std::max(m_benchmark.m_frameTime[i], 0.001f) << "x frame rate";
+		}
+		std::cout << std::endl;
+	}
+
+	m_benchmark.m_running = false;
+	m_dynamicResolution = m_benchmark.m_savedDynamicResolution;
+	m_resolutionController.reset(m_settings.m_resolutionX, m_settings.m_resolutionY, m_dynamicResolutionSettings);
+	applyPreset(m_benchmark.m_savedPreset);
+}
+
+void VulpixApp::updatePathBenchmark(const float dt)
+{
+	if (!m_pathBenchmark.m_running)
+	{
+		return;
+	}
+
+	PathBenchmark& benchmark = m_pathBenchmark;
+	const BenchmarkSettings& settings = benchmark.m_settings;
+	BenchmarkReport& report = benchmark.m_report;
+
+	// dt, the GPU time and the ray counters all belong to earlier frames, the warmup frames cover that lag
+	if (benchmark.m_frame > settings.m_warmupFrames)
+	{
+		report.m_cpuFrameTimes.addSample(dt * 1000.0f);
+		if (m_gpuFrameTimes.getCount() != benchmark.m_gpuSamples)
+		{
+			report.m_gpuFrameTimes.addSample(m_gpuFrameTimes.getLast());
+		}
+#if VULPIX_RAY_COUNTERS
+		report.m_rays += m_raysPerFrame;
+		report.m_traceTime += m_traceTime;
+#endif
+	}
+	benchmark.m_gpuSamples = m_gpuFrameTimes.getCount();
+
+	// the path advances by a fixed step, every run renders the same poses whatever the frame rate
+	const float duration = m_cameraPath.getDuration();
+	const float pathTime = static_cast<float>(benchmark.m_frame) * settings.m_timeStep;
+	benchmark.m_pathTime = duration > 0.0f ? std::fmod(pathTime, duration) : 0.0f;
+
+	if (benchmark.m_frame++ >= settings.m_warmupFrames + settings.m_measuredFrames)
+	{
+		finishPathBenchmark();
+	}
+}
+
+void VulpixApp::finishPathBenchmark()
+{
+	BenchmarkReport& report = m_pathBenchmark.m_report;
+	report.m_scene = m_sceneFile;
+	report.m_meshMerging = m_mergeSmallMeshes;
+	report.m_triangleSplitting = m_splitLongTriangles;
+	report.m_meshCount = static_cast<uint32_t>(m_scene.m_meshes.size());
+	report.m_cameraPath = m_pathBenchmark.m_settings.m_cameraPath;
+	report.m_width = m_renderExtent.width;
+	report.m_height = m_renderExtent.height;
+	report.m_warmupFrames = m_pathBenchmark.m_settings.m_warmupFrames;
+	report.m_peakHostMemory = vulpix::getPeakHostMemory();
+	report.m_peakDeviceMemory = m_context.m_peakAllocatedMemory;
+
+	std::cout << "Path benchmark, " << report.m_width << "x" << report.m_height << ", " << report.m_meshCount << " meshes"
+		<< (report.m_meshMerging ? "" : " (not merged)") << (report.m_triangleSplitting ? "" : " (not split)") << ", load " << report.m_loadTime << " ms, BLAS "
+		<< report.m_blasTime << " ms, TLAS " << report.m_tlasTime << " ms" << std::endl;
+	report.m_cpuFrameTimes.print(std::cout, "  CPU");
+	report.m_gpuFrameTimes.print(std::cout, "  GPU");
+
+	const std::string& outputPath = m_pathBenchmark.m_settings.m_outputPath;
+	if (report.writeJson(outputPath))
+	{
+		std::cout << "Benchmark results written to " << outputPath << std::endl;
+	}
+	else
+	{
+		std::cout << "Could not write " << outputPath << std::endl;
+	}
+
+	m_pathBenchmark.m_running = false;
+	requestQuit();
+}
+
+void VulpixApp::toggleCameraRecording()
+{
+	if (m_pathBenchmark.m_running)
+	{
+		return;
 	}
 
-	if (m_pipelineLayout)
+	if (!m_recordingCamera)
 	{
-		vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-		m_pipelineLayout = VK_NULL_HANDLE;
+		m_cameraPath.clear();
+		m_recordingTime = 0.0f;
+		m_recordingCamera = true;
+		std::cout << "Recording the camera path, K to stop" << std::endl;
+		return;
 	}
 
-	for (VkDescriptorSetLayout& layout : m_descriptorSetLayouts)
+	m_recordingCamera = false;
+	if (m_cameraPath.save("camera_path.txt"))
 	{
-		vkDestroyDescriptorSetLayout(m_device, layout, nullptr);
+		std::cout << "Camera path of " << m_cameraPath.getKeyframeCount() << " keyframes, " << m_cameraPath.getDuration()
+			<< " s written to camera_path.txt" << std::endl;
 	}
-	m_descriptorSetLayouts.clear();
-
 }
 
-void VulpixApp::fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+bool VulpixApp::startRenderQueue()
 {
-	vkCmdBindPipeline(commandBuffer,
-		VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
-		m_pipeline);
-
-	vkCmdBindDescriptorSets(commandBuffer,
-		VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
-		m_pipelineLayout, 0,
-		static_cast<uint32_t>(m_descriptorSets.size()), m_descriptorSets.data(),
-		0, 0);
-
-	VkStridedDeviceAddressRegionKHR raygenRegion = {
-		m_sbt.getSBTAddress() + m_sbt.getRaygenOffset(),
-		m_sbt.getGroupsStride(),
-		m_sbt.getRaygenSize()
-	};
-
-	VkStridedDeviceAddressRegionKHR missRegion = {
-		m_sbt.getSBTAddress() + m_sbt.getMissGroupsOffset(),
-		m_sbt.getGroupsStride(),
-		m_sbt.getMissGroupsSize()
-	};
-
-	VkStridedDeviceAddressRegionKHR hitRegion = {
-		m_sbt.getSBTAddress() + m_sbt.getHitGroupsOffset(),
-		m_sbt.getGroupsStride(),
-		m_sbt.getHitGroupsSize()
-	};
+	RenderQueue& queue = m_renderQueue;
+	if (!queue.m_goldenCasesPath.empty())
+	{
+		if (!vulpix::loadGoldenCases(queue.m_goldenCasesPath, queue.m_goldenCases))
+		{
+			std::cout << "Could not load the golden cases " << queue.m_goldenCasesPath << std::endl;
+			return false;
+		}
 
-	VkStridedDeviceAddressRegionKHR callableRegion = {};
+		const size_t slash = queue.m_goldenCasesPath.find_last_of("/\\");
+		queue.m_goldenDirectory = slash != std::string::npos ? queue.m_goldenCasesPath.substr(0, slash) : std::string(".");
 
-	vkCmdTraceRaysKHR(commandBuffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, m_settings.m_resolutionX, m_settings.m_resolutionY, 1u);
+		// the references are at the full resolution
+		for (size_t i = 0; i < queue.m_goldenCases.size(); ++i)
+		{
+			const GoldenCase& goldenCase = queue.m_goldenCases[i];
+			RenderJob job;
+			job.m_samples = goldenCase.m_samples;
+			job.m_width = m_settings.m_resolutionX;
+			job.m_height = m_settings.m_resolutionY;
+			job.m_position = goldenCase.m_position;
+			job.m_forward = goldenCase.m_forward;
+			job.m_goldenCase = static_cast<int32_t>(i);
+			queue.m_jobs.push_back(job);
+		}
+	}
 
-}
+	queue.m_captureFrames.assign(queue.m_jobs.size(), UINT32_MAX);
+	queue.m_startTime = vulpix::trace::now();
 
-void VulpixApp::onMouseMove(const float x, const float y)
-{
-	vulpix::math::vec2 newCursorPos(x, y);
-	vulpix::math::vec2 delta = m_cursorPos - newCursorPos;
+	// nothing that depends on the machine's speed or on earlier frames: a fixed launch size, every pixel traced
+	// every frame, no reused bounces
+	m_dynamicResolution = false;
+	m_progressive = true;
+	m_secondaryCacheEnabled = false;
+	applyPreset(RenderPreset::Quality);
 
-	if (m_LMBDown)
+	if (m_tileClient)
 	{
-		m_camera.rotateCamera(delta.x * m_rotationSpeed, delta.y * m_rotationSpeed);
+		std::cout << "Tile worker: tiles up to " << m_settings.m_resolutionX << "x" << m_settings.m_resolutionY << std::endl;
 	}
-	m_cursorPos = newCursorPos;
+	else if (queue.m_goldenCases.empty())
+	{
+		std::cout << "Batch: " << queue.m_jobs.size() << " jobs, images up to " << m_settings.m_resolutionX << "x" << m_settings.m_resolutionY << std::endl;
+	}
+	else
+	{
+		std::cout << "Golden test: " << queue.m_goldenCases.size() << " cases from " << queue.m_goldenCasesPath << std::endl;
+	}
+	return true;
 }
 
-void VulpixApp::onMouseButton(const int button, const int action, const int mods)
+void VulpixApp::updateRenderQueue()
 {
+	RenderQueue& queue = m_renderQueue;
+	if (!queue.m_running)
+	{
+		return;
+	}
 
-	if (button == GLFW_MOUSE_BUTTON_LEFT)
+	if (queue.m_sample == 0 && queue.m_job == queue.m_jobs.size() && m_tileClient)
 	{
-		if (action == GLFW_PRESS)
-		{
-			m_LMBDown = true;
-		}
-		else if (action == GLFW_RELEASE)
+		// the frames in flight hold tiles the coordinator may be waiting for before it has another one
+		completeCaptures();
+
+		RenderJob tileJob;
+		if (!m_tileClient->receiveJob(tileJob))
 		{
-			m_LMBDown = false;
+			std::cout << "Tile worker: the coordinator is done" << std::endl;
+			queue.m_running = false;
+			requestQuit();
+			return;
 		}
+
+		std::lock_guard<std::mutex> lock(m_renderQueueMutex);
+		queue.m_jobs.push_back(tileJob);
+		queue.m_captureFrames.push_back(UINT32_MAX);
 	}
-}
 
-void VulpixApp::onKeyboard(const int key, const int scancode, const int action, const int mods)
-{
-	if (GLFW_PRESS == action) {
-		switch (key) {
-		case GLFW_KEY_W: m_WKeyDown = true; break;
-		case GLFW_KEY_A: m_AKeyDown = true; break;
-		case GLFW_KEY_S: m_SKeyDown = true; break;
-		case GLFW_KEY_D: m_DKeyDown = true; break;
+	const RenderJob& job = queue.m_jobs[queue.m_job];
+	if (queue.m_sample == 0)
+	{
+		// the noise only depends on the frame number, every job renders the same whatever ran before it
+		m_frameNumber = 0;
+		m_restartAccumulation = true;
+		m_outputExtent = { job.m_width, job.m_height };
+		m_tileOffset = { static_cast<int32_t>(job.m_tileX), static_cast<int32_t>(job.m_tileY) };
+		m_tileImageExtent = { job.m_imageWidth, job.m_imageHeight };
+	}
+	m_camera.lookCameraAt(job.m_position, job.m_position + job.m_forward);
 
-		case GLFW_KEY_LEFT_SHIFT:
-		case GLFW_KEY_RIGHT_SHIFT:
-			m_ShiftDown = true;
-			break;
-		}
+	if (++queue.m_sample < job.m_samples)
+	{
+		return;
 	}
-	else if (GLFW_RELEASE == action) {
-		switch (key) {
-		case GLFW_KEY_W: m_WKeyDown = false; break;
-		case GLFW_KEY_A: m_AKeyDown = false; break;
-		case GLFW_KEY_S: m_SKeyDown = false; break;
-		case GLFW_KEY_D: m_DKeyDown = false; break;
 
-		case GLFW_KEY_LEFT_SHIFT:
-		case GLFW_KEY_RIGHT_SHIFT:
-			m_ShiftDown = false;
-			break;
-		}
+	// this frame holds the last sample, it gets submitted under the next frame number
+	{
+		std::lock_guard<std::mutex> lock(m_renderQueueMutex);
+		queue.m_captureFrames[queue.m_job] = m_submittedFrames;
+	}
+	queue.m_sample = 0;
+	// a tile worker's queue ends when the coordinator has nothing left
+	if (++queue.m_job == queue.m_jobs.size() && !m_tileClient)
+	{
+		// the frames still in flight are read back before the main loop returns
+		queue.m_running = false;
+		requestQuit();
 	}
 }
 
-void VulpixApp::update(size_t imageIndex, const float dt)
+void VulpixApp::onFrameReadback(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height)
 {
-	std::string camPos = "x: " + std::to_string(m_camera.getPosition().x) + " y: " + std::to_string(m_camera.getPosition().y) + " z:" + std::to_string(m_camera.getPosition().z);
-	std::string frameStat = "Frame: " + std::to_string(m_FPSCounter.getFPS()) + "   "+ std::to_string(m_FPSCounter.getFrameTime()) + " ms " + " Camera Position: " + camPos;
-	std::string title = m_settings.m_name + " " + frameStat;
-	glfwSetWindowTitle(m_window, title.c_str());
+	AppBase::onFrameReadback(frameNumber, pixels, width, height);
 
-	UniformParams *params =  reinterpret_cast<UniformParams*>(m_cameraBuffer.mapMemory());
-	params->m_sunPosAndAmbient = vulpix::math::vec4(sunPos, ambientLight);
-	updateCamera(params, dt);
-	m_cameraBuffer.unmapMemory();
+	uint32_t jobIndex = UINT32_MAX;
+	{
+		std::lock_guard<std::mutex> lock(m_renderQueueMutex);
+		const RenderQueue& queue = m_renderQueue;
+		for (size_t i = 0; i < queue.m_captureFrames.size(); ++i)
+		{
+			if (queue.m_captureFrames[i] == frameNumber)
+			{
+				jobIndex = static_cast<uint32_t>(i);
+			}
+		}
+	}
 
-	//renderUI();
+	if (jobIndex != UINT32_MAX)
+	{
+		finishRenderJob(jobIndex, pixels, width, height);
+	}
 }
 
-void VulpixApp::loadScene()
+void VulpixApp::finishRenderJob(const uint32_t jobIndex, const uint8_t* pixels, const uint32_t width, const uint32_t height)
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, error;
-	
-	//std::string fileName = "assets/scene/vulpix_scene/vulpix_scene.obj";
-	std::string fileName = "assets/scene/sponza/vulpix_sponza.obj";
-	std::string baseDir = fileName;
-	const size_t slash = baseDir.find_last_of('/');
-	if (slash != std::string::npos) {
-		baseDir.erase(slash);
+	RenderQueue& queue = m_renderQueue;
+	RenderJob job;
+	{
+		// a tile worker's frame loop appends jobs meanwhile
+		std::lock_guard<std::mutex> lock(m_renderQueueMutex);
+		job = queue.m_jobs[jobIndex];
 	}
 
-	const bool result = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, fileName.c_str(), baseDir.c_str(), true);
-	if (result) {
-		m_scene.m_meshes.resize(shapes.size());
-		m_scene.m_materials.resize(materials.size());
-
-		for (size_t meshIdx = 0; meshIdx < shapes.size(); ++meshIdx) {
-			VulpixMesh& mesh = m_scene.m_meshes[meshIdx];
-			const tinyobj::shape_t& shape = shapes[meshIdx];
-
-			const size_t numFaces = shape.mesh.num_face_vertices.size();
-			const size_t numVertices = numFaces * 3;
-
-			mesh.m_vertexCount = static_cast<uint32_t>(numVertices);
-			mesh.m_faceCount = static_cast<uint32_t>(numFaces);
-
-			const size_t positionsBufferSize = numVertices * sizeof(vec3);
-			const size_t indicesBufferSize = numFaces * 3 * sizeof(uint32_t);
-			const size_t facesBufferSize = numFaces * 4 * sizeof(uint32_t);
-			const size_t attribsBufferSize = numVertices * sizeof(VertexAttributes);
-			const size_t matIDsBufferSize = numFaces * sizeof(uint32_t);
-
-			VkResult error = mesh.m_position.createBuffer(positionsBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			CHECK_VK_ERROR(error, "mesh.positions.Create");
-
-			error = mesh.m_index.createBuffer(indicesBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			CHECK_VK_ERROR(error, "mesh.indices.Create");
-
-			error = mesh.m_faces.createBuffer(facesBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			CHECK_VK_ERROR(error, "mesh.faces.Create");
-
-			error = mesh.m_attribute.createBuffer(attribsBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			CHECK_VK_ERROR(error, "mesh.attribs.Create");
-
-			error = mesh.m_material.createBuffer(matIDsBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			CHECK_VK_ERROR(error, "mesh.matIDs.Create");
-
-			vec3* positions = reinterpret_cast<vec3*>(mesh.m_position.mapMemory());
-			VertexAttributes* attribs = reinterpret_cast<VertexAttributes*>(mesh.m_attribute.mapMemory());
-			uint32_t* indices = reinterpret_cast<uint32_t*>(mesh.m_index.mapMemory());
-			uint32_t* faces = reinterpret_cast<uint32_t*>(mesh.m_faces.mapMemory());
-			uint32_t* matIDs = reinterpret_cast<uint32_t*>(mesh.m_material.mapMemory());
-
-			size_t vIdx = 0;
-			for (size_t f = 0; f < numFaces; ++f) {
-				assert(shape.mesh.num_face_vertices[f] == 3);
-				for (size_t j = 0; j < 3; ++j, ++vIdx) {
-					const tinyobj::index_t& i = shape.mesh.indices[vIdx];
-
-					vec3& pos = positions[vIdx];
-					vec4& normal = attribs[vIdx].m_normal;
-					vec4& uv = attribs[vIdx].m_uv;
-
-					pos.x = attrib.vertices[3 * i.vertex_index + 0];
-					pos.y = attrib.vertices[3 * i.vertex_index + 1];
-					pos.z = attrib.vertices[3 * i.vertex_index + 2];
-					normal.x = attrib.normals[3 * i.normal_index + 0];
-					normal.y = attrib.normals[3 * i.normal_index + 1];
-					normal.z = attrib.normals[3 * i.normal_index + 2];
-					uv.x = attrib.texcoords[2 * i.texcoord_index + 0];
-					uv.y = attrib.texcoords[2 * i.texcoord_index + 1];
-				}
-
-				const uint32_t a = static_cast<uint32_t>(3 * f + 0);
-				const uint32_t b = static_cast<uint32_t>(3 * f + 1);
-				const uint32_t c = static_cast<uint32_t>(3 * f + 2);
-				indices[a] = a;
-				indices[b] = b;
-				indices[c] = c;
-				faces[4 * f + 0] = a;
-				faces[4 * f + 1] = b;
-				faces[4 * f + 2] = c;
-
-				matIDs[f] = static_cast<uint32_t>(shape.mesh.material_ids[f]);
-			}
-
-			mesh.m_material.unmapMemory();
-			mesh.m_index.unmapMemory();
-			mesh.m_faces.unmapMemory();
-			mesh.m_attribute.unmapMemory();
-			mesh.m_position.unmapMemory();
-		}
+	// the cases don't change while the queue runs, the encoding runs in parallel with the other workers
+	bool succeeded = false;
+	if (job.m_tile != UINT32_MAX)
+	{
+		// a failed send means the coordinator is done and hung up on a tile someone else finished first
+		m_tileClient->sendResult(job.m_tile, pixels, width, height);
+		succeeded = true;
+	}
+	else if (job.m_goldenCase >= 0)
+	{
+		succeeded = vulpix::checkGoldenImage(queue.m_goldenCases[job.m_goldenCase], queue.m_goldenDirectory, pixels, width, height, queue.m_goldenUpdate);
+	}
+	else
+	{
+		succeeded = vulpix::writeRenderJobImage(job, pixels);
+	}
 
-		VkImageSubresourceRange subresourceRange = {};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseMipLevel = 0;
-		subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-		subresourceRange.baseArrayLayer = 0;
-		subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	std::lock_guard<std::mutex> lock(m_renderQueueMutex);
+	if (job.m_goldenCase < 0 && job.m_tile == UINT32_MAX)
+	{
+		std::cout << "Batch " << jobIndex + 1 << "/" << queue.m_jobs.size() << ": " << (succeeded ? "" : "could not write ") << job.m_output << std::endl;
+	}
 
-		for (size_t i = 0; i < materials.size(); ++i) {
-			const tinyobj::material_t& srcMat = materials[i];
-			VulpixMaterial& dstMat = m_scene.m_materials[i];
+	if (!succeeded)
+	{
+		++queue.m_failed;
+	}
 
-			std::string fullTexturePath = baseDir + "/" + srcMat.diffuse_texname;
-			if (dstMat.m_texture.load(fullTexturePath.c_str())) {
-				dstMat.m_texture.createImageView(VK_IMAGE_VIEW_TYPE_2D, dstMat.m_texture.getFormat(), subresourceRange);
-				dstMat.m_texture.createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
-			}
-		}
+	// a tile worker never knows which tile is its last
+	if (m_tileClient)
+	{
+		++queue.m_finished;
+		return;
 	}
 
-	// prepare shader resources infos
-	const size_t numMeshes = m_scene.m_meshes.size();
-	const size_t numMaterials = m_scene.m_materials.size();
+	if (++queue.m_finished < queue.m_jobs.size())
+	{
+		return;
+	}
 
-	m_scene.m_matBufferInfos.resize(numMeshes);
-	m_scene.m_attributesBufferInfos.resize(numMeshes);
-	m_scene.m_facesBufferInfos.resize(numMeshes);
+	if (queue.m_goldenCases.empty())
+	{
+		const double seconds = static_cast<double>(vulpix::trace::now() - queue.m_startTime) * 1e-9;
+		std::cout << "Batch: " << queue.m_finished - queue.m_failed << " of " << queue.m_finished << " images written in " << seconds << " s, "
+			<< static_cast<double>(queue.m_finished) / std::max(seconds, 1e-3) << " images/s" << std::endl;
+	}
+	else
+	{
+		std::cout << "Golden test: " << queue.m_finished - queue.m_failed << " of " << queue.m_finished << " cases passed" << std::endl;
+	}
+	m_exitCode = queue.m_failed > 0 ? 1 : 0;
+}
 
-	for (size_t i = 0; i < numMeshes; ++i) {
-		const VulpixMesh& mesh = m_scene.m_meshes[i];
-		VkDescriptorBufferInfo& matIDsInfo = m_scene.m_matBufferInfos[i];
-		VkDescriptorBufferInfo& attribsInfo = m_scene.m_attributesBufferInfos[i];
-		VkDescriptorBufferInfo& facesInfo = m_scene.m_facesBufferInfos[i];
+void VulpixApp::dumpGpuProfile() const
+{
+	if (!m_gpuProfiler.isEnabled())
+	{
+		std::cout << "GPU timestamps are not supported on the graphics queue" << std::endl;
+		return;
+	}
 
-		matIDsInfo.buffer = mesh.m_material.getBuffer();
-		matIDsInfo.offset = 0;
-		matIDsInfo.range = mesh.m_material.getSize();
+	std::cout << "GPU stages over the last " << VulpixGpuProfiler::m_historySize << " frames (min / avg / p99 ms)" << std::endl;
+	for (const GpuStageStats& stage : m_gpuProfiler.getStats())
+	{
+		std::cout << "  " << stage.m_name << ": " << stage.m_min << " / " << stage.m_avg << " / " << stage.m_p99 << std::endl;
+	}
 
-		attribsInfo.buffer = mesh.m_attribute.getBuffer();
-		attribsInfo.offset = 0;
-		attribsInfo.range = mesh.m_attribute.getSize();
+#if VULPIX_RAY_COUNTERS
+	std::cout << "Rays of the last frame: " << m_rayCounts.m_primary << " primary, " << m_rayCounts.m_reflection << " reflection, "
+		<< m_rayCounts.m_refraction << " refraction, " << m_rayCounts.m_shadow << " shadow, " << m_mraysPerSecond << " Mrays/s" << std::endl;
+#endif
 
-		facesInfo.buffer = mesh.m_faces.getBuffer();
-		facesInfo.offset = 0;
-		facesInfo.range = mesh.m_faces.getSize();
+	if (m_gpuProfiler.writeCsv("gpu_profile.csv"))
+	{
+		std::cout << "Written to gpu_profile.csv" << std::endl;
 	}
+}
 
-	m_scene.m_texBufferInfos.resize(numMaterials);
-	for (size_t i = 0; i < numMaterials; ++i) {
-		const VulpixMaterial& mat = m_scene.m_materials[i];
-		VkDescriptorImageInfo& textureInfo = m_scene.m_texBufferInfos[i];
+void VulpixApp::updateRayCounters(uint32_t frameIndex)
+{
+#if VULPIX_RAY_COUNTERS
+	// this frame's fence has signaled, its counters and the profiler's times are from the same submission
+	RayCounters& counters = m_frameStats[frameIndex]->m_rays;
+	m_rayCounts = counters;
+	counters = {};
 
-		textureInfo.sampler = mat.m_texture.getSampler();
-		textureInfo.imageView = mat.m_texture.getImageView();
-		textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	m_raysPerFrame = static_cast<uint64_t>(m_rayCounts.m_primary) + m_rayCounts.m_reflection + m_rayCounts.m_refraction + m_rayCounts.m_shadow;
+
+	// without timestamps the whole CPU frame is the best there is, and an underestimate
+	float traceTime = m_gpuProfiler.getLastStageTime("trace");
+	if (traceTime <= 0.0f)
+	{
+		traceTime = m_cpuFrameTimes.getLast();
 	}
+	m_traceTime = std::max(traceTime, 0.001f);
+	m_mraysPerSecond = static_cast<double>(m_raysPerFrame) / (static_cast<double>(m_traceTime) * 1000.0);
+#endif
 }
 
-void VulpixApp::createScene()
+void VulpixApp::updateAccumulation(uint32_t frameIndex, UniformParams* params, const bool sceneChanged)
 {
-	m_scene.buildBLAS(m_device, m_commandPool, m_graphicsQueue);
-	m_scene.buildTLAS(m_device, m_commandPool, m_graphicsQueue);
+	// this frame's fence has signaled, its counters hold the result of the last time it was traced
+	ConvergenceParams& convergence = m_frameStats[frameIndex]->m_convergence;
+	if (convergence.m_sampleCount > 0)
+	{
+		m_convergence = static_cast<float>(convergence.m_luminanceDeltaSum) / (VULPIX_CONVERGENCE_SCALE * static_cast<float>(convergence.m_sampleCount));
+	}
+	convergence = {};
 
-	m_envTexture.load("assets/env_map/blue_photo_studio_4k.hdr");
+	const bool cameraMoved = params->m_cameraPosition != params->m_prevCameraPosition || params->m_cameraDirection != params->m_prevCameraDirection;
 
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-	subresourceRange.baseArrayLayer = 0;
-	subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	// interleaved frames are reconstructed from history instead
+	const bool accumulate = m_progressive && m_interleave == VULPIX_INTERLEAVE_NONE;
 
-	m_envTexture.createImageView(VK_IMAGE_VIEW_TYPE_2D, m_envTexture.getFormat(), subresourceRange);
-	m_envTexture.createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_MIPMAP_MODE_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+	if (!accumulate || cameraMoved || sceneChanged || m_restartAccumulation)
+	{
+		m_accumulatedSamples = 0;
+		m_convergence = 0.0f;
+		m_restartAccumulation = false;
+	}
 
-	m_envTextureInfo.sampler = m_envTexture.getSampler();
-	m_envTextureInfo.imageView = m_envTexture.getImageView();
-	m_envTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	params->m_accumulationParams = vec4(static_cast<float>(m_accumulatedSamples), accumulate ? 1.0f : 0.0f, 0.0f, 0.0f);
 
+	if (accumulate)
+	{
+		++m_accumulatedSamples;
+	}
 }
 
-void VulpixApp::createCamera()
+void VulpixApp::createSecondaryCache()
 {
-	VkResult error = m_cameraBuffer.createBuffer(sizeof(UniformParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	CHECK_VK_ERROR(error, "Could not create camera buffer");
-
-	m_camera.setViewport( { 0, 0, static_cast<int>(m_settings.m_resolutionX), static_cast<int>(m_settings.m_resolutionY) } ) ;
-	m_camera.setPlanes(0.1f, 10000.f);
-	m_camera.setFOV(45.0f);
-	m_camera.lookCameraAt(vulpix::math::vec3(0.f, 2.f, 15.f), vulpix::math::vec3(0.f, 0.f, 0.f));
+	const VkExtent3D extent = { m_settings.m_resolutionX, m_settings.m_resolutionY, 1 };
+	VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
 
+	for (Image& cache : m_secondaryCache)
+	{
+		VkResult error = cache.createImage(VK_IMAGE_TYPE_2D,
+			VK_FORMAT_R16G16B16A16_SFLOAT,
+			extent,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		CHECK_VK_ERROR(error, "Could not create a secondary cache image");
+
+		error = cache.createImageView(VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R16G16B16A16_SFLOAT, range);
+		CHECK_VK_ERROR(error, "Could not create a secondary cache image view");
+	}
 }
 
-void VulpixApp::updateCamera(UniformParams* params, const float dt)
+void VulpixApp::updateSecondaryCache(uint32_t frameIndex, UniformParams* params)
 {
-	vec2 moveDelta(0.0f, 0.0f);
-	if (m_WKeyDown) {
-		moveDelta.y += 1.0f;
-	}
-	if (m_SKeyDown) {
-		moveDelta.y -= 1.0f;
-	}
-	if (m_AKeyDown) {
-		moveDelta.x -= 1.0f;
+	// this frame's fence has signaled, its counters hold the result of the last time it was traced
+	SecondaryCacheStats& stats = m_frameStats[frameIndex]->m_secondaryCache;
+	if (stats.m_candidatePixels > 0)
+	{
+		m_secondaryCacheReuse = static_cast<float>(stats.m_reusedPixels) / static_cast<float>(stats.m_candidatePixels);
+
+		// a reused pixel skips about as many rays as the traced candidates spent
+		const uint32_t tracedPixels = stats.m_candidatePixels - stats.m_reusedPixels;
+		const double raysPerPixel = (tracedPixels > 0) ? static_cast<double>(stats.m_secondaryRays) / static_cast<double>(tracedPixels) : 0.0;
+		m_secondaryRaysSaved = static_cast<uint64_t>(raysPerPixel * stats.m_reusedPixels * VULPIX_STATS_STRIDE * VULPIX_STATS_STRIDE);
 	}
-	if (m_DKeyDown) {
-		moveDelta.x += 1.0f;
+	else
+	{
+		m_secondaryCacheReuse = 0.0f;
+		m_secondaryRaysSaved = 0;
 	}
+	stats = {};
 
-	moveDelta *= m_moveSpeed * dt * (m_ShiftDown ? m_mouseSensitivity : 1.0f);
-	m_camera.moveCamera(moveDelta.x, moveDelta.y);
+	// accumulated samples after the first have to trace fresh jittered bounces, interleaved frames have their own history
+	m_secondaryCacheActive = m_secondaryCacheEnabled && m_interleave == VULPIX_INTERLEAVE_NONE && params->m_accumulationParams.x == 0.0f;
+	m_secondaryCacheValid = m_secondaryCacheActive && m_secondaryCacheWritten &&
+		m_secondaryCacheExtent.width == m_renderExtent.width && m_secondaryCacheExtent.height == m_renderExtent.height;
 
-	params->m_cameraPosition = vec4(m_camera.getPosition(), 0.0f);
-	params->m_cameraDirection = vec4(m_camera.getForward(), 0.0f);
-	params->m_cameraUp = vec4(m_camera.getUp(), 0.0f);
-	params->m_cameraRight = vec4(m_camera.getSide(), 0.0f);
-	params->m_cameraNearFarFOV = vec4(m_camera.getNearPlane(), m_camera.getFarPlane(), glm::radians(m_camera.getFOV()), 0.0f);
+	if (m_secondaryCacheActive)
+	{
+		// last frame wrote the other cache image
+		m_secondaryCacheParity = 1 - m_secondaryCacheParity;
+	}
 
+	m_secondaryCacheWritten = m_secondaryCacheActive;
+	m_secondaryCacheExtent = m_renderExtent;
 
-	
+	params->m_historyParams.y = static_cast<float>(m_secondaryCacheParity);
+	params->m_historyParams.z = m_secondaryCacheValid ? 1.0f : 0.0f;
+	params->m_historyParams.w = m_secondaryCacheActive ? static_cast<float>(m_secondaryCacheRefreshInterval) : 0.0f;
 }
 
 void VulpixApp::createDescriptorSetLayouts()
@@ -435,6 +1745,10 @@ void VulpixApp::createDescriptorSetLayouts()
 	//  binding 0  ->  AS
 	//  binding 1  ->  output image
 	//  binding 2  ->  Camera data
+	//  binding 3  ->  per-mesh info (alpha tested face range)
+	//  binding 4  ->  accumulation image
+	//  binding 5  ->  frame stats (convergence, secondary cache counters)
+	//  binding 6  ->  interleaved samples
 
 	VkDescriptorSetLayoutBinding accelerationStructureLayoutBinding;
 	accelerationStructureLayoutBinding.binding = VULPIX_SCENE_AS_BINDING;
@@ -452,15 +1766,55 @@ void VulpixApp::createDescriptorSetLayouts()
 
 	VkDescriptorSetLayoutBinding camdataBufferBinding;
 	camdataBufferBinding.binding = VULPIX_CAMDATA_BINDING;
-	camdataBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	camdataBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	camdataBufferBinding.descriptorCount = 1;
 	camdataBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
 	camdataBufferBinding.pImmutableSamplers = nullptr;
 
+	VkDescriptorSetLayoutBinding meshInfoBufferBinding;
+	meshInfoBufferBinding.binding = VULPIX_MESH_INFO_BINDING;
+	meshInfoBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	meshInfoBufferBinding.descriptorCount = 1;
+	meshInfoBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+	meshInfoBufferBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding accumulationImageLayoutBinding;
+	accumulationImageLayoutBinding.binding = VULPIX_ACCUMULATION_IMAGE_BINDING;
+	accumulationImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	accumulationImageLayoutBinding.descriptorCount = 1;
+	accumulationImageLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	accumulationImageLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding frameStatsBufferBinding;
+	frameStatsBufferBinding.binding = VULPIX_FRAME_STATS_BINDING;
+	frameStatsBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	frameStatsBufferBinding.descriptorCount = 1;
+	frameStatsBufferBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	frameStatsBufferBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding sampleImageLayoutBinding;
+	sampleImageLayoutBinding.binding = VULPIX_SAMPLE_IMAGE_BINDING;
+	sampleImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	sampleImageLayoutBinding.descriptorCount = 1;
+	sampleImageLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	sampleImageLayoutBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding secondaryCacheLayoutBinding;
+	secondaryCacheLayoutBinding.binding = VULPIX_SECONDARY_CACHE_BINDING;
+	secondaryCacheLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	secondaryCacheLayoutBinding.descriptorCount = 2;
+	secondaryCacheLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	secondaryCacheLayoutBinding.pImmutableSamplers = nullptr;
+
 	std::vector<VkDescriptorSetLayoutBinding> bindings({
 		accelerationStructureLayoutBinding,
 		resultImageLayoutBinding,
-		camdataBufferBinding
+		camdataBufferBinding,
+		meshInfoBufferBinding,
+		accumulationImageLayoutBinding,
+		frameStatsBufferBinding,
+		sampleImageLayoutBinding,
+		secondaryCacheLayoutBinding
 		});
 
 	VkDescriptorSetLayoutCreateInfo set0LayoutInfo;
@@ -488,7 +1842,7 @@ void VulpixApp::createDescriptorSetLayouts()
 	ssboBinding.binding = 0;
 	ssboBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	ssboBinding.descriptorCount = numMeshes;
-	ssboBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+	ssboBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
 	ssboBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutCreateInfo set1LayoutInfo;
@@ -522,7 +1876,7 @@ void VulpixApp::createDescriptorSetLayouts()
 	textureBinding.binding = 0;
 	textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	textureBinding.descriptorCount = numMaterials;
-	textureBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+	textureBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
 	textureBinding.pImmutableSamplers = nullptr;
 
 	set1LayoutInfo.pBindings = &textureBinding;
@@ -547,7 +1901,7 @@ void VulpixApp::createDescriptorSetLayouts()
 
 }
 
-void VulpixApp::createRTPipelineAndSBT()
+bool VulpixApp::createRTPipelineAndSBT()
 {
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -558,20 +1912,50 @@ void VulpixApp::createRTPipelineAndSBT()
 	CHECK_VK_ERROR(error, "vkCreatePipelineLayout");
 
 
-	Shader rayGenShader, rayChitShader, rayMissShader, shadowChit, shadowMiss;
-	rayGenShader.load(("assets/out_shaders/ray_gen.bin"));
-	rayChitShader.load(("assets/out_shaders/ray_chit.bin"));
-	rayMissShader.load(("assets/out_shaders/ray_miss.bin"));
-	shadowChit.load(("assets/out_shaders/shadow_ray_chit.bin"));
-	shadowMiss.load(("assets/out_shaders/shadow_ray_miss.bin"));
+	// the ray counters are summed with subgroup arithmetic, which not every device has in ray generation shaders
+	const char* rayGenPath = "assets/out_shaders/ray_gen.bin";
+#if VULPIX_RAY_COUNTERS
+	const bool subgroupCounters = (m_subgroupProperties.supportedStages & VK_SHADER_STAGE_RAYGEN_BIT_KHR) != 0
+		&& (m_subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_ARITHMETIC_BIT) != 0;
+	if (!subgroupCounters)
+	{
+		std::cout << "No subgroup arithmetic in ray generation shaders, the ray counters use one atomic per invocation" << std::endl;
+		rayGenPath = "assets/out_shaders/ray_gen_atomics.bin";
+	}
+#endif
+
+	Shader rayGenShader, rayChitShader, rayAhitShader, rayMissShader, shadowChit, shadowMiss;
+	const std::pair<Shader*, const char*> shaders[] = {
+		{ &rayGenShader, rayGenPath },
+		{ &rayChitShader, "assets/out_shaders/ray_chit.bin" },
+		{ &rayAhitShader, "assets/out_shaders/ray_ahit.bin" },
+		{ &rayMissShader, "assets/out_shaders/ray_miss.bin" },
+		{ &shadowChit, "assets/out_shaders/shadow_ray_chit.bin" },
+		{ &shadowMiss, "assets/out_shaders/shadow_ray_miss.bin" },
+	};
+
+	// the binaries aren't built with the project, a missing one would only show up as a broken pipeline
+	for (const auto& shader : shaders)
+	{
+		if (!shader.first->load(shader.second))
+		{
+			std::cout << "Could not load " << shader.second << ", run assets/compile_shaders.cmd after changing the shaders" << std::endl;
+			return false;
+		}
+	}
 
-	m_sbt.initSBT(2, 2, m_rayTracingPipelineProperties.shaderGroupHandleSize, m_rayTracingPipelineProperties.shaderGroupBaseAlignment);
+	m_sbt.initSBT(VULPIX_NUM_HIT_GROUPS, 2, m_rayTracingPipelineProperties.shaderGroupHandleSize, m_rayTracingPipelineProperties.shaderGroupBaseAlignment);
 
 	m_sbt.setRaygenStage(rayGenShader.getShaderStageInfo(VK_SHADER_STAGE_RAYGEN_BIT_KHR));
 
+	// opaque geometry
 	m_sbt.addStageToHitGroup({ rayChitShader.getShaderStageInfo(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, VULPIX_PRIMARY_HIT_SHADERS_INDEX);
 	m_sbt.addStageToHitGroup({ shadowChit.getShaderStageInfo(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) }, VULPIX_PRIMARY_SHADOW_HIT_SHADERS_INDEX);
 
+	// alpha tested geometry, same closest-hits plus the alpha test
+	m_sbt.addStageToHitGroup({ rayChitShader.getShaderStageInfo(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR), rayAhitShader.getShaderStageInfo(VK_SHADER_STAGE_ANY_HIT_BIT_KHR) }, VULPIX_ALPHA_HIT_SHADERS_INDEX);
+	m_sbt.addStageToHitGroup({ shadowChit.getShaderStageInfo(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR), rayAhitShader.getShaderStageInfo(VK_SHADER_STAGE_ANY_HIT_BIT_KHR) }, VULPIX_ALPHA_SHADOW_HIT_SHADERS_INDEX);
+
 	m_sbt.addStageToMissGroup(rayMissShader.getShaderStageInfo(VK_SHADER_STAGE_MISS_BIT_KHR), VULPIX_PRIMARY_MISS_SHADERS_INDEX);
 	m_sbt.addStageToMissGroup(shadowMiss.getShaderStageInfo(VK_SHADER_STAGE_MISS_BIT_KHR), VULPIX_PRIMARY_SHADOW_MISS_SHADERS_INDEX);
 
@@ -587,20 +1971,28 @@ void VulpixApp::createRTPipelineAndSBT()
 
 	error = vkCreateRayTracingPipelinesKHR(m_device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayPipelineInfo, VK_NULL_HANDLE, &m_pipeline);
 	CHECK_VK_ERROR(error, "vkCreateRayTracingPipelinesKHR");
+	if (VK_SUCCESS != error)
+	{
+		return false;
+	}
 
 	m_sbt.createSBT(m_device, m_pipeline);
-
+	return true;
 }
 
 void VulpixApp::updateDescriptorSets()
 {
 	const uint32_t numMeshes = static_cast<uint32_t>(m_scene.m_meshes.size());
 	const uint32_t numMaterials = static_cast<uint32_t>(m_scene.m_materials.size());
+	const uint32_t numFrames = m_settings.m_framesInFlight;
+	const uint32_t numFrameSets = numFrames * 2; // set 0 per frame in flight, direct and upscaled
+	const uint32_t numSets = NUM_DESCRIPTOR_SETS - 1 + numFrameSets;
 
 	std::vector<VkDescriptorPoolSize> poolSizes({
-		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },       // top-level AS
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },                    // output image
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },                   // Camera data
+		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, numFrameSets },    // top-level AS
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numFrameSets * 5 },             // output image, accumulation image, samples, secondary caches
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, numFrameSets },        // frame params
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numFrameSets * 2 },            // mesh infos, frame stats
 		//
 		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numMeshes * 3 },       // per-face material IDs for each mesh
 		// vertex attribs for each mesh
@@ -616,40 +2008,49 @@ void VulpixApp::updateDescriptorSets()
 	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolCreateInfo.pNext = nullptr;
 	descriptorPoolCreateInfo.flags = 0;
-	descriptorPoolCreateInfo.maxSets = NUM_DESCRIPTOR_SETS;
+	descriptorPoolCreateInfo.maxSets = numSets;
 	descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	descriptorPoolCreateInfo.pPoolSizes = poolSizes.data();
 
 	VkResult error = vkCreateDescriptorPool(m_device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool);
 	CHECK_VK_ERROR(error, "vkCreateDescriptorPool");
 
-	m_descriptorSets.resize(NUM_DESCRIPTOR_SETS);
-
 	std::vector<uint32_t> variableDescriptorCounts({
-		1,
 		numMeshes,      // per-face material IDs for each mesh
 		numMeshes,      // vertex attribs for each mesh
 		numMeshes,      // faces buffer for each mesh
 		numMaterials,   // textures for each material
 		1,              // environment texture
 		});
+	variableDescriptorCounts.insert(variableDescriptorCounts.begin(), numFrameSets, 1u);
+
+	// the per-frame set 0 copies come first, then sets 1..5
+	std::vector<VkDescriptorSetLayout> setLayouts(numFrameSets, m_descriptorSetLayouts[VULPIX_SCENE_AS_SET]);
+	setLayouts.insert(setLayouts.end(), m_descriptorSetLayouts.begin() + 1, m_descriptorSetLayouts.end());
 
 	VkDescriptorSetVariableDescriptorCountAllocateInfo variableDescriptorCountInfo;
 	variableDescriptorCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
 	variableDescriptorCountInfo.pNext = nullptr;
-	variableDescriptorCountInfo.descriptorSetCount = NUM_DESCRIPTOR_SETS;
+	variableDescriptorCountInfo.descriptorSetCount = numSets;
 	variableDescriptorCountInfo.pDescriptorCounts = variableDescriptorCounts.data(); // actual number of descriptors
 
 	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo;
 	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	descriptorSetAllocateInfo.pNext = &variableDescriptorCountInfo;
 	descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
-	descriptorSetAllocateInfo.descriptorSetCount = NUM_DESCRIPTOR_SETS;
-	descriptorSetAllocateInfo.pSetLayouts = m_descriptorSetLayouts.data();
+	descriptorSetAllocateInfo.descriptorSetCount = numSets;
+	descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
 
-	error = vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, m_descriptorSets.data());
+	std::vector<VkDescriptorSet> sets(numSets);
+	error = vkAllocateDescriptorSets(m_device, &descriptorSetAllocateInfo, sets.data());
 	CHECK_VK_ERROR(error, "vkAllocateDescriptorSets");
 
+	// m_descriptorSets keeps the set numbering, its set 0 is frame 0's
+	m_frameDescriptorSets.assign(sets.begin(), sets.begin() + numFrameSets);
+	m_descriptorSets.resize(NUM_DESCRIPTOR_SETS);
+	m_descriptorSets[VULPIX_SCENE_AS_SET] = m_frameDescriptorSets[0];
+	std::copy(sets.begin() + numFrameSets, sets.end(), m_descriptorSets.begin() + 1);
+
 	///////////////////////////////////////////////////////////
 
 	VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo;
@@ -674,7 +2075,7 @@ void VulpixApp::updateDescriptorSets()
 
 	VkDescriptorImageInfo descriptorOutputImageInfo;
 	descriptorOutputImageInfo.sampler = VK_NULL_HANDLE;
-	descriptorOutputImageInfo.imageView = m_offscreenImage.getImageView();
+	descriptorOutputImageInfo.imageView = VK_NULL_HANDLE; // per frame, filled below
 	descriptorOutputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
 	VkWriteDescriptorSet resultImageWrite;
@@ -692,9 +2093,9 @@ void VulpixApp::updateDescriptorSets()
 	///////////////////////////////////////////////////////////
 
 	VkDescriptorBufferInfo camdataBufferInfo;
-	camdataBufferInfo.buffer = m_cameraBuffer.getBuffer();
+	camdataBufferInfo.buffer = m_uniformRing.getBuffer();
 	camdataBufferInfo.offset = 0;
-	camdataBufferInfo.range = m_cameraBuffer.getSize();
+	camdataBufferInfo.range = sizeof(UniformParams); // the dynamic offset picks the frame's block
 
 	VkWriteDescriptorSet camdataBufferWrite;
 	camdataBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -703,13 +2104,111 @@ void VulpixApp::updateDescriptorSets()
 	camdataBufferWrite.dstBinding = VULPIX_CAMDATA_BINDING;
 	camdataBufferWrite.dstArrayElement = 0;
 	camdataBufferWrite.descriptorCount = 1;
-	camdataBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	camdataBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	camdataBufferWrite.pImageInfo = nullptr;
 	camdataBufferWrite.pBufferInfo = &camdataBufferInfo;
 	camdataBufferWrite.pTexelBufferView = nullptr;
 
 	///////////////////////////////////////////////////////////
 
+	VkDescriptorBufferInfo meshInfoBufferInfo;
+	meshInfoBufferInfo.buffer = m_scene.m_meshInfos.getBuffer();
+	meshInfoBufferInfo.offset = 0;
+	meshInfoBufferInfo.range = m_scene.m_meshInfos.getSize();
+
+	VkWriteDescriptorSet meshInfoBufferWrite;
+	meshInfoBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	meshInfoBufferWrite.pNext = nullptr;
+	meshInfoBufferWrite.dstSet = m_descriptorSets[VULPIX_MESH_INFO_SET];
+	meshInfoBufferWrite.dstBinding = VULPIX_MESH_INFO_BINDING;
+	meshInfoBufferWrite.dstArrayElement = 0;
+	meshInfoBufferWrite.descriptorCount = 1;
+	meshInfoBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	meshInfoBufferWrite.pImageInfo = nullptr;
+	meshInfoBufferWrite.pBufferInfo = &meshInfoBufferInfo;
+	meshInfoBufferWrite.pTexelBufferView = nullptr;
+
+	///////////////////////////////////////////////////////////
+
+	VkDescriptorImageInfo accumulationImageInfo;
+	accumulationImageInfo.sampler = VK_NULL_HANDLE;
+	accumulationImageInfo.imageView = m_accumulationImage.getImageView();
+	accumulationImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet accumulationImageWrite;
+	accumulationImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	accumulationImageWrite.pNext = nullptr;
+	accumulationImageWrite.dstSet = m_descriptorSets[VULPIX_ACCUMULATION_IMAGE_SET];
+	accumulationImageWrite.dstBinding = VULPIX_ACCUMULATION_IMAGE_BINDING;
+	accumulationImageWrite.dstArrayElement = 0;
+	accumulationImageWrite.descriptorCount = 1;
+	accumulationImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	accumulationImageWrite.pImageInfo = &accumulationImageInfo;
+	accumulationImageWrite.pBufferInfo = nullptr;
+	accumulationImageWrite.pTexelBufferView = nullptr;
+
+	///////////////////////////////////////////////////////////
+
+	VkDescriptorBufferInfo frameStatsBufferInfo;
+	frameStatsBufferInfo.buffer = VK_NULL_HANDLE; // per frame, filled below
+	frameStatsBufferInfo.offset = 0;
+	frameStatsBufferInfo.range = sizeof(FrameStats);
+
+	VkWriteDescriptorSet frameStatsBufferWrite;
+	frameStatsBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	frameStatsBufferWrite.pNext = nullptr;
+	frameStatsBufferWrite.dstSet = m_descriptorSets[VULPIX_FRAME_STATS_SET];
+	frameStatsBufferWrite.dstBinding = VULPIX_FRAME_STATS_BINDING;
+	frameStatsBufferWrite.dstArrayElement = 0;
+	frameStatsBufferWrite.descriptorCount = 1;
+	frameStatsBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	frameStatsBufferWrite.pImageInfo = nullptr;
+	frameStatsBufferWrite.pBufferInfo = &frameStatsBufferInfo;
+	frameStatsBufferWrite.pTexelBufferView = nullptr;
+
+	///////////////////////////////////////////////////////////
+
+	VkDescriptorImageInfo sampleImageInfo;
+	sampleImageInfo.sampler = VK_NULL_HANDLE;
+	sampleImageInfo.imageView = m_sampleImage.getImageView();
+	sampleImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet sampleImageWrite;
+	sampleImageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	sampleImageWrite.pNext = nullptr;
+	sampleImageWrite.dstSet = m_descriptorSets[VULPIX_SAMPLE_IMAGE_SET];
+	sampleImageWrite.dstBinding = VULPIX_SAMPLE_IMAGE_BINDING;
+	sampleImageWrite.dstArrayElement = 0;
+	sampleImageWrite.descriptorCount = 1;
+	sampleImageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	sampleImageWrite.pImageInfo = &sampleImageInfo;
+	sampleImageWrite.pBufferInfo = nullptr;
+	sampleImageWrite.pTexelBufferView = nullptr;
+
+	///////////////////////////////////////////////////////////
+
+	VkDescriptorImageInfo secondaryCacheInfos[2];
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		secondaryCacheInfos[i].sampler = VK_NULL_HANDLE;
+		secondaryCacheInfos[i].imageView = m_secondaryCache[i].getImageView();
+		secondaryCacheInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	}
+
+	VkWriteDescriptorSet secondaryCacheWrite;
+	secondaryCacheWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	secondaryCacheWrite.pNext = nullptr;
+	secondaryCacheWrite.dstSet = m_descriptorSets[VULPIX_SECONDARY_CACHE_SET];
+	secondaryCacheWrite.dstBinding = VULPIX_SECONDARY_CACHE_BINDING;
+	secondaryCacheWrite.dstArrayElement = 0;
+	secondaryCacheWrite.descriptorCount = 2;
+	secondaryCacheWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	secondaryCacheWrite.pImageInfo = secondaryCacheInfos;
+	secondaryCacheWrite.pBufferInfo = nullptr;
+	secondaryCacheWrite.pTexelBufferView = nullptr;
+
+	///////////////////////////////////////////////////////////
+
 	VkWriteDescriptorSet matIDsBufferWrite;
 	matIDsBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	matIDsBufferWrite.pNext = nullptr;
@@ -781,10 +2280,6 @@ void VulpixApp::updateDescriptorSets()
 	///////////////////////////////////////////////////////////
 
 	std::vector<VkWriteDescriptorSet> descriptorWrites({
-		accelerationStructureWrite,
-		resultImageWrite,
-		camdataBufferWrite,
-		//
 		matIDsBufferWrite,
 		//
 		attribsBufferWrite,
@@ -798,6 +2293,31 @@ void VulpixApp::updateDescriptorSets()
 
 	vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, VK_NULL_HANDLE);
 
+	// set 0 for every frame in flight, only the result image and the frame stats differ
+	for (uint32_t frameSet = 0; frameSet < numFrameSets; ++frameSet)
+	{
+		const uint32_t frame = frameSet % numFrames;
+		descriptorOutputImageInfo.imageView = (frameSet < numFrames) ? m_frameImages[frame].getImageView() : m_traceImages[frame].getImageView();
+		frameStatsBufferInfo.buffer = m_frameStatsBuffers[frame].getBuffer();
+
+		VkWriteDescriptorSet frameWrites[] = {
+			accelerationStructureWrite,
+			resultImageWrite,
+			camdataBufferWrite,
+			meshInfoBufferWrite,
+			accumulationImageWrite,
+			frameStatsBufferWrite,
+			sampleImageWrite,
+			secondaryCacheWrite
+		};
+
+		for (VkWriteDescriptorSet& write : frameWrites)
+		{
+			write.dstSet = m_frameDescriptorSets[frameSet];
+		}
+
+		vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(sizeof(frameWrites) / sizeof(frameWrites[0])), frameWrites, 0, VK_NULL_HANDLE);
+	}
 }
 
 void VulpixApp::renderUI()
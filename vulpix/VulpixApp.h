@@ -6,6 +6,18 @@
 #include "Renderer/Camera.h"
 #include "Core/ShaderBindingTable.h"
 #include "Core/Vulpix_Scene.h"
+#include "Core/Vulpix_Deformer.h"
+#include "Core/Vulpix_MeshProcessing.h"
+#include "Core/Vulpix_SceneLoader.h"
+#include "Core/Vulpix_UniformRing.h"
+#include "Core/Vulpix_DynamicResolution.h"
+#include "Core/Vulpix_Upscaler.h"
+#include "Core/Vulpix_Reconstruction.h"
+#include "Core/Vulpix_Composite.h"
+#include "Core/Vulpix_Benchmark.h"
+#include "Core/Vulpix_Golden.h"
+#include "Core/Vulpix_RenderJob.h"
+#include "Core/Vulpix_TileNetwork.h"
 #include "Core/Image.h"
 #include "Core/Buffer.h"
 #include "Shader/Shader.h"
@@ -17,31 +29,150 @@
 
 #define NUM_DESCRIPTOR_SETS 6
 
+// quality / performance trade-off of the primary rays, see applyPreset
+enum class RenderPreset
+{
+	Quality,     // every pixel every frame, accumulates when still
+	Balanced,    // checkerboard, half the pixels per frame
+	Performance, // 2x2 interleave, a quarter of the pixels per frame
+	Count
+};
+
+// runs every preset for a fixed number of frames and prints frame time and primary ray throughput
+struct PresetBenchmark
+{
+	static const uint32_t m_warmupFrames = 60;
+	static const uint32_t m_measuredFrames = 300;
+
+	bool m_running = false;
+	uint32_t m_preset = 0;
+	uint32_t m_frame = 0;
+	double m_time = 0.0;
+	double m_rays = 0.0;
+	float m_frameTime[static_cast<size_t>(RenderPreset::Count)] = {};
+	double m_raysPerFrame[static_cast<size_t>(RenderPreset::Count)] = {};
+
+	// restored when the run ends
+	RenderPreset m_savedPreset = RenderPreset::Quality;
+	bool m_savedDynamicResolution = false;
+};
+
+// replays a camera path for a fixed number of frames and writes a BenchmarkReport, see setBenchmark
+struct PathBenchmark
+{
+	BenchmarkSettings m_settings;
+	BenchmarkReport m_report;
+	bool m_running = false;
+	uint32_t m_frame = 0;
+	float m_pathTime = 0.0f;
+	uint64_t m_gpuSamples = 0; // m_gpuFrameTimes count at the last update, a new GPU time arrived when it grows
+};
+
+// images rendered headless one after the other, each from a restarted accumulation and frame counter, at its own
+// resolution. Batch jobs are written out, golden cases checked against their references, tiles sent back to the
+// coordinator, see setBatch / setGoldenTest / setTileWorker
+struct RenderQueue
+{
+	std::vector<RenderJob> m_jobs;
+	std::vector<uint32_t> m_captureFrames; // frame number of each job's last sample, UINT32_MAX until it is submitted
+	bool m_running = false;
+	uint32_t m_job = 0;
+	uint32_t m_sample = 0;
+	uint32_t m_finished = 0;
+	uint32_t m_failed = 0;                 // images that could not be written, golden cases that differ
+	uint64_t m_startTime = 0;
+
+	// golden test, every case becomes a job
+	std::vector<GoldenCase> m_goldenCases;
+	std::string m_goldenCasesPath;
+	std::string m_goldenDirectory;         // of the case file, holds the references
+	bool m_goldenUpdate = false;
+};
+
 class VulpixApp : public AppBase
 {
 public:
 	VulpixApp();
 	~VulpixApp();
 
+	// call before run(). The OBJ file to load instead of the default Sponza
+	void setScene(const std::string& fileName);
+	// call before run(). The environment map to load instead of the default one
+	void setEnvironmentMap(const std::string& fileName);
+	// call before run(). Turns the small mesh merging of the scene loader on or off (on by default), for A/B
+	// benchmarks of its effect
+	void setMeshMerging(const bool enabled);
+	// call before run(). Turns the long triangle splitting of the scene loader on or off (on by default), for A/B
+	// benchmarks of its effect
+	void setTriangleSplitting(const bool enabled);
+	// call before run(). Animates the mesh with that index with a morph target, so the deform pass, the BLAS refits
+	// and the rebuilds of the refit meshes run every frame
+	void setDeformDemo(const uint32_t meshIndex);
+	// call before run(). Skins the mesh with that index to two joints and swings the upper one, so the joint palette
+	// upload and the skinned path of the deform pass run every frame. Can't be the setDeformDemo mesh
+	void setSkinDemo(const uint32_t meshIndex);
+	// call before run(). Replays settings.m_cameraPath instead of the keyboard and mouse, with a fixed launch size,
+	// and ends the run after the warmup and the measured frames
+	void setBenchmark(const BenchmarkSettings& settings);
+	// call before run(), headless only. Renders the cases of casesPath one after the other, each from a restarted
+	// accumulation and frame counter, and checks them with vulpix::checkGoldenImage. getExitCode is 1 when any
+	// case failed. update writes the renders as the new references instead
+	void setGoldenTest(const std::string& casesPath, const bool update);
+	// call before run(), headless only. Renders every job of jobsPath (see vulpix::loadRenderJobs) with one device,
+	// pipeline, scene and set of textures, and writes each image as soon as it is read back. The output images are
+	// sized for the largest job. False when the job file can't be read
+	bool setBatch(const std::string& jobsPath);
+	// call before run(), headless only. Connects to a VulpixTileCoordinator at host:port and renders the tiles it
+	// hands out until it is done. The output images are sized for its tiles. False when it can't be reached
+	bool setTileWorker(const std::string& address);
+
 
 protected:
 	virtual void initApp() override;
 	virtual void initSettings() override;
 	virtual void freeResources() override;
-	virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) override;
+	virtual void fillCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t presentTarget) override;
 
 	virtual void onMouseMove(const float x, const float y) override;
 	virtual void onMouseButton(const int button, const int action, const int mods) override;
 	virtual void onKeyboard(const int key, const int scancode, const int action, const int mods) override;
-	virtual void update(size_t imageIndex, const float dt) override;
+	virtual void update(uint32_t frameIndex, const float dt) override;
+	virtual void report(const float fps, const float frameTime) override;
+	virtual void onFrameReadback(const uint32_t frameNumber, const uint8_t* pixels, const uint32_t width, const uint32_t height) override;
 
 private:
 	void loadScene();
+	void createMeshBuffers(VulpixMesh& mesh, const VulpixMeshData& data);
 	void createScene();
+	void createDeformDemo();
+	void updateDeformDemo(const float dt);
+	void createSkinDemo();
+	void updateSkinDemo(const float dt);
 	void createCamera();
 	void updateCamera(struct UniformParams* params,const float dt);
+	void createAccumulation();
+	void createTraceImages();
+	bool createComposite();
+	void updateRenderExtent(const float dt);
+	void createInterleaveImages();
+	void updateInterleave(struct UniformParams* params);
+	VkExtent2D getLaunchExtent() const;
+	void applyPreset(const RenderPreset preset);
+	void startBenchmark();
+	void updateBenchmark(const float dt);
+	void updatePathBenchmark(const float dt);
+	void finishPathBenchmark();
+	void toggleCameraRecording();
+	bool startRenderQueue();
+	void updateRenderQueue();
+	void finishRenderJob(const uint32_t job, const uint8_t* pixels, const uint32_t width, const uint32_t height);
+	void dumpGpuProfile() const;
+	void updateAccumulation(uint32_t frameIndex, struct UniformParams* params, const bool sceneChanged);
+	void createSecondaryCache();
+	void updateSecondaryCache(uint32_t frameIndex, struct UniformParams* params);
+	void updateRayCounters(uint32_t frameIndex);
 	void createDescriptorSetLayouts();
-	void createRTPipelineAndSBT();
+	bool createRTPipelineAndSBT();
 	void updateDescriptorSets();
 	void renderUI();
 	void initImGui();
@@ -54,14 +185,94 @@ private:
 	VkPipeline m_pipeline;
 	VkDescriptorPool m_descriptorPool;
 	std::vector<VkDescriptorSet> m_descriptorSets;
+	// set 0 (TLAS, result image, camera, mesh infos, accumulation) per frame in flight, twice: the first
+	// numFrames write the frame image directly, the next numFrames the trace image that gets upscaled
+	std::vector<VkDescriptorSet> m_frameDescriptorSets;
 
 	VulpixShaderBindingTable m_sbt;
 	VulpixScene m_scene;
+	VulpixDeformer m_deformer;
+	VulpixUpscaler m_upscaler;
+	VulpixReconstruction m_reconstruction;
+	VulpixComposite m_composite;
 	Image m_envTexture;
 	VkDescriptorImageInfo m_envTextureInfo;
 
 	Camera m_camera;
-	Buffer m_cameraBuffer;
+	VulpixUniformRing m_uniformRing;
+	std::vector<uint32_t> m_frameParamsOffsets; // dynamic offset of each frame's UniformParams in the ring
+	uint32_t m_frameNumber = 0;
+	// last frame's camera, for reprojection and to detect movement
+	vec4 m_prevCameraPosition = vec4(0.0f);
+	vec4 m_prevCameraDirection = vec4(0.0f);
+	vec4 m_prevCameraUp = vec4(0.0f);
+	vec4 m_prevCameraRight = vec4(0.0f);
+
+	// progressive accumulation, restarts whenever the camera or the scene changes
+	bool m_progressive = true;
+	Image m_accumulationImage;
+	std::vector<Buffer> m_frameStatsBuffers; // one per frame in flight, host visible
+	std::vector<FrameStats*> m_frameStats;
+	uint32_t m_accumulatedSamples = 0;
+	float m_convergence = 0.0f; // mean per-pixel luminance change of the last read back frame
+	bool m_restartAccumulation = true;
+
+	// dynamic resolution, rays are launched at m_renderExtent and upscaled when it is below the output size
+	bool m_dynamicResolution = true;
+	DynamicResolutionSettings m_dynamicResolutionSettings;
+	VulpixDynamicResolution m_resolutionController;
+	std::vector<Image> m_traceImages; // one per frame in flight, output sized
+
+	// every pass before the composite works in linear radiance, the composite tonemaps and writes the presented image
+	std::vector<Image> m_frameImages; // one per frame in flight, output sized
+	uint32_t m_tonemap = VULPIX_TONEMAP_CLAMP;
+	VkExtent2D m_renderExtent = { 0, 0 };
+
+	// interleaved tracing, the skipped pixels are reconstructed from last frame's history
+	RenderPreset m_preset = RenderPreset::Quality;
+	uint32_t m_interleave = VULPIX_INTERLEAVE_NONE;
+	uint32_t m_interleaveFrame = 0;
+	Image m_sampleImage;           // this frame's traced pixels, shared by the frames in flight
+	Image m_historyImages[2];      // ping-ponged, last frame's reconstruction is read while this frame's is written
+	uint32_t m_historyParity = 0;  // the history image read this frame
+	bool m_historyValid = false;   // the history read this frame matches the current extent and pattern
+	bool m_historyWritten = false;
+	uint32_t m_historyInterleave = VULPIX_INTERLEAVE_NONE;
+	VkExtent2D m_historyExtent = { 0, 0 };
+	PresetBenchmark m_benchmark;
+	PathBenchmark m_pathBenchmark;
+	RenderQueue m_renderQueue;
+	std::unique_ptr<VulpixTileClient> m_tileClient; // tile worker only, the render queue's jobs come from it
+	VkOffset2D m_tileOffset = { 0, 0 };             // of the current tile in its image
+	VkExtent2D m_tileImageExtent = { 0, 0 };        // the image the current tile is part of, 0 when not rendering a tile
+	std::mutex m_renderQueueMutex; // the capture workers finish the jobs while the frame loop submits the next ones
+
+	// camera path recording, K starts and stops it
+	bool m_recordingCamera = false;
+	float m_recordingTime = 0.0f;
+	VulpixCameraPath m_cameraPath; // the recorded path, or the replayed one during a path benchmark
+
+	// secondary bounce cache, reflective and refractive pixels reuse last frame's bounces while their
+	// primary hit stays put. Only used for frames that are neither interleaved nor accumulating
+	bool m_secondaryCacheEnabled = true;
+	uint32_t m_secondaryCacheRefreshInterval = 4; // a cached pixel is retraced at least every this many frames
+	Image m_secondaryCache[2];                    // ping-ponged like the history images
+	uint32_t m_secondaryCacheParity = 0;          // the cache image read this frame
+	bool m_secondaryCacheActive = false;
+	bool m_secondaryCacheValid = false;
+	bool m_secondaryCacheWritten = false;
+	VkExtent2D m_secondaryCacheExtent = { 0, 0 };
+	float m_secondaryCacheReuse = 0.0f;           // of the last read back frame's candidate pixels
+	uint64_t m_secondaryRaysSaved = 0;            // estimate for the last read back frame
+
+#if VULPIX_RAY_COUNTERS
+	// rays the last read back frame traced, per type
+	RayCounters m_rayCounts = {};
+	uint64_t m_raysPerFrame = 0;
+	double m_mraysPerSecond = 0.0; // all types, over the GPU time of the trace pass
+	float m_traceTime = 0.0f;      // ms, the time m_mraysPerSecond is based on
+#endif
+
 	// keyboard and mouse
 	bool m_WKeyDown;
 	bool m_AKeyDown;
@@ -79,6 +290,20 @@ private:
 	float m_rotationSpeed = 0.25f;
 	float m_mouseSensitivity = 15.0f;
 
+	// scene loading settings
+	std::string m_sceneFile = vulpix::SCENE_DEFAULT_FILE;
+	std::string m_environmentMap = vulpix::SCENE_ENVIRONMENT_MAP;
+	bool m_splitLongTriangles = true;
+	vulpix::SplitSettings m_splitSettings;
+	bool m_mergeSmallMeshes = true;
+	vulpix::MergeSettings m_mergeSettings;
+	bool m_generateLods = true;
+	vulpix::LodSettings m_lodSettings;
+	int32_t m_deformDemoMesh = -1; // see setDeformDemo
+	float m_deformDemoTime = 0.0f;
+	int32_t m_skinDemoMesh = -1; // see setSkinDemo
+	float m_skinDemoTime = 0.0f;
+
 };
 
 
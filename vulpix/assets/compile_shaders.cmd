@@ -7,13 +7,23 @@ set BINARIES_FOLDER="./out_shaders/"
 
 :: raygen shaders
 %GLSL_COMPILER% --target-env vulkan1.2 -V -S rgen %SOURCE_FOLDER%ray_gen.glsl -o %BINARIES_FOLDER%ray_gen.bin
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S rgen -DVULPIX_SUBGROUP_RAY_COUNTERS=0 %SOURCE_FOLDER%ray_gen.glsl -o %BINARIES_FOLDER%ray_gen_atomics.bin
 
 :: closest-hit shaders
 %GLSL_COMPILER% --target-env vulkan1.2 -V -S rchit %SOURCE_FOLDER%ray_chit.glsl -o %BINARIES_FOLDER%ray_chit.bin
 %GLSL_COMPILER% --target-env vulkan1.2 -V -S rchit %SOURCE_FOLDER%shadow_ray_chit.glsl -o %BINARIES_FOLDER%shadow_ray_chit.bin
 
+:: any-hit shaders
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S rahit %SOURCE_FOLDER%ray_ahit.glsl -o %BINARIES_FOLDER%ray_ahit.bin
+
 :: miss shaders
 %GLSL_COMPILER% --target-env vulkan1.2 -V -S rmiss %SOURCE_FOLDER%ray_miss.glsl -o %BINARIES_FOLDER%ray_miss.bin
 %GLSL_COMPILER% --target-env vulkan1.2 -V -S rmiss %SOURCE_FOLDER%shadow_ray_miss.glsl -o %BINARIES_FOLDER%shadow_ray_miss.bin
 
+:: compute shaders
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S comp %SOURCE_FOLDER%deform.glsl -o %BINARIES_FOLDER%deform.bin
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S comp %SOURCE_FOLDER%composite.glsl -o %BINARIES_FOLDER%composite.bin
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S comp %SOURCE_FOLDER%upscale.glsl -o %BINARIES_FOLDER%upscale.bin
+%GLSL_COMPILER% --target-env vulkan1.2 -V -S comp %SOURCE_FOLDER%reconstruct.glsl -o %BINARIES_FOLDER%reconstruct.bin
+
 pause
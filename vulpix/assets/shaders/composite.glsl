@@ -0,0 +1,45 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "../../Shader/Shader_Config.h"
+
+layout(local_size_x = VULPIX_COMPOSITE_GROUP_SIZE, local_size_y = VULPIX_COMPOSITE_GROUP_SIZE) in;
+
+// the frame's linear radiance
+layout(set = 0, binding = VULPIX_COMPOSITE_SOURCE_BINDING, rgba16f) readonly uniform image2D SourceImage;
+// no format qualifier, the store converts to the target's own format and channel order (BGRA swapchains included)
+layout(set = 0, binding = VULPIX_COMPOSITE_TARGET_BINDING) writeonly uniform image2D TargetImage;
+
+layout(push_constant) uniform CompositePushConstants {
+    uvec4 Params; // xy: extent, z: VULPIX_TONEMAP_*, w: 1 when the target is UNORM and expects sRGB encoded values
+};
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 TonemapAces(vec3 color) {
+    const float a = 2.51f;
+    const float b = 0.03f;
+    const float c = 2.43f;
+    const float d = 0.59f;
+    const float e = 0.14f;
+    return (color * (a * color + b)) / (color * (c * color + d) + e);
+}
+
+void main() {
+    const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(gl_GlobalInvocationID.xy, Params.xy))) {
+        return;
+    }
+
+    vec3 color = max(imageLoad(SourceImage, pixel).rgb, vec3(0.0f));
+
+    if (Params.z == VULPIX_TONEMAP_ACES) {
+        color = TonemapAces(color);
+    }
+    color = clamp(color, vec3(0.0f), vec3(1.0f));
+
+    if (Params.w != 0u) {
+        color = linearToSrgb(color);
+    }
+
+    imageStore(TargetImage, pixel, vec4(color, 1.0f));
+}
@@ -0,0 +1,87 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "../../Shader/Shader_Config.h"
+
+layout(local_size_x = VULPIX_DEFORM_GROUP_SIZE) in;
+
+// positions are tightly packed vec3s (same layout the BLAS reads), so we go through floats
+layout(set = 0, binding = VULPIX_DEFORM_REST_POSITIONS_BINDING, std430) readonly buffer RestPositionsBuffer {
+    float RestPositions[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_REST_ATTRIBUTES_BINDING, std430) readonly buffer RestAttribsBuffer {
+    VertexAttributes RestAttribs[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_OUT_POSITIONS_BINDING, std430) writeonly buffer OutPositionsBuffer {
+    float OutPositions[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_OUT_ATTRIBUTES_BINDING, std430) writeonly buffer OutAttribsBuffer {
+    VertexAttributes OutAttribs[];
+};
+
+// the same binding holds skin weights or a morph target, depending on the mesh mode
+layout(set = 0, binding = VULPIX_DEFORM_DATA_BINDING, std430) readonly buffer SkinBuffer {
+    SkinVertex SkinVertices[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_DATA_BINDING, std430) readonly buffer MorphBuffer {
+    MorphVertex MorphVertices[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_JOINTS_BINDING, std430) readonly buffer JointsBuffer {
+    mat4 Joints[];
+};
+
+layout(set = 0, binding = VULPIX_DEFORM_PARAMS_BINDING, std430) readonly buffer ParamsBuffer {
+    DeformParams Params[];
+};
+
+layout(push_constant) uniform DeformPushConstants {
+    uint DeformSlot; // frame in flight * deformable count + deform slot
+};
+
+void main() {
+    const DeformParams params = Params[DeformSlot];
+    const uint idx = gl_GlobalInvocationID.x;
+
+    if (idx >= params.m_vertexCountModeJointBase.x) {
+        return;
+    }
+
+    const vec3 restPos = vec3(RestPositions[3 * idx + 0], RestPositions[3 * idx + 1], RestPositions[3 * idx + 2]);
+    const VertexAttributes rest = RestAttribs[idx];
+
+    vec3 pos;
+    vec3 normal;
+
+    if (params.m_vertexCountModeJointBase.y == VULPIX_DEFORM_MODE_SKINNED) {
+        // linear blend skinning
+        const SkinVertex skin = SkinVertices[idx];
+        const uvec4 joints = skin.m_joints + uvec4(params.m_vertexCountModeJointBase.z);
+
+        const mat4 skinMat = Joints[joints.x] * skin.m_weights.x +
+                             Joints[joints.y] * skin.m_weights.y +
+                             Joints[joints.z] * skin.m_weights.z +
+                             Joints[joints.w] * skin.m_weights.w;
+
+        pos = (skinMat * vec4(restPos, 1.0f)).xyz;
+        normal = normalize(mat3(skinMat) * rest.m_normal.xyz);
+    } else {
+        // vertex animation, blend towards the morph target
+        const MorphVertex target = MorphVertices[idx];
+        const float weight = params.m_morphWeight.x;
+
+        pos = mix(restPos, target.m_position.xyz, weight);
+        normal = normalize(mix(rest.m_normal.xyz, target.m_normal.xyz, weight));
+    }
+
+    OutPositions[3 * idx + 0] = pos.x;
+    OutPositions[3 * idx + 1] = pos.y;
+    OutPositions[3 * idx + 2] = pos.z;
+
+    OutAttribs[idx].m_normal = vec4(normal, rest.m_normal.w);
+    OutAttribs[idx].m_uv = rest.m_uv;
+}
@@ -0,0 +1,51 @@
+#version 460
+#extension GL_EXT_ray_tracing : enable
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "../../Shader/Shader_Config.h"
+
+// alpha test for both ray types, only bound to the alpha tested geometry (geometry 1 of a BLAS)
+
+layout(set = VULPIX_MESH_INFO_SET, binding = VULPIX_MESH_INFO_BINDING, std430) readonly buffer MeshInfoBuffer {
+    MeshInfo MeshInfos[];
+};
+
+layout(set = VULPIX_MATERIAL_IDS_SET, binding = 0, std430) readonly buffer MatIDsBuffer {
+    uint MatIDs[];
+} MatIDsArray[];
+
+layout(set = VULPIX_ATTRIBUTES_SET, binding = 0, std430) readonly buffer AttribsBuffer {
+    VertexAttributes VertexAttribs[];
+} AttribsArray[];
+
+layout(set = VULPIX_FACES_SET, binding = 0, std430) readonly buffer FacesBuffer {
+    uvec4 Faces[];
+} FacesArray[];
+
+layout(set = VULPIX_TEXTURES_SET, binding = 0) uniform sampler2D TexturesArray[];
+
+hitAttributeEXT vec2 HitAttribs;
+
+void main() {
+    const vec3 barycentrics = vec3(1.0f - HitAttribs.x - HitAttribs.y, HitAttribs.x, HitAttribs.y);
+
+    const uint meshIdx = gl_InstanceCustomIndexEXT / VULPIX_MAX_LODS;
+    const uint faceIdx = gl_PrimitiveID + MeshInfos[gl_InstanceCustomIndexEXT].m_faceRange.y;
+
+    const uint matID = MatIDsArray[nonuniformEXT(meshIdx)].MatIDs[faceIdx];
+
+    const uvec4 face = FacesArray[nonuniformEXT(meshIdx)].Faces[faceIdx];
+
+    const vec2 uv0 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.x)].m_uv.xy;
+    const vec2 uv1 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.y)].m_uv.xy;
+    const vec2 uv2 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.z)].m_uv.xy;
+
+    const vec2 uv = barycentricLerp(uv0, uv1, uv2, barycentrics);
+
+    const float alpha = textureLod(TexturesArray[nonuniformEXT(matID)], uv, 0.0f).a;
+
+    if (alpha < VULPIX_ALPHA_CUTOFF) {
+        ignoreIntersectionEXT;
+    }
+}
@@ -5,6 +5,10 @@
 
 #include "../../Shader/Shader_Config.h"
 
+layout(set = VULPIX_MESH_INFO_SET, binding = VULPIX_MESH_INFO_BINDING, std430) readonly buffer MeshInfoBuffer {
+    MeshInfo MeshInfos[];
+};
+
 layout(set = VULPIX_MATERIAL_IDS_SET, binding = 0, std430) readonly buffer MatIDsBuffer {
     uint MatIDs[];
 } MatIDsArray[];
@@ -25,13 +29,20 @@ layout(location = VULPIX_PRIMARY_RAYGEN_SHADER_LOC) rayPayloadInEXT RayPayLoad P
 void main() {
     const vec3 barycentrics = vec3(1.0f - HitAttribs.x - HitAttribs.y, HitAttribs.x, HitAttribs.y);
 
-    const uint matID = MatIDsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].MatIDs[gl_PrimitiveID];
+    // the custom index picks the mesh LOD, the descriptor arrays are per mesh
+    const uint meshIdx = gl_InstanceCustomIndexEXT / VULPIX_MAX_LODS;
+    const MeshInfo info = MeshInfos[gl_InstanceCustomIndexEXT];
+
+    // primitive ids restart per geometry, the alpha tested geometry starts after the opaque faces of the LOD
+    const uint faceIdx = gl_PrimitiveID + ((gl_GeometryIndexEXT == 0) ? info.m_faceRange.x : info.m_faceRange.y);
+
+    const uint matID = MatIDsArray[nonuniformEXT(meshIdx)].MatIDs[faceIdx];
 
-    const uvec4 face = FacesArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].Faces[gl_PrimitiveID];
+    const uvec4 face = FacesArray[nonuniformEXT(meshIdx)].Faces[faceIdx];
 
-    VertexAttributes v0 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.x)];
-    VertexAttributes v1 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.y)];
-    VertexAttributes v2 = AttribsArray[nonuniformEXT(gl_InstanceCustomIndexEXT)].VertexAttribs[int(face.z)];
+    VertexAttributes v0 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.x)];
+    VertexAttributes v1 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.y)];
+    VertexAttributes v2 = AttribsArray[nonuniformEXT(meshIdx)].VertexAttribs[int(face.z)];
 
     // interpolate our vertex attribs
     const vec3 normal = normalize(barycentricLerp(v0.m_normal.xyz, v1.m_normal.xyz, v2.m_normal.xyz, barycentrics));
@@ -39,7 +50,8 @@ void main() {
 
     const vec3 texel = textureLod(TexturesArray[nonuniformEXT(matID)], uv, 0.0f).rgb;
 
-    const float objId = float(gl_InstanceCustomIndexEXT);
+    // meshes can be merged at load time, so the object id lives in the face, not the instance
+    const float objId = float(face.w);
 
     PrimaryRay.m_colorAndDistance = vec4(texel, gl_HitTEXT);
     PrimaryRay.m_normalAndObjectId = vec4(normal, objId);
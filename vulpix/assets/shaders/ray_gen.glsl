@@ -1,61 +1,156 @@
 #version 460
 #extension GL_EXT_ray_tracing : enable
 #extension GL_GOOGLE_include_directive : require
+// only used by the ray counters, without them nothing needs the subgroup capability
+#extension GL_KHR_shader_subgroup_basic : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
 
 #include "../../Shader/Shader_Config.h"
 
 layout(set = VULPIX_SCENE_AS_SET,     binding = VULPIX_SCENE_AS_BINDING)            uniform accelerationStructureEXT Scene;
-layout(set = VULPIX_RESULT_IMAGE_SET, binding = VULPIX_RESULT_IMAGE_BINDING, rgba8) uniform image2D ResultImage;
+layout(set = VULPIX_RESULT_IMAGE_SET, binding = VULPIX_RESULT_IMAGE_BINDING, rgba16f) uniform image2D ResultImage;
 
 layout(set = VULPIX_CAMDATA_SET,      binding = VULPIX_CAMDATA_BINDING, std140)     uniform AppData {
     UniformParams Params;
 };
 
+// linear radiance mean in rgb, sample count in a
+layout(set = VULPIX_ACCUMULATION_IMAGE_SET, binding = VULPIX_ACCUMULATION_IMAGE_BINDING, rgba32f) uniform image2D AccumulationImage;
+
+layout(set = VULPIX_FRAME_STATS_SET,  binding = VULPIX_FRAME_STATS_BINDING, std430) buffer FrameStatsBuffer {
+    FrameStats Stats;
+};
+
+// interleaved tracing only: linear radiance in rgb, primary hit distance in a (negative on a miss),
+// the reconstruct pass fills the pixels that were skipped
+layout(set = VULPIX_SAMPLE_IMAGE_SET, binding = VULPIX_SAMPLE_IMAGE_BINDING, rgba16f) uniform image2D SampleImage;
+
+// radiance of the bounces behind reflective / refractive primary hits in rgb, primary hit distance in a
+// (negative for other pixels). Last frame's is read, this frame's written
+layout(set = VULPIX_SECONDARY_CACHE_SET, binding = VULPIX_SECONDARY_CACHE_BINDING, rgba16f) uniform image2D SecondaryCache[2];
+
 layout(location = VULPIX_PRIMARY_RAYGEN_SHADER_LOC) rayPayloadEXT RayPayLoad PrimaryRay;
 layout(location = VULPIX_SHADOW_RAYGEN_SHADER_LOC)  rayPayloadEXT ShadowRayPayLoad ShadowRay;
 
 const float eratoRefract = 1.0f / 1.31f; // ice refract
 
+#if VULPIX_RAY_COUNTERS
+#define COUNT_RAY(counter) ++rayCounts.counter
+#else
+#define COUNT_RAY(counter)
+#endif
+
 vec3 CalcRayDir(vec2 screenUV, float aspect) {
-    vec3 u = Params.m_cameraRight.xyz;
-    vec3 v = Params.m_cameraUp.xyz;
+    return cameraRayDir(Params.m_cameraDirection.xyz, Params.m_cameraRight.xyz, Params.m_cameraUp.xyz, Params.m_cameraNearFarFOV.z, aspect, screenUV);
+}
 
-    const float planeWidth = tan(Params.m_cameraNearFarFOV.z * 0.5f);
+// pcg hash, one well mixed value per (pixel, frame) is all the jitter needs
+uint PcgHash(uint v) {
+    const uint state = v * 747796405u + 2891336453u;
+    const uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
 
-    u *= (planeWidth * aspect);
-    v *= planeWidth;
+vec2 PixelJitter(uvec2 pixel, uint frame) {
+    const uint seed = PcgHash(pixel.x + PcgHash(pixel.y + PcgHash(frame)));
+    const uint second = PcgHash(seed);
+    return vec2(float(seed), float(second)) * (1.0f / 4294967296.0f) - 0.5f;
+}
 
-    const vec3 rayDir = normalize(Params.m_cameraDirection.xyz + (u * screenUV.x) - (v * screenUV.y));
-    return rayDir;
+float Luminance(vec3 color) {
+    return dot(color, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// reprojects a primary hit into last frame's secondary cache. Returns true when the entry there is usable,
+// rejected is set when there is an entry but it belongs to another surface or to a too different view
+bool LookupSecondaryCache(vec3 hitPos, vec3 viewDir, vec2 extent, out vec3 color, out bool rejected) {
+    rejected = false;
+    color = vec3(0.0f);
+
+    const vec3 toHit = hitPos - Params.m_prevCameraPosition.xyz;
+    const float prevDistance = length(toHit);
+    const vec3 prevDir = toHit / prevDistance;
+    if (dot(prevDir, Params.m_prevCameraDirection.xyz) <= 0.0f) {
+        return false;
+    }
+
+    const vec2 prevUv = cameraProject(Params.m_prevCameraDirection.xyz, Params.m_prevCameraRight.xyz, Params.m_prevCameraUp.xyz, Params.m_cameraNearFarFOV.z, extent.x / extent.y, prevDir);
+    const ivec2 prevPixel = ivec2(round(uvToPixel(prevUv, extent)));
+    if (any(lessThan(prevPixel, ivec2(0))) || any(greaterThanEqual(prevPixel, ivec2(extent)))) {
+        return false;
+    }
+
+    const vec4 cached = imageLoad(SecondaryCache[uint(Params.m_historyParams.y)], prevPixel);
+    if (cached.a < 0.0f) {
+        return false;
+    }
+
+    rejected = abs(cached.a - prevDistance) > VULPIX_CACHE_DEPTH_TOLERANCE * prevDistance || dot(viewDir, prevDir) < VULPIX_CACHE_VIEW_COS;
+    color = cached.rgb;
+    return !rejected;
 }
 
 void main() {
-    const vec2 curPixel = vec2(gl_LaunchIDEXT.xy);
-    const vec2 bottomRight = vec2(gl_LaunchSizeEXT.xy - 1);
+    const bool progressive = Params.m_accumulationParams.y > 0.0f;
+    const uint frame = uint(Params.m_frameParams.x);
+
+    // interleaved launches are narrower than the traced extent, map the launch id to the pixel it covers
+    const uint interleave = uint(Params.m_renderParams.z);
+    const vec2 extent = Params.m_renderParams.xy;
+    const uvec2 launchPixel = interleavedPixel(gl_LaunchIDEXT.xy, interleave, uint(Params.m_renderParams.w));
+    if (any(greaterThanEqual(launchPixel, uvec2(extent)))) {
+        return;
+    }
+
+    // a tile of a larger image traces the rays of its pixels in that image, with the same noise
+    const uvec2 imagePixel = launchPixel + uvec2(Params.m_tileParams.xy);
+    const vec2 imageExtent = Params.m_tileParams.zw;
 
-    const vec2 uv = (curPixel / bottomRight) * 2.0f - 1.0f;
+    // progressive frames pick a new random subpixel position per pixel, otherwise the shared jitter (if any)
+    const vec2 jitter = progressive ? PixelJitter(imagePixel, frame) : Params.m_frameParams.zw;
+    const vec2 curPixel = vec2(imagePixel) + jitter;
 
-    const float aspect = float(gl_LaunchSizeEXT.x) / float(gl_LaunchSizeEXT.y);
+    const vec2 uv = pixelToUv(curPixel, imageExtent);
+
+    const float aspect = imageExtent.x / imageExtent.y;
 
     vec3 origin = Params.m_cameraPosition.xyz;
     vec3 direction = CalcRayDir(uv, aspect);
 
-    const uint rayFlags = gl_RayFlagsOpaqueEXT;
-    const uint shadowRayFlags = gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT;
+    // no forced opaque flag, the geometry flags decide, so only alpha tested geometry runs the any-hit shader
+    const uint rayFlags = gl_RayFlagsNoneEXT;
+    const uint shadowRayFlags = gl_RayFlagsTerminateOnFirstHitEXT;
 
-    const uint cullMask = 0xFF;
+    // camera rays see the primary LOD of every mesh, bounces and shadows the (possibly coarser) secondary one
+    const uint shadowCullMask = VULPIX_SECONDARY_RAY_MASK;
 
-    const uint stbRecordStride = 1;
+    const uint stbRecordStride = VULPIX_NUM_RAY_TYPES;
 
     const float tmin = 0.0f;
     const float tmax = Params.m_cameraNearFarFOV.y;
 
     vec3 finalColor = vec3(0.0f);
+    float primaryDistance = -1.0f;
+
+    // secondary cache, only for frames that are neither interleaved nor accumulating
+    const uint cacheRefreshInterval = uint(Params.m_historyParams.w);
+    const bool cacheEnabled = cacheRefreshInterval > 0u;
+    const bool cacheUsable = cacheEnabled && Params.m_historyParams.z > 0.0f;
+    bool cacheCandidate = false;
+    bool cacheFound = false;
+    bool cacheRejected = false;
+    bool cacheReused = false;
+    vec3 cachedColor = vec3(0.0f);
+    uint rayCount = 0u;
+#if VULPIX_RAY_COUNTERS
+    uvec4 rayCounts = uvec4(0u); // x: primary, y: reflection, z: refraction, w: shadow rays of this invocation
+#endif
+    bool reflected = false; // kind of the bounce the next iteration traces, for the ray counters
 
     for (int i = 0; i < VULPIX_MAX_RECURSION; ++i) {
         traceRayEXT(Scene,
                     rayFlags,
-                    cullMask,
+                    (i == 0) ? VULPIX_PRIMARY_RAY_MASK : VULPIX_SECONDARY_RAY_MASK,
                     VULPIX_PRIMARY_HIT_SHADERS_INDEX,
                     stbRecordStride,
                     VULPIX_PRIMARY_MISS_SHADERS_INDEX,
@@ -64,10 +159,22 @@ void main() {
                     direction,
                     tmax,
                     VULPIX_PRIMARY_RAYGEN_SHADER_LOC);
+        ++rayCount;
+        if (i == 0) {
+            COUNT_RAY(x);
+        } else if (reflected) {
+            COUNT_RAY(y);
+        } else {
+            COUNT_RAY(z);
+        }
 
         const vec3 hitColor = PrimaryRay.m_colorAndDistance.rgb;
         const float hitDistance = PrimaryRay.m_colorAndDistance.w;
 
+        if (i == 0) {
+            primaryDistance = hitDistance;
+        }
+
         // if hit background - quit
         if (hitDistance < 0.0f) {
             finalColor += hitColor;
@@ -78,11 +185,28 @@ void main() {
 
             const vec3 hitPos = origin + direction * hitDistance;
 
+            // the color of reflective and refractive surfaces comes entirely from the bounces behind them,
+            // which is what the cache holds. Stable pixels still refresh every cacheRefreshInterval frames
+            if (i == 0 && cacheEnabled && (objectId == VULPIX_OBJECT_ID_TEAPOT || objectId == VULPIX_OBJECT_ID_ERATO)) {
+                cacheCandidate = true;
+                if (cacheUsable) {
+                    cacheFound = LookupSecondaryCache(hitPos, direction, extent, cachedColor, cacheRejected);
+                }
+
+                const bool refresh = ((PcgHash(launchPixel.x + PcgHash(launchPixel.y)) + frame) % cacheRefreshInterval) == 0u;
+                if (cacheFound && !refresh) {
+                    finalColor = cachedColor;
+                    cacheReused = true;
+                    break;
+                }
+            }
+
             if (objectId == VULPIX_OBJECT_ID_TEAPOT) {
                 // reflection part
 
                 origin = hitPos + hitNormal * 0.001f;
                 direction = reflect(direction, hitNormal);
+                reflected = true;
             } else if (objectId == VULPIX_OBJECT_ID_ERATO) {
                 //  refract part
 
@@ -101,6 +225,7 @@ void main() {
 
                 origin = hitPos + direction * 0.001f;
                 direction = refract(direction, refrNormal, refrEta);
+                reflected = false;
             } else {
                 // diffuse part
 
@@ -109,7 +234,7 @@ void main() {
 
                 traceRayEXT(Scene,
                             shadowRayFlags,
-                            cullMask,
+                            shadowCullMask,
                             VULPIX_PRIMARY_SHADOW_HIT_SHADERS_INDEX,
                             stbRecordStride,
                             VULPIX_PRIMARY_SHADOW_MISS_SHADERS_INDEX,
@@ -118,6 +243,8 @@ void main() {
                             toLight,
                             tmax,
                             VULPIX_SHADOW_RAYGEN_SHADER_LOC);
+                ++rayCount;
+                COUNT_RAY(w);
 
                 const float lighting = (ShadowRay.m_distance > 0.0f) ? Params.m_sunPosAndAmbient.w : max(Params.m_sunPosAndAmbient.w, dot(hitNormal, toLight));
 
@@ -128,5 +255,71 @@ void main() {
         }
     }
 
-    imageStore(ResultImage, ivec2(gl_LaunchIDEXT.xy), vec4(linearToSrgb(finalColor), 1.0f));
+    const ivec2 pixel = ivec2(launchPixel);
+
+#if VULPIX_RAY_COUNTERS && VULPIX_SUBGROUP_RAY_COUNTERS
+    // one atomic per counter and subgroup instead of one per invocation
+    rayCounts = subgroupAdd(rayCounts);
+    if (subgroupElect()) {
+        atomicAdd(Stats.m_rays.m_primary, rayCounts.x);
+        atomicAdd(Stats.m_rays.m_reflection, rayCounts.y);
+        atomicAdd(Stats.m_rays.m_refraction, rayCounts.z);
+        atomicAdd(Stats.m_rays.m_shadow, rayCounts.w);
+    }
+#elif VULPIX_RAY_COUNTERS
+    // devices without subgroup arithmetic in ray generation shaders, only the counters that changed
+    if (rayCounts.x > 0u) {
+        atomicAdd(Stats.m_rays.m_primary, rayCounts.x);
+    }
+    if (rayCounts.y > 0u) {
+        atomicAdd(Stats.m_rays.m_reflection, rayCounts.y);
+    }
+    if (rayCounts.z > 0u) {
+        atomicAdd(Stats.m_rays.m_refraction, rayCounts.z);
+    }
+    if (rayCounts.w > 0u) {
+        atomicAdd(Stats.m_rays.m_shadow, rayCounts.w);
+    }
+#endif
+
+    if (cacheEnabled) {
+        if (cacheCandidate && cacheFound && !cacheReused) {
+            finalColor = mix(cachedColor, finalColor, VULPIX_CACHE_BLEND);
+        }
+
+        const uint writeIndex = 1u - uint(Params.m_historyParams.y);
+        imageStore(SecondaryCache[writeIndex], pixel, cacheCandidate ? vec4(finalColor, primaryDistance) : vec4(0.0f, 0.0f, 0.0f, -1.0f));
+
+        if (cacheCandidate && all(equal(launchPixel % VULPIX_STATS_STRIDE, uvec2(0)))) {
+            atomicAdd(Stats.m_secondaryCache.m_candidatePixels, 1u);
+            atomicAdd(Stats.m_secondaryCache.m_reusedPixels, cacheReused ? 1u : 0u);
+            atomicAdd(Stats.m_secondaryCache.m_rejectedPixels, cacheRejected ? 1u : 0u);
+            atomicAdd(Stats.m_secondaryCache.m_secondaryRays, rayCount - 1u);
+        }
+    }
+
+    if (interleave != VULPIX_INTERLEAVE_NONE) {
+        imageStore(SampleImage, pixel, vec4(finalColor, primaryDistance));
+        return;
+    }
+
+    if (progressive) {
+        // running mean, the first sample after a reset ignores whatever the image held
+        const float sampleCount = Params.m_accumulationParams.x;
+        const vec3 history = (sampleCount > 0.0f) ? imageLoad(AccumulationImage, pixel).rgb : finalColor;
+        const vec3 mean = mix(history, finalColor, 1.0f / (sampleCount + 1.0f));
+
+        imageStore(AccumulationImage, pixel, vec4(mean, sampleCount + 1.0f));
+
+        if (sampleCount > 0.0f && all(equal(launchPixel % VULPIX_STATS_STRIDE, uvec2(0)))) {
+            const float delta = min(abs(Luminance(mean) - Luminance(history)), 1.0f);
+            atomicAdd(Stats.m_convergence.m_luminanceDeltaSum, uint(delta * VULPIX_CONVERGENCE_SCALE));
+            atomicAdd(Stats.m_convergence.m_sampleCount, 1u);
+        }
+
+        finalColor = mean;
+    }
+
+    // linear, the composite pass tonemaps and encodes
+    imageStore(ResultImage, pixel, vec4(finalColor, 1.0f));
 }
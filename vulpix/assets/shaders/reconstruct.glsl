@@ -0,0 +1,100 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "../../Shader/Shader_Config.h"
+
+layout(local_size_x = VULPIX_RECONSTRUCT_GROUP_SIZE, local_size_y = VULPIX_RECONSTRUCT_GROUP_SIZE) in;
+
+// this frame's traced pixels, linear radiance in rgb and primary hit distance in a (negative on a miss)
+layout(set = 0, binding = VULPIX_RECONSTRUCT_SAMPLES_BINDING, rgba16f) readonly uniform image2D SampleImage;
+// last frame's reconstruction in linear radiance, and this frame's
+layout(set = 0, binding = VULPIX_RECONSTRUCT_HISTORY_IN_BINDING, rgba16f) readonly uniform image2D HistoryIn;
+layout(set = 0, binding = VULPIX_RECONSTRUCT_HISTORY_OUT_BINDING, rgba16f) writeonly uniform image2D HistoryOut;
+layout(set = 0, binding = VULPIX_RECONSTRUCT_OUTPUT_BINDING, rgba16f) writeonly uniform image2D OutputImage;
+
+layout(set = 0, binding = VULPIX_RECONSTRUCT_PARAMS_BINDING, std140) uniform AppData {
+    UniformParams Params;
+};
+
+vec4 LoadHistory(ivec2 pixel, ivec2 extent) {
+    return imageLoad(HistoryIn, clamp(pixel, ivec2(0), extent - 1));
+}
+
+vec3 SampleHistory(vec2 pos, ivec2 extent) {
+    const ivec2 base = ivec2(floor(pos));
+    const vec2 t = pos - vec2(base);
+
+    const vec3 top = mix(LoadHistory(base, extent).rgb, LoadHistory(base + ivec2(1, 0), extent).rgb, t.x);
+    const vec3 bottom = mix(LoadHistory(base + ivec2(0, 1), extent).rgb, LoadHistory(base + ivec2(1, 1), extent).rgb, t.x);
+    return mix(top, bottom, t.y);
+}
+
+void main() {
+    const ivec2 extent = ivec2(Params.m_renderParams.xy);
+    const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, extent))) {
+        return;
+    }
+
+    const uint mode = uint(Params.m_renderParams.z);
+    const uint phase = uint(Params.m_renderParams.w);
+
+    vec3 color;
+
+    if (isInterleavedPixelTraced(uvec2(pixel), mode, phase)) {
+        color = imageLoad(SampleImage, pixel).rgb;
+    } else {
+        // every 3x3 window holds at least one traced pixel in both patterns (four for the checkerboard)
+        vec3 minColor = vec3(1e30f);
+        vec3 maxColor = vec3(-1e30f);
+        vec3 sumColor = vec3(0.0f);
+        float count = 0.0f;
+        float nearest = -1.0f;
+
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                const ivec2 neighbor = pixel + ivec2(x, y);
+                if (any(lessThan(neighbor, ivec2(0))) || any(greaterThanEqual(neighbor, extent)) ||
+                    !isInterleavedPixelTraced(uvec2(neighbor), mode, phase)) {
+                    continue;
+                }
+
+                const vec4 neighborSample = imageLoad(SampleImage, neighbor);
+                minColor = min(minColor, neighborSample.rgb);
+                maxColor = max(maxColor, neighborSample.rgb);
+                sumColor += neighborSample.rgb;
+                count += 1.0f;
+
+                // the closest surface around us is the likeliest one to cover this pixel too
+                if (neighborSample.a > 0.0f && (nearest < 0.0f || neighborSample.a < nearest)) {
+                    nearest = neighborSample.a;
+                }
+            }
+        }
+
+        color = sumColor / max(count, 1.0f);
+
+        if (Params.m_historyParams.x > 0.0f && count > 0.0f) {
+            const vec2 extentF = vec2(extent);
+            const float aspect = extentF.x / extentF.y;
+            const float fovY = Params.m_cameraNearFarFOV.z;
+
+            // this pixel's primary ray, ended at the neighbors' surface (or at infinity on a miss)
+            const vec3 dir = cameraRayDir(Params.m_cameraDirection.xyz, Params.m_cameraRight.xyz, Params.m_cameraUp.xyz, fovY, aspect, pixelToUv(vec2(pixel), extentF));
+            const vec3 prevDir = (nearest > 0.0f) ? normalize(Params.m_cameraPosition.xyz + dir * nearest - Params.m_prevCameraPosition.xyz) : dir;
+
+            if (dot(prevDir, Params.m_prevCameraDirection.xyz) > 0.0f) {
+                const vec2 prevUv = cameraProject(Params.m_prevCameraDirection.xyz, Params.m_prevCameraRight.xyz, Params.m_prevCameraUp.xyz, fovY, aspect, prevDir);
+                const vec2 prevPixel = uvToPixel(prevUv, extentF);
+
+                if (all(greaterThanEqual(prevPixel, vec2(-0.5f))) && all(lessThan(prevPixel, extentF - 0.5f))) {
+                    // clamping to what the traced neighbors see rejects history from disoccluded or changed surfaces
+                    color = clamp(SampleHistory(prevPixel, extent), minColor, maxColor);
+                }
+            }
+        }
+    }
+
+    imageStore(HistoryOut, pixel, vec4(color, 1.0f));
+    imageStore(OutputImage, pixel, vec4(color, 1.0f));
+}
@@ -0,0 +1,35 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "../../Shader/Shader_Config.h"
+
+layout(local_size_x = VULPIX_UPSCALE_GROUP_SIZE, local_size_y = VULPIX_UPSCALE_GROUP_SIZE) in;
+
+// the source is as big as the target, only its top-left SourceSize pixels were traced
+layout(set = 0, binding = VULPIX_UPSCALE_SOURCE_BINDING, rgba16f) readonly uniform image2D SourceImage;
+layout(set = 0, binding = VULPIX_UPSCALE_TARGET_BINDING, rgba16f) writeonly uniform image2D TargetImage;
+
+layout(push_constant) uniform UpscalePushConstants {
+    uvec4 Extents; // xy: traced source size, zw: target size
+};
+
+vec4 LoadSource(ivec2 pixel) {
+    return imageLoad(SourceImage, clamp(pixel, ivec2(0), ivec2(Extents.xy) - 1));
+}
+
+void main() {
+    const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(gl_GlobalInvocationID.xy, Extents.zw))) {
+        return;
+    }
+
+    // bilinear, pixel centers of both images line up at the edges
+    const vec2 sourcePos = (vec2(pixel) + 0.5f) * vec2(Extents.xy) / vec2(Extents.zw) - 0.5f;
+    const ivec2 base = ivec2(floor(sourcePos));
+    const vec2 t = sourcePos - vec2(base);
+
+    const vec4 top = mix(LoadSource(base), LoadSource(base + ivec2(1, 0)), t.x);
+    const vec4 bottom = mix(LoadSource(base + ivec2(0, 1)), LoadSource(base + ivec2(1, 1)), t.x);
+
+    imageStore(TargetImage, pixel, mix(top, bottom, t.y));
+}
@@ -2,14 +2,303 @@
 //
 
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "VulpixApp.h"
+#include "Core/Vulpix_CpuTracer.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+    // --trace <file> writes the CPU / GPU timeline of the whole run when the window closes.
+    // --headless <frames> renders without a window, --output <prefix> writes those frames as <prefix>_00000.png, ...
+    // --scene <obj> loads another OBJ file, --env-map <image> another environment map.
+    // --no-merge loads the scene without merging small meshes, to benchmark the merge against.
+    // --no-split loads the scene without splitting long thin triangles, to benchmark the split against.
+    // --deform <mesh> animates the mesh with that index with a morph target (deform pass, BLAS refits and rebuilds).
+    // --skin <mesh> bends the mesh with that index with two skinned joints instead.
+    // --bench <camera path> replays a path recorded with K, --warmup <frames> and --frames <frames> set the frame
+    // counts, --json <file> names the results. The benchmark ends the run, with --headless its frame count is ignored.
+    // --golden <cases> renders the golden cases headless and exits with 1 when one differs from its reference,
+    // --golden-update <cases> writes the references.
+    // --batch <jobs> renders every job of the file headless into its own image
+    // --capture <prefix> writes every frame of a windowed run as <prefix>_00000.png, ... (V toggles it at runtime),
+    // --capture-format png|jpg picks the format of the captured and the headless frames
+    // --coordinate <port> serves the jobs of --batch as tiles of --tile-size <pixels> (256) to the processes started
+    // with --tile-worker <host:port>, and writes the composited images. The coordinator needs no GPU
+    // --stream <path> writes every frame to a pipe, - for stdout, --stream-format y4m|rgba (y4m) and
+    // --stream-fps <rate> (60) describe the stream
+    // --cpu renders the jobs of --batch, --golden / --golden-update or --tile-worker with the CPU tracer instead of the
+    // GPU, on --cpu-threads <count> threads (all of them). --cpu-scaling first renders the first job with 1, 2, 4, ...
+    // threads and prints the Mrays/s of each
+    const char* tracePath = nullptr;
+    const char* outputPrefix = "";
+    const char* sceneFile = nullptr;
+    const char* environmentMap = nullptr;
+    int deformMesh = -1;
+    int skinMesh = -1;
+    bool meshMerging = true;
+    bool triangleSplitting = true;
+    int headlessFrames = -1;
+    bool benchmark = false;
+    BenchmarkSettings benchmarkSettings;
+    const char* goldenCases = nullptr;
+    bool goldenUpdate = false;
+    const char* batchJobs = nullptr;
+    const char* capturePrefix = nullptr;
+    const char* captureFormat = nullptr;
+    const char* streamPath = nullptr;
+    int coordinatorPort = -1;
+    uint32_t tileSize = 256u;
+    const char* tileWorker = nullptr;
+    VideoStreamFormat streamFormat = VideoStreamFormat::Y4m;
+    uint32_t streamFrameRate = 60u;
+    bool cpuTracer = false;
+    bool cpuScaling = false;
+    uint32_t cpuThreads = 0u;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            tracePath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+        {
+            headlessFrames = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputPrefix = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+        {
+            sceneFile = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--env-map") == 0 && i + 1 < argc)
+        {
+            environmentMap = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--no-merge") == 0)
+        {
+            meshMerging = false;
+        }
+        else if (std::strcmp(argv[i], "--no-split") == 0)
+        {
+            triangleSplitting = false;
+        }
+        else if (std::strcmp(argv[i], "--deform") == 0 && i + 1 < argc)
+        {
+            deformMesh = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--skin") == 0 && i + 1 < argc)
+        {
+            skinMesh = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            benchmark = true;
+            benchmarkSettings.m_cameraPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            benchmarkSettings.m_warmupFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            benchmarkSettings.m_measuredFrames = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            benchmarkSettings.m_outputPath = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--golden") == 0 || std::strcmp(argv[i], "--golden-update") == 0) && i + 1 < argc)
+        {
+            goldenUpdate = std::strcmp(argv[i], "--golden-update") == 0;
+            goldenCases = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchJobs = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            capturePrefix = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc)
+        {
+            captureFormat = argv[++i];
+            if (!vulpix::canWriteImage(std::string("frame.") + captureFormat))
+            {
+                std::cout << "Unknown capture format " << captureFormat << ", png or jpg" << std::endl;
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--coordinate") == 0 && i + 1 < argc)
+        {
+            coordinatorPort = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc)
+        {
+            tileSize = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 16));
+        }
+        else if (std::strcmp(argv[i], "--tile-worker") == 0 && i + 1 < argc)
+        {
+            tileWorker = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+        {
+            streamPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc)
+        {
+            streamFormat = std::strcmp(argv[++i], "rgba") == 0 ? VideoStreamFormat::Rgba : VideoStreamFormat::Y4m;
+        }
+        else if (std::strcmp(argv[i], "--stream-fps") == 0 && i + 1 < argc)
+        {
+            streamFrameRate = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 1));
+        }
+        else if (std::strcmp(argv[i], "--cpu") == 0)
+        {
+            cpuTracer = true;
+        }
+        else if (std::strcmp(argv[i], "--cpu-threads") == 0 && i + 1 < argc)
+        {
+            cpuThreads = static_cast<uint32_t>(std::max(std::atoi(argv[++i]), 0));
+        }
+        else if (std::strcmp(argv[i], "--cpu-scaling") == 0)
+        {
+            cpuScaling = true;
+        }
+    }
+
+    // the video owns stdout, everything printed goes to stderr instead
+    if (streamPath && std::strcmp(streamPath, "-") == 0)
+    {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     std::cout << "Hello World!\n";
 
-    VulpixApp app;
-    app.run();
+    // only hands out tiles and composites, no device of its own
+    if (coordinatorPort >= 0)
+    {
+        std::vector<RenderJob> jobs;
+        if (!batchJobs || !vulpix::loadRenderJobs(batchJobs, jobs))
+        {
+            std::cout << "The coordinator needs the render jobs, --batch <jobs>" << std::endl;
+            return 1;
+        }
+        VulpixTileCoordinator coordinator;
+        return coordinator.run(static_cast<uint16_t>(coordinatorPort), jobs, tileSize) ? 0 : 1;
+    }
 
-}
+    int exitCode = 0;
+    if (cpuTracer)
+    {
+        if (!goldenCases && !tileWorker && !batchJobs)
+        {
+            std::cout << "The CPU tracer needs jobs, --batch <jobs>, --golden <cases> or --tile-worker <host:port>" << std::endl;
+            return 1;
+        }
+
+        CpuRenderOptions cpuOptions;
+        if (goldenCases)
+        {
+            cpuOptions.m_goldenCases = goldenCases;
+            cpuOptions.m_goldenUpdate = goldenUpdate;
+        }
+        else if (tileWorker)
+        {
+            cpuOptions.m_tileWorker = tileWorker;
+        }
+        else
+        {
+            cpuOptions.m_batchJobs = batchJobs;
+        }
+        if (sceneFile)
+        {
+            cpuOptions.m_sceneFile = sceneFile;
+        }
+        if (environmentMap)
+        {
+            cpuOptions.m_environmentMap = environmentMap;
+        }
+        cpuOptions.m_scaling = cpuScaling;
 
+        CpuTracerSettings cpuSettings;
+        cpuSettings.m_threadCount = cpuThreads;
+        exitCode = vulpix::runCpuRender(cpuOptions, cpuSettings);
+    }
+    else
+    {
+        VulpixApp app;
+        if (goldenCases)
+        {
+            app.setHeadless(UINT32_MAX, outputPrefix);
+            app.setGoldenTest(goldenCases, goldenUpdate);
+        }
+        else if (tileWorker)
+        {
+            if (!app.setTileWorker(tileWorker))
+            {
+                return 1;
+            }
+            app.setHeadless(UINT32_MAX, "");
+        }
+        else if (batchJobs)
+        {
+            if (!app.setBatch(batchJobs))
+            {
+                return 1;
+            }
+            app.setHeadless(UINT32_MAX, outputPrefix);
+        }
+        else if (headlessFrames >= 0)
+        {
+            app.setHeadless(benchmark ? UINT32_MAX : static_cast<uint32_t>(headlessFrames), outputPrefix);
+        }
+        if (headlessFrames >= 0 && captureFormat)
+        {
+            app.setCapture(outputPrefix, captureFormat);
+        }
+        else if (headlessFrames < 0 && capturePrefix)
+        {
+            app.setCapture(capturePrefix, captureFormat ? captureFormat : "png");
+        }
+        if (streamPath)
+        {
+            app.setStream(streamPath, streamFormat, streamFrameRate);
+        }
+        if (sceneFile)
+        {
+            app.setScene(sceneFile);
+        }
+        if (environmentMap)
+        {
+            app.setEnvironmentMap(environmentMap);
+        }
+        app.setMeshMerging(meshMerging);
+        app.setTriangleSplitting(triangleSplitting);
+        if (deformMesh >= 0)
+        {
+            app.setDeformDemo(static_cast<uint32_t>(deformMesh));
+        }
+        if (skinMesh >= 0)
+        {
+            app.setSkinDemo(static_cast<uint32_t>(skinMesh));
+        }
+        if (benchmark)
+        {
+            app.setBenchmark(benchmarkSettings);
+        }
+        app.run();
+        exitCode = app.getExitCode();
+    }
+
+    if (tracePath && vulpix::trace::writeJson(tracePath))
+    {
+        std::cout << "Timeline written to " << tracePath << std::endl;
+    }
+
+    return exitCode;
+}